@@ -0,0 +1,132 @@
+#ifndef ASSET_MANIFEST_H
+#define ASSET_MANIFEST_H
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+// Asset build manifest written by asset_builder.
+//
+// The manifest is the build's memory between runs. For every input file it
+// records the size and modification time at which the file was last hashed,
+// its content hash and the files it references (OBJ -> MTL -> textures), so a
+// later build only rereads files whose stamp moved and only rescans their
+// references. For every model whose cooked cache is current it records the
+// build key the cache was cooked with: a hash over the cooker version and the
+// contents of the model and everything it depends on.
+//
+// It is a text file, one record per line; paths go last since they can
+// contain spaces, and "dep" lines belong to the "file" line above them:
+//
+//   manifest <version> <cooker key>
+//   file <size> <mtime> <hash> <path>     (size -1: the file was missing)
+//   dep <path>
+//   model <key> <path>
+#define ASSET_MANIFEST_VERSION 1
+#define ASSET_MANIFEST_PATH "assets.manifest"
+#define ASSET_MANIFEST_LINE 4096
+
+struct ManifestFile {
+    long long size;
+    long long time;
+    unsigned long long hash;
+    std::vector<std::string> dependencies;  // Direct references, as paths
+};
+
+struct AssetManifest {
+    unsigned long long cookerKey;
+    std::map<std::string, ManifestFile> files;
+    std::map<std::string, unsigned long long> models;  // Source path -> build key of its cache
+};
+
+// What the last asset build produced (read by the game at startup)
+AssetManifest assetManifest;
+
+// The path that follows the first n fields of a record, without the newline
+std::string getManifestPath(const char* line, int fields) {
+    const char* p = line;
+    for (int i = 0; i < fields && p; i++) {
+        p = strchr(p, ' ');
+        if (p) p++;
+    }
+    if (!p) return std::string();
+    size_t length = strcspn(p, "\r\n");
+    return std::string(p, length);
+}
+
+bool loadAssetManifest(const char* path, AssetManifest& manifest) {
+    manifest.cookerKey = 0;
+    manifest.files.clear();
+    manifest.models.clear();
+    FILE* file = fopen(path, "r");
+    if (!file) return false;
+
+    char line[ASSET_MANIFEST_LINE];
+    int version = 0;
+    bool ok = fgets(line, sizeof(line), file) &&
+              sscanf(line, "manifest %d %llx", &version, &manifest.cookerKey) == 2 &&
+              version == ASSET_MANIFEST_VERSION;
+    ManifestFile* current = NULL;
+    while (ok && fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "file ", 5) == 0) {
+            ManifestFile entry;
+            ok = sscanf(line, "file %lld %lld %llx", &entry.size, &entry.time, &entry.hash) == 3;
+            std::string name = getManifestPath(line, 4);
+            ok = ok && !name.empty();
+            if (ok) current = &(manifest.files[name] = entry);
+        } else if (strncmp(line, "dep ", 4) == 0) {
+            ok = current != NULL;
+            if (ok) current->dependencies.push_back(getManifestPath(line, 1));
+        } else if (strncmp(line, "model ", 6) == 0) {
+            unsigned long long key;
+            ok = sscanf(line, "model %llx", &key) == 1;
+            if (ok) manifest.models[getManifestPath(line, 2)] = key;
+        }
+    }
+    fclose(file);
+    if (!ok) {
+        printf("Warning: Ignoring malformed asset manifest: %s\n", path);
+        manifest.files.clear();
+        manifest.models.clear();
+    }
+    return ok;
+}
+
+// Written to a temporary file and renamed over the old manifest, so an
+// interrupted build leaves the previous one intact
+bool saveAssetManifest(const char* path, const AssetManifest& manifest) {
+    std::string temporary = std::string(path) + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "w");
+    if (!file) {
+        printf("Error: Could not write asset manifest: %s\n", path);
+        return false;
+    }
+    fprintf(file, "manifest %d %016llx\n", ASSET_MANIFEST_VERSION, manifest.cookerKey);
+    for (std::map<std::string, ManifestFile>::const_iterator it = manifest.files.begin();
+         it != manifest.files.end(); ++it) {
+        const ManifestFile& entry = it->second;
+        fprintf(file, "file %lld %lld %016llx %s\n", entry.size, entry.time, entry.hash, it->first.c_str());
+        for (size_t d = 0; d < entry.dependencies.size(); d++) {
+            fprintf(file, "dep %s\n", entry.dependencies[d].c_str());
+        }
+    }
+    for (std::map<std::string, unsigned long long>::const_iterator it = manifest.models.begin();
+         it != manifest.models.end(); ++it) {
+        fprintf(file, "model %016llx %s\n", it->second, it->first.c_str());
+    }
+    bool ok = !ferror(file);
+    ok = (fclose(file) == 0) && ok;
+#ifdef _WIN32
+    if (ok) remove(path);  // rename does not replace an existing file on Windows
+#endif
+    ok = ok && rename(temporary.c_str(), path) == 0;
+    if (!ok) {
+        printf("Error: Failed writing asset manifest: %s\n", path);
+        remove(temporary.c_str());
+    }
+    return ok;
+}
+
+#endif // ASSET_MANIFEST_H
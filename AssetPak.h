@@ -0,0 +1,168 @@
+#ifndef ASSET_PAK_H
+#define ASSET_PAK_H
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "MappedFile.h"
+
+// Packed asset archive (.blitzpak) written by asset_packer.
+//
+// The archive holds cooked assets (models in the arena layout the loaders
+// produce, textures as GL-ready pixel rows) so the game maps one file instead
+// of opening and parsing every source under models/. Layout:
+//
+//   header | table of contents | names | asset data
+//
+// The table of contents is 64-byte aligned and sorted by name for binary
+// search; names are NUL-terminated paths as the game passes them to
+// loadModel/loadTexture. Each asset's data starts page-aligned, so uploads
+// can hand GL pointers straight into the mapping. Assets are stored in the
+// order the packer was given (the game's load order), which makes startup a
+// single front-to-back read of the file. Entries with identical content share
+// one copy of the data. Each entry records its source file's size and
+// modification time; an entry whose source has since changed is ignored, so
+// an out-of-date pak never hides edited models (without the sources, as in
+// a shipped build, every entry is used).
+#define ASSET_PAK_MAGIC 0x4B415042  // "BPAK"
+#define ASSET_PAK_VERSION 1
+#define ASSET_PAK_PATH "assets.blitzpak"
+#define ASSET_PAK_TOC_ALIGNMENT 64
+#define ASSET_PAK_DATA_ALIGNMENT 4096
+
+enum AssetType {
+    ASSET_MODEL = 1,    // info: vertexCount, indexCount, meshCount; data: arena, then mesh table
+    ASSET_TEXTURE = 2   // info: width, height, GL pixel format, row alignment; data: rows bottom-up
+};
+
+struct AssetPakHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int vertexStride;  // Model vertex layout the pak was cooked for
+    int entryCount;
+    long long tocOffset;
+    long long namesOffset;
+    long long namesSize;
+    long long dataSize;         // Bytes of asset data after deduplication
+};
+
+struct AssetPakEntry {
+    unsigned int nameOffset;    // Into the names block
+    unsigned int type;
+    long long offset;           // From the start of the file
+    long long size;
+    unsigned long long contentHash;
+    long long sourceSize;       // Stamp of the source file the asset was cooked from
+    long long sourceTime;
+    int info[4];                // Per-type metadata (see AssetType)
+};
+
+struct AssetPak {
+    MappedFile file;
+    const AssetPakHeader* header;
+    const AssetPakEntry* entries;
+    const char* names;
+};
+
+AssetPak assetPak = { { NULL, 0 }, NULL, NULL, NULL };
+
+// Content hash of a byte range: FNV-1a over 8-byte words (the tail byte by
+// byte), then a final avalanche so every input bit reaches every output bit.
+// Pass a previous result as hash to extend it over more data.
+unsigned long long hashAssetBytes(const void* data, size_t size,
+                                  unsigned long long hash = 14695981039346656037ULL) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t words = size / 8;
+    for (size_t i = 0; i < words; i++) {
+        unsigned long long word;
+        memcpy(&word, bytes + i * 8, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (size_t i = words * 8; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+void closeAssetPak() {
+    if (assetPak.file.data) unmapFile(assetPak.file);
+    assetPak.header = NULL;
+    assetPak.entries = NULL;
+    assetPak.names = NULL;
+}
+
+// Map the archive and start reading it ahead. Fails (leaving the loose files
+// in use) if it is missing, truncated or cooked for another vertex layout.
+bool openAssetPak(const char* path, unsigned int vertexStride) {
+    closeAssetPak();
+    if (!mapFile(path, assetPak.file)) return false;
+
+    const MappedFile& file = assetPak.file;
+    const AssetPakHeader* header = (const AssetPakHeader*)file.data;
+    bool valid = file.size >= sizeof(AssetPakHeader) &&
+                 header->magic == ASSET_PAK_MAGIC && header->version == ASSET_PAK_VERSION &&
+                 header->entryCount >= 0 && header->tocOffset >= (long long)sizeof(AssetPakHeader) &&
+                 (size_t)header->tocOffset + (size_t)header->entryCount * sizeof(AssetPakEntry) <= file.size &&
+                 header->namesOffset >= 0 && header->namesSize > 0 &&
+                 (size_t)(header->namesOffset + header->namesSize) <= file.size &&
+                 file.data[header->namesOffset + header->namesSize - 1] == '\0';
+    const AssetPakEntry* entries = valid ? (const AssetPakEntry*)(file.data + header->tocOffset) : NULL;
+    for (int i = 0; valid && i < header->entryCount; i++) {
+        valid = entries[i].nameOffset < (unsigned long long)header->namesSize &&
+                entries[i].offset >= 0 && entries[i].size >= 0 &&
+                (size_t)(entries[i].offset + entries[i].size) <= file.size;
+    }
+    if (!valid) {
+        printf("Warning: Ignoring invalid asset pak: %s\n", path);
+        closeAssetPak();
+        return false;
+    }
+    if (header->vertexStride != vertexStride) {
+        printf("Asset pak %s was built for another vertex format, using loose files\n", path);
+        closeAssetPak();
+        return false;
+    }
+
+    assetPak.header = header;
+    assetPak.entries = entries;
+    assetPak.names = (const char*)(file.data + header->namesOffset);
+    prefetchMappedFile(file);
+    printf("Mapped asset pak: %s (%d assets, %.1f MB)\n", path, header->entryCount, file.size / (1024.0 * 1024.0));
+    return true;
+}
+
+// False if the asset's source file exists and differs from the one cooked
+bool isAssetCurrent(const AssetPakEntry* entry, const char* sourcePath) {
+    struct stat st;
+    if (stat(sourcePath, &st) != 0) return true;
+    if ((long long)st.st_size == entry->sourceSize && (long long)st.st_mtime == entry->sourceTime) return true;
+    printf("Asset pak entry for %s is out of date, using the loose file\n", sourcePath);
+    return false;
+}
+
+// Entry for name with the given type, or NULL if the pak is closed or lacks it
+const AssetPakEntry* findAsset(const char* name, unsigned int type) {
+    if (!assetPak.header) return NULL;
+    int lo = 0, hi = assetPak.header->entryCount;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int order = strcmp(assetPak.names + assetPak.entries[mid].nameOffset, name);
+        if (order == 0) {
+            const AssetPakEntry* entry = &assetPak.entries[mid];
+            return entry->type == type && isAssetCurrent(entry, name) ? entry : NULL;
+        }
+        if (order < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+const unsigned char* getAssetData(const AssetPakEntry* entry) {
+    return assetPak.file.data + entry->offset;
+}
+
+#endif // ASSET_PAK_H
@@ -0,0 +1,208 @@
+#ifndef BAKED_LIGHTING_H
+#define BAKED_LIGHTING_H
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "Terrain.h"
+#include "FrameRing.h"
+#include "Profiler.h"
+
+// Baked sun and sky lighting for the terrain.
+//
+// light_baker ray-traces, for every terrain vertex, an ambient occlusion term
+// and the sun's contribution (N.L times soft-shadow visibility) at
+// BAKE_KEYFRAMES sun angles spread over the day cycle, and stores them in a
+// level file. At runtime the terrain is drawn prelit: its vertex colors are
+// albedo * (ambient * AO + sun diffuse * sun term), blended between the two
+// keyframes around the current sunAngle. The colors are only re-blended and
+// re-uploaded when the blend factor moves to the next of BAKE_BLEND_STEPS
+// steps or the sun colors change, so the sun costs no per-frame lighting.
+// The blended sun term goes in the color's alpha, so the shaders can take
+// out the sun where a shadow map has a dynamic caster the bake never saw.
+
+#define BAKE_MAGIC 0x454B4142      // "BAKE"
+#define BAKE_VERSION 1
+#define BAKE_DEFAULT_PATH "levels/rural.bake"
+#define BAKE_KEYFRAMES 24          // Sun angle every 15 degrees
+#define BAKE_BLEND_STEPS 32        // Blend resolution between two keyframes
+#define BAKE_SCENE_AMBIENT 0.2f    // GL's default light model ambient
+
+struct BakeHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int layoutHash;       // Heightmap and static objects the bake was made for
+    int chunkCount;
+    int vertsPerChunk;
+    int keyframes;
+};
+
+// Per vertex, chunk by chunk in terrain order: AO, then one sun term per keyframe
+#define BAKE_VERTEX_SIZE (1 + BAKE_KEYFRAMES)
+
+struct BakedLighting {
+    BakeHeader header;
+    std::vector<unsigned char> samples;
+    std::vector<unsigned char> albedo;   // RGB per vertex
+    std::vector<unsigned char> colors;   // Blended RGB plus sun term per vertex
+    int blendKeyframe, blendStep;        // State the colors were last blended for
+    float blendAmbient[3], blendDiffuse[3];
+    bool loaded;
+};
+
+BakedLighting bakedLighting;
+
+// Average grass color, used for lamp light on prelit terrain
+const float BAKE_TERRAIN_ALBEDO[3] = { 0.42f, 0.62f, 0.32f };
+
+float getBakeKeyframeAngle(int keyframe) {
+    return keyframe * 360.0f / BAKE_KEYFRAMES;
+}
+
+// FNV-1a over the heightmap and the static object layout, so a bake made for
+// a different level is rejected
+unsigned int computeBakeLayoutHash() {
+    unsigned int hash = 2166136261u;
+    std::vector<float> values(terrain.heights);
+    for (size_t i = 0; i < levelObjects.size(); i++) {
+        const LevelObject& obj = levelObjects[i];
+        values.push_back((float)obj.type);
+        values.push_back(obj.x);
+        values.push_back(obj.z);
+        values.push_back(obj.size);
+        values.push_back(obj.rotation);
+    }
+    const unsigned char* bytes = values.empty() ? NULL : (const unsigned char*)&values[0];
+    for (size_t i = 0; i < values.size() * sizeof(float); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+bool saveBakedLighting(const char* filename, const BakedLighting& bake) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        printf("Error: Could not write baked lighting: %s\n", filename);
+        return false;
+    }
+    bool ok = fwrite(&bake.header, sizeof(BakeHeader), 1, file) == 1 &&
+              fwrite(&bake.samples[0], 1, bake.samples.size(), file) == bake.samples.size();
+    fclose(file);
+    if (!ok) {
+        printf("Error: Failed writing baked lighting: %s\n", filename);
+    }
+    return ok;
+}
+
+// Load the bake for the current terrain and level, and attach a color buffer
+// to every terrain chunk. Call after buildTerrainChunks and placeLevelOnTerrain.
+bool loadBakedLighting(const char* filename) {
+    PROFILE_FUNCTION();
+    BakedLighting& bake = bakedLighting;
+    bake.loaded = false;
+
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        printf("Warning: Could not open baked lighting: %s (terrain lit per frame)\n", filename);
+        return false;
+    }
+
+    BakeHeader& header = bake.header;
+    bool ok = fread(&header, sizeof(BakeHeader), 1, file) == 1 &&
+              header.magic == BAKE_MAGIC && header.version == BAKE_VERSION &&
+              header.keyframes == BAKE_KEYFRAMES &&
+              header.chunkCount == (int)terrain.chunks.size() &&
+              header.vertsPerChunk == TERRAIN_CHUNK_VERTS * TERRAIN_CHUNK_VERTS &&
+              header.layoutHash == computeBakeLayoutHash();
+    if (ok) {
+        bake.samples.resize((size_t)header.chunkCount * header.vertsPerChunk * BAKE_VERTEX_SIZE);
+        ok = fread(&bake.samples[0], 1, bake.samples.size(), file) == bake.samples.size();
+    }
+    fclose(file);
+    if (!ok) {
+        printf("Warning: Baked lighting %s does not match this level, ignoring it\n", filename);
+        bake.samples.clear();
+        return false;
+    }
+
+    // Albedo per vertex; the chunk vertex data itself may already be GPU-only
+    size_t vertexCount = (size_t)header.chunkCount * header.vertsPerChunk;
+    bake.albedo.resize(vertexCount * 3);
+    bake.colors.assign(vertexCount * 4, 255);
+    for (int c = 0; c < header.chunkCount; c++) {
+        TerrainChunk& chunk = terrain.chunks[c];
+        for (int v = 0; v < header.vertsPerChunk; v++) {
+            int sx = chunk.sampleX + v % TERRAIN_CHUNK_VERTS;
+            int sz = chunk.sampleZ + v / TERRAIN_CHUNK_VERTS;
+            getTerrainAlbedo(terrain.originX + sx * terrain.spacing, terrain.originZ + sz * terrain.spacing,
+                             &bake.albedo[((size_t)c * header.vertsPerChunk + v) * 3]);
+        }
+
+        const unsigned char* colors = &bake.colors[(size_t)c * header.vertsPerChunk * 4];
+        if (glBuffersSupported) {
+            pglGenBuffers(1, &chunk.colorBuffer);
+            cachedBindBuffer(GL_ARRAY_BUFFER, chunk.colorBuffer);
+            pglBufferData(GL_ARRAY_BUFFER, header.vertsPerChunk * 4, colors, GL_DYNAMIC_DRAW);
+        } else {
+            chunk.bakedColors = colors;
+        }
+    }
+
+    bake.blendKeyframe = -1;
+    bake.blendStep = -1;
+    bake.loaded = true;
+    printf("Loaded baked lighting: %s (%d keyframes)\n", filename, header.keyframes);
+    return true;
+}
+
+float clampUnit(float v) {
+    return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
+
+// Blend the terrain colors for the given sun angle and sun colors. Cheap to
+// call every frame: nothing happens until the quantized blend state changes.
+void updateBakedLighting(float sunAngle, const float ambient[3], const float diffuse[3]) {
+    PROFILE_FUNCTION();
+    BakedLighting& bake = bakedLighting;
+    if (!bake.loaded) return;
+
+    float position = sunAngle / 360.0f * BAKE_KEYFRAMES;
+    int keyframe = (int)floor(position);
+    int step = (int)((position - keyframe) * BAKE_BLEND_STEPS);
+    keyframe = ((keyframe % BAKE_KEYFRAMES) + BAKE_KEYFRAMES) % BAKE_KEYFRAMES;
+    if (keyframe == bake.blendKeyframe && step == bake.blendStep &&
+        memcmp(ambient, bake.blendAmbient, sizeof(bake.blendAmbient)) == 0 &&
+        memcmp(diffuse, bake.blendDiffuse, sizeof(bake.blendDiffuse)) == 0) {
+        return;
+    }
+    bake.blendKeyframe = keyframe;
+    bake.blendStep = step;
+    memcpy(bake.blendAmbient, ambient, sizeof(bake.blendAmbient));
+    memcpy(bake.blendDiffuse, diffuse, sizeof(bake.blendDiffuse));
+
+    int next = (keyframe + 1) % BAKE_KEYFRAMES;
+    float t = (float)step / BAKE_BLEND_STEPS;
+    int verts = bake.header.vertsPerChunk;
+
+    for (int c = 0; c < bake.header.chunkCount; c++) {
+        for (int v = 0; v < verts; v++) {
+            size_t index = (size_t)c * verts + v;
+            const unsigned char* sample = &bake.samples[index * BAKE_VERTEX_SIZE];
+            float ao = sample[0] / 255.0f;
+            float sun = (sample[1 + keyframe] * (1.0f - t) + sample[1 + next] * t) / 255.0f;
+            const unsigned char* albedo = &bake.albedo[index * 3];
+            unsigned char* color = &bake.colors[index * 4];
+            for (int k = 0; k < 3; k++) {
+                float light = (BAKE_SCENE_AMBIENT + ambient[k]) * ao + diffuse[k] * sun;
+                color[k] = (unsigned char)(clampUnit(albedo[k] / 255.0f * light) * 255.0f + 0.5f);
+            }
+            color[3] = (unsigned char)(sun * 255.0f + 0.5f);
+        }
+        if (terrain.chunks[c].colorBuffer != 0) {
+            streamBufferSubData(terrain.chunks[c].colorBuffer, 0, verts * 4, &bake.colors[(size_t)c * verts * 4]);
+        }
+    }
+}
+
+#endif // BAKED_LIGHTING_H
@@ -0,0 +1,160 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include "GLExtensions.h"
+#include "RenderQueue.h"
+
+// Persistently mapped ring for data that changes every frame.
+//
+// One buffer is created with immutable storage and mapped once, persistent
+// and coherent, for the life of the context. It is split into
+// FRAME_RING_FRAMES regions. Each frame writes its dynamic data into its own
+// region with frameRingAllocate: the cluster light tables, sky pixels and
+// baked terrain colors. GL reads that data by buffer offset (as a pixel
+// unpack source or a copy source), so no upload waits on memory the GPU may
+// still be reading, and the driver never has to copy or rename a buffer.
+// endFrameRing fences the region. beginFrameRing waits on the fence of the
+// region it reuses, which only blocks if the GPU is FRAME_RING_FRAMES - 1
+// frames behind.
+//
+// Without buffer storage (GL 4.4 / ARB_buffer_storage), or once a frame has
+// used up its region, allocations fail and the stream* helpers upload
+// directly, as before.
+#define FRAME_RING_FRAMES 3
+#define FRAME_RING_FRAME_SIZE (1024 * 1024)
+
+struct FrameRingAllocation {
+    unsigned char* data;  // Write-combined memory: write it, never read it back
+    GLuint buffer;
+    size_t offset;        // Of data within buffer
+};
+
+struct FrameRing {
+    GLuint buffer;
+    unsigned char* mapped;
+    int frame;                             // Region this frame writes
+    size_t head;                           // Next free byte in it
+    GLsyncType fences[FRAME_RING_FRAMES];
+    bool active;
+    bool inFrame;                          // Between beginFrameRing and endFrameRing
+    bool overflowReported;
+    size_t peakBytes;                      // Most used by one frame, and frames that
+    int waits;                             // had to wait for the GPU (since the last reset)
+};
+
+FrameRing frameRing = { 0, NULL, 0, 0, { NULL }, false, false, false, 0, 0 };
+
+// Needs a GL context and loadGLExtensions()
+bool initFrameRing() {
+    if (!glBufferStorageSupported || !glSyncSupported || !glCopyBufferSupported) {
+        printf("Frame ring: needs buffer storage, sync objects and buffer copies; uploading directly\n");
+        return false;
+    }
+    size_t size = (size_t)FRAME_RING_FRAMES * FRAME_RING_FRAME_SIZE;
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    pglGenBuffers(1, &frameRing.buffer);
+    cachedBindBuffer(GL_ARRAY_BUFFER, frameRing.buffer);
+    pglBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+    frameRing.mapped = (unsigned char*)pglMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    cachedBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (!frameRing.mapped) {
+        printf("Frame ring: could not map the ring buffer; uploading directly\n");
+        pglDeleteBuffers(1, &frameRing.buffer);
+        frameRing.buffer = 0;
+        return false;
+    }
+    frameRing.frame = 0;
+    frameRing.head = 0;
+    frameRing.active = true;
+    printf("Frame ring ready: %d x %d KB persistently mapped\n", FRAME_RING_FRAMES, FRAME_RING_FRAME_SIZE / 1024);
+    return true;
+}
+
+// Start a frame: move to the next region once the GPU is done with it
+void beginFrameRing() {
+    if (!frameRing.active) return;
+    frameRing.frame = (frameRing.frame + 1) % FRAME_RING_FRAMES;
+    frameRing.head = 0;
+    frameRing.inFrame = true;
+    GLsyncType& fence = frameRing.fences[frameRing.frame];
+    if (!fence) return;
+    GLenum status = pglClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        frameRing.waits++;
+        while (pglClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL) == GL_TIMEOUT_EXPIRED) {
+        }
+    }
+    pglDeleteSync(fence);
+    fence = NULL;
+}
+
+// Fence everything this frame read from its region (after its last draw)
+void endFrameRing() {
+    if (!frameRing.active) return;
+    frameRing.inFrame = false;
+    if (frameRing.head > frameRing.peakBytes) frameRing.peakBytes = frameRing.head;
+    frameRing.fences[frameRing.frame] = pglFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// size bytes from this frame's region, aligned to alignment (a power of two).
+// Valid until the end of the frame; false if the ring is off or full, or
+// outside a frame (nothing would fence the data).
+bool frameRingAllocate(size_t size, size_t alignment, FrameRingAllocation& allocation) {
+    if (!frameRing.inFrame) return false;
+    size_t offset = (frameRing.head + alignment - 1) & ~(alignment - 1);
+    if (offset + size > FRAME_RING_FRAME_SIZE) {
+        if (!frameRing.overflowReported) {
+            printf("Warning: Frame ring region full (%d KB), uploading the rest directly\n",
+                   FRAME_RING_FRAME_SIZE / 1024);
+            frameRing.overflowReported = true;
+        }
+        return false;
+    }
+    frameRing.head = offset + size;
+    allocation.offset = (size_t)frameRing.frame * FRAME_RING_FRAME_SIZE + offset;
+    allocation.data = frameRing.mapped + allocation.offset;
+    allocation.buffer = frameRing.buffer;
+    return true;
+}
+
+// glTexSubImage2D into the bound texture through the ring. bytes is the size
+// of the pixel data under the current unpack alignment.
+void streamTexSubImage2D(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type,
+                         const void* pixels, size_t bytes) {
+    FrameRingAllocation allocation;
+    if (!frameRingAllocate(bytes, 16, allocation)) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, format, type, pixels);
+        return;
+    }
+    memcpy(allocation.data, pixels, bytes);
+    pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, allocation.buffer);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, format, type, (const void*)allocation.offset);
+    pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// Replace part of a buffer through the ring (a GPU-side copy, ordered after
+// earlier draws that read the buffer instead of waiting for them)
+void streamBufferSubData(GLuint buffer, size_t offset, size_t size, const void* data) {
+    FrameRingAllocation allocation;
+    if (!frameRingAllocate(size, 16, allocation)) {
+        cachedBindBuffer(GL_ARRAY_BUFFER, buffer);
+        pglBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+        return;
+    }
+    memcpy(allocation.data, data, size);
+    pglBindBuffer(GL_COPY_READ_BUFFER, allocation.buffer);
+    pglBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    pglCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.offset, offset, size);
+    pglBindBuffer(GL_COPY_READ_BUFFER, 0);
+    pglBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void resetFrameRingStats() {
+    frameRing.peakBytes = 0;
+    frameRing.waits = 0;
+}
+
+#endif // FRAME_RING_H
@@ -0,0 +1,428 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#ifdef _WIN32
+#include <glut.h>
+#else
+#include <GL/glut.h>
+#endif
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+// Declared directly instead of including <GL/glx.h>, whose X11 headers
+// define names (Display, Window) that clash with the game's callbacks
+extern "C" void (*glXGetProcAddressARB(const GLubyte* procName))(void);
+#endif
+#ifdef __APPLE__
+#include <dlfcn.h>
+#endif
+
+// Runtime loader for the post-1.1 OpenGL entry points the engine uses.
+// The headers shipped with Windows only cover OpenGL 1.1, so everything newer
+// is fetched by name once a context exists (call loadGLExtensions() after
+// glutCreateWindow). Each feature group has a flag so callers can fall back
+// to the plain 1.1 path when the driver does not provide it.
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+// OpenGL constants that may not be defined in older headers
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#endif
+#ifndef GL_ELEMENT_ARRAY_BUFFER
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#endif
+#ifndef GL_STATIC_DRAW
+#define GL_STATIC_DRAW 0x88E4
+#endif
+#ifndef GL_DYNAMIC_DRAW
+#define GL_DYNAMIC_DRAW 0x88E8
+#endif
+#ifndef GL_TEXTURE0
+#define GL_TEXTURE0 0x84C0
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#endif
+#ifndef GL_VERTEX_SHADER
+#define GL_VERTEX_SHADER 0x8B31
+#endif
+#ifndef GL_COMPILE_STATUS
+#define GL_COMPILE_STATUS 0x8B81
+#endif
+#ifndef GL_LINK_STATUS
+#define GL_LINK_STATUS 0x8B82
+#endif
+#ifndef GL_RGBA32F_ARB
+#define GL_RGBA32F_ARB 0x8814
+#endif
+#ifndef GL_LUMINANCE32F_ARB
+#define GL_LUMINANCE32F_ARB 0x8818
+#endif
+#ifndef GL_DEPTH_COMPONENT24
+#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+#ifndef GL_TEXTURE_COMPARE_MODE
+#define GL_TEXTURE_COMPARE_MODE 0x884C
+#endif
+#ifndef GL_TEXTURE_COMPARE_FUNC
+#define GL_TEXTURE_COMPARE_FUNC 0x884D
+#endif
+#ifndef GL_COMPARE_R_TO_TEXTURE
+#define GL_COMPARE_R_TO_TEXTURE 0x884E
+#endif
+#ifndef GL_FRAMEBUFFER
+#define GL_FRAMEBUFFER 0x8D40
+#endif
+#ifndef GL_READ_FRAMEBUFFER
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#endif
+#ifndef GL_DRAW_FRAMEBUFFER
+#define GL_DRAW_FRAMEBUFFER 0x8CA9
+#endif
+#ifndef GL_FRAMEBUFFER_BINDING
+#define GL_FRAMEBUFFER_BINDING 0x8CA6
+#endif
+#ifndef GL_DEPTH_ATTACHMENT
+#define GL_DEPTH_ATTACHMENT 0x8D00
+#endif
+#ifndef GL_FRAMEBUFFER_COMPLETE
+#define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_COPY_READ_BUFFER
+#define GL_COPY_READ_BUFFER 0x8F36
+#endif
+#ifndef GL_COPY_WRITE_BUFFER
+#define GL_COPY_WRITE_BUFFER 0x8F37
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED 0x911A
+#endif
+#ifndef GL_TIMEOUT_EXPIRED
+#define GL_TIMEOUT_EXPIRED 0x911B
+#endif
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+#ifndef GL_WAIT_FAILED
+#define GL_WAIT_FAILED 0x911D
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+typedef char GLcharType;  // GLchar is missing from the 1.1 headers
+
+// Buffer objects (OpenGL 1.5)
+typedef void (APIENTRY *GenBuffersProc)(GLsizei n, GLuint* buffers);
+typedef void (APIENTRY *DeleteBuffersProc)(GLsizei n, const GLuint* buffers);
+typedef void (APIENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *BufferDataProc)(GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+typedef void (APIENTRY *BufferSubDataProc)(GLenum target, ptrdiff_t offset, ptrdiff_t size, const void* data);
+
+GenBuffersProc pglGenBuffers = NULL;
+DeleteBuffersProc pglDeleteBuffers = NULL;
+BindBufferProc pglBindBuffer = NULL;
+BufferDataProc pglBufferData = NULL;
+BufferSubDataProc pglBufferSubData = NULL;
+
+bool glBuffersSupported = false;
+
+// Multitexture (OpenGL 1.3)
+typedef void (APIENTRY *ActiveTextureProc)(GLenum texture);
+
+ActiveTextureProc pglActiveTexture = NULL;
+
+// GLSL programs (OpenGL 2.0)
+typedef GLuint (APIENTRY *CreateShaderProc)(GLenum type);
+typedef void (APIENTRY *ShaderSourceProc)(GLuint shader, GLsizei count, const GLcharType* const* source, const GLint* length);
+typedef void (APIENTRY *CompileShaderProc)(GLuint shader);
+typedef void (APIENTRY *GetShaderivProc)(GLuint shader, GLenum pname, GLint* params);
+typedef void (APIENTRY *GetShaderInfoLogProc)(GLuint shader, GLsizei bufSize, GLsizei* length, GLcharType* infoLog);
+typedef void (APIENTRY *DeleteShaderProc)(GLuint shader);
+typedef GLuint (APIENTRY *CreateProgramProc)(void);
+typedef void (APIENTRY *AttachShaderProc)(GLuint program, GLuint shader);
+typedef void (APIENTRY *LinkProgramProc)(GLuint program);
+typedef void (APIENTRY *GetProgramivProc)(GLuint program, GLenum pname, GLint* params);
+typedef void (APIENTRY *GetProgramInfoLogProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLcharType* infoLog);
+typedef void (APIENTRY *UseProgramProc)(GLuint program);
+typedef GLint (APIENTRY *GetUniformLocationProc)(GLuint program, const GLcharType* name);
+typedef void (APIENTRY *Uniform1iProc)(GLint location, GLint v0);
+typedef void (APIENTRY *Uniform1fProc)(GLint location, GLfloat v0);
+typedef void (APIENTRY *Uniform2fProc)(GLint location, GLfloat v0, GLfloat v1);
+typedef void (APIENTRY *UniformMatrix4fvProc)(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+
+CreateShaderProc pglCreateShader = NULL;
+ShaderSourceProc pglShaderSource = NULL;
+CompileShaderProc pglCompileShader = NULL;
+GetShaderivProc pglGetShaderiv = NULL;
+GetShaderInfoLogProc pglGetShaderInfoLog = NULL;
+DeleteShaderProc pglDeleteShader = NULL;
+CreateProgramProc pglCreateProgram = NULL;
+AttachShaderProc pglAttachShader = NULL;
+LinkProgramProc pglLinkProgram = NULL;
+GetProgramivProc pglGetProgramiv = NULL;
+GetProgramInfoLogProc pglGetProgramInfoLog = NULL;
+UseProgramProc pglUseProgram = NULL;
+GetUniformLocationProc pglGetUniformLocation = NULL;
+Uniform1iProc pglUniform1i = NULL;
+Uniform1fProc pglUniform1f = NULL;
+Uniform2fProc pglUniform2f = NULL;
+UniformMatrix4fvProc pglUniformMatrix4fv = NULL;
+
+bool glShadersSupported = false;
+bool glFloatTexturesSupported = false;  // GL 3.0 or ARB_texture_float
+
+// Framebuffer objects with blits (OpenGL 3.0 / ARB_framebuffer_object)
+typedef void (APIENTRY *GenFramebuffersProc)(GLsizei n, GLuint* framebuffers);
+typedef void (APIENTRY *BindFramebufferProc)(GLenum target, GLuint framebuffer);
+typedef void (APIENTRY *FramebufferTexture2DProc)(GLenum target, GLenum attachment, GLenum textarget,
+                                                  GLuint texture, GLint level);
+typedef GLenum (APIENTRY *CheckFramebufferStatusProc)(GLenum target);
+typedef void (APIENTRY *BlitFramebufferProc)(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1,
+                                             GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1,
+                                             GLbitfield mask, GLenum filter);
+
+GenFramebuffersProc pglGenFramebuffers = NULL;
+BindFramebufferProc pglBindFramebuffer = NULL;
+FramebufferTexture2DProc pglFramebufferTexture2D = NULL;
+CheckFramebufferStatusProc pglCheckFramebufferStatus = NULL;
+BlitFramebufferProc pglBlitFramebuffer = NULL;
+
+bool glFramebuffersSupported = false;
+
+// Buffer mapping (OpenGL 3.0 / ARB_map_buffer_range) and sync objects
+// (OpenGL 3.2 / ARB_sync)
+typedef struct __GLsync* GLsyncType;  // GLsync is missing from the 1.1 headers
+typedef void* (APIENTRY *MapBufferRangeProc)(GLenum target, ptrdiff_t offset, ptrdiff_t length, GLbitfield access);
+typedef GLboolean (APIENTRY *UnmapBufferProc)(GLenum target);
+typedef GLsyncType (APIENTRY *FenceSyncProc)(GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRY *ClientWaitSyncProc)(GLsyncType sync, GLbitfield flags, unsigned long long timeout);
+typedef void (APIENTRY *DeleteSyncProc)(GLsyncType sync);
+
+MapBufferRangeProc pglMapBufferRange = NULL;
+UnmapBufferProc pglUnmapBuffer = NULL;
+FenceSyncProc pglFenceSync = NULL;
+ClientWaitSyncProc pglClientWaitSync = NULL;
+DeleteSyncProc pglDeleteSync = NULL;
+
+bool glMapBufferRangeSupported = false;
+bool glSyncSupported = false;
+
+// Immutable buffer storage (OpenGL 4.4 / ARB_buffer_storage) and buffer to
+// buffer copies (OpenGL 3.1 / ARB_copy_buffer)
+typedef void (APIENTRY *BufferStorageProc)(GLenum target, ptrdiff_t size, const void* data, GLbitfield flags);
+typedef void (APIENTRY *CopyBufferSubDataProc)(GLenum readTarget, GLenum writeTarget, ptrdiff_t readOffset,
+                                               ptrdiff_t writeOffset, ptrdiff_t size);
+
+BufferStorageProc pglBufferStorage = NULL;
+CopyBufferSubDataProc pglCopyBufferSubData = NULL;
+
+bool glBufferStorageSupported = false;
+bool glCopyBufferSupported = false;
+
+// Swap interval for vsync (WGL_EXT_swap_control, GLX_MESA_swap_control or
+// GLX_SGI_swap_control). The window system entry points are loaded the same
+// way as the GL ones.
+typedef int (APIENTRY *SwapIntervalProc)(int interval);
+
+SwapIntervalProc pglSwapInterval = NULL;
+
+bool glSwapIntervalSupported = false;
+
+// GPU timer queries (OpenGL 3.3 / ARB_timer_query)
+typedef void (APIENTRY *GenQueriesProc)(GLsizei n, GLuint* ids);
+typedef void (APIENTRY *DeleteQueriesProc)(GLsizei n, const GLuint* ids);
+typedef void (APIENTRY *BeginQueryProc)(GLenum target, GLuint id);
+typedef void (APIENTRY *EndQueryProc)(GLenum target);
+typedef void (APIENTRY *GetQueryObjectivProc)(GLuint id, GLenum pname, GLint* params);
+typedef void (APIENTRY *GetQueryObjectui64vProc)(GLuint id, GLenum pname, unsigned long long* params);
+
+GenQueriesProc pglGenQueries = NULL;
+DeleteQueriesProc pglDeleteQueries = NULL;
+BeginQueryProc pglBeginQuery = NULL;
+EndQueryProc pglEndQuery = NULL;
+GetQueryObjectivProc pglGetQueryObjectiv = NULL;
+GetQueryObjectui64vProc pglGetQueryObjectui64v = NULL;
+
+bool glTimerQueriesSupported = false;
+
+void* getGLProcAddress(const char* name) {
+#if defined(_WIN32)
+    return (void*)wglGetProcAddress(name);
+#elif defined(__APPLE__)
+    return dlsym(RTLD_DEFAULT, name);
+#else
+    return (void*)glXGetProcAddressARB((const GLubyte*)name);
+#endif
+}
+
+// Checks the context's GL_VERSION string ("major.minor ...")
+bool glVersionAtLeast(int major, int minor) {
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int ctxMajor = 0, ctxMinor = 0;
+    if (!version || sscanf(version, "%d.%d", &ctxMajor, &ctxMinor) != 2) {
+        return false;
+    }
+    return ctxMajor > major || (ctxMajor == major && ctxMinor >= minor);
+}
+
+// Looks for a whole word in the GL_EXTENSIONS string
+bool glHasExtension(const char* name) {
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    size_t length = strlen(name);
+    while (extensions && (extensions = strstr(extensions, name)) != NULL) {
+        if (extensions[length] == ' ' || extensions[length] == '\0') {
+            return true;
+        }
+        extensions += length;
+    }
+    return false;
+}
+
+void loadGLExtensions() {
+    pglGenBuffers = (GenBuffersProc)getGLProcAddress("glGenBuffers");
+    pglDeleteBuffers = (DeleteBuffersProc)getGLProcAddress("glDeleteBuffers");
+    pglBindBuffer = (BindBufferProc)getGLProcAddress("glBindBuffer");
+    pglBufferData = (BufferDataProc)getGLProcAddress("glBufferData");
+    pglBufferSubData = (BufferSubDataProc)getGLProcAddress("glBufferSubData");
+    glBuffersSupported = glVersionAtLeast(1, 5) && pglGenBuffers && pglDeleteBuffers && pglBindBuffer &&
+                         pglBufferData && pglBufferSubData;
+
+    pglActiveTexture = (ActiveTextureProc)getGLProcAddress("glActiveTexture");
+    pglCreateShader = (CreateShaderProc)getGLProcAddress("glCreateShader");
+    pglShaderSource = (ShaderSourceProc)getGLProcAddress("glShaderSource");
+    pglCompileShader = (CompileShaderProc)getGLProcAddress("glCompileShader");
+    pglGetShaderiv = (GetShaderivProc)getGLProcAddress("glGetShaderiv");
+    pglGetShaderInfoLog = (GetShaderInfoLogProc)getGLProcAddress("glGetShaderInfoLog");
+    pglDeleteShader = (DeleteShaderProc)getGLProcAddress("glDeleteShader");
+    pglCreateProgram = (CreateProgramProc)getGLProcAddress("glCreateProgram");
+    pglAttachShader = (AttachShaderProc)getGLProcAddress("glAttachShader");
+    pglLinkProgram = (LinkProgramProc)getGLProcAddress("glLinkProgram");
+    pglGetProgramiv = (GetProgramivProc)getGLProcAddress("glGetProgramiv");
+    pglGetProgramInfoLog = (GetProgramInfoLogProc)getGLProcAddress("glGetProgramInfoLog");
+    pglUseProgram = (UseProgramProc)getGLProcAddress("glUseProgram");
+    pglGetUniformLocation = (GetUniformLocationProc)getGLProcAddress("glGetUniformLocation");
+    pglUniform1i = (Uniform1iProc)getGLProcAddress("glUniform1i");
+    pglUniform1f = (Uniform1fProc)getGLProcAddress("glUniform1f");
+    pglUniform2f = (Uniform2fProc)getGLProcAddress("glUniform2f");
+    pglUniformMatrix4fv = (UniformMatrix4fvProc)getGLProcAddress("glUniformMatrix4fv");
+    glShadersSupported = glVersionAtLeast(2, 0) && pglActiveTexture && pglCreateShader && pglShaderSource &&
+                         pglCompileShader && pglGetShaderiv && pglGetShaderInfoLog && pglDeleteShader &&
+                         pglCreateProgram && pglAttachShader && pglLinkProgram && pglGetProgramiv &&
+                         pglGetProgramInfoLog && pglUseProgram && pglGetUniformLocation &&
+                         pglUniform1i && pglUniform1f && pglUniform2f && pglUniformMatrix4fv;
+    glFloatTexturesSupported = glVersionAtLeast(3, 0) || glHasExtension("GL_ARB_texture_float");
+
+    pglGenFramebuffers = (GenFramebuffersProc)getGLProcAddress("glGenFramebuffers");
+    pglBindFramebuffer = (BindFramebufferProc)getGLProcAddress("glBindFramebuffer");
+    pglFramebufferTexture2D = (FramebufferTexture2DProc)getGLProcAddress("glFramebufferTexture2D");
+    pglCheckFramebufferStatus = (CheckFramebufferStatusProc)getGLProcAddress("glCheckFramebufferStatus");
+    pglBlitFramebuffer = (BlitFramebufferProc)getGLProcAddress("glBlitFramebuffer");
+    glFramebuffersSupported = (glVersionAtLeast(3, 0) || glHasExtension("GL_ARB_framebuffer_object")) &&
+                              pglGenFramebuffers && pglBindFramebuffer && pglFramebufferTexture2D &&
+                              pglCheckFramebufferStatus && pglBlitFramebuffer;
+
+    pglMapBufferRange = (MapBufferRangeProc)getGLProcAddress("glMapBufferRange");
+    pglUnmapBuffer = (UnmapBufferProc)getGLProcAddress("glUnmapBuffer");
+    glMapBufferRangeSupported = glBuffersSupported &&
+                                (glVersionAtLeast(3, 0) || glHasExtension("GL_ARB_map_buffer_range")) &&
+                                pglMapBufferRange && pglUnmapBuffer;
+    pglFenceSync = (FenceSyncProc)getGLProcAddress("glFenceSync");
+    pglClientWaitSync = (ClientWaitSyncProc)getGLProcAddress("glClientWaitSync");
+    pglDeleteSync = (DeleteSyncProc)getGLProcAddress("glDeleteSync");
+    glSyncSupported = (glVersionAtLeast(3, 2) || glHasExtension("GL_ARB_sync")) &&
+                      pglFenceSync && pglClientWaitSync && pglDeleteSync;
+
+    pglBufferStorage = (BufferStorageProc)getGLProcAddress("glBufferStorage");
+    glBufferStorageSupported = glMapBufferRangeSupported &&
+                               (glVersionAtLeast(4, 4) || glHasExtension("GL_ARB_buffer_storage")) &&
+                               pglBufferStorage;
+    pglCopyBufferSubData = (CopyBufferSubDataProc)getGLProcAddress("glCopyBufferSubData");
+    glCopyBufferSupported = glBuffersSupported &&
+                            (glVersionAtLeast(3, 1) || glHasExtension("GL_ARB_copy_buffer")) &&
+                            pglCopyBufferSubData;
+
+#if defined(_WIN32)
+    pglSwapInterval = (SwapIntervalProc)getGLProcAddress("wglSwapIntervalEXT");
+#elif !defined(__APPLE__)
+    pglSwapInterval = (SwapIntervalProc)getGLProcAddress("glXSwapIntervalMESA");
+    if (!pglSwapInterval) {
+        pglSwapInterval = (SwapIntervalProc)getGLProcAddress("glXSwapIntervalSGI");
+    }
+#endif
+    glSwapIntervalSupported = pglSwapInterval != NULL;
+
+    pglGenQueries = (GenQueriesProc)getGLProcAddress("glGenQueries");
+    pglDeleteQueries = (DeleteQueriesProc)getGLProcAddress("glDeleteQueries");
+    pglBeginQuery = (BeginQueryProc)getGLProcAddress("glBeginQuery");
+    pglEndQuery = (EndQueryProc)getGLProcAddress("glEndQuery");
+    pglGetQueryObjectiv = (GetQueryObjectivProc)getGLProcAddress("glGetQueryObjectiv");
+    pglGetQueryObjectui64v = (GetQueryObjectui64vProc)getGLProcAddress("glGetQueryObjectui64v");
+    glTimerQueriesSupported = (glVersionAtLeast(3, 3) || glHasExtension("GL_ARB_timer_query")) &&
+                              pglGenQueries && pglDeleteQueries && pglBeginQuery && pglEndQuery &&
+                              pglGetQueryObjectiv && pglGetQueryObjectui64v;
+
+    printf("OpenGL buffer objects: %s\n", glBuffersSupported ? "available" : "not available");
+    printf("OpenGL shaders: %s, float textures: %s, framebuffers: %s\n",
+           glShadersSupported ? "available" : "not available",
+           glFloatTexturesSupported ? "available" : "not available",
+           glFramebuffersSupported ? "available" : "not available");
+    printf("OpenGL buffer mapping: %s, sync objects: %s, buffer storage: %s\n",
+           glMapBufferRangeSupported ? "available" : "not available",
+           glSyncSupported ? "available" : "not available",
+           glBufferStorageSupported ? "available" : "not available");
+    printf("OpenGL timer queries: %s\n", glTimerQueriesSupported ? "available" : "not available");
+}
+
+// Wait for interval vertical blanks per buffer swap (0 = don't wait)
+bool setSwapInterval(int interval) {
+    if (!glSwapIntervalSupported) {
+        return false;
+    }
+#if defined(_WIN32)
+    return pglSwapInterval(interval) != 0;  // BOOL, TRUE on success
+#else
+    return pglSwapInterval(interval) == 0;  // GLX error code
+#endif
+}
+
+#endif // GL_EXTENSIONS_H
@@ -0,0 +1,361 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Profiler.h"
+
+// Work-stealing job scheduler.
+//
+// The main thread and jobSystem.workerCount - 1 worker threads each own a
+// deque of ready jobs. A thread pushes and pops its own deque at the bottom
+// (newest first, which keeps its caches warm) and, when that is empty, steals
+// the oldest job from the top of another thread's deque. The deques are
+// Chase-Lev: the owner only synchronises with thieves when one job is left,
+// and thieves race for it with a single compare-and-swap, so neither side
+// takes a lock.
+//
+// A job counts itself and its unfinished children; it is finished when that
+// count reaches zero, which also counts it off its own parent. waitForJob
+// runs other jobs (its own first) until the one waited on is finished, so a
+// job may wait for its children without tying up a thread. parallelFor splits
+// a range in halves, as children of the job running the split, until pieces
+// are no larger than the grain; idle threads steal the big halves first.
+//
+// Jobs come from a per-thread ring of JOB_POOL_SIZE that is reused without
+// freeing; allocation skips jobs that have not finished, and runs other jobs
+// while the whole ring is busy. Only the main thread and code running inside
+// jobs may create jobs, and a job may only be waited for by the thread that
+// created it (its slot is reused once it has finished). With one thread (or
+// before initJobSystem) everything runs inline on the caller, exactly as the
+// serial code did.
+#define JOB_POOL_SIZE 4096
+#define JOB_DEQUE_SIZE 4096   // Power of two; jobs that do not fit run at once
+#define JOB_SPIN_COUNT 64     // Empty searches before an idle worker sleeps
+#define JOB_MAX_THREADS 64
+
+typedef void (*JobFunc)(void* data);
+typedef void (*JobRangeFunc)(void* data, int begin, int end);
+
+struct Job {
+    JobFunc function;              // Either a plain job...
+    JobRangeFunc rangeFunction;    // ...or a piece of a parallelFor
+    void* data;
+    int begin, end, grain;
+    Job* parent;
+    std::atomic<int> unfinished;   // 1 for the job itself, plus its unfinished children
+};
+
+struct JobDeque {
+    std::atomic<long long> top;     // Thieves take from here
+    char padding[64];               // Keeps the two ends on separate cache lines
+    std::atomic<long long> bottom;  // The owner pushes and pops here
+    std::atomic<Job*> jobs[JOB_DEQUE_SIZE];
+};
+
+struct JobWorker {
+    JobDeque deque;
+    Job pool[JOB_POOL_SIZE];
+    unsigned int allocated;        // Jobs taken from the pool so far
+    unsigned int random;           // Victim selection for steals
+    std::atomic<int> executed;     // Jobs run (since the last stats reset)
+    std::atomic<int> stolen;       // Of those, taken from other threads
+};
+
+struct JobSystem {
+    std::vector<JobWorker*> workers;        // [0] is the main thread
+    std::vector<std::thread> threads;
+    std::mutex mutex;                       // Only for sleeping and waking idle workers
+    std::condition_variable wake;
+    std::atomic<int> queued;                // Jobs sitting in any deque
+    std::atomic<int> sleeping;
+    std::atomic<bool> stopping;
+    int workerCount;                        // Threads, including the main thread
+    bool running;
+};
+
+JobSystem jobSystem;
+
+// Index of the calling thread's worker, or -1 for threads outside the system
+thread_local int jobWorkerIndex = -1;
+
+bool jobDequePush(JobDeque& deque, Job* job) {
+    long long b = deque.bottom.load(std::memory_order_relaxed);
+    long long t = deque.top.load(std::memory_order_acquire);
+    if (b - t >= JOB_DEQUE_SIZE) return false;
+    deque.jobs[b & (JOB_DEQUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+    deque.bottom.store(b + 1, std::memory_order_release);  // Publishes the job to thieves
+    return true;
+}
+
+Job* jobDequePop(JobDeque& deque) {
+    long long b = deque.bottom.load(std::memory_order_relaxed) - 1;
+    deque.bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long long t = deque.top.load(std::memory_order_relaxed);
+    if (t > b) {
+        deque.bottom.store(b + 1, std::memory_order_relaxed);
+        return NULL;
+    }
+    Job* job = deque.jobs[b & (JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // Last job: a thief may be after it too
+        if (!deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = NULL;
+        }
+        deque.bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* jobDequeSteal(JobDeque& deque) {
+    long long t = deque.top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long long b = deque.bottom.load(std::memory_order_acquire);
+    if (t >= b) return NULL;
+    Job* job = deque.jobs[t & (JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+    if (!deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return NULL;  // Lost the race to the owner or another thief
+    }
+    return job;
+}
+
+// True on the main thread and in jobs once there are workers to share with
+bool isJobSystemParallel() {
+    return jobSystem.running && jobWorkerIndex >= 0 && jobSystem.workerCount > 1;
+}
+
+// A job from the calling thread's pool. Pass a parent to have the parent wait
+// for this job too; the child must be created before the parent finishes
+// (from inside the parent, or before the parent is run).
+Job* findJob();
+void executeJob(Job* job);
+
+Job* createJob(JobFunc function, void* data, Job* parent = NULL) {
+    JobWorker* worker = jobSystem.workers[jobWorkerIndex];
+    Job* job = NULL;
+    while (!job) {
+        for (int i = 0; i < JOB_POOL_SIZE && !job; i++) {
+            Job* candidate = &worker->pool[worker->allocated++ % JOB_POOL_SIZE];
+            if (candidate->unfinished.load(std::memory_order_acquire) == 0) job = candidate;
+        }
+        if (!job) {
+            Job* other = findJob();
+            if (other) executeJob(other);
+            else std::this_thread::yield();
+        }
+    }
+    job->function = function;
+    job->rangeFunction = NULL;
+    job->data = data;
+    job->begin = job->end = job->grain = 0;
+    job->parent = parent;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    if (parent) parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    return job;
+}
+
+// Count a job (or a child of it) as done. Its parent is read first: once
+// the count reaches zero, the job's slot may be reused by its owner.
+void finishJob(Job* job) {
+    while (job) {
+        Job* parent = job->parent;
+        if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        job = parent;
+    }
+}
+
+void runJob(Job* job);
+
+void executeJob(Job* job) {
+    if (job->rangeFunction) {
+        // Hand off the upper half until the rest is small enough to run here
+        while (job->end - job->begin > job->grain) {
+            int middle = job->begin + (job->end - job->begin) / 2;
+            Job* half = createJob(NULL, job->data, job);
+            half->rangeFunction = job->rangeFunction;
+            half->begin = middle;
+            half->end = job->end;
+            half->grain = job->grain;
+            runJob(half);
+            job->end = middle;
+        }
+        job->rangeFunction(job->data, job->begin, job->end);
+    } else {
+        job->function(job->data);
+    }
+    jobSystem.workers[jobWorkerIndex]->executed.fetch_add(1, std::memory_order_relaxed);
+    finishJob(job);
+}
+
+// Make a job available to every thread. Runs it at once if the calling
+// thread's deque is full.
+void runJob(Job* job) {
+    JobWorker* worker = jobSystem.workers[jobWorkerIndex];
+    if (!jobDequePush(worker->deque, job)) {
+        executeJob(job);
+        return;
+    }
+    jobSystem.queued.fetch_add(1, std::memory_order_seq_cst);
+    if (jobSystem.sleeping.load(std::memory_order_seq_cst) > 0) {
+        std::lock_guard<std::mutex> lock(jobSystem.mutex);
+        jobSystem.wake.notify_one();
+    }
+}
+
+// The calling thread's newest job, or the oldest of a random other thread's
+Job* findJob() {
+    JobWorker* worker = jobSystem.workers[jobWorkerIndex];
+    Job* job = jobDequePop(worker->deque);
+    if (job) {
+        jobSystem.queued.fetch_sub(1, std::memory_order_relaxed);
+        return job;
+    }
+    int count = jobSystem.workerCount;
+    worker->random ^= worker->random << 13;
+    worker->random ^= worker->random >> 17;
+    worker->random ^= worker->random << 5;
+    int first = (int)(worker->random % (unsigned int)count);
+    for (int i = 0; i < count; i++) {
+        int victim = (first + i) % count;
+        if (victim == jobWorkerIndex) continue;
+        job = jobDequeSteal(jobSystem.workers[victim]->deque);
+        if (job) {
+            jobSystem.queued.fetch_sub(1, std::memory_order_relaxed);
+            worker->stolen.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    return NULL;
+}
+
+bool isJobFinished(const Job* job) {
+    return job->unfinished.load(std::memory_order_acquire) == 0;
+}
+
+// Run jobs until job has finished, yielding only when there is nothing to do
+void waitForJob(const Job* job) {
+    while (!isJobFinished(job)) {
+        Job* next = findJob();
+        if (next) executeJob(next);
+        else std::this_thread::yield();
+    }
+}
+
+// Call function(data, begin, end) over pieces of [0, count) of at most grain
+// items, on every thread, and return once all have run. Pieces of one call
+// run in any order and at the same time, so they must not write shared state.
+void parallelFor(int count, int grain, JobRangeFunc function, void* data) {
+    if (count <= 0) return;
+    if (grain < 1) grain = 1;
+    if (!isJobSystemParallel() || count <= grain) {
+        function(data, 0, count);
+        return;
+    }
+    Job* job = createJob(NULL, data);
+    job->rangeFunction = function;
+    job->begin = 0;
+    job->end = count;
+    job->grain = grain;
+    runJob(job);
+    waitForJob(job);
+}
+
+void jobWorkerMain(int index) {
+    jobWorkerIndex = index;
+    setProfilerThreadName("Job", index);
+    int idle = 0;
+    while (!jobSystem.stopping.load(std::memory_order_relaxed)) {
+        Job* job = findJob();
+        if (job) {
+            executeJob(job);
+            idle = 0;
+        } else if (++idle < JOB_SPIN_COUNT) {
+            std::this_thread::yield();
+        } else {
+            std::unique_lock<std::mutex> lock(jobSystem.mutex);
+            jobSystem.sleeping.fetch_add(1, std::memory_order_seq_cst);
+            jobSystem.wake.wait(lock, []() {
+                return jobSystem.queued.load(std::memory_order_seq_cst) > 0 ||
+                       jobSystem.stopping.load(std::memory_order_relaxed);
+            });
+            jobSystem.sleeping.fetch_sub(1, std::memory_order_relaxed);
+            idle = 0;
+        }
+    }
+}
+
+// Stop and join the workers; called at exit. Must not run while a job does.
+void shutdownJobSystem() {
+    if (!jobSystem.running) return;
+    {
+        std::lock_guard<std::mutex> lock(jobSystem.mutex);
+        jobSystem.stopping.store(true);
+    }
+    jobSystem.wake.notify_all();
+    for (size_t i = 0; i < jobSystem.threads.size(); i++) jobSystem.threads[i].join();
+    jobSystem.threads.clear();
+    for (size_t i = 0; i < jobSystem.workers.size(); i++) delete jobSystem.workers[i];
+    jobSystem.workers.clear();
+    jobSystem.running = false;
+    jobWorkerIndex = -1;
+}
+
+// Start the scheduler on the calling (main) thread with threadCount threads in
+// total; 0 uses one per hardware thread
+void initJobSystem(int threadCount = 0) {
+    shutdownJobSystem();
+    if (threadCount <= 0) threadCount = (int)std::thread::hardware_concurrency();
+    if (threadCount < 1) threadCount = 1;
+    if (threadCount > JOB_MAX_THREADS) threadCount = JOB_MAX_THREADS;
+
+    jobSystem.workerCount = threadCount;
+    jobSystem.queued.store(0);
+    jobSystem.sleeping.store(0);
+    jobSystem.stopping.store(false);
+    for (int i = 0; i < threadCount; i++) {
+        JobWorker* worker = new JobWorker;
+        worker->deque.top.store(0);
+        worker->deque.bottom.store(0);
+        for (int j = 0; j < JOB_POOL_SIZE; j++) worker->pool[j].unfinished.store(0);
+        worker->allocated = 0;
+        worker->random = 2463534242u + i * 7919u;
+        worker->executed.store(0);
+        worker->stolen.store(0);
+        jobSystem.workers.push_back(worker);
+    }
+    jobWorkerIndex = 0;
+    jobSystem.running = true;
+    for (int i = 1; i < threadCount; i++) {
+        jobSystem.threads.push_back(std::thread(jobWorkerMain, i));
+    }
+    static bool shutdownRegistered = false;
+    if (!shutdownRegistered) {
+        atexit(shutdownJobSystem);
+        shutdownRegistered = true;
+    }
+    printf("Job system: %d thread%s\n", threadCount, threadCount == 1 ? "" : "s");
+}
+
+// Jobs run and stolen across all threads since the last reset
+void getJobStats(int& executed, int& stolen) {
+    executed = stolen = 0;
+    for (size_t i = 0; i < jobSystem.workers.size(); i++) {
+        executed += jobSystem.workers[i]->executed.load(std::memory_order_relaxed);
+        stolen += jobSystem.workers[i]->stolen.load(std::memory_order_relaxed);
+    }
+}
+
+void resetJobStats() {
+    for (size_t i = 0; i < jobSystem.workers.size(); i++) {
+        jobSystem.workers[i]->executed.store(0, std::memory_order_relaxed);
+        jobSystem.workers[i]->stolen.store(0, std::memory_order_relaxed);
+    }
+}
+
+#endif // JOB_SYSTEM_H
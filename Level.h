@@ -0,0 +1,235 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <math.h>
+#include "ModelLoader.h"
+#include "Profiler.h"
+
+// Static level layout shared by the game and the offline tools.
+// Everything listed here is placed once and never moves; packages and
+// the player are dynamic and are handled separately.
+
+enum LevelObjectType {
+    LEVEL_HOUSE = 0,
+    LEVEL_TREE,
+    LEVEL_FENCE,
+    LEVEL_ROCK,
+    LEVEL_CROP,
+    LEVEL_GRASS_BLOCK,
+    LEVEL_STREET_LAMP
+};
+
+struct LevelObject {
+    int type;
+    float x, z;
+    float y;         // Ground height under (x, z), set by placeLevelOnTerrain
+    float size;      // House scale, tree height, fence length or rock size
+    float rotation;  // Only used by fences (degrees around Y)
+    Vector3 boundsMin, boundsMax;  // World-space AABB, filled by addLevelObject
+    int node, modelNode;           // Game scene graph nodes (-1 until the game builds them)
+};
+
+// Model file paths - Using .obj and .3ds formats (Assimp no longer needed)
+// Note: Some models may need to be exported from .blend to .obj using Blender if not available
+const char* MODEL_PATH_PLAYER = "models/98-hikerbasemesh/Player.obj";  // Export from Player.blend if needed
+const char* MODEL_PATH_TREE = "models/tree/tree1_3ds/Tree1.3ds";
+const char* MODEL_PATH_ROCK1 = "models/1elmla01hh-Rock1_BYTyroSmith/Rock1/Rock1.obj";
+const char* MODEL_PATH_ROCKSET = "models/xvs3wxwo2o-RockSet_MadeByTyroSmith/RockSet/RockSet.obj";
+const char* MODEL_PATH_FARMHOUSE = "models/4vd2sk31doow-farmhouse_maya16/Farmhouse Maya 2016 Updated/farmhouse_obj.obj";
+const char* MODEL_PATH_STREETLAMP = "models/s3duldjjt9fk-StreetLampByTyroSmith/Street Lamp/StreetLamp.obj";
+const char* MODEL_PATH_FENCE = "models/6od9waw1za0w-fence/fence/cerca.obj";  // Export from cerca.blend if needed
+const char* MODEL_PATH_WHEAT = "models/10458_Wheat_Field_v1_L3.123c5ecd0518-ae16-4fee-bf80-4177de196237/10458_Wheat_Field_v1_L3.123c5ecd0518-ae16-4fee-bf80-4177de196237/10458_Wheat_Field_v1_max2010_it2.obj";
+const char* MODEL_PATH_CARROT = "models/Carrot_v01_l3.123c059c383a-f43b-48c0-b28a-bec318013e17/Carrot_v01_l3.123c059c383a-f43b-48c0-b28a-bec318013e17/10170_Carrot_v01_L3.obj";
+const char* MODEL_PATH_GRASSBLOCK = "models/grass-block/grass-block.3DS";
+const char* MODEL_PATH_TREE_ALT = "models/15od5xhlv2jc-Tree_02/Tree 02/Tree.obj";
+
+// Farmhouse model size: file units are scaled by LEVEL_HOUSE_MODEL_SCALE, then
+// by LEVEL_HOUSE_MODEL_PLACEMENT times the house's size
+#define LEVEL_HOUSE_MODEL_SCALE 0.015f
+#define LEVEL_HOUSE_MODEL_PLACEMENT 2.5f
+
+// Crop field dimensions
+const int NORTH_FIELD_CROP_COLUMNS = 6;
+const int SOUTH_FIELD_CROP_COLUMNS = 5;
+
+// Walkable area covered by the level (square, centered on the origin)
+#define LEVEL_HALF_EXTENT 100.0f
+
+std::vector<LevelObject> levelObjects;
+
+// Conservative world-space bounds of an object (used for culling and as
+// ray targets by the PVS builder)
+void getLevelObjectBounds(const LevelObject& obj, Vector3& bmin, Vector3& bmax) {
+    switch (obj.type) {
+        case LEVEL_HOUSE: {
+            float r = 3.0f * obj.size;
+            bmin = Vector3(obj.x - r, 0, obj.z - r);
+            bmax = Vector3(obj.x + r, 6.5f * obj.size, obj.z + r);
+            break;
+        }
+        case LEVEL_TREE: {
+            float r = obj.size * 0.45f;
+            bmin = Vector3(obj.x - r, 0, obj.z - r);
+            bmax = Vector3(obj.x + r, obj.size * 1.2f, obj.z + r);
+            break;
+        }
+        case LEVEL_FENCE: {
+            // Fence runs along its local +X axis from the anchor point
+            float rad = obj.rotation * 3.14159265359f / 180.0f;
+            float ex = cos(rad) * obj.size;
+            float ez = -sin(rad) * obj.size;
+            bmin = Vector3((ex < 0 ? obj.x + ex : obj.x) - 0.2f, 0, (ez < 0 ? obj.z + ez : obj.z) - 0.2f);
+            bmax = Vector3((ex > 0 ? obj.x + ex : obj.x) + 0.2f, 1.6f, (ez > 0 ? obj.z + ez : obj.z) + 0.2f);
+            break;
+        }
+        case LEVEL_ROCK: {
+            float r = obj.size;
+            bmin = Vector3(obj.x - r, 0, obj.z - r);
+            bmax = Vector3(obj.x + r, obj.size * 1.0f, obj.z + r);
+            break;
+        }
+        case LEVEL_CROP:
+            bmin = Vector3(obj.x - 0.7f, 0, obj.z - 0.7f);
+            bmax = Vector3(obj.x + 0.7f, 0.7f, obj.z + 0.7f);
+            break;
+        case LEVEL_GRASS_BLOCK:
+            bmin = Vector3(obj.x - 0.5f, 0, obj.z - 0.5f);
+            bmax = Vector3(obj.x + 0.5f, 1.0f, obj.z + 0.5f);
+            break;
+        case LEVEL_STREET_LAMP:
+        default:
+            bmin = Vector3(obj.x - 0.4f, 0, obj.z - 0.4f);
+            bmax = Vector3(obj.x + 0.4f, 5.5f, obj.z + 0.4f);
+            break;
+    }
+    bmin.y += obj.y;
+    bmax.y += obj.y;
+}
+
+void addLevelObject(int type, float x, float z, float size, float rotation) {
+    LevelObject obj;
+    obj.type = type;
+    obj.x = x;
+    obj.z = z;
+    obj.y = 0.0f;
+    obj.size = size;
+    obj.rotation = rotation;
+    obj.node = -1;
+    obj.modelNode = -1;
+    getLevelObjectBounds(obj, obj.boundsMin, obj.boundsMax);
+    levelObjects.push_back(obj);
+}
+
+// Build the static object list. The order is stable, so object indices can be
+// stored in precomputed data such as the PVS file.
+void buildLevel() {
+    PROFILE_FUNCTION();
+    levelObjects.clear();
+
+    // Houses (farmhouses scattered at proper distances around the scene)
+    addLevelObject(LEVEL_HOUSE, -30.0f, -25.0f, 1.0f, 0);  // Northwest house
+    addLevelObject(LEVEL_HOUSE, 25.0f, -30.0f, 1.0f, 0);   // Northeast house
+    addLevelObject(LEVEL_HOUSE, -20.0f, 30.0f, 1.0f, 0);   // Southwest house
+    addLevelObject(LEVEL_HOUSE, 35.0f, 20.0f, 1.0f, 0);    // Southeast house
+
+    // Trees (scattered naturally around the rural scene)
+    addLevelObject(LEVEL_TREE, -8.0f, -18.0f, 4.0f, 0);
+    addLevelObject(LEVEL_TREE, 12.0f, -12.0f, 3.5f, 0);
+    addLevelObject(LEVEL_TREE, -15.0f, 8.0f, 4.5f, 0);
+    addLevelObject(LEVEL_TREE, 18.0f, 10.0f, 3.8f, 0);
+    addLevelObject(LEVEL_TREE, -25.0f, -8.0f, 4.2f, 0);
+    addLevelObject(LEVEL_TREE, 28.0f, -20.0f, 3.9f, 0);
+    addLevelObject(LEVEL_TREE, -10.0f, 25.0f, 4.1f, 0);
+    addLevelObject(LEVEL_TREE, 22.0f, 28.0f, 3.7f, 0);
+    addLevelObject(LEVEL_TREE, 5.0f, -25.0f, 4.3f, 0);
+    addLevelObject(LEVEL_TREE, -18.0f, 18.0f, 3.6f, 0);
+
+    // Fences (around properties and fields)
+    addLevelObject(LEVEL_FENCE, -20.0f, -28.0f, 12.0f, 0);    // North fence
+    addLevelObject(LEVEL_FENCE, 18.0f, -25.0f, 10.0f, 45);    // Northeast fence
+    addLevelObject(LEVEL_FENCE, -15.0f, 20.0f, 15.0f, 90);    // West fence
+    addLevelObject(LEVEL_FENCE, 25.0f, 15.0f, 12.0f, 0);      // East fence
+    addLevelObject(LEVEL_FENCE, -8.0f, -35.0f, 20.0f, 0);     // Crop field fence
+
+    // Rocks (scattered naturally)
+    addLevelObject(LEVEL_ROCK, 8.0f, -8.0f, 0.8f, 0);
+    addLevelObject(LEVEL_ROCK, -12.0f, -15.0f, 1.0f, 0);
+    addLevelObject(LEVEL_ROCK, 15.0f, 5.0f, 0.7f, 0);
+    addLevelObject(LEVEL_ROCK, -22.0f, 12.0f, 0.9f, 0);
+    addLevelObject(LEVEL_ROCK, 25.0f, -12.0f, 1.1f, 0);
+    addLevelObject(LEVEL_ROCK, -5.0f, 20.0f, 0.8f, 0);
+
+    // Crops (wheat and carrots in organized fields)
+    // North field
+    for (int i = 0; i < NORTH_FIELD_CROP_COLUMNS; i++) {
+        addLevelObject(LEVEL_CROP, -8.0f + i * 3, -32.0f, 1.0f, 0);
+        addLevelObject(LEVEL_CROP, -8.0f + i * 3, -35.0f, 1.0f, 0);
+    }
+    // South field
+    for (int i = 0; i < SOUTH_FIELD_CROP_COLUMNS; i++) {
+        addLevelObject(LEVEL_CROP, 12.0f + i * 3, 32.0f, 1.0f, 0);
+    }
+
+    // Grass blocks (reduced density to avoid clutter)
+    for (int i = -2; i <= 2; i++) {
+        for (int j = -2; j <= 2; j++) {
+            // Skip center area where player and main objects are
+            if (abs(i) <= 1 && abs(j) <= 1) continue;
+            if ((i + j) % 2 == 0) {
+                addLevelObject(LEVEL_GRASS_BLOCK, i * 8.0f, j * 8.0f, 1.0f, 0);
+            }
+        }
+    }
+
+    // Street lamps (positioned at corners around central area)
+    addLevelObject(LEVEL_STREET_LAMP, -10.0f, -10.0f, 1.0f, 0);  // Northwest
+    addLevelObject(LEVEL_STREET_LAMP, 10.0f, -10.0f, 1.0f, 0);   // Northeast
+    addLevelObject(LEVEL_STREET_LAMP, -10.0f, 10.0f, 1.0f, 0);   // Southwest
+    addLevelObject(LEVEL_STREET_LAMP, 10.0f, 10.0f, 1.0f, 0);    // Southeast
+}
+
+// Lighting stress scene: extra street lamps on a regular grid over the whole
+// level. Changes the object count, so the baked PVS is rejected and every
+// object counts as visible.
+void addStressLamps(int count) {
+    int side = (int)ceil(sqrt((float)count));
+    float spacing = 2.0f * (LEVEL_HALF_EXTENT - 10.0f) / side;
+    for (int i = 0; i < count; i++) {
+        float x = -LEVEL_HALF_EXTENT + 10.0f + spacing * (i % side + 0.5f);
+        float z = -LEVEL_HALF_EXTENT + 10.0f + spacing * (i / side + 0.5f);
+        addLevelObject(LEVEL_STREET_LAMP, x, z, 1.0f, 0);
+    }
+    printf("Stress scene: added %d street lamps\n", count);
+}
+
+// Box inside a model's enclosed interior, in the model's file units (found
+// by the PVS builder from its collision copy)
+struct ModelSolidBox {
+    bool found;
+    Vector3 bmin, bmax;
+};
+
+// Solid part of an object that blocks sight lines. It must lie inside the
+// geometry that is actually rendered so that visibility stays conservative.
+// Houses drawn with the primitive fallback (houseModelSolid NULL) use the
+// inside of their wall cube; houses drawn with the farmhouse model use the
+// model's solid box placed like the model, or nothing if it has none.
+bool getLevelObjectOccluder(const LevelObject& obj, const ModelSolidBox* houseModelSolid,
+                            Vector3& bmin, Vector3& bmax) {
+    if (obj.type != LEVEL_HOUSE) return false;
+    if (!houseModelSolid) {
+        // Inside the 4x3x4 wall cube of the fallback house
+        float r = 1.9f * obj.size;
+        bmin = Vector3(obj.x - r, obj.y + 1.1f * obj.size, obj.z - r);
+        bmax = Vector3(obj.x + r, obj.y + 3.9f * obj.size, obj.z + r);
+        return true;
+    }
+    if (!houseModelSolid->found) return false;
+    float scale = obj.size * LEVEL_HOUSE_MODEL_PLACEMENT * LEVEL_HOUSE_MODEL_SCALE;
+    Vector3 origin(obj.x, obj.y, obj.z);
+    bmin = origin + houseModelSolid->bmin * scale;
+    bmax = origin + houseModelSolid->bmax * scale;
+    return true;
+}
+
+#endif // LEVEL_H
@@ -0,0 +1,599 @@
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include <math.h>
+#include <vector>
+
+#include "GLExtensions.h"
+#include "RenderQueue.h"
+#include "FrameRing.h"
+#include "Level.h"
+#include "Shadows.h"
+#include "Profiler.h"
+
+// Point lights for the street lamps, shaded one of three ways:
+//
+//   LIGHTING_FIXED     - fixed-function GL_LIGHT1..4, fed with the four lamps
+//                        nearest to the camera (fallback without GLSL)
+//   LIGHTING_FORWARD   - GLSL, every fragment loops over every light. Only
+//                        kept as the baseline for frame-time comparisons.
+//   LIGHTING_CLUSTERED - GLSL clustered forward shading. The view frustum is
+//                        split into a CLUSTER_X x CLUSTER_Y x CLUSTER_Z grid
+//                        (screen tiles x exponential depth slices). Each
+//                        frame the CPU bins the lights into the clusters
+//                        their bounding boxes touch and uploads the per-
+//                        cluster lists as float textures; a fragment finds
+//                        its cluster and shades only with that list.
+//
+// The shaders reproduce the fixed-function sun (GL_LIGHT0), color material
+// and texture modulation, so the rest of the renderer is unchanged, and add
+// the cascaded sun shadows from Shadows.h. Prelit geometry (baked sun and sky
+// light in the vertex color, baked sun term in its alpha) only adds lamps and
+// loses the sun where a shadow map says something blocks it.
+
+#define LIGHTING_FIXED 0
+#define LIGHTING_FORWARD 1
+#define LIGHTING_CLUSTERED 2
+#define LIGHTING_MODE_COUNT 3
+
+#define CLUSTER_X 16
+#define CLUSTER_Y 8
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#define CLUSTER_NEAR 1.0f                 // Depth slice 0 covers [near plane, CLUSTER_NEAR)
+#define CLUSTER_MAX_LIGHTS 1024           // Width of the light texture
+#define CLUSTER_INDEX_WIDTH 1024          // Light index texture is WIDTH x ROWS
+#define CLUSTER_INDEX_ROWS 64
+#define CLUSTER_MAX_INDICES (CLUSTER_INDEX_WIDTH * CLUSTER_INDEX_ROWS)
+#define CLUSTER_MAX_LIGHTS_PER_CLUSTER 256  // Shader loop bound
+
+#define FIXED_LAMP_LIGHTS 4               // GL_LIGHT1..GL_LIGHT4
+
+#define LAMP_LIGHT_HEIGHT 5.0f            // Bulb height above the lamp's base
+#define LAMP_LIGHT_RADIUS 15.0f           // Distance where a lamp's light reaches zero
+
+struct PointLight {
+    float x, y, z;
+    float radius;
+    float r, g, b;
+};
+
+struct ClusterRange {
+    int x0, x1, y0, y1, z0, z1;
+};
+
+struct ClusteredLighting {
+    // Projection, set from Reshape
+    int viewportWidth, viewportHeight;
+    float tanHalfFovY, aspect, nearPlane, farPlane;
+
+    // CPU-side copies of the textures
+    std::vector<float> lightData;      // RGBA x CLUSTER_MAX_LIGHTS x 2 rows (view pos + radius, color)
+    std::vector<float> clusterTable;   // RGBA per cluster: first index, light count
+    std::vector<float> lightIndices;   // One light index per texel
+    std::vector<int> clusterCounts;
+    std::vector<ClusterRange> ranges;
+    int lightCount;
+    int indexCount;
+
+    GLuint lightTexture, clusterTexture, indexTexture, whiteTexture;
+    GLuint programs[LIGHTING_MODE_COUNT];  // Indexed by mode, 0 for LIGHTING_FIXED
+    bool ready;
+};
+
+std::vector<PointLight> pointLights;  // World space
+ClusteredLighting clusterLighting;
+int lightingMode = LIGHTING_FIXED;
+
+const char* getLightingModeName(int mode) {
+    switch (mode) {
+        case LIGHTING_FORWARD:   return "forward (all lights)";
+        case LIGHTING_CLUSTERED: return "clustered";
+        default:                 return "fixed-function";
+    }
+}
+
+// One light per street lamp in the level
+void buildLampLights() {
+    pointLights.clear();
+    for (size_t i = 0; i < levelObjects.size(); i++) {
+        const LevelObject& obj = levelObjects[i];
+        if (obj.type != LEVEL_STREET_LAMP) continue;
+        PointLight light;
+        light.x = obj.x;
+        light.y = obj.y + LAMP_LIGHT_HEIGHT;
+        light.z = obj.z;
+        light.radius = LAMP_LIGHT_RADIUS;
+        light.r = 1.0f;
+        light.g = 1.0f;
+        light.b = 0.8f;
+        pointLights.push_back(light);
+    }
+}
+
+void setClusterProjection(int width, int height, float fovY, float nearPlane, float farPlane) {
+    clusterLighting.viewportWidth = width;
+    clusterLighting.viewportHeight = height > 0 ? height : 1;
+    clusterLighting.tanHalfFovY = tan(fovY * 0.5f * 3.14159265359f / 180.0f);
+    clusterLighting.aspect = (float)width / clusterLighting.viewportHeight;
+    clusterLighting.nearPlane = nearPlane;
+    clusterLighting.farPlane = farPlane;
+}
+
+// Depth slice for a positive view-space depth. Must match the fragment shader.
+int getClusterSlice(float depth) {
+    if (depth < CLUSTER_NEAR) return 0;
+    float t = log(depth / CLUSTER_NEAR) / log(clusterLighting.farPlane / CLUSTER_NEAR);
+    int slice = 1 + (int)floor(t * (CLUSTER_Z - 1));
+    return slice < CLUSTER_Z - 1 ? slice : CLUSTER_Z - 1;
+}
+
+// Screen tile range covered by [lo, hi] (NDC) split into count tiles
+bool getClusterTileRange(float lo, float hi, int count, int& first, int& last) {
+    if (hi < -1.0f || lo > 1.0f) return false;
+    first = (int)floor((lo * 0.5f + 0.5f) * count);
+    last = (int)floor((hi * 0.5f + 0.5f) * count);
+    if (first < 0) first = 0;
+    if (last > count - 1) last = count - 1;
+    return true;
+}
+
+// Clusters touched by the view-space AABB of a light. Conservative: the box
+// is projected at whichever end of its depth range makes it widest.
+bool getLightClusterRange(float vx, float vy, float vz, float radius, ClusterRange& range) {
+    const ClusteredLighting& cl = clusterLighting;
+    float depthMin = -vz - radius;
+    float depthMax = -vz + radius;
+    if (depthMax <= cl.nearPlane || depthMin >= cl.farPlane) return false;
+    if (depthMin < cl.nearPlane) depthMin = cl.nearPlane;
+
+    float tanX = cl.tanHalfFovY * cl.aspect;
+    float left = vx - radius, right = vx + radius;
+    float bottom = vy - radius, top = vy + radius;
+    float minX = left / (left < 0 ? depthMin : depthMax) / tanX;
+    float maxX = right / (right > 0 ? depthMin : depthMax) / tanX;
+    float minY = bottom / (bottom < 0 ? depthMin : depthMax) / cl.tanHalfFovY;
+    float maxY = top / (top > 0 ? depthMin : depthMax) / cl.tanHalfFovY;
+
+    if (!getClusterTileRange(minX, maxX, CLUSTER_X, range.x0, range.x1)) return false;
+    if (!getClusterTileRange(minY, maxY, CLUSTER_Y, range.y0, range.y1)) return false;
+    range.z0 = getClusterSlice(depthMin);
+    range.z1 = getClusterSlice(depthMax);
+    return true;
+}
+
+// Transform the lights into view space with the current modelview matrix and
+// build the per-cluster light lists (count, prefix sum, fill)
+void binClusterLights(const std::vector<PointLight>& lights, float intensity) {
+    PROFILE_FUNCTION();
+    ClusteredLighting& cl = clusterLighting;
+    float mv[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+
+    cl.lightCount = (int)lights.size() < CLUSTER_MAX_LIGHTS ? (int)lights.size() : CLUSTER_MAX_LIGHTS;
+    cl.ranges.resize(cl.lightCount);
+    cl.clusterCounts.assign(CLUSTER_COUNT, 0);
+
+    for (int i = 0; i < cl.lightCount; i++) {
+        const PointLight& light = lights[i];
+        float vx = mv[0] * light.x + mv[4] * light.y + mv[8] * light.z + mv[12];
+        float vy = mv[1] * light.x + mv[5] * light.y + mv[9] * light.z + mv[13];
+        float vz = mv[2] * light.x + mv[6] * light.y + mv[10] * light.z + mv[14];
+
+        float* position = &cl.lightData[i * 4];
+        float* color = &cl.lightData[(CLUSTER_MAX_LIGHTS + i) * 4];
+        position[0] = vx; position[1] = vy; position[2] = vz; position[3] = light.radius;
+        color[0] = light.r * intensity; color[1] = light.g * intensity; color[2] = light.b * intensity; color[3] = 1.0f;
+
+        ClusterRange& range = cl.ranges[i];
+        if (!getLightClusterRange(vx, vy, vz, light.radius, range)) {
+            range.x0 = 1;
+            range.x1 = 0;  // Empty
+            continue;
+        }
+        for (int z = range.z0; z <= range.z1; z++)
+            for (int y = range.y0; y <= range.y1; y++)
+                for (int x = range.x0; x <= range.x1; x++)
+                    cl.clusterCounts[(z * CLUSTER_Y + y) * CLUSTER_X + x]++;
+    }
+
+    // Prefix sum into the cluster table; lists that would overflow the index
+    // texture are truncated
+    int offset = 0;
+    for (int c = 0; c < CLUSTER_COUNT; c++) {
+        int count = cl.clusterCounts[c];
+        if (offset + count > CLUSTER_MAX_INDICES) count = CLUSTER_MAX_INDICES - offset;
+        cl.clusterTable[c * 4] = (float)offset;
+        cl.clusterTable[c * 4 + 1] = (float)count;
+        cl.clusterCounts[c] = 0;  // Reused as the fill cursor
+        offset += count;
+    }
+    cl.indexCount = offset;
+
+    for (int i = 0; i < cl.lightCount; i++) {
+        const ClusterRange& range = cl.ranges[i];
+        for (int z = range.z0; z <= range.z1 && range.x0 <= range.x1; z++) {
+            for (int y = range.y0; y <= range.y1; y++) {
+                for (int x = range.x0; x <= range.x1; x++) {
+                    int c = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+                    int& cursor = cl.clusterCounts[c];
+                    if (cursor < (int)cl.clusterTable[c * 4 + 1]) {
+                        cl.lightIndices[(int)cl.clusterTable[c * 4] + cursor] = (float)i;
+                        cursor++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void uploadClusterLights() {
+    PROFILE_FUNCTION();
+    ClusteredLighting& cl = clusterLighting;
+    glBindTexture(GL_TEXTURE_2D, cl.lightTexture);
+    if (cl.lightCount > 0) {
+        size_t rowBytes = (size_t)cl.lightCount * 4 * sizeof(float);
+        streamTexSubImage2D(0, 0, cl.lightCount, 1, GL_RGBA, GL_FLOAT, &cl.lightData[0], rowBytes);
+        streamTexSubImage2D(0, 1, cl.lightCount, 1, GL_RGBA, GL_FLOAT, &cl.lightData[CLUSTER_MAX_LIGHTS * 4],
+                            rowBytes);
+    }
+    glBindTexture(GL_TEXTURE_2D, cl.clusterTexture);
+    streamTexSubImage2D(0, 0, CLUSTER_X * CLUSTER_Y, CLUSTER_Z, GL_RGBA, GL_FLOAT, &cl.clusterTable[0],
+                        cl.clusterTable.size() * sizeof(float));
+    if (cl.indexCount > 0) {
+        // Only the rows that hold indices
+        int rows = (cl.indexCount + CLUSTER_INDEX_WIDTH - 1) / CLUSTER_INDEX_WIDTH;
+        glBindTexture(GL_TEXTURE_2D, cl.indexTexture);
+        streamTexSubImage2D(0, 0, CLUSTER_INDEX_WIDTH, rows, GL_LUMINANCE, GL_FLOAT, &cl.lightIndices[0],
+                            (size_t)CLUSTER_INDEX_WIDTH * rows * sizeof(float));
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+const char* LIGHTING_VERTEX_SHADER =
+    "uniform mat4 shadowMatrix[SHADOW_CASCADES];\n"  // Eye space to cascade texture space
+    "varying vec3 viewPos;\n"
+    "varying vec3 viewNormal;\n"
+    "varying vec4 shadowCoord[SHADOW_CASCADES];\n"
+    "void main() {\n"
+    "    viewPos = (gl_ModelViewMatrix * gl_Vertex).xyz;\n"
+    "    for (int i = 0; i < SHADOW_CASCADES; i++) {\n"
+    "        shadowCoord[i] = shadowMatrix[i] * vec4(viewPos, 1.0);\n"
+    "    }\n"
+    "    viewNormal = gl_NormalMatrix * gl_Normal;\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_Position = ftransform();\n"
+    "}\n";
+
+const char* LIGHTING_FRAGMENT_SHADER =
+    "uniform sampler2D diffuseMap;\n"
+    "uniform sampler2D lightData;\n"
+    "uniform sampler2D clusterTable;\n"
+    "uniform sampler2D lightIndices;\n"
+    "uniform vec2 viewportSize;\n"
+    "uniform float sliceScale;\n"  // Depth slices per log unit past CLUSTER_NEAR
+    "uniform float lightCount;\n"
+    "uniform float prelit;\n"
+    "uniform sampler2DShadow shadowMap0;\n"
+    "uniform sampler2DShadow shadowMap1;\n"
+    "uniform sampler2DShadow shadowMap2;\n"
+    "uniform float shadowsOn;\n"
+    "varying vec3 viewPos;\n"
+    "varying vec3 viewNormal;\n"
+    "varying vec4 shadowCoord[SHADOW_CASCADES];\n"
+    "\n"
+    "// Four taps of the filtered depth comparison, a 3x3 texel footprint\n"
+    "float sampleShadowMap(sampler2DShadow map, vec3 coord) {\n"
+    "    float o = 0.5 / SHADOW_MAP_SIZE;\n"
+    "    return 0.25 * (shadow2D(map, coord + vec3(-o, -o, 0.0)).r + shadow2D(map, coord + vec3(o, -o, 0.0)).r +\n"
+    "                   shadow2D(map, coord + vec3(-o, o, 0.0)).r + shadow2D(map, coord + vec3(o, o, 0.0)).r);\n"
+    "}\n"
+    "\n"
+    "bool inShadowCascade(vec3 coord) {\n"
+    "    float edge = 2.0 / SHADOW_MAP_SIZE;\n"
+    "    return all(greaterThan(coord, vec3(edge))) && all(lessThan(coord, vec3(1.0 - edge)));\n"
+    "}\n"
+    "\n"
+    "// Sun visibility from the smallest cascade that covers the fragment\n"
+    "float sunShadow() {\n"
+    "    if (shadowsOn < 0.5) return 1.0;\n"
+    "    if (inShadowCascade(shadowCoord[0].xyz)) return sampleShadowMap(shadowMap0, shadowCoord[0].xyz);\n"
+    "    if (inShadowCascade(shadowCoord[1].xyz)) return sampleShadowMap(shadowMap1, shadowCoord[1].xyz);\n"
+    "    if (inShadowCascade(shadowCoord[2].xyz)) return sampleShadowMap(shadowMap2, shadowCoord[2].xyz);\n"
+    "    return 1.0;\n"
+    "}\n"
+    "\n"
+    "vec3 shadeLight(float index, vec3 N, vec3 P) {\n"
+    "    float u = (index + 0.5) / CLUSTER_MAX_LIGHTS;\n"
+    "    vec4 posRadius = texture2D(lightData, vec2(u, 0.25));\n"
+    "    vec3 color = texture2D(lightData, vec2(u, 0.75)).rgb;\n"
+    "    vec3 L = posRadius.xyz - P;\n"
+    "    float d = length(L);\n"
+    "    float window = clamp(1.0 - pow(d / posRadius.w, 4.0), 0.0, 1.0);\n"
+    "    float attenuation = window * window / (1.0 + 0.1 * d);\n"
+    "    return color * attenuation * max(dot(N, L / max(d, 0.0001)), 0.0);\n"
+    "}\n"
+    "\n"
+    "void main() {\n"
+    "    vec3 N = normalize(viewNormal);\n"
+    "    vec3 P = viewPos;\n"
+    "    vec3 light = vec3(0.0);\n"
+    "#ifdef SHADE_ALL_LIGHTS\n"
+    "    for (int i = 0; i < CLUSTER_MAX_LIGHTS_INT; i++) {\n"
+    "        if (float(i) >= lightCount) break;\n"
+    "        light += shadeLight(float(i), N, P);\n"
+    "    }\n"
+    "#else\n"
+    "    vec2 tile = min(floor(gl_FragCoord.xy / viewportSize * vec2(CLUSTER_X, CLUSTER_Y)),\n"
+    "                    vec2(CLUSTER_X - 1.0, CLUSTER_Y - 1.0));\n"
+    "    float depth = -P.z;\n"
+    "    float slice = depth < CLUSTER_NEAR ? 0.0 :\n"
+    "        min(1.0 + floor(log(depth / CLUSTER_NEAR) * sliceScale), CLUSTER_Z - 1.0);\n"
+    "    vec2 entry = texture2D(clusterTable, vec2((tile.y * CLUSTER_X + tile.x + 0.5) / (CLUSTER_X * CLUSTER_Y),\n"
+    "                                              (slice + 0.5) / CLUSTER_Z)).rg;\n"
+    "    for (int i = 0; i < CLUSTER_MAX_LIGHTS_PER_CLUSTER; i++) {\n"
+    "        if (float(i) >= entry.y) break;\n"
+    "        float k = entry.x + float(i);\n"
+    "        vec2 uv = vec2((mod(k, CLUSTER_INDEX_WIDTH) + 0.5) / CLUSTER_INDEX_WIDTH,\n"
+    "                       (floor(k / CLUSTER_INDEX_WIDTH) + 0.5) / CLUSTER_INDEX_ROWS);\n"
+    "        light += shadeLight(texture2D(lightIndices, uv).r, N, P);\n"
+    "    }\n"
+    "#endif\n"
+    "    vec4 base = gl_Color * texture2D(diffuseMap, gl_TexCoord[0].xy);\n"
+    "    float shadow = sunShadow();\n"
+    "    if (prelit > 0.5) {\n"
+    "        // Color already holds baked sun and sky light, alpha the baked sun term.\n"
+    "        // Remove the sun the shadow maps block (the bake lacks dynamic casters);\n"
+    "        // lamps use the material albedo.\n"
+    "        vec3 blocked = gl_FrontMaterial.diffuse.rgb * gl_LightSource[0].diffuse.rgb * base.a * (1.0 - shadow);\n"
+    "        gl_FragColor = vec4(max(base.rgb - blocked, 0.0) + gl_FrontMaterial.diffuse.rgb * light, 1.0);\n"
+    "        return;\n"
+    "    }\n"
+    "    vec3 sunDir = normalize(gl_LightSource[0].position.xyz);\n"
+    "    light += gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb +\n"
+    "             gl_LightSource[0].diffuse.rgb * max(dot(N, sunDir), 0.0) * shadow;\n"
+    "    gl_FragColor = vec4(base.rgb * light, base.a);\n"
+    "}\n";
+
+GLuint compileLightingShader(GLenum type, const char* defines, const char* body) {
+    GLuint shader = pglCreateShader(type);
+    const GLcharType* sources[2] = { defines, body };
+    pglShaderSource(shader, 2, sources, NULL);
+    pglCompileShader(shader);
+
+    GLint status = 0;
+    pglGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[1024];
+        pglGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        printf("Error: Lighting shader failed to compile:\n%s\n", log);
+        pglDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint buildLightingProgram(bool shadeAllLights) {
+    // The grid constants are shared with the CPU binning code
+    char defines[1024];
+    sprintf(defines,
+            "#version 120\n"
+            "%s"
+            "#define CLUSTER_X %d.0\n#define CLUSTER_Y %d.0\n#define CLUSTER_Z %d.0\n"
+            "#define CLUSTER_NEAR %f\n"
+            "#define CLUSTER_MAX_LIGHTS %d.0\n#define CLUSTER_MAX_LIGHTS_INT %d\n"
+            "#define CLUSTER_MAX_LIGHTS_PER_CLUSTER %d\n"
+            "#define CLUSTER_INDEX_WIDTH %d.0\n#define CLUSTER_INDEX_ROWS %d.0\n"
+            "#define SHADOW_CASCADES %d\n#define SHADOW_MAP_SIZE %d.0\n",
+            shadeAllLights ? "#define SHADE_ALL_LIGHTS\n" : "",
+            CLUSTER_X, CLUSTER_Y, CLUSTER_Z, CLUSTER_NEAR,
+            CLUSTER_MAX_LIGHTS, CLUSTER_MAX_LIGHTS, CLUSTER_MAX_LIGHTS_PER_CLUSTER,
+            CLUSTER_INDEX_WIDTH, CLUSTER_INDEX_ROWS, SHADOW_CASCADES, SHADOW_MAP_SIZE);
+
+    GLuint vertexShader = compileLightingShader(GL_VERTEX_SHADER, defines, LIGHTING_VERTEX_SHADER);
+    GLuint fragmentShader = compileLightingShader(GL_FRAGMENT_SHADER, defines, LIGHTING_FRAGMENT_SHADER);
+    if (!vertexShader || !fragmentShader) return 0;
+
+    GLuint program = pglCreateProgram();
+    pglAttachShader(program, vertexShader);
+    pglAttachShader(program, fragmentShader);
+    pglLinkProgram(program);
+    pglDeleteShader(vertexShader);
+    pglDeleteShader(fragmentShader);
+
+    GLint status = 0;
+    pglGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[1024];
+        pglGetProgramInfoLog(program, sizeof(log), NULL, log);
+        printf("Error: Lighting shader failed to link:\n%s\n", log);
+        return 0;
+    }
+
+    // Texture units never change
+    pglUseProgram(program);
+    pglUniform1i(pglGetUniformLocation(program, "diffuseMap"), 0);
+    pglUniform1i(pglGetUniformLocation(program, "lightData"), 1);
+    pglUniform1i(pglGetUniformLocation(program, "clusterTable"), 2);
+    pglUniform1i(pglGetUniformLocation(program, "lightIndices"), 3);
+    pglUniform1i(pglGetUniformLocation(program, "shadowMap0"), SHADOW_FIRST_UNIT);
+    pglUniform1i(pglGetUniformLocation(program, "shadowMap1"), SHADOW_FIRST_UNIT + 1);
+    pglUniform1i(pglGetUniformLocation(program, "shadowMap2"), SHADOW_FIRST_UNIT + 2);
+    pglUseProgram(0);
+    return program;
+}
+
+GLuint createLightingTexture(int width, int height, GLenum internalFormat, GLenum format, const void* data) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format,
+                 internalFormat == GL_RGBA ? GL_UNSIGNED_BYTE : GL_FLOAT, data);
+    return texture;
+}
+
+// Create the shader programs and light textures. Without GLSL or float
+// textures the fixed-function path stays the only mode.
+bool initClusteredLighting() {
+    ClusteredLighting& cl = clusterLighting;
+    cl.ready = false;
+    cl.lightCount = 0;
+    cl.indexCount = 0;
+    if (!glShadersSupported || !glFloatTexturesSupported) {
+        printf("Clustered lighting not available, using fixed-function lamps\n");
+        return false;
+    }
+
+    cl.programs[LIGHTING_FIXED] = 0;
+    cl.programs[LIGHTING_FORWARD] = buildLightingProgram(true);
+    cl.programs[LIGHTING_CLUSTERED] = buildLightingProgram(false);
+    if (!cl.programs[LIGHTING_FORWARD] || !cl.programs[LIGHTING_CLUSTERED]) {
+        return false;
+    }
+
+    cl.lightData.assign(CLUSTER_MAX_LIGHTS * 2 * 4, 0.0f);
+    cl.clusterTable.assign(CLUSTER_COUNT * 4, 0.0f);
+    cl.lightIndices.assign(CLUSTER_MAX_INDICES, 0.0f);
+
+    unsigned char white[4] = { 255, 255, 255, 255 };
+    cl.whiteTexture = createLightingTexture(1, 1, GL_RGBA, GL_RGBA, white);
+    cl.lightTexture = createLightingTexture(CLUSTER_MAX_LIGHTS, 2, GL_RGBA32F_ARB, GL_RGBA, &cl.lightData[0]);
+    cl.clusterTexture = createLightingTexture(CLUSTER_X * CLUSTER_Y, CLUSTER_Z, GL_RGBA32F_ARB, GL_RGBA, &cl.clusterTable[0]);
+    cl.indexTexture = createLightingTexture(CLUSTER_INDEX_WIDTH, CLUSTER_INDEX_ROWS, GL_LUMINANCE32F_ARB,
+                                            GL_LUMINANCE, &cl.lightIndices[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    cl.ready = true;
+    lightingMode = LIGHTING_CLUSTERED;
+    printf("Clustered lighting ready: %dx%dx%d clusters, up to %d lights\n",
+           CLUSTER_X, CLUSTER_Y, CLUSTER_Z, CLUSTER_MAX_LIGHTS);
+    return true;
+}
+
+void cycleLightingMode() {
+    if (!clusterLighting.ready) {
+        printf("Lighting: only %s is available\n", getLightingModeName(LIGHTING_FIXED));
+        return;
+    }
+    lightingMode = (lightingMode + 1) % LIGHTING_MODE_COUNT;
+    printf("Lighting: %s\n", getLightingModeName(lightingMode));
+}
+
+// Constant lamp parameters for the fixed-function path, set once. Lamps have
+// no ambient term, which would otherwise brighten the whole scene by day.
+void setupFixedLampLights() {
+    for (int i = 0; i < FIXED_LAMP_LIGHTS; i++) {
+        GLenum light = GL_LIGHT1 + i;
+        glEnable(light);
+        glLightf(light, GL_CONSTANT_ATTENUATION, 1.0f);
+        glLightf(light, GL_LINEAR_ATTENUATION, 0.1f);
+    }
+}
+
+// Fixed-function path: the nearest lamps get GL_LIGHT1..4. Positions go
+// through the current modelview matrix, so they are re-sent every frame.
+void updateFixedLampLights(float camX, float camZ, bool lampsOn, float intensity) {
+    int nearest[FIXED_LAMP_LIGHTS];
+    float nearestDist[FIXED_LAMP_LIGHTS];
+    int found = 0;
+    if (lampsOn) {
+        for (size_t i = 0; i < pointLights.size(); i++) {
+            float dx = pointLights[i].x - camX, dz = pointLights[i].z - camZ;
+            float dist = dx * dx + dz * dz;
+            // Insertion into the short sorted list
+            int slot;
+            if (found < FIXED_LAMP_LIGHTS) slot = found++;
+            else if (dist < nearestDist[FIXED_LAMP_LIGHTS - 1]) slot = FIXED_LAMP_LIGHTS - 1;
+            else continue;
+            while (slot > 0 && nearestDist[slot - 1] > dist) {
+                nearest[slot] = nearest[slot - 1];
+                nearestDist[slot] = nearestDist[slot - 1];
+                slot--;
+            }
+            nearest[slot] = (int)i;
+            nearestDist[slot] = dist;
+        }
+    }
+
+    GLfloat off[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    for (int i = 0; i < FIXED_LAMP_LIGHTS; i++) {
+        GLenum light = GL_LIGHT1 + i;
+        if (i >= found) {
+            glLightfv(light, GL_DIFFUSE, off);
+            continue;
+        }
+        const PointLight& lamp = pointLights[nearest[i]];
+        GLfloat position[] = { lamp.x, lamp.y, lamp.z, 1.0f };
+        GLfloat diffuse[] = { lamp.r * intensity, lamp.g * intensity, lamp.b * intensity, 1.0f };
+        glLightfv(light, GL_POSITION, position);
+        glLightfv(light, GL_DIFFUSE, diffuse);
+    }
+}
+
+// Shader paths: bin and upload this frame's lights (modelview must hold the
+// camera), then bind the program and light textures for the render queue
+void beginShadedLighting(bool lampsOn, float intensity) {
+    ClusteredLighting& cl = clusterLighting;
+    static const std::vector<PointLight> noLights;
+    binClusterLights(lampsOn ? pointLights : noLights, intensity);
+    uploadClusterLights();
+
+    GLuint program = cl.programs[lightingMode];
+    pglUseProgram(program);
+    pglUniform2f(pglGetUniformLocation(program, "viewportSize"),
+                 (float)cl.viewportWidth, (float)cl.viewportHeight);
+    pglUniform1f(pglGetUniformLocation(program, "sliceScale"),
+                 (CLUSTER_Z - 1) / log(cl.farPlane / CLUSTER_NEAR));
+    pglUniform1f(pglGetUniformLocation(program, "lightCount"), (float)cl.lightCount);
+    pglUniform1f(pglGetUniformLocation(program, "prelit"), 0.0f);
+
+    pglActiveTexture(GL_TEXTURE0 + 1);
+    glBindTexture(GL_TEXTURE_2D, cl.lightTexture);
+    pglActiveTexture(GL_TEXTURE0 + 2);
+    glBindTexture(GL_TEXTURE_2D, cl.clusterTexture);
+    pglActiveTexture(GL_TEXTURE0 + 3);
+    glBindTexture(GL_TEXTURE_2D, cl.indexTexture);
+    pglActiveTexture(GL_TEXTURE0);
+    bindShadowMaps(program);
+
+    // The shader always samples unit 0
+    glState.untexturedTexture = cl.whiteTexture;
+    glState.boundTexture = 0;
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Switch between normal and prelit shading. Prelit vertex colors already
+// contain the sun and sky, so GL_LIGHT0 is turned off and the color array
+// drives the emission; lamps still light the constant material albedo.
+void setPrelitLighting(bool prelit, const float albedo[3]) {
+    GLfloat black[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    if (prelit) {
+        GLfloat diffuse[] = { albedo[0], albedo[1], albedo[2], 1.0f };
+        glDisable(GL_LIGHT0);
+        glColorMaterial(GL_FRONT_AND_BACK, GL_EMISSION);
+        glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, black);
+        glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, diffuse);
+    } else {
+        glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+        glMaterialfv(GL_FRONT_AND_BACK, GL_EMISSION, black);
+        glEnable(GL_LIGHT0);
+    }
+    if (lightingMode != LIGHTING_FIXED && clusterLighting.ready) {
+        GLuint program = clusterLighting.programs[lightingMode];
+        pglUniform1f(pglGetUniformLocation(program, "prelit"), prelit ? 1.0f : 0.0f);
+    }
+    glState.colorValid = false;
+    renderStats.stateChanges++;
+}
+
+void endShadedLighting() {
+    pglUseProgram(0);
+    glState.untexturedTexture = 0;
+}
+
+#endif // LIGHTING_H
@@ -0,0 +1,100 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Read-only memory mapping of a whole file. Loaders read straight out of the
+// page cache this way, with no intermediate buffer; pages are only read from
+// disk when they are first touched.
+
+struct MappedFile {
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+void unmapFile(MappedFile& mapped);
+
+bool mapFile(const char* filename, MappedFile& mapped) {
+    mapped.data = NULL;
+    mapped.size = 0;
+#ifdef _WIN32
+    mapped.mapping = NULL;
+    mapped.file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mapped.file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(mapped.file, &size) && size.QuadPart > 0) {
+        mapped.size = (size_t)size.QuadPart;
+        mapped.mapping = CreateFileMappingA(mapped.file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapped.mapping) {
+            mapped.data = (const unsigned char*)MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+    }
+#else
+    mapped.fd = open(filename, O_RDONLY);
+    if (mapped.fd < 0) return false;
+    struct stat st;
+    if (fstat(mapped.fd, &st) == 0 && st.st_size > 0) {
+        mapped.size = (size_t)st.st_size;
+        void* data = mmap(NULL, mapped.size, PROT_READ, MAP_PRIVATE, mapped.fd, 0);
+        if (data != MAP_FAILED) {
+            mapped.data = (const unsigned char*)data;
+        }
+    }
+#endif
+    if (!mapped.data) {
+        unmapFile(mapped);
+        return false;
+    }
+    return true;
+}
+
+void unmapFile(MappedFile& mapped) {
+#ifdef _WIN32
+    if (mapped.data) UnmapViewOfFile(mapped.data);
+    if (mapped.mapping) CloseHandle(mapped.mapping);
+    if (mapped.file != INVALID_HANDLE_VALUE) CloseHandle(mapped.file);
+    mapped.mapping = NULL;
+    mapped.file = INVALID_HANDLE_VALUE;
+#else
+    if (mapped.data) munmap((void*)mapped.data, mapped.size);
+    if (mapped.fd >= 0) close(mapped.fd);
+    mapped.fd = -1;
+#endif
+    mapped.data = NULL;
+    mapped.size = 0;
+}
+
+// Tell the OS the mapping will be read front to back soon, so it starts large
+// sequential read-ahead instead of faulting pages in one at a time. Windows
+// has no equivalent that predates Windows 8, so there it is a no-op.
+void prefetchMappedFile(const MappedFile& mapped) {
+#ifndef _WIN32
+    if (!mapped.data) return;
+    madvise((void*)mapped.data, mapped.size, MADV_SEQUENTIAL);
+    madvise((void*)mapped.data, mapped.size, MADV_WILLNEED);
+#else
+    (void)mapped;
+#endif
+}
+
+#endif // MAPPED_FILE_H
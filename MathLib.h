@@ -0,0 +1,343 @@
+#ifndef MATH_LIB_H
+#define MATH_LIB_H
+
+#include <math.h>
+
+// Small vector math library: vec3/vec4/quat/mat4 value types and batch
+// routines over arrays of points, spheres and boxes. The batch code is written
+// once against a 4-wide float type that maps to SSE or NEON when the compiler
+// targets them, and to plain floats otherwise (or when MATH_NO_SIMD is defined,
+// which test_math uses to check that path too). Matrices are column-major
+// float[16], the layout GL uses, so they can be passed to glMultMatrixf.
+
+#if defined(MATH_NO_SIMD)
+// Plain floats
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MATH_SIMD_SSE 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MATH_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define MATH_PI 3.14159265359f
+
+constexpr float degToRad(float degrees) { return degrees * (MATH_PI / 180.0f); }
+constexpr float radToDeg(float radians) { return radians * (180.0f / MATH_PI); }
+constexpr float minf(float a, float b) { return a < b ? a : b; }
+constexpr float maxf(float a, float b) { return a > b ? a : b; }
+constexpr float clampf(float v, float lo, float hi) { return v < lo ? lo : (v > hi ? hi : v); }
+constexpr float lerpf(float a, float b, float t) { return a + (b - a) * t; }
+
+struct vec3 {
+    float x, y, z;
+    constexpr vec3() : x(0), y(0), z(0) {}
+    constexpr vec3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+    vec3& operator+=(const vec3& b) { x += b.x; y += b.y; z += b.z; return *this; }
+    vec3& operator-=(const vec3& b) { x -= b.x; y -= b.y; z -= b.z; return *this; }
+    vec3& operator*=(float s) { x *= s; y *= s; z *= s; return *this; }
+};
+
+constexpr vec3 operator+(const vec3& a, const vec3& b) { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+constexpr vec3 operator-(const vec3& a, const vec3& b) { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+constexpr vec3 operator-(const vec3& a) { return vec3(-a.x, -a.y, -a.z); }
+constexpr vec3 operator*(const vec3& a, float s) { return vec3(a.x * s, a.y * s, a.z * s); }
+constexpr vec3 operator*(float s, const vec3& a) { return vec3(a.x * s, a.y * s, a.z * s); }
+constexpr float dot(const vec3& a, const vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+constexpr vec3 cross(const vec3& a, const vec3& b) {
+    return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+constexpr vec3 componentMin(const vec3& a, const vec3& b) { return vec3(minf(a.x, b.x), minf(a.y, b.y), minf(a.z, b.z)); }
+constexpr vec3 componentMax(const vec3& a, const vec3& b) { return vec3(maxf(a.x, b.x), maxf(a.y, b.y), maxf(a.z, b.z)); }
+
+float length(const vec3& v) {
+    return sqrtf(dot(v, v));
+}
+
+vec3 normalize(const vec3& v) {
+    float len = length(v);
+    return len > 0 ? v * (1.0f / len) : v;
+}
+
+// Horizontal direction for a yaw in degrees (0 looks down +Z, 90 down +X)
+vec3 yawForward(float yawDegrees) {
+    float rad = degToRad(yawDegrees);
+    return vec3(sinf(rad), 0, cosf(rad));
+}
+
+struct vec4 {
+    float x, y, z, w;
+    constexpr vec4() : x(0), y(0), z(0), w(0) {}
+    constexpr vec4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+    constexpr vec4(const vec3& v, float _w) : x(v.x), y(v.y), z(v.z), w(_w) {}
+};
+
+constexpr float dot(const vec4& a, const vec4& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+struct quat {
+    float x, y, z, w;
+    constexpr quat() : x(0), y(0), z(0), w(1) {}
+    constexpr quat(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+};
+
+quat quatFromAxisAngle(const vec3& axis, float degrees) {
+    float half = degToRad(degrees) * 0.5f;
+    vec3 a = normalize(axis) * sinf(half);
+    return quat(a.x, a.y, a.z, cosf(half));
+}
+
+constexpr quat operator*(const quat& a, const quat& b) {
+    return quat(a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+                a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+                a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+}
+
+quat normalize(const quat& q) {
+    float len = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+    return len > 0 ? quat(q.x / len, q.y / len, q.z / len, q.w / len) : quat();
+}
+
+// v' = v + 2w(u x v) + 2u x (u x v), for a unit quaternion
+vec3 rotate(const quat& q, const vec3& v) {
+    vec3 u(q.x, q.y, q.z);
+    vec3 t = cross(u, v) * 2.0f;
+    return v + t * q.w + cross(u, t);
+}
+
+struct mat4 {
+    float m[16];  // Column-major
+};
+
+// ---------------------------------------------------------------------------
+// 4-wide floats for the batch routines
+
+#if MATH_SIMD_SSE
+typedef __m128 float4;
+inline float4 f4Load(const float* p) { return _mm_loadu_ps(p); }
+inline void f4Store(float* p, float4 v) { _mm_storeu_ps(p, v); }
+inline float4 f4Set(float x, float y, float z, float w) { return _mm_set_ps(w, z, y, x); }
+inline float4 f4Splat(float s) { return _mm_set1_ps(s); }
+inline float4 f4Add(float4 a, float4 b) { return _mm_add_ps(a, b); }
+inline float4 f4Sub(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+inline float4 f4Mul(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+inline float4 f4Madd(float4 a, float4 b, float4 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline float4 f4Abs(float4 v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+inline bool f4AnyNegative(float4 v) { return _mm_movemask_ps(_mm_cmplt_ps(v, _mm_setzero_ps())) != 0; }
+#elif MATH_SIMD_NEON
+typedef float32x4_t float4;
+inline float4 f4Load(const float* p) { return vld1q_f32(p); }
+inline void f4Store(float* p, float4 v) { vst1q_f32(p, v); }
+inline float4 f4Set(float x, float y, float z, float w) { float v[4] = { x, y, z, w }; return vld1q_f32(v); }
+inline float4 f4Splat(float s) { return vdupq_n_f32(s); }
+inline float4 f4Add(float4 a, float4 b) { return vaddq_f32(a, b); }
+inline float4 f4Sub(float4 a, float4 b) { return vsubq_f32(a, b); }
+inline float4 f4Mul(float4 a, float4 b) { return vmulq_f32(a, b); }
+inline float4 f4Madd(float4 a, float4 b, float4 c) { return vmlaq_f32(c, a, b); }
+inline float4 f4Abs(float4 v) { return vabsq_f32(v); }
+inline bool f4AnyNegative(float4 v) {
+    uint32x4_t neg = vcltq_f32(v, vdupq_n_f32(0));
+    uint32x2_t half = vorr_u32(vget_low_u32(neg), vget_high_u32(neg));
+    return vget_lane_u32(vpmax_u32(half, half), 0) != 0;
+}
+#else
+struct float4 { float v[4]; };
+inline float4 f4Load(const float* p) { float4 r = { { p[0], p[1], p[2], p[3] } }; return r; }
+inline void f4Store(float* p, float4 v) { for (int i = 0; i < 4; i++) p[i] = v.v[i]; }
+inline float4 f4Set(float x, float y, float z, float w) { float4 r = { { x, y, z, w } }; return r; }
+inline float4 f4Splat(float s) { return f4Set(s, s, s, s); }
+inline float4 f4Add(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+inline float4 f4Sub(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+inline float4 f4Mul(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+inline float4 f4Madd(float4 a, float4 b, float4 c) { return f4Add(f4Mul(a, b), c); }
+inline float4 f4Abs(float4 v) { for (int i = 0; i < 4; i++) v.v[i] = fabsf(v.v[i]); return v; }
+inline bool f4AnyNegative(float4 v) { return v.v[0] < 0 || v.v[1] < 0 || v.v[2] < 0 || v.v[3] < 0; }
+#endif
+
+// Columns of m times (x, y, z, w)
+inline float4 f4Transform(const float4 cols[4], float x, float y, float z, float w) {
+    float4 r = f4Mul(cols[0], f4Splat(x));
+    r = f4Madd(cols[1], f4Splat(y), r);
+    r = f4Madd(cols[2], f4Splat(z), r);
+    return f4Madd(cols[3], f4Splat(w), r);
+}
+
+inline void f4LoadColumns(const float m[16], float4 cols[4]) {
+    for (int c = 0; c < 4; c++) cols[c] = f4Load(&m[c * 4]);
+}
+
+// ---------------------------------------------------------------------------
+// Matrices
+
+// out = a * b (out may alias a or b)
+void multiplyMatrices(const float a[16], const float b[16], float out[16]) {
+    float4 cols[4], result[4];
+    f4LoadColumns(a, cols);
+    for (int c = 0; c < 4; c++) {
+        result[c] = f4Transform(cols, b[c * 4 + 0], b[c * 4 + 1], b[c * 4 + 2], b[c * 4 + 3]);
+    }
+    for (int c = 0; c < 4; c++) f4Store(&out[c * 4], result[c]);
+}
+
+mat4 operator*(const mat4& a, const mat4& b) {
+    mat4 r;
+    multiplyMatrices(a.m, b.m, r.m);
+    return r;
+}
+
+mat4 mat4Identity() {
+    mat4 r = { { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 } };
+    return r;
+}
+
+mat4 mat4Translation(const vec3& t) {
+    mat4 r = mat4Identity();
+    r.m[12] = t.x; r.m[13] = t.y; r.m[14] = t.z;
+    return r;
+}
+
+mat4 mat4Scale(const vec3& s) {
+    mat4 r = mat4Identity();
+    r.m[0] = s.x; r.m[5] = s.y; r.m[10] = s.z;
+    return r;
+}
+
+mat4 mat4FromQuat(const quat& q) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    mat4 r = mat4Identity();
+    r.m[0] = 1 - 2 * (yy + zz); r.m[1] = 2 * (xy + wz);     r.m[2] = 2 * (xz - wy);
+    r.m[4] = 2 * (xy - wz);     r.m[5] = 1 - 2 * (xx + zz); r.m[6] = 2 * (yz + wx);
+    r.m[8] = 2 * (xz + wy);     r.m[9] = 2 * (yz - wx);     r.m[10] = 1 - 2 * (xx + yy);
+    return r;
+}
+
+// Translate * rotate * scale, the order glTranslatef/glRotatef/glScalef apply
+mat4 mat4TRS(const vec3& t, const quat& r, const vec3& s) {
+    mat4 m = mat4FromQuat(r);
+    for (int i = 0; i < 3; i++) {
+        m.m[0 + i] *= s.x;
+        m.m[4 + i] *= s.y;
+        m.m[8 + i] *= s.z;
+    }
+    m.m[12] = t.x; m.m[13] = t.y; m.m[14] = t.z;
+    return m;
+}
+
+// Same as mat4TRS with a rotation of yawDegrees around +Y
+mat4 mat4TRSY(const vec3& t, float yawDegrees, const vec3& s) {
+    float rad = degToRad(yawDegrees);
+    float c = cosf(rad), sn = sinf(rad);
+    mat4 m = { { c * s.x, 0, -sn * s.x, 0,  0, s.y, 0, 0,  sn * s.z, 0, c * s.z, 0,  t.x, t.y, t.z, 1 } };
+    return m;
+}
+
+vec3 transformPoint(const mat4& m, const vec3& p) {
+    return vec3(m.m[0] * p.x + m.m[4] * p.y + m.m[8] * p.z + m.m[12],
+                m.m[1] * p.x + m.m[5] * p.y + m.m[9] * p.z + m.m[13],
+                m.m[2] * p.x + m.m[6] * p.y + m.m[10] * p.z + m.m[14]);
+}
+
+vec3 transformDirection(const mat4& m, const vec3& d) {
+    return vec3(m.m[0] * d.x + m.m[4] * d.y + m.m[8] * d.z,
+                m.m[1] * d.x + m.m[5] * d.y + m.m[9] * d.z,
+                m.m[2] * d.x + m.m[6] * d.y + m.m[10] * d.z);
+}
+
+// ---------------------------------------------------------------------------
+// Batch routines
+
+void transformPoints(const float m[16], const vec3* in, vec3* out, int count) {
+    float4 cols[4];
+    f4LoadColumns(m, cols);
+    float r[4];
+    for (int i = 0; i < count; i++) {
+        f4Store(r, f4Transform(cols, in[i].x, in[i].y, in[i].z, 1.0f));
+        out[i] = vec3(r[0], r[1], r[2]);
+    }
+}
+
+// Spheres as (center, radius); radii grow by the matrix's largest axis scale
+void transformSpheres(const float m[16], const vec4* in, vec4* out, int count) {
+    float sx = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+    float sy = m[4] * m[4] + m[5] * m[5] + m[6] * m[6];
+    float sz = m[8] * m[8] + m[9] * m[9] + m[10] * m[10];
+    float scale = sqrtf(maxf(sx, maxf(sy, sz)));
+
+    float4 cols[4];
+    f4LoadColumns(m, cols);
+    float r[4];
+    for (int i = 0; i < count; i++) {
+        f4Store(r, f4Transform(cols, in[i].x, in[i].y, in[i].z, 1.0f));
+        out[i] = vec4(r[0], r[1], r[2], in[i].w * scale);
+    }
+}
+
+// Conservative AABB of a transformed box: the center moves with the matrix and
+// the half-extent grows by |upper 3x3| (equivalent to Arvo's method)
+void transformAABBs(const float m[16], const vec3* mins, const vec3* maxs, vec3* outMins, vec3* outMaxs,
+                    int count) {
+    float4 cols[4], absCols[3];
+    f4LoadColumns(m, cols);
+    for (int c = 0; c < 3; c++) absCols[c] = f4Abs(cols[c]);
+    float lo[4], hi[4];
+    for (int i = 0; i < count; i++) {
+        float cx = (mins[i].x + maxs[i].x) * 0.5f, ex = (maxs[i].x - mins[i].x) * 0.5f;
+        float cy = (mins[i].y + maxs[i].y) * 0.5f, ey = (maxs[i].y - mins[i].y) * 0.5f;
+        float cz = (mins[i].z + maxs[i].z) * 0.5f, ez = (maxs[i].z - mins[i].z) * 0.5f;
+        float4 center = f4Transform(cols, cx, cy, cz, 1.0f);
+        float4 extent = f4Mul(absCols[0], f4Splat(ex));
+        extent = f4Madd(absCols[1], f4Splat(ey), extent);
+        extent = f4Madd(absCols[2], f4Splat(ez), extent);
+        f4Store(lo, f4Sub(center, extent));
+        f4Store(hi, f4Add(center, extent));
+        outMins[i] = vec3(lo[0], lo[1], lo[2]);
+        outMaxs[i] = vec3(hi[0], hi[1], hi[2]);
+    }
+}
+
+void transformAABB(const float m[16], const vec3& bmin, const vec3& bmax, vec3& outMin, vec3& outMax) {
+    transformAABBs(m, &bmin, &bmax, &outMin, &outMax, 1);
+}
+
+// Frustum test for many boxes against planes ax + by + cz + d >= 0. Each box is
+// visible unless it lies entirely behind one plane; four planes are tested at
+// once with the planes stored by component.
+void cullAABBs(const float planes[6][4], const vec3* mins, const vec3* maxs, int count, unsigned char* visible) {
+    // Planes 6 and 7 pad the second group and always pass
+    float px[8], py[8], pz[8], pd[8];
+    for (int p = 0; p < 8; p++) {
+        px[p] = p < 6 ? planes[p][0] : 0.0f;
+        py[p] = p < 6 ? planes[p][1] : 0.0f;
+        pz[p] = p < 6 ? planes[p][2] : 0.0f;
+        pd[p] = p < 6 ? planes[p][3] : 1.0f;
+    }
+    float4 nx[2], ny[2], nz[2], nd[2], ax[2], ay[2], az[2];
+    for (int g = 0; g < 2; g++) {
+        nx[g] = f4Load(&px[g * 4]); ax[g] = f4Abs(nx[g]);
+        ny[g] = f4Load(&py[g * 4]); ay[g] = f4Abs(ny[g]);
+        nz[g] = f4Load(&pz[g * 4]); az[g] = f4Abs(nz[g]);
+        nd[g] = f4Load(&pd[g * 4]);
+    }
+
+    for (int i = 0; i < count; i++) {
+        float4 cx = f4Splat((mins[i].x + maxs[i].x) * 0.5f), ex = f4Splat((maxs[i].x - mins[i].x) * 0.5f);
+        float4 cy = f4Splat((mins[i].y + maxs[i].y) * 0.5f), ey = f4Splat((maxs[i].y - mins[i].y) * 0.5f);
+        float4 cz = f4Splat((mins[i].z + maxs[i].z) * 0.5f), ez = f4Splat((maxs[i].z - mins[i].z) * 0.5f);
+        bool inside = true;
+        for (int g = 0; g < 2 && inside; g++) {
+            // Signed distance of the box corner furthest along each normal
+            float4 d = f4Madd(nx[g], cx, nd[g]);
+            d = f4Madd(ny[g], cy, d);
+            d = f4Madd(nz[g], cz, d);
+            d = f4Madd(ax[g], ex, d);
+            d = f4Madd(ay[g], ey, d);
+            d = f4Madd(az[g], ez, d);
+            inside = !f4AnyNegative(d);
+        }
+        visible[i] = inside ? 1 : 0;
+    }
+}
+
+#endif // MATH_LIB_H
@@ -9,10 +9,23 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <sys/stat.h>
+
+#include "RenderQueue.h"
+#include "MathLib.h"
+#include "VertexFormat.h"
+#include "MappedFile.h"
+#include "AssetPak.h"
+#include "AssetManifest.h"
+#include "Profiler.h"
 
 #ifdef _WIN32
 // Windows doesn't have strcasecmp
@@ -23,13 +36,12 @@
 #ifndef GL_BGR
 #define GL_BGR 0x80E0
 #endif
+#ifndef GL_BGRA
+#define GL_BGRA 0x80E1
+#endif
 
 // Simple 3D model structures
-struct Vector3 {
-    float x, y, z;
-    Vector3() : x(0), y(0), z(0) {}
-    Vector3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
-};
+typedef vec3 Vector3;
 
 struct Vector2 {
     float u, v;
@@ -37,93 +49,416 @@ struct Vector2 {
     Vector2(float _u, float _v) : u(_u), v(_v) {}
 };
 
-struct Face {
-    int vertexIndices[3];
-    int normalIndices[3];
-    int texCoordIndices[3];
+// Layout models are drawn with. Swapping an attribute (e.g. Norm3f for
+// Norm8x4) is all it takes to change the packed format.
+typedef Vertex<Pos3f, Norm8x4, UV2f> ModelVertex;
+
+// Allocation totals for model data and loader scratch space. loadModel resets
+// the peak and reports the difference for each file it loads. The totals are
+// per thread, so tools can run loaders on several threads at once.
+struct ModelLoadStats {
+    int allocations;
+    size_t liveBytes;
+    size_t peakBytes;
 };
 
-// Mesh stores expanded vertex/normal/texcoord data for rendering
+thread_local ModelLoadStats modelLoadStats = { 0, 0, 0 };
+
+// Allocator for everything the loaders allocate, so the totals above cover it
+template <typename T>
+struct ModelAllocator {
+    typedef T value_type;
+
+    ModelAllocator() {}
+    template <typename U> ModelAllocator(const ModelAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        modelLoadStats.allocations++;
+        modelLoadStats.liveBytes += n * sizeof(T);
+        if (modelLoadStats.liveBytes > modelLoadStats.peakBytes) {
+            modelLoadStats.peakBytes = modelLoadStats.liveBytes;
+        }
+        return (T*)::operator new(n * sizeof(T));
+    }
+    void deallocate(T* p, size_t n) {
+        modelLoadStats.liveBytes -= n * sizeof(T);
+        ::operator delete(p);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const ModelAllocator<T>&, const ModelAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const ModelAllocator<T>&, const ModelAllocator<U>&) { return false; }
+
+template <typename T> using ModelArray = std::vector<T, ModelAllocator<T> >;
+
+// A mesh is a range of its model's arena: vertexCount vertices starting at
+// firstVertex and indexCount indices starting at firstIndex. Indices are
+// relative to the mesh's first vertex.
 struct Mesh {
-    std::vector<Vector3> vertices;
-    std::vector<Vector3> normals;
-    std::vector<Vector2> texCoords;
-    std::vector<Face> faces;  // Available for future indexed rendering
+    int firstVertex;
+    int vertexCount;
+    int firstIndex;
+    int indexCount;
     GLuint textureID;
     std::string materialName;
+    
+    Mesh() : firstVertex(0), vertexCount(0), firstIndex(0), indexCount(0), textureID(0) {}
 };
 
+// What a model keeps in RAM once its GPU buffers exist (see applyModelResidency)
+enum ModelResidency {
+    MODEL_RESIDENCY_FULL,       // The whole arena
+    MODEL_RESIDENCY_COLLISION,  // Welded positions and indices only
+    MODEL_RESIDENCY_NONE        // Nothing; buffers are rebuilt from the cache file
+};
+
+// A mapping of a model's cache file, unmapped when the model lets go of it
+struct ModelCacheMapping {
+    MappedFile file;   // data is NULL when nothing is mapped
+    
+    ModelCacheMapping() { file.data = NULL; file.size = 0; }
+    ModelCacheMapping(ModelCacheMapping&& other) : file(other.file) { other.file.data = NULL; }
+    ModelCacheMapping& operator=(ModelCacheMapping&& other) {
+        if (this != &other) {
+            release();
+            file = other.file;
+            other.file.data = NULL;
+        }
+        return *this;
+    }
+    ~ModelCacheMapping() { release(); }
+    void release() {
+        if (file.data) unmapFile(file);
+    }
+};
+
+// A model owns one contiguous arena holding every mesh's packed ModelVertex
+// data followed by every mesh's 32-bit indices. Models are move-only, so the
+// arena is never copied once loaded. A model loaded from the asset pak or its
+// cache file has no arena of its own; mappedArena points at the same layout
+// inside the pak, or inside cacheMapping.
 struct Model {
-    std::vector<Mesh> meshes;
+    ModelArray<Mesh> meshes;
+    ModelArray<unsigned char> arena;
+    const unsigned char* mappedArena;
+    ModelCacheMapping cacheMapping;
+    int vertexCount;      // Totals across meshes (sizes of the two arena blocks)
+    int indexCount;
+    GLuint vertexBuffer;  // GPU copies of the arena blocks, 0 if not uploaded
+    GLuint indexBuffer;
+    ModelResidency residency;
+    ModelArray<Vector3> collisionPositions;  // MODEL_RESIDENCY_COLLISION only; the
+    ModelArray<GLuint> collisionIndices;     // indices span all meshes
+    std::string sourcePath;
     float scale;
     Vector3 offset;
     
-    Model() : scale(1.0f), offset(0, 0, 0) {}
+    Model() : mappedArena(NULL), vertexCount(0), indexCount(0), vertexBuffer(0), indexBuffer(0),
+              residency(MODEL_RESIDENCY_FULL), scale(1.0f), offset(0, 0, 0) {}
+    Model(Model&&) = default;
+    Model& operator=(Model&&) = default;
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
 };
 
+// Size the arena for vertexCount vertices and indexCount indices in one allocation
+void allocateModelArena(Model& model, int vertexCount, int indexCount) {
+    model.vertexCount = vertexCount;
+    model.indexCount = indexCount;
+    model.arena.resize((size_t)vertexCount * ModelVertex::STRIDE + (size_t)indexCount * sizeof(GLuint));
+}
+
+unsigned char* getModelVertices(Model& model) {
+    return model.arena.empty() ? NULL : &model.arena[0];
+}
+
+// Read-only access also sees a model's data in the asset pak
+const unsigned char* getModelVertices(const Model& model) {
+    return model.arena.empty() ? model.mappedArena : &model.arena[0];
+}
+
+GLuint* getModelIndices(Model& model) {
+    return (GLuint*)(getModelVertices(model) + (size_t)model.vertexCount * ModelVertex::STRIDE);
+}
+
+const GLuint* getModelIndices(const Model& model) {
+    return (const GLuint*)(getModelVertices(model) + (size_t)model.vertexCount * ModelVertex::STRIDE);
+}
+
+// Shrink the arena to the counts a loader actually filled, moving the index
+// block down if fewer vertices were read than allocated. Never reallocates.
+void trimModelArena(Model& model, int vertexCount, int indexCount) {
+    if (vertexCount < model.vertexCount) {
+        GLuint* indices = getModelIndices(model);
+        model.vertexCount = vertexCount;
+        memmove(getModelIndices(model), indices, (size_t)indexCount * sizeof(GLuint));
+    }
+    model.indexCount = indexCount;
+    model.arena.resize((size_t)vertexCount * ModelVertex::STRIDE + (size_t)indexCount * sizeof(GLuint));
+}
+
 // Texture cache to avoid loading the same texture multiple times
 std::map<std::string, GLuint> textureCache;
 
-// Texture loading functions
-GLuint loadBMPTexture(const char* filename) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
-        printf("Warning: Could not open BMP file: %s\n", filename);
-        return 0;
-    }
+// GPU resources are also shared by content: textures and model buffers are
+// keyed by a 64-bit hash of the decoded data they were created from (plus
+// its dimensions), so the same image or mesh found under several paths is
+// uploaded once. Collisions are not checked; at 64 bits they are not a
+// practical concern for a few thousand assets. The upload thread (see
+// UploadThread.h) looks resources up too, so the maps and stats are only
+// touched under sharedGPUResourceMutex; a resource is added once its data is
+// complete and visible to the render context.
+struct AssetDedupStats {
+    int textures, sharedTextures;
+    size_t textureBytesSaved;
+    int modelBuffers, sharedModelBuffers;
+    size_t modelBytesSaved;
+};
+
+AssetDedupStats assetDedupStats = { 0, 0, 0, 0, 0, 0 };
+std::map<unsigned long long, GLuint> texturesByContent;
+std::mutex sharedGPUResourceMutex;
+
+// Texture already created from identical pixels, or 0 (counts the request)
+GLuint findTextureByContent(unsigned long long hash, size_t bytes) {
+    std::lock_guard<std::mutex> lock(sharedGPUResourceMutex);
+    assetDedupStats.textures++;
+    std::map<unsigned long long, GLuint>::const_iterator found = texturesByContent.find(hash);
+    if (found == texturesByContent.end()) return 0;
+    assetDedupStats.sharedTextures++;
+    assetDedupStats.textureBytesSaved += bytes;
+    return found->second;
+}
+
+// Register a new texture. If one with identical pixels was registered in the
+// meantime (by the other thread), textureID becomes that one and false is
+// returned; the caller then deletes its own.
+bool addTextureByContent(unsigned long long hash, GLuint& textureID, size_t bytes) {
+    std::lock_guard<std::mutex> lock(sharedGPUResourceMutex);
+    std::pair<std::map<unsigned long long, GLuint>::iterator, bool> added =
+        texturesByContent.insert(std::make_pair(hash, textureID));
+    if (added.second) return true;
+    textureID = added.first->second;
+    assetDedupStats.sharedTextures++;
+    assetDedupStats.textureBytesSaved += bytes;
+    return false;
+}
+
+// Pixels ready for glTexImage2D, pointing into a mapped BMP file or the pak
+struct TextureImage {
+    int width, height;
+    GLenum format;        // GL_BGR or GL_BGRA
+    int alignment;        // GL_UNPACK_ALIGNMENT of the rows
+    bool topDown;         // Rows are stored top row first and have to be flipped
+    const unsigned char* pixels;
+    size_t bytes;
+    MappedFile file;      // The file pixels point into (data is NULL for the pak)
     
-    // Read BMP header
-    unsigned char header[54];
-    if (fread(header, 1, 54, file) != 54) {
-        fclose(file);
-        return 0;
+    TextureImage() : width(0), height(0), format(GL_BGR), alignment(4), topDown(false), pixels(NULL), bytes(0) {
+        file.data = NULL;
+        file.size = 0;
     }
-    
-    // Check BMP signature
-    if (header[0] != 'B' || header[1] != 'M') {
-        fclose(file);
-        return 0;
+};
+
+// Unmap the image's file; call once its pixels have been handed to GL
+void releaseTextureImage(TextureImage& image) {
+    if (image.file.data) unmapFile(image.file);
+    image.pixels = NULL;
+}
+
+unsigned long long hashTextureContent(const TextureImage& image) {
+    int shape[4] = { image.width, image.height, (int)image.format, image.topDown ? 1 : 0 };
+    return hashAssetBytes(image.pixels, image.bytes, hashAssetBytes(shape, sizeof(shape)));
+}
+
+// Copy an image's rows bottom row first, as GL expects them
+void copyTextureRows(const TextureImage& image, unsigned char* destination) {
+    if (!image.topDown) {
+        memcpy(destination, image.pixels, image.bytes);
+        return;
     }
-    
-    // Get image info - BMP files use little-endian byte order
-    unsigned int dataPos = header[0x0A] | (header[0x0B] << 8) | (header[0x0C] << 16) | (header[0x0D] << 24);
-    unsigned int imageSize = header[0x22] | (header[0x23] << 8) | (header[0x24] << 16) | (header[0x25] << 24);
-    unsigned int width = header[0x12] | (header[0x13] << 8) | (header[0x14] << 16) | (header[0x15] << 24);
-    unsigned int height = header[0x16] | (header[0x17] << 8) | (header[0x18] << 16) | (header[0x19] << 24);
-    
-    if (imageSize == 0) imageSize = width * height * 3;
-    if (dataPos == 0) dataPos = 54;
-    
-    // Read image data
-    std::vector<unsigned char> data(imageSize);
-    fseek(file, dataPos, SEEK_SET);
-    fread(&data[0], 1, imageSize, file);
-    fclose(file);
-    
-    // Create OpenGL texture
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    
-    // Upload texture data (BMP is BGR format)
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, &data[0]);
-    
-    // Set texture parameters
+    size_t rowSize = image.bytes / image.height;
+    for (int y = 0; y < image.height; y++) {
+        memcpy(destination + rowSize * y, image.pixels + rowSize * (image.height - 1 - y), rowSize);
+    }
+}
+
+// Pixel buffer objects: GL 2.1 or ARB_pixel_buffer_object, filled by mapping
+bool texturePixelBuffersSupported() {
+    return glMapBufferRangeSupported && (glVersionAtLeast(2, 1) || glHasExtension("GL_ARB_pixel_buffer_object"));
+}
+
+// Copy an image's rows into a pixel unpack buffer, bottom row first. Binds
+// the buffer directly, so the upload thread can fill buffers for the render
+// thread. Returns false if the mapping failed and the buffer holds nothing.
+bool fillTexturePixelBuffer(const TextureImage& image, GLuint pixelBuffer) {
+    pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+    pglBufferData(GL_PIXEL_UNPACK_BUFFER, image.bytes, NULL, GL_STREAM_DRAW);  // Orphans the last image
+    void* mapped = pglMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, image.bytes,
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped) copyTextureRows(image, (unsigned char*)mapped);
+    bool filled = mapped && pglUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return filled;
+}
+
+// glTexImage2D for the bound texture, from client memory or (source NULL
+// with a pixel buffer bound) offset 0 of the buffer
+void defineTextureImage(const TextureImage& image, const void* source) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, image.alignment);
+    GLint internalFormat = image.format == GL_BGRA ? GL_RGBA : GL_RGB;
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, image.format,
+                 GL_UNSIGNED_BYTE, source);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+// Define the bound texture from rows already in a pixel buffer (see
+// fillTexturePixelBuffer); GL reads them without touching client memory
+void setTextureFromPixelBuffer(const TextureImage& image, GLuint pixelBuffer) {
+    pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+    defineTextureImage(image, NULL);
+    pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// Define the bound texture straight from the image's mapping; only top-down
+// rows are copied, to flip them. On the render thread this beats staging in
+// a pixel buffer first, which adds a copy glTexImage2D then waits on; the
+// upload thread stages instead (see UploadThread.h), off the render thread.
+void setTextureImage(const TextureImage& image) {
+    std::vector<unsigned char> flipped;
+    if (image.topDown) {
+        flipped.resize(image.bytes);
+        copyTextureRows(image, &flipped[0]);
+    }
+    defineTextureImage(image, image.topDown ? &flipped[0] : image.pixels);
+}
+
+// Create a texture from an image, or reuse one made from identical pixels
+GLuint createTexture(const TextureImage& image, const char* name) {
+    unsigned long long hash = hashTextureContent(image);
+    GLuint sharedID = findTextureByContent(hash, image.bytes);
+    if (sharedID != 0) {
+        printf("Texture %s is identical to one already loaded, sharing it\n", name);
+        return sharedID;
+    }
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    setTextureImage(image);
+    GLuint ownID = textureID;
+    if (!addTextureByContent(hash, textureID, image.bytes)) glDeleteTextures(1, &ownID);
+    return textureID;
+}
+
+unsigned int readLE16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+unsigned int readLE32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_INFO_HEADER_SIZE 40
+#define BMP_MAX_DIMENSION 32768
+#define BMP_RGB 0        // Uncompressed
+#define BMP_BITFIELDS 3  // Uncompressed with channel masks
+
+// Map an uncompressed 24/32-bit BMP. The pixels stay in the mapping: rows are
+// already padded to 4 bytes as GL_UNPACK_ALIGNMENT 4 expects, and bottom-up
+// files (the usual kind) are in GL's row order; top-down ones are flagged for
+// flipping during upload. 32-bit files become GL_BGRA.
+bool readBMPImage(const char* filename, TextureImage& image) {
+    if (!mapFile(filename, image.file)) {
+        printf("Warning: Could not open BMP file: %s\n", filename);
+        return false;
+    }
+    const unsigned char* h = image.file.data;
+    size_t fileSize = image.file.size;
+    bool ok = fileSize >= BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE && h[0] == 'B' && h[1] == 'M' &&
+              readLE32(h + 0x0E) >= BMP_INFO_HEADER_SIZE;
+    unsigned int dataPos = ok ? readLE32(h + 0x0A) : 0;
+    int width = ok ? (int)readLE32(h + 0x12) : 0;
+    int height = ok ? (int)readLE32(h + 0x16) : 0;
+    unsigned int planes = ok ? readLE16(h + 0x1A) : 0;
+    unsigned int bpp = ok ? readLE16(h + 0x1C) : 0;
+    unsigned int compression = ok ? readLE32(h + 0x1E) : 0;
+    
+    // Channel masks follow the info header; only the usual BGRA order is accepted
+    bool standardMasks = compression == BMP_BITFIELDS && bpp == 32 &&
+                         fileSize >= BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + 12 &&
+                         readLE32(h + 0x36) == 0x00FF0000 && readLE32(h + 0x3A) == 0x0000FF00 &&
+                         readLE32(h + 0x3E) == 0x000000FF;
+    bool topDown = height < 0;
+    if (topDown) height = -height;
+    ok = ok && width > 0 && width <= BMP_MAX_DIMENSION && height > 0 && height <= BMP_MAX_DIMENSION &&
+         planes == 1 && (bpp == 24 || bpp == 32) && (compression == BMP_RGB || standardMasks);
+    size_t rowSize = ((size_t)width * bpp + 31) / 32 * 4;
+    size_t pixelBytes = rowSize * height;
+    if (!ok || dataPos < BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE || dataPos > fileSize ||
+        pixelBytes > fileSize - dataPos) {
+        printf("Warning: Unsupported or damaged BMP (need uncompressed 24/32-bit): %s\n", filename);
+        releaseTextureImage(image);
+        return false;
+    }
     
-    printf("Loaded BMP texture: %s (%dx%d)\n", filename, width, height);
+    image.width = width;
+    image.height = height;
+    image.format = bpp == 32 ? GL_BGRA : GL_BGR;
+    image.alignment = 4;
+    image.topDown = topDown;
+    image.pixels = h + dataPos;
+    image.bytes = pixelBytes;
+    prefetchMappedFile(image.file);
+    return true;
+}
+
+GLuint loadBMPTexture(const char* filename) {
+    TextureImage image;
+    if (!readBMPImage(filename, image)) return 0;
+    GLuint textureID = createTexture(image, filename);
+    releaseTextureImage(image);
+    printf("Loaded BMP texture: %s (%dx%d, %d-bit)\n", filename, image.width, image.height,
+           image.format == GL_BGRA ? 32 : 24);
     return textureID;
 }
 
+// A cooked texture in the asset pak, pointing straight into the mapping
+void getPakTextureImage(const AssetPakEntry* entry, TextureImage& image) {
+    image.width = entry->info[0];
+    image.height = entry->info[1];
+    image.format = entry->info[2];
+    image.alignment = entry->info[3];
+    image.topDown = false;
+    image.pixels = getAssetData(entry);
+    image.bytes = (size_t)entry->size;
+}
+
+GLuint loadPakTexture(const AssetPakEntry* entry, const char* name) {
+    TextureImage image;
+    getPakTextureImage(entry, image);
+    return createTexture(image, name);
+}
+
 GLuint loadTexture(const char* filename) {
     // Check cache first
     if (textureCache.find(filename) != textureCache.end()) {
         return textureCache[filename];
     }
     
+    const AssetPakEntry* entry = findAsset(filename, ASSET_TEXTURE);
+    if (entry) {
+        GLuint texID = loadPakTexture(entry, filename);
+        textureCache[filename] = texID;
+        return texID;
+    }
+    
     // Check file extension
     const char* ext = strrchr(filename, '.');
     if (ext && (strcasecmp(ext, ".bmp") == 0)) {
@@ -148,7 +483,60 @@ std::string getDirectory(const std::string& filepath) {
     return "";
 }
 
-// OBJ file parser - supports vertices, normals, texture coordinates, and faces
+// OBJ face corner: 1-based position/texcoord/normal indices, 0 for the default
+struct OBJCorner {
+    int position, texCoord, normal;
+};
+
+// True if all three 1-based OBJ indices refer to elements read so far
+bool objIndicesValid(int a, int b, int c, int count) {
+    return a > 0 && a <= count && b > 0 && b <= count && c > 0 && c <= count;
+}
+
+// Parse the corners of a face line (after "f ") in v/vt/vn, v//vn or v form.
+// The counts are the elements read so far; the first triangle is kept, and
+// normals and texture coordinates fall back to 0 (the default) unless all
+// three are valid. False if the face has no valid triangle.
+bool parseOBJFace(const char* face, int numPositions, int numTexCoords, int numNormals,
+                  int v[3], int vt[3], int vn[3]) {
+    vt[0] = vt[1] = vt[2] = 0;
+    vn[0] = vn[1] = vn[2] = 0;
+    if (sscanf(face, "%d/%d/%d %d/%d/%d %d/%d/%d",
+               &v[0], &vt[0], &vn[0], &v[1], &vt[1], &vn[1], &v[2], &vt[2], &vn[2]) == 9) {
+        if (!objIndicesValid(vt[0], vt[1], vt[2], numTexCoords)) vt[0] = vt[1] = vt[2] = 0;
+    } else if (sscanf(face, "%d//%d %d//%d %d//%d",
+                      &v[0], &vn[0], &v[1], &vn[1], &v[2], &vn[2]) == 6) {
+        vt[0] = vt[1] = vt[2] = 0;
+    } else if (sscanf(face, "%d %d %d", &v[0], &v[1], &v[2]) == 3) {
+        vn[0] = vn[1] = vn[2] = 0;
+    } else {
+        return false;
+    }
+    if (!objIndicesValid(vn[0], vn[1], vn[2], numNormals)) vn[0] = vn[1] = vn[2] = 0;
+    return objIndicesValid(v[0], v[1], v[2], numPositions);
+}
+
+// Vertex number of a face corner, adding it if this (v, vt, vn) triple is new.
+// table is an open-addressing hash of corner numbers (-1 empty) with
+// mask + 1 slots, at least twice the number of corners it will hold.
+GLuint addOBJCorner(ModelArray<int>& table, size_t mask, ModelArray<OBJCorner>& corners,
+                    int v, int vt, int vn) {
+    size_t slot = ((unsigned int)v * 73856093u ^ (unsigned int)vt * 19349663u ^ (unsigned int)vn * 83492791u) & mask;
+    while (table[slot] >= 0) {
+        const OBJCorner& c = corners[table[slot]];
+        if (c.position == v && c.texCoord == vt && c.normal == vn) return (GLuint)table[slot];
+        slot = (slot + 1) & mask;
+    }
+    OBJCorner corner = { v, vt, vn };
+    table[slot] = (int)corners.size();
+    corners.push_back(corner);
+    return (GLuint)table[slot];
+}
+
+// OBJ file parser - supports vertices, normals, texture coordinates, and faces.
+// A pre-scan counts every element type so scratch arrays and the model arena
+// are each allocated once. Face corners are deduplicated on their index triple,
+// so shared corners become one indexed vertex.
 #define MAX_LINE_LENGTH 256
 bool loadOBJ(const char* filename, Model& model) {
     printf("Loading OBJ model: %s\n", filename);
@@ -159,139 +547,107 @@ bool loadOBJ(const char* filename, Model& model) {
         return false;
     }
     
-    std::string modelDir = getDirectory(filename);
+    char line[MAX_LINE_LENGTH];
+    int positionCount = 0, normalCount = 0, texCoordCount = 0, faceCount = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "v ", 2) == 0) positionCount++;
+        else if (strncmp(line, "vn ", 3) == 0) normalCount++;
+        else if (strncmp(line, "vt ", 3) == 0) texCoordCount++;
+        else if (strncmp(line, "f ", 2) == 0) faceCount++;
+    }
+    rewind(file);
     
     // Temporary storage for indexed data
-    std::vector<Vector3> temp_vertices;
-    std::vector<Vector3> temp_normals;
-    std::vector<Vector2> temp_texcoords;
+    ModelArray<Vector3> positions;
+    ModelArray<Vector3> normals;
+    ModelArray<Vector2> texCoords;
+    positions.reserve(positionCount);
+    normals.reserve(normalCount);
+    texCoords.reserve(texCoordCount);
     
-    Mesh currentMesh;
-    bool hasMesh = false;
+    // Each face line yields one triangle. Unique corners get consecutive vertex
+    // numbers through an open-addressing table sized for the worst case.
+    ModelArray<OBJCorner> corners;
+    ModelArray<GLuint> indices;
+    ModelArray<int> cornerTable;
+    corners.reserve((size_t)faceCount * 3);
+    indices.reserve((size_t)faceCount * 3);
+    size_t tableMask = 0;
+    if (faceCount > 0) {
+        size_t tableSize = 1;
+        while (tableSize < (size_t)faceCount * 6) tableSize <<= 1;
+        cornerTable.assign(tableSize, -1);
+        tableMask = tableSize - 1;
+    }
     
-    char line[MAX_LINE_LENGTH];
     while (fgets(line, sizeof(line), file)) {
         // Parse vertices
         if (strncmp(line, "v ", 2) == 0) {
             Vector3 vertex;
             if (sscanf(line + 2, "%f %f %f", &vertex.x, &vertex.y, &vertex.z) == 3) {
-                temp_vertices.push_back(vertex);
+                positions.push_back(vertex);
             }
         }
         // Parse normals
         else if (strncmp(line, "vn ", 3) == 0) {
             Vector3 normal;
             if (sscanf(line + 3, "%f %f %f", &normal.x, &normal.y, &normal.z) == 3) {
-                temp_normals.push_back(normal);
+                normals.push_back(normal);
             }
         }
         // Parse texture coordinates
         else if (strncmp(line, "vt ", 3) == 0) {
             Vector2 texcoord;
             if (sscanf(line + 3, "%f %f", &texcoord.u, &texcoord.v) == 2) {
-                temp_texcoords.push_back(texcoord);
+                texCoords.push_back(texcoord);
             }
         }
         // Parse faces
         else if (strncmp(line, "f ", 2) == 0) {
-            if (!hasMesh) {
-                hasMesh = true;
+            int v[3], vt[3], vn[3];
+            if (!parseOBJFace(line + 2, (int)positions.size(), (int)texCoords.size(), (int)normals.size(),
+                              v, vt, vn)) {
+                continue;
             }
-            
-            int v1, v2, v3, vt1, vt2, vt3, vn1, vn2, vn3;
-            int matches = sscanf(line + 2, "%d/%d/%d %d/%d/%d %d/%d/%d",
-                                &v1, &vt1, &vn1, &v2, &vt2, &vn2, &v3, &vt3, &vn3);
-            
-            if (matches == 9) {
-                // f v/vt/vn
-                // OBJ indices are 1-based, convert to 0-based
-                if (v1 > 0 && v1 <= (int)temp_vertices.size() &&
-                    v2 > 0 && v2 <= (int)temp_vertices.size() &&
-                    v3 > 0 && v3 <= (int)temp_vertices.size()) {
-                    currentMesh.vertices.push_back(temp_vertices[v1 - 1]);
-                    currentMesh.vertices.push_back(temp_vertices[v2 - 1]);
-                    currentMesh.vertices.push_back(temp_vertices[v3 - 1]);
-                }
-                
-                if (vn1 > 0 && vn1 <= (int)temp_normals.size() &&
-                    vn2 > 0 && vn2 <= (int)temp_normals.size() &&
-                    vn3 > 0 && vn3 <= (int)temp_normals.size()) {
-                    currentMesh.normals.push_back(temp_normals[vn1 - 1]);
-                    currentMesh.normals.push_back(temp_normals[vn2 - 1]);
-                    currentMesh.normals.push_back(temp_normals[vn3 - 1]);
-                }
-                
-                if (vt1 > 0 && vt1 <= (int)temp_texcoords.size() &&
-                    vt2 > 0 && vt2 <= (int)temp_texcoords.size() &&
-                    vt3 > 0 && vt3 <= (int)temp_texcoords.size()) {
-                    currentMesh.texCoords.push_back(temp_texcoords[vt1 - 1]);
-                    currentMesh.texCoords.push_back(temp_texcoords[vt2 - 1]);
-                    currentMesh.texCoords.push_back(temp_texcoords[vt3 - 1]);
-                }
-            } else {
-                // Try f v//vn (no texture coords)
-                matches = sscanf(line + 2, "%d//%d %d//%d %d//%d",
-                               &v1, &vn1, &v2, &vn2, &v3, &vn3);
-                if (matches == 6) {
-                    if (v1 > 0 && v1 <= (int)temp_vertices.size() &&
-                        v2 > 0 && v2 <= (int)temp_vertices.size() &&
-                        v3 > 0 && v3 <= (int)temp_vertices.size()) {
-                        currentMesh.vertices.push_back(temp_vertices[v1 - 1]);
-                        currentMesh.vertices.push_back(temp_vertices[v2 - 1]);
-                        currentMesh.vertices.push_back(temp_vertices[v3 - 1]);
-                    }
-                    
-                    if (vn1 > 0 && vn1 <= (int)temp_normals.size() &&
-                        vn2 > 0 && vn2 <= (int)temp_normals.size() &&
-                        vn3 > 0 && vn3 <= (int)temp_normals.size()) {
-                        currentMesh.normals.push_back(temp_normals[vn1 - 1]);
-                        currentMesh.normals.push_back(temp_normals[vn2 - 1]);
-                        currentMesh.normals.push_back(temp_normals[vn3 - 1]);
-                    }
-                } else {
-                    // Try f v (only vertices)
-                    matches = sscanf(line + 2, "%d %d %d", &v1, &v2, &v3);
-                    if (matches == 3 && v1 > 0 && v1 <= (int)temp_vertices.size() &&
-                        v2 > 0 && v2 <= (int)temp_vertices.size() &&
-                        v3 > 0 && v3 <= (int)temp_vertices.size()) {
-                        currentMesh.vertices.push_back(temp_vertices[v1 - 1]);
-                        currentMesh.vertices.push_back(temp_vertices[v2 - 1]);
-                        currentMesh.vertices.push_back(temp_vertices[v3 - 1]);
-                    }
-                }
+            for (int k = 0; k < 3; k++) {
+                indices.push_back(addOBJCorner(cornerTable, tableMask, corners, v[k], vt[k], vn[k]));
             }
         }
     }
     
     fclose(file);
     
-    // Add the mesh if we parsed any data
-    if (hasMesh && currentMesh.vertices.size() > 0) {
-        // Fill in missing normals with default values
-        while (currentMesh.normals.size() < currentMesh.vertices.size()) {
-            currentMesh.normals.push_back(Vector3(0, 1, 0));
-        }
-        // Fill in missing texture coordinates
-        while (currentMesh.texCoords.size() < currentMesh.vertices.size()) {
-            currentMesh.texCoords.push_back(Vector2(0, 0));
+    // Pack the unique corners and copy the indices into the arena
+    if (!indices.empty()) {
+        allocateModelArena(model, (int)corners.size(), (int)indices.size());
+        unsigned char* vertices = getModelVertices(model);
+        SourceVertex v;
+        for (size_t i = 0; i < corners.size(); i++) {
+            const OBJCorner& c = corners[i];
+            v.position = positions[c.position - 1];
+            v.normal = c.normal ? normals[c.normal - 1] : Vector3(0, 1, 0);
+            v.u = c.texCoord ? texCoords[c.texCoord - 1].u : 0.0f;
+            v.v = c.texCoord ? texCoords[c.texCoord - 1].v : 0.0f;
+            ModelVertex::pack(vertices + i * ModelVertex::STRIDE, v);
         }
+        memcpy(getModelIndices(model), &indices[0], indices.size() * sizeof(GLuint));
         
-        model.meshes.push_back(currentMesh);
-    }
-    
-    // Calculate total vertices across all meshes
-    int totalVertices = 0;
-    for (size_t i = 0; i < model.meshes.size(); i++) {
-        totalVertices += model.meshes[i].vertices.size();
+        Mesh mesh;
+        mesh.vertexCount = model.vertexCount;
+        mesh.indexCount = model.indexCount;
+        model.meshes.push_back(std::move(mesh));
     }
     
-    printf("Successfully loaded OBJ: %s (%d meshes, %d vertices)\n",
-           filename, (int)model.meshes.size(), totalVertices);
+    printf("Successfully loaded OBJ: %s (%d meshes, %d vertices, %d indices)\n",
+           filename, (int)model.meshes.size(), model.vertexCount, model.indexCount);
     
     return model.meshes.size() > 0;
 }
 
-// Simple 3DS file parser - basic implementation for triangular meshes
+// Simple 3DS file parser - basic implementation for triangular meshes.
+// A pre-scan totals the vertex and face counts of every object so the arena
+// is allocated once; the main pass then packs vertices and writes indices
+// straight into it.
 #define MAX_3DS_VERTICES 1000000  // Maximum vertices per mesh (safety limit)
 #define MAX_3DS_FACES 1000000     // Maximum faces per mesh (safety limit)
 bool load3DS(const char* filename, Model& model) {
@@ -303,12 +659,42 @@ bool load3DS(const char* filename, Model& model) {
         return false;
     }
     
-    Mesh mesh;
-    
     // 3DS file format uses chunks with IDs and lengths
     unsigned short chunkID;
     unsigned int chunkLength;
     
+    int totalVertices = 0, totalFaces = 0;
+    while (fread(&chunkID, 2, 1, file) == 1) {
+        long chunkStart = ftell(file) - 2;
+        if (fread(&chunkLength, 4, 1, file) != 1) break;
+        
+        // Containers are entered, object names stepped over, the rest skipped
+        if (chunkID == 0x4D4D || chunkID == 0x3D3D || chunkID == 0x4100) {
+            continue;
+        } else if (chunkID == 0x4000) {
+            int c, i = 0;
+            while (i++ < 256 && (c = fgetc(file)) != EOF && c != 0) {}
+            continue;
+        } else if (chunkID == 0x4110 || chunkID == 0x4120) {
+            unsigned short count;
+            if (fread(&count, 2, 1, file) != 1) break;
+            if (chunkID == 0x4110) totalVertices += count;
+            else totalFaces += count;
+        }
+        if (chunkLength < 6) break;
+        fseek(file, chunkStart + (long)chunkLength, SEEK_SET);
+    }
+    rewind(file);
+    
+    allocateModelArena(model, totalVertices, totalFaces * 3);
+    unsigned char* vertices = getModelVertices(model);
+    GLuint* indices = getModelIndices(model);
+    int vertexCursor = 0, indexCursor = 0;
+    int objectFirstVertex = 0;  // Faces and mapping coordinates index the current object's vertices
+    
+    SourceVertex v;
+    v.normal = Vector3(0, 1, 0);
+    
     while (fread(&chunkID, 2, 1, file) == 1) {
         if (fread(&chunkLength, 4, 1, file) != 1) break;
         
@@ -339,13 +725,15 @@ bool load3DS(const char* filename, Model& model) {
         // Vertices list
         else if (chunkID == 0x4110) {
             unsigned short numVertices;
+            objectFirstVertex = vertexCursor;
             if (fread(&numVertices, 2, 1, file) == 1 && numVertices <= MAX_3DS_VERTICES) {
-                for (int i = 0; i < numVertices; i++) {
-                    Vector3 vertex;
-                    if (fread(&vertex.x, 4, 1, file) != 1) break;
-                    if (fread(&vertex.y, 4, 1, file) != 1) break;
-                    if (fread(&vertex.z, 4, 1, file) != 1) break;
-                    mesh.vertices.push_back(vertex);
+                for (int i = 0; i < numVertices && vertexCursor < totalVertices; i++) {
+                    float p[3];
+                    if (fread(p, 4, 3, file) != 3) break;
+                    v.position = Vector3(p[0], p[1], p[2]);
+                    v.u = v.v = 0.0f;
+                    ModelVertex::pack(vertices + (size_t)vertexCursor * ModelVertex::STRIDE, v);
+                    vertexCursor++;
                 }
             }
         }
@@ -353,22 +741,15 @@ bool load3DS(const char* filename, Model& model) {
         else if (chunkID == 0x4120) {
             unsigned short numFaces;
             if (fread(&numFaces, 2, 1, file) == 1 && numFaces <= MAX_3DS_FACES) {
-                std::vector<Vector3> originalVertices = mesh.vertices;
-                mesh.vertices.clear();
-                
-                for (int i = 0; i < numFaces; i++) {
-                    unsigned short v1, v2, v3, flags;
-                    if (fread(&v1, 2, 1, file) != 1) break;
-                    if (fread(&v2, 2, 1, file) != 1) break;
-                    if (fread(&v3, 2, 1, file) != 1) break;
-                    if (fread(&flags, 2, 1, file) != 1) break;
+                int objectVertices = vertexCursor - objectFirstVertex;
+                for (int i = 0; i < numFaces && indexCursor + 3 <= totalFaces * 3; i++) {
+                    unsigned short face[4];  // Three corners and the edge flags
+                    if (fread(face, 2, 4, file) != 4) break;
                     
-                    if (v1 < originalVertices.size() &&
-                        v2 < originalVertices.size() &&
-                        v3 < originalVertices.size()) {
-                        mesh.vertices.push_back(originalVertices[v1]);
-                        mesh.vertices.push_back(originalVertices[v2]);
-                        mesh.vertices.push_back(originalVertices[v3]);
+                    if (face[0] < objectVertices && face[1] < objectVertices && face[2] < objectVertices) {
+                        indices[indexCursor++] = objectFirstVertex + face[0];
+                        indices[indexCursor++] = objectFirstVertex + face[1];
+                        indices[indexCursor++] = objectFirstVertex + face[2];
                     }
                 }
             }
@@ -377,11 +758,11 @@ bool load3DS(const char* filename, Model& model) {
         else if (chunkID == 0x4140) {
             unsigned short numCoords;
             if (fread(&numCoords, 2, 1, file) == 1 && numCoords <= MAX_3DS_VERTICES) {
-                for (int i = 0; i < numCoords; i++) {
-                    Vector2 texcoord;
-                    if (fread(&texcoord.u, 4, 1, file) != 1) break;
-                    if (fread(&texcoord.v, 4, 1, file) != 1) break;
-                    mesh.texCoords.push_back(texcoord);
+                for (int i = 0; i < numCoords && objectFirstVertex + i < vertexCursor; i++) {
+                    if (fread(&v.u, 4, 1, file) != 1) break;
+                    if (fread(&v.v, 4, 1, file) != 1) break;
+                    unsigned char* vertex = vertices + (size_t)(objectFirstVertex + i) * ModelVertex::STRIDE;
+                    UV2f::pack(vertex + VertexOffset<UV2f, ModelVertex>::VALUE, v);
                 }
             }
         }
@@ -396,75 +777,1376 @@ bool load3DS(const char* filename, Model& model) {
     
     fclose(file);
     
-    // Fill in missing data
-    while (mesh.normals.size() < mesh.vertices.size()) {
-        mesh.normals.push_back(Vector3(0, 1, 0));
+    trimModelArena(model, vertexCursor, indexCursor);
+    if (indexCursor > 0) {
+        Mesh mesh;
+        mesh.vertexCount = model.vertexCount;
+        mesh.indexCount = model.indexCount;
+        model.meshes.push_back(std::move(mesh));
     }
-    while (mesh.texCoords.size() < mesh.vertices.size()) {
-        mesh.texCoords.push_back(Vector2(0, 0));
+    
+    printf("Successfully loaded 3DS: %s (%d meshes, %d vertices, %d indices)\n",
+           filename, (int)model.meshes.size(), model.vertexCount, model.indexCount);
+    
+    return model.meshes.size() > 0;
+}
+
+// Mapped-file loaders (PLY, STL). Both read straight out of a MappedFile: no
+// line buffers or intermediate vertex arrays, and values stored as
+// native-endian floats are copied out of the mapping with memcpy.
+
+bool hostIsLittleEndian() {
+    unsigned int one = 1;
+    return *(const unsigned char*)&one == 1;
+}
+
+// Copy n bytes, reversing their order if swap is set
+void copyEndian(void* dst, const unsigned char* src, int n, bool swap) {
+    if (!swap) {
+        memcpy(dst, src, n);
+        return;
+    }
+    unsigned char* d = (unsigned char*)dst;
+    for (int i = 0; i < n; i++) d[i] = src[n - 1 - i];
+}
+
+// PLY loader: ASCII and binary little/big endian. The header gives the exact
+// vertex count; a quick walk over the face lists gives the triangle count
+// (polygons are fan-triangulated), so the arena is allocated once and filled
+// straight from the mapping. Binary vertex and face records in the common
+// native-endian float/int layouts take a fixed-stride fast path.
+#define PLY_MAX_ELEMENTS 8
+#define PLY_MAX_PROPERTIES 32
+
+enum PLYType { PLY_NONE, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+
+const int PLY_TYPE_SIZE[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+
+enum PLYFormat { PLY_ASCII, PLY_BINARY_LE, PLY_BINARY_BE };
+
+// Vertex attributes the loader uses (slots into an 8-float record)
+enum PLYAttribute { PLY_X, PLY_Y, PLY_Z, PLY_NX, PLY_NY, PLY_NZ, PLY_U, PLY_V, PLY_ATTRIBUTE_COUNT };
+
+struct PLYProperty {
+    int type;        // Scalar type, or the item type of a list
+    int countType;   // List count type, PLY_NONE for scalars
+    int attribute;   // PLYAttribute, or -1 if unused
+    int offset;      // Byte offset in a fixed-size binary record
+};
+
+struct PLYElement {
+    char name[32];
+    long long count;
+    int propertyCount;
+    PLYProperty properties[PLY_MAX_PROPERTIES];
+    int recordSize;  // Binary record size, 0 if the element has lists
+    const unsigned char* data;  // First record, set while walking the body
+};
+
+struct PLYCursor {
+    const unsigned char* p;
+    const unsigned char* end;
+    int format;
+    bool swap;
+};
+
+int parsePLYType(const char* name) {
+    static const char* names[][2] = {
+        { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+        { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" }
+    };
+    for (int i = 0; i < 8; i++) {
+        if (strcmp(name, names[i][0]) == 0 || strcmp(name, names[i][1]) == 0) return PLY_INT8 + i;
+    }
+    return PLY_NONE;
+}
+
+int getPLYAttribute(const char* name) {
+    static const char* names[][3] = {
+        { "x", "", "" }, { "y", "", "" }, { "z", "", "" }, { "nx", "", "" }, { "ny", "", "" }, { "nz", "", "" },
+        { "s", "u", "texture_u" }, { "t", "v", "texture_v" }
+    };
+    for (int a = 0; a < PLY_ATTRIBUTE_COUNT; a++) {
+        for (int k = 0; k < 3; k++) {
+            if (names[a][k][0] && strcmp(name, names[a][k]) == 0) return a;
+        }
+    }
+    return -1;
+}
+
+// Read one value of the given type, advancing the cursor
+bool readPLYValue(PLYCursor& c, int type, double& value) {
+    if (c.format == PLY_ASCII) {
+        while (c.p < c.end && (*c.p == ' ' || *c.p == '\t' || *c.p == '\r' || *c.p == '\n')) c.p++;
+        char token[64];
+        int n = 0;
+        while (c.p < c.end && n < 63 && *c.p > ' ') token[n++] = (char)*c.p++;
+        if (n == 0) return false;
+        token[n] = 0;
+        char* parsed;
+        value = strtod(token, &parsed);
+        return *parsed == 0;
+    }
+    int size = PLY_TYPE_SIZE[type];
+    if (c.p + size > c.end) return false;
+    unsigned char b[8];
+    copyEndian(b, c.p, size, c.swap);
+    c.p += size;
+    switch (type) {
+        case PLY_INT8:    value = (signed char)b[0]; break;
+        case PLY_UINT8:   value = b[0]; break;
+        case PLY_INT16:   { short s; memcpy(&s, b, 2); value = s; break; }
+        case PLY_UINT16:  { unsigned short s; memcpy(&s, b, 2); value = s; break; }
+        case PLY_INT32:   { int i; memcpy(&i, b, 4); value = i; break; }
+        case PLY_UINT32:  { unsigned int i; memcpy(&i, b, 4); value = i; break; }
+        case PLY_FLOAT32: { float f; memcpy(&f, b, 4); value = f; break; }
+        case PLY_FLOAT64: memcpy(&value, b, 8); break;
+        default: return false;
+    }
+    return true;
+}
+
+// Read one record of an element. attributes receives the vertex attributes it
+// carries; list receives the items of its list property (if any).
+bool readPLYRecord(PLYCursor& c, const PLYElement& element, float* attributes,
+                   ModelArray<GLuint>* list, int* listCount) {
+    for (int i = 0; i < element.propertyCount; i++) {
+        const PLYProperty& prop = element.properties[i];
+        double value;
+        if (prop.countType == PLY_NONE) {
+            if (!readPLYValue(c, prop.type, value)) return false;
+            if (attributes && prop.attribute >= 0) attributes[prop.attribute] = (float)value;
+            continue;
+        }
+        if (!readPLYValue(c, prop.countType, value) || value < 0) return false;
+        int count = (int)value;
+        if (listCount) *listCount = count;
+        if (list) list->clear();
+        if (!list && c.format != PLY_ASCII) {
+            c.p += (size_t)count * PLY_TYPE_SIZE[prop.type];
+            if (c.p > c.end) return false;
+            continue;
+        }
+        for (int k = 0; k < count; k++) {
+            if (!readPLYValue(c, prop.type, value)) return false;
+            if (list) list->push_back((GLuint)value);
+        }
+    }
+    return true;
+}
+
+bool loadPLY(const char* filename, Model& model) {
+    printf("Loading PLY model: %s\n", filename);
+    
+    MappedFile file;
+    if (!mapFile(filename, file)) {
+        printf("Error: Could not open PLY file: %s\n", filename);
+        return false;
+    }
+    
+    // Header: text lines up to end_header
+    PLYElement elements[PLY_MAX_ELEMENTS];
+    int elementCount = 0;
+    int format = -1;
+    const unsigned char* p = file.data;
+    const unsigned char* end = file.data + file.size;
+    bool headerOk = file.size > 4 && memcmp(p, "ply", 3) == 0;
+    bool headerDone = false;
+    while (headerOk && !headerDone && p < end) {
+        char line[MAX_LINE_LENGTH];
+        int n = 0;
+        while (p < end && *p != '\n') {
+            if (n < MAX_LINE_LENGTH - 1) line[n++] = (char)*p;
+            p++;
+        }
+        if (p < end) p++;
+        line[n] = 0;
+        
+        char word[3][32];
+        long long count;
+        int words = sscanf(line, "%31s %31s %31s", word[0], word[1], word[2]);
+        if (words < 1 || strcmp(word[0], "comment") == 0 || strcmp(word[0], "obj_info") == 0 ||
+            strcmp(word[0], "ply") == 0) {
+            continue;
+        } else if (strcmp(word[0], "end_header") == 0) {
+            headerDone = true;
+        } else if (strcmp(word[0], "format") == 0 && words >= 2) {
+            if (strcmp(word[1], "ascii") == 0) format = PLY_ASCII;
+            else if (strcmp(word[1], "binary_little_endian") == 0) format = PLY_BINARY_LE;
+            else if (strcmp(word[1], "binary_big_endian") == 0) format = PLY_BINARY_BE;
+        } else if (strcmp(word[0], "element") == 0) {
+            // Anything dropped here would leave the following properties on
+            // the wrong element, so a header the loader cannot hold is an error
+            if (elementCount == PLY_MAX_ELEMENTS) {
+                printf("Error: PLY file has more than %d elements: %s\n", PLY_MAX_ELEMENTS, filename);
+                headerOk = false;
+                continue;
+            }
+            if (sscanf(line, "element %31s %lld", word[1], &count) != 2 || count < 0) {
+                headerOk = false;
+                continue;
+            }
+            PLYElement& element = elements[elementCount++];
+            strcpy(element.name, word[1]);
+            element.count = count;
+            element.propertyCount = 0;
+            element.recordSize = 0;
+            element.data = NULL;
+        } else if (strcmp(word[0], "property") == 0) {
+            if (elementCount == 0 || words < 3) {
+                headerOk = false;
+                continue;
+            }
+            if (elements[elementCount - 1].propertyCount == PLY_MAX_PROPERTIES) {
+                printf("Error: PLY element \"%s\" has more than %d properties: %s\n",
+                       elements[elementCount - 1].name, PLY_MAX_PROPERTIES, filename);
+                headerOk = false;
+                continue;
+            }
+            PLYElement& element = elements[elementCount - 1];
+            PLYProperty& prop = element.properties[element.propertyCount++];
+            char itemType[32], name[32];
+            prop.attribute = -1;
+            if (strcmp(word[1], "list") == 0 && sscanf(line, "property list %31s %31s %31s", word[2], itemType, name) == 3) {
+                prop.countType = parsePLYType(word[2]);
+                prop.type = parsePLYType(itemType);
+            } else if (words == 3) {
+                prop.countType = PLY_NONE;
+                prop.type = parsePLYType(word[1]);
+                if (strcmp(element.name, "vertex") == 0) prop.attribute = getPLYAttribute(word[2]);
+            } else {
+                prop.type = PLY_NONE;
+            }
+            if (prop.type == PLY_NONE || (strcmp(word[1], "list") == 0 && prop.countType == PLY_NONE)) headerOk = false;
+        }
+    }
+    if (!headerOk || !headerDone || format < 0) {
+        printf("Error: Unsupported or malformed PLY header: %s\n", filename);
+        unmapFile(file);
+        return false;
+    }
+    
+    // Fixed record layouts for the binary fast paths
+    for (int e = 0; e < elementCount; e++) {
+        PLYElement& element = elements[e];
+        int offset = 0;
+        for (int i = 0; i < element.propertyCount; i++) {
+            PLYProperty& prop = element.properties[i];
+            prop.offset = offset;
+            if (prop.countType != PLY_NONE) {
+                offset = -1;
+                break;
+            }
+            offset += PLY_TYPE_SIZE[prop.type];
+        }
+        element.recordSize = (format != PLY_ASCII && offset > 0) ? offset : 0;
     }
     
-    if (mesh.vertices.size() > 0) {
-        model.meshes.push_back(mesh);
+    // Walk the body once: find where the vertex and face records start and
+    // count the triangles the faces fan out to
+    PLYCursor cursor = { p, end, format, format != PLY_ASCII && (format == PLY_BINARY_LE) != hostIsLittleEndian() };
+    PLYElement* vertexElement = NULL;
+    PLYElement* faceElement = NULL;
+    long long triangleCount = 0;
+    bool bodyOk = true;
+    for (int e = 0; e < elementCount && bodyOk; e++) {
+        PLYElement& element = elements[e];
+        element.data = cursor.p;
+        bool isFace = strcmp(element.name, "face") == 0;
+        if (strcmp(element.name, "vertex") == 0) vertexElement = &element;
+        if (isFace) faceElement = &element;
+        if (element.recordSize > 0) {
+            if (element.count > (long long)(cursor.end - cursor.p) / element.recordSize) bodyOk = false;
+            else cursor.p += (size_t)element.count * element.recordSize;
+            continue;
+        }
+        for (long long r = 0; r < element.count && bodyOk; r++) {
+            int listCount = 0;
+            bodyOk = readPLYRecord(cursor, element, NULL, NULL, &listCount);
+            if (isFace && listCount > 2) triangleCount += listCount - 2;
+        }
+    }
+    if (!bodyOk || !vertexElement || vertexElement->count > INT_MAX || triangleCount * 3 > INT_MAX) {
+        printf("Error: Truncated or oversized PLY file: %s\n", filename);
+        unmapFile(file);
+        return false;
     }
     
-    printf("Successfully loaded 3DS: %s (%d meshes, %d vertices)\n",
-           filename, (int)model.meshes.size(), (int)mesh.vertices.size());
+    int vertexCount = (int)vertexElement->count;
+    allocateModelArena(model, vertexCount, (int)triangleCount * 3);
+    unsigned char* vertices = getModelVertices(model);
+    GLuint* indices = getModelIndices(model);
+    
+    // Vertices. Attributes missing from the file keep their defaults.
+    float defaults[PLY_ATTRIBUTE_COUNT] = { 0, 0, 0, 0, 1, 0, 0, 0 };
+    const PLYProperty* attributeProps[PLY_ATTRIBUTE_COUNT] = { NULL };
+    for (int i = 0; i < vertexElement->propertyCount; i++) {
+        const PLYProperty& prop = vertexElement->properties[i];
+        if (prop.attribute >= 0) attributeProps[prop.attribute] = &prop;
+    }
+    bool hasNormals = attributeProps[PLY_NX] && attributeProps[PLY_NY] && attributeProps[PLY_NZ];
+    if (!hasNormals) attributeProps[PLY_NX] = attributeProps[PLY_NY] = attributeProps[PLY_NZ] = NULL;
+    cursor.p = vertexElement->data;
+    SourceVertex v;
+    bool recordsOk = true;
+    for (int i = 0; i < vertexCount && recordsOk; i++) {
+        float a[PLY_ATTRIBUTE_COUNT];
+        memcpy(a, defaults, sizeof(a));
+        if (vertexElement->recordSize > 0) {
+            const unsigned char* record = vertexElement->data + (size_t)i * vertexElement->recordSize;
+            for (int k = 0; k < PLY_ATTRIBUTE_COUNT; k++) {
+                const PLYProperty* prop = attributeProps[k];
+                if (!prop) continue;
+                if (prop->type == PLY_FLOAT32 && !cursor.swap) {
+                    memcpy(&a[k], record + prop->offset, sizeof(float));
+                } else {
+                    PLYCursor field = { record + prop->offset, end, format, cursor.swap };
+                    double value;
+                    recordsOk = readPLYValue(field, prop->type, value) && recordsOk;
+                    a[k] = (float)value;
+                }
+            }
+        } else {
+            recordsOk = readPLYRecord(cursor, *vertexElement, a, NULL, NULL);
+            if (!hasNormals) {
+                a[PLY_NX] = defaults[PLY_NX];
+                a[PLY_NY] = defaults[PLY_NY];
+                a[PLY_NZ] = defaults[PLY_NZ];
+            }
+        }
+        v.position = Vector3(a[PLY_X], a[PLY_Y], a[PLY_Z]);
+        v.normal = Vector3(a[PLY_NX], a[PLY_NY], a[PLY_NZ]);
+        v.u = a[PLY_U];
+        v.v = a[PLY_V];
+        ModelVertex::pack(vertices + (size_t)i * ModelVertex::STRIDE, v);
+    }
+    
+    // Faces, fan-triangulated; faces with out-of-range indices are dropped
+    int indexCursor = 0;
+    if (recordsOk && faceElement && triangleCount > 0) {
+        const PLYProperty* listProp = NULL;
+        for (int i = 0; i < faceElement->propertyCount; i++) {
+            if (faceElement->properties[i].countType != PLY_NONE) listProp = &faceElement->properties[i];
+        }
+        bool directTriangles = listProp && format != PLY_ASCII && !cursor.swap && faceElement->propertyCount == 1 &&
+                               listProp->countType == PLY_UINT8 &&
+                               (listProp->type == PLY_INT32 || listProp->type == PLY_UINT32);
+        ModelArray<GLuint> polygon;
+        cursor.p = faceElement->data;
+        for (long long f = 0; f < faceElement->count; f++) {
+            if (directTriangles && cursor.p + 13 <= end && cursor.p[0] == 3) {
+                // uchar 3 + three native-endian 32-bit indices, copied as is
+                GLuint* tri = indices + indexCursor;
+                memcpy(tri, cursor.p + 1, 3 * sizeof(GLuint));
+                cursor.p += 13;
+                if (tri[0] < (GLuint)vertexCount && tri[1] < (GLuint)vertexCount && tri[2] < (GLuint)vertexCount) {
+                    indexCursor += 3;
+                }
+                continue;
+            }
+            if (!readPLYRecord(cursor, *faceElement, NULL, &polygon, NULL)) {
+                recordsOk = false;
+                break;
+            }
+            bool valid = true;
+            for (size_t k = 0; k < polygon.size(); k++) {
+                if (polygon[k] >= (GLuint)vertexCount) valid = false;
+            }
+            for (size_t k = 2; valid && k < polygon.size(); k++) {
+                indices[indexCursor++] = polygon[0];
+                indices[indexCursor++] = polygon[k - 1];
+                indices[indexCursor++] = polygon[k];
+            }
+        }
+    }
+    unmapFile(file);
+    if (!recordsOk) {
+        printf("Error: Malformed PLY records: %s\n", filename);
+        ModelArray<unsigned char>().swap(model.arena);
+        model.vertexCount = model.indexCount = 0;
+        return false;
+    }
+    
+    trimModelArena(model, vertexCount, indexCursor);
+    if (indexCursor > 0) {
+        Mesh mesh;
+        mesh.vertexCount = model.vertexCount;
+        mesh.indexCount = model.indexCount;
+        model.meshes.push_back(std::move(mesh));
+    }
     
+    printf("Successfully loaded PLY: %s (%d meshes, %d vertices, %d indices)\n",
+           filename, (int)model.meshes.size(), model.vertexCount, model.indexCount);
     return model.meshes.size() > 0;
 }
 
-// Load model - detects format and uses appropriate parser
-bool loadModel(const char* filename, Model& model) {
-    // Check file extension
+// Hash of a welding key's floats. Whole-number coordinates have all-zero low
+// mantissa bits, so the bits are mixed through a 64-bit multiply and folded
+// down rather than masked into a slot directly (which clusters grid-aligned
+// models into a few slots).
+size_t hashWeldKey(const float* key, int count) {
+    unsigned long long h = 0;
+    for (int i = 0; i < count; i++) {
+        unsigned int bits;
+        memcpy(&bits, &key[i], sizeof(bits));
+        h = (h ^ bits) * 0x9E3779B97F4A7C15ull;
+    }
+    return (size_t)(h ^ (h >> 32));
+}
+
+// Binary STL loader. Every triangle carries its own three corners; corners
+// are welded where position and facet normal match exactly, which keeps flat
+// shading while sharing vertices across coplanar facets. A zero facet normal
+// (common in exports) is recomputed from the winding.
+#define STL_HEADER_SIZE 84
+#define STL_TRIANGLE_SIZE 50
+bool loadSTL(const char* filename, Model& model) {
+    printf("Loading STL model: %s\n", filename);
+    
+    MappedFile file;
+    if (!mapFile(filename, file)) {
+        printf("Error: Could not open STL file: %s\n", filename);
+        return false;
+    }
+    unsigned int triangleCount = 0;
+    if (file.size >= STL_HEADER_SIZE) {
+        copyEndian(&triangleCount, file.data + 80, 4, !hostIsLittleEndian());
+    }
+    if (file.size < STL_HEADER_SIZE || triangleCount > INT_MAX / 3 ||
+        file.size != STL_HEADER_SIZE + (size_t)triangleCount * STL_TRIANGLE_SIZE) {
+        printf("Error: Not a binary STL file (ASCII STL is not supported): %s\n", filename);
+        unmapFile(file);
+        return false;
+    }
+    
+    // Weld into unique (position, normal) keys: 6 floats each
+    size_t cornerCount = (size_t)triangleCount * 3;
+    size_t tableSize = 1;
+    while (tableSize < cornerCount * 2) tableSize <<= 1;
+    ModelArray<int> table(tableSize, -1);
+    ModelArray<float> keys;
+    ModelArray<GLuint> indices;
+    keys.reserve(cornerCount * 6);
+    indices.reserve(cornerCount);
+    bool swap = !hostIsLittleEndian();
+    for (unsigned int t = 0; t < triangleCount; t++) {
+        const unsigned char* record = file.data + STL_HEADER_SIZE + (size_t)t * STL_TRIANGLE_SIZE;
+        float f[12];  // Normal, then three corners
+        for (int k = 0; k < 12; k++) copyEndian(&f[k], record + k * 4, 4, swap);
+        Vector3 normal(f[0], f[1], f[2]);
+        if (normal.x == 0.0f && normal.y == 0.0f && normal.z == 0.0f) {
+            Vector3 a(f[3], f[4], f[5]), b(f[6], f[7], f[8]), c(f[9], f[10], f[11]);
+            normal = normalize(cross(b - a, c - a));
+        }
+        for (int k = 0; k < 3; k++) {
+            float key[6] = { f[3 + k * 3], f[4 + k * 3], f[5 + k * 3], normal.x, normal.y, normal.z };
+            size_t slot = hashWeldKey(key, 6) & (tableSize - 1);
+            while (table[slot] >= 0 && memcmp(&keys[(size_t)table[slot] * 6], key, sizeof(key)) != 0) {
+                slot = (slot + 1) & (tableSize - 1);
+            }
+            if (table[slot] < 0) {
+                table[slot] = (int)(keys.size() / 6);
+                keys.insert(keys.end(), key, key + 6);
+            }
+            indices.push_back((GLuint)table[slot]);
+        }
+    }
+    unmapFile(file);
+    
+    if (!indices.empty()) {
+        allocateModelArena(model, (int)(keys.size() / 6), (int)indices.size());
+        unsigned char* vertices = getModelVertices(model);
+        SourceVertex v;
+        v.u = v.v = 0.0f;
+        for (int i = 0; i < model.vertexCount; i++) {
+            const float* key = &keys[(size_t)i * 6];
+            v.position = Vector3(key[0], key[1], key[2]);
+            v.normal = Vector3(key[3], key[4], key[5]);
+            ModelVertex::pack(vertices + (size_t)i * ModelVertex::STRIDE, v);
+        }
+        memcpy(getModelIndices(model), &indices[0], indices.size() * sizeof(GLuint));
+        
+        Mesh mesh;
+        mesh.vertexCount = model.vertexCount;
+        mesh.indexCount = model.indexCount;
+        model.meshes.push_back(std::move(mesh));
+    }
+    
+    printf("Successfully loaded STL: %s (%d meshes, %d vertices welded from %d, %d indices)\n",
+           filename, (int)model.meshes.size(), model.vertexCount, (int)cornerCount, model.indexCount);
+    return model.meshes.size() > 0;
+}
+
+// Binary model cache. After a model is parsed its arena is written next to
+// the source as "<file>.bmc"; later loads map that file and use the arena in
+// place (like the asset pak), and GPU buffers can be rebuilt from it without
+// a CPU copy.
+// The cache records the source's size and modification time and the vertex
+// stride, so editing the model or changing ModelVertex invalidates it.
+//
+// Layout: header, arena (at MODEL_CACHE_ARENA_OFFSET), mesh table. The mesh
+// table goes last so a streaming writer need not know the mesh count up front.
+#define MODEL_CACHE_MAGIC 0x434D4D42  // "BMMC"
+#define MODEL_CACHE_VERSION 2
+#define MODEL_CACHE_EXTENSION ".bmc"
+
+struct ModelCacheHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int vertexStride;
+    int meshCount;
+    long long sourceSize;
+    long long sourceTime;
+    int vertexCount;
+    int indexCount;
+    long long meshTableOffset;
+};
+
+struct ModelCacheMesh {
+    int firstVertex, vertexCount;
+    int firstIndex, indexCount;
+};
+
+// The arena starts 16-byte aligned after the header
+#define MODEL_CACHE_ARENA_OFFSET ((sizeof(ModelCacheHeader) + 15) & ~(size_t)15)
+
+std::string getModelCachePath(const std::string& sourcePath) {
+    return sourcePath + MODEL_CACHE_EXTENSION;
+}
+
+bool getModelSourceStamp(const char* filename, long long& size, long long& time) {
+    struct stat st;
+    if (stat(filename, &st) != 0) return false;
+    size = (long long)st.st_size;
+    time = (long long)st.st_mtime;
+    return true;
+}
+
+// Fill in a header for a cache of sourcePath (counts and mesh table offset are left 0)
+bool initModelCacheHeader(const char* sourcePath, ModelCacheHeader& header) {
+    memset(&header, 0, sizeof(header));
+    header.magic = MODEL_CACHE_MAGIC;
+    header.version = MODEL_CACHE_VERSION;
+    header.vertexStride = ModelVertex::STRIDE;
+    return getModelSourceStamp(sourcePath, header.sourceSize, header.sourceTime);
+}
+
+// The cache's header if it is complete and matches the source, else NULL
+const ModelCacheHeader* getValidModelCache(const char* sourcePath, const MappedFile& cache) {
+    if (cache.size < MODEL_CACHE_ARENA_OFFSET) return NULL;
+    const ModelCacheHeader* header = (const ModelCacheHeader*)cache.data;
+    long long sourceSize, sourceTime;
+    if (header->magic != MODEL_CACHE_MAGIC || header->version != MODEL_CACHE_VERSION ||
+        header->vertexStride != (unsigned int)ModelVertex::STRIDE ||
+        header->vertexCount < 0 || header->indexCount < 0 || header->meshCount < 0 ||
+        !getModelSourceStamp(sourcePath, sourceSize, sourceTime) ||
+        header->sourceSize != sourceSize || header->sourceTime != sourceTime) {
+        return NULL;
+    }
+    size_t arenaSize = (size_t)header->vertexCount * ModelVertex::STRIDE + (size_t)header->indexCount * sizeof(GLuint);
+    if ((size_t)header->meshTableOffset != MODEL_CACHE_ARENA_OFFSET + arenaSize ||
+        cache.size < (size_t)header->meshTableOffset + (size_t)header->meshCount * sizeof(ModelCacheMesh)) {
+        return NULL;
+    }
+    return header;
+}
+
+bool saveModelCache(const char* sourcePath, const Model& model) {
+    ModelCacheHeader header;
+    if (!initModelCacheHeader(sourcePath, header)) return false;
+    header.vertexCount = model.vertexCount;
+    header.indexCount = model.indexCount;
+    header.meshCount = (int)model.meshes.size();
+    header.meshTableOffset = MODEL_CACHE_ARENA_OFFSET + model.arena.size();
+    
+    std::string cachePath = getModelCachePath(sourcePath);
+    FILE* file = fopen(cachePath.c_str(), "wb");
+    if (!file) {
+        printf("Warning: Could not write model cache: %s\n", cachePath.c_str());
+        return false;
+    }
+    static const unsigned char padding[16] = { 0 };
+    size_t padBytes = MODEL_CACHE_ARENA_OFFSET - sizeof(header);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              (padBytes == 0 || fwrite(padding, 1, padBytes, file) == padBytes);
+    if (ok && !model.arena.empty()) ok = fwrite(&model.arena[0], 1, model.arena.size(), file) == model.arena.size();
+    for (size_t m = 0; ok && m < model.meshes.size(); m++) {
+        const Mesh& mesh = model.meshes[m];
+        ModelCacheMesh entry = { mesh.firstVertex, mesh.vertexCount, mesh.firstIndex, mesh.indexCount };
+        ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+    }
+    fclose(file);
+    if (!ok) {
+        printf("Warning: Failed writing model cache: %s\n", cachePath.c_str());
+        remove(cachePath.c_str());
+    }
+    return ok;
+}
+
+// Use a model's cache file. Nothing is copied: the model keeps the file
+// mapped and its arena stays in the mapping, as with the asset pak.
+bool loadModelCache(const char* sourcePath, Model& model) {
+    std::string cachePath = getModelCachePath(sourcePath);
+    MappedFile cache;
+    if (!mapFile(cachePath.c_str(), cache)) return false;
+    const ModelCacheHeader* header = getValidModelCache(sourcePath, cache);
+    if (!header) {
+        printf("Model cache %s is out of date, reparsing\n", cachePath.c_str());
+        unmapFile(cache);
+        return false;
+    }
+    
+    model.cacheMapping.release();
+    model.cacheMapping.file = cache;
+    model.mappedArena = cache.data + MODEL_CACHE_ARENA_OFFSET;
+    model.vertexCount = header->vertexCount;
+    model.indexCount = header->indexCount;
+    const ModelCacheMesh* entries = (const ModelCacheMesh*)(cache.data + header->meshTableOffset);
+    model.meshes.reserve(header->meshCount);
+    for (int m = 0; m < header->meshCount; m++) {
+        Mesh mesh;
+        mesh.firstVertex = entries[m].firstVertex;
+        mesh.vertexCount = entries[m].vertexCount;
+        mesh.firstIndex = entries[m].firstIndex;
+        mesh.indexCount = entries[m].indexCount;
+        model.meshes.push_back(std::move(mesh));
+    }
+    
+    printf("Loaded model cache: %s (%d meshes, %d vertices, %d indices)\n",
+           cachePath.c_str(), (int)model.meshes.size(), model.vertexCount, model.indexCount);
+    return model.meshes.size() > 0;
+}
+
+// Incremental cache writer for data that never exists as one arena. Each
+// added mesh's vertices go straight to the cache file and its indices to a
+// side file, which is copied in behind the vertex block when finishing; the
+// mesh table and header are written last.
+struct ModelCacheWriter {
+    FILE* file;
+    FILE* indexFile;
+    std::string path;
+    std::string indexPath;
+    ModelCacheHeader header;
+    ModelArray<ModelCacheMesh> meshes;
+    bool ok;
+};
+
+bool beginModelCache(ModelCacheWriter& writer, const char* sourcePath) {
+    writer.path = getModelCachePath(sourcePath);
+    writer.indexPath = writer.path + ".idx";
+    writer.file = NULL;
+    writer.indexFile = NULL;
+    writer.ok = initModelCacheHeader(sourcePath, writer.header);
+    if (writer.ok) writer.file = fopen(writer.path.c_str(), "wb");
+    if (writer.file) writer.indexFile = fopen(writer.indexPath.c_str(), "w+b");
+    if (!writer.indexFile) {
+        printf("Warning: Could not write model cache: %s\n", writer.path.c_str());
+        if (writer.file) {
+            fclose(writer.file);
+            remove(writer.path.c_str());
+        }
+        return writer.ok = false;
+    }
+    // Header placeholder, rewritten by finishModelCache
+    static const unsigned char zeros[MODEL_CACHE_ARENA_OFFSET] = { 0 };
+    writer.ok = fwrite(zeros, 1, sizeof(zeros), writer.file) == sizeof(zeros);
+    return writer.ok;
+}
+
+// Append a mesh; its indices are relative to its own first vertex
+bool addModelCacheMesh(ModelCacheWriter& writer, const unsigned char* vertices, int vertexCount,
+                       const GLuint* indices, int indexCount) {
+    ModelCacheMesh entry = { writer.header.vertexCount, vertexCount, writer.header.indexCount, indexCount };
+    writer.ok = writer.ok &&
+        fwrite(vertices, ModelVertex::STRIDE, vertexCount, writer.file) == (size_t)vertexCount &&
+        fwrite(indices, sizeof(GLuint), indexCount, writer.indexFile) == (size_t)indexCount;
+    writer.meshes.push_back(entry);
+    writer.header.vertexCount += vertexCount;
+    writer.header.indexCount += indexCount;
+    writer.header.meshCount++;
+    return writer.ok;
+}
+
+// Complete the cache, or delete it if ok is false or any write failed
+bool finishModelCache(ModelCacheWriter& writer, bool ok) {
+    writer.ok = writer.ok && ok;
+    if (writer.ok) {
+        unsigned char buffer[16384];
+        size_t bytes;
+        rewind(writer.indexFile);
+        while (writer.ok && (bytes = fread(buffer, 1, sizeof(buffer), writer.indexFile)) > 0) {
+            writer.ok = fwrite(buffer, 1, bytes, writer.file) == bytes;
+        }
+        writer.header.meshTableOffset = MODEL_CACHE_ARENA_OFFSET +
+            (long long)writer.header.vertexCount * ModelVertex::STRIDE + (long long)writer.header.indexCount * sizeof(GLuint);
+        writer.ok = writer.ok && (writer.meshes.empty() ||
+            fwrite(&writer.meshes[0], sizeof(ModelCacheMesh), writer.meshes.size(), writer.file) == writer.meshes.size());
+        writer.ok = writer.ok && fseek(writer.file, 0, SEEK_SET) == 0 &&
+                    fwrite(&writer.header, sizeof(writer.header), 1, writer.file) == 1;
+    }
+    writer.ok = (fclose(writer.file) == 0) && writer.ok;
+    fclose(writer.indexFile);
+    remove(writer.indexPath.c_str());
+    if (!writer.ok) {
+        printf("Warning: Failed writing model cache: %s\n", writer.path.c_str());
+        remove(writer.path.c_str());
+    }
+    ModelArray<ModelCacheMesh>().swap(writer.meshes);
+    return writer.ok;
+}
+
+// Streaming OBJ reader for files too large to parse in memory (multi-gigabyte
+// scans). Triangles come out in batches of at most batchTriangles, each with
+// its own packed vertices and batch-local indices, from buffers allocated
+// once. The v/vt/vn records stay in memory while they fit the budget; past
+// that they are spilled to files in the temp directory (the asset directory
+// may be read-only) and mapped back, which leaves their residency to the OS
+// page cache. Face parsing matches loadOBJ.
+// loadModel streams OBJ files over OBJ_STREAM_THRESHOLD straight into the
+// model cache, one mesh per batch.
+#define OBJ_STREAM_THRESHOLD (64 * 1024 * 1024)
+#define OBJ_STREAM_BATCH_TRIANGLES 65536
+#define OBJ_STREAM_MEMORY_BUDGET (256 * 1024 * 1024)
+#define OBJ_SPILL_BUFFER_FLOATS 65536   // Write buffer per attribute once spilled
+
+struct OBJStreamOptions {
+    int batchTriangles;
+    size_t memoryBudget;   // Heap bytes for attribute records and batch buffers
+    
+    OBJStreamOptions() : batchTriangles(OBJ_STREAM_BATCH_TRIANGLES), memoryBudget(OBJ_STREAM_MEMORY_BUDGET) {}
+};
+
+struct OBJBatch {
+    const unsigned char* vertices;  // ModelVertex
+    int vertexCount;
+    const GLuint* indices;          // Relative to the batch's first vertex
+    int indexCount;
+};
+
+// Receives each batch; the data is only valid during the call. Return false to stop.
+typedef bool (*OBJBatchCallback)(const OBJBatch& batch, void* user);
+
+// Records of one attribute (3 floats for v and vn, 2 for vt)
+struct OBJAttributeStore {
+    int components;
+    int count;
+    ModelArray<float> values;  // All records, or the write buffer once spilled
+    FILE* spill;
+    std::string spillPath;
+    MappedFile mapped;
+    const float* data;         // All records, set by finishOBJAttributes
+};
+
+#define OBJ_POSITIONS 0
+#define OBJ_TEXCOORDS 1
+#define OBJ_NORMALS 2
+
+struct OBJAttributes {
+    OBJAttributeStore stores[3];
+    size_t budget;
+    bool spilled;
+};
+
+// Directory for scratch files, with a trailing separator
+std::string getTempDirectory() {
+#ifdef _WIN32
+    char path[MAX_PATH + 1];
+    DWORD length = GetTempPathA(sizeof(path), path);
+    return length > 0 && length < sizeof(path) ? std::string(path) : std::string(".\\");
+#else
+    const char* dir = getenv("TMPDIR");
+    return std::string(dir && *dir ? dir : "/tmp") + "/";
+#endif
+}
+
+// Spill files are named after the source, the process and a per-stream
+// number, so concurrent streams (the asset builder's workers) never share one
+void initOBJAttributes(OBJAttributes& attributes, const char* sourcePath, size_t budget) {
+    static const char* suffixes[3] = { ".v.spill", ".vt.spill", ".vn.spill" };
+    static const int components[3] = { 3, 2, 3 };
+    static std::atomic<int> streams(0);
+    const char* name = sourcePath;
+    for (const char* p = sourcePath; *p; p++) {
+        if (*p == '/' || *p == '\\') name = p + 1;
+    }
+#ifdef _WIN32
+    unsigned long process = (unsigned long)GetCurrentProcessId();
+#else
+    unsigned long process = (unsigned long)getpid();
+#endif
+    char unique[64];
+    snprintf(unique, sizeof(unique), ".%lu.%d", process, streams++);
+    std::string base = getTempDirectory() + name + unique;
+    for (int i = 0; i < 3; i++) {
+        OBJAttributeStore& store = attributes.stores[i];
+        store.components = components[i];
+        store.count = 0;
+        store.spill = NULL;
+        store.spillPath = base + suffixes[i];
+        store.mapped.data = NULL;
+        store.data = NULL;
+    }
+    attributes.budget = budget;
+    attributes.spilled = false;
+}
+
+bool flushOBJAttributeStore(OBJAttributeStore& store) {
+    bool ok = store.values.empty() ||
+              fwrite(&store.values[0], sizeof(float), store.values.size(), store.spill) == store.values.size();
+    store.values.clear();
+    return ok;
+}
+
+// Move every store's records to its spill file, keeping a small write buffer
+bool spillOBJAttributes(OBJAttributes& attributes) {
+    for (int i = 0; i < 3; i++) {
+        OBJAttributeStore& store = attributes.stores[i];
+        store.spill = fopen(store.spillPath.c_str(), "wb");
+        if (!store.spill || !flushOBJAttributeStore(store)) {
+            printf("Error: Could not spill OBJ attributes to %s\n", store.spillPath.c_str());
+            return false;
+        }
+        ModelArray<float>().swap(store.values);
+        store.values.reserve(OBJ_SPILL_BUFFER_FLOATS);
+    }
+    attributes.spilled = true;
+    return true;
+}
+
+bool appendOBJAttribute(OBJAttributes& attributes, int which, const float* record) {
+    OBJAttributeStore& store = attributes.stores[which];
+    if (store.values.size() + store.components > store.values.capacity()) {
+        if (attributes.spilled) {
+            if (!flushOBJAttributeStore(store)) return false;
+        } else {
+            // Grow by doubling while all three stores fit the budget
+            size_t grown = store.values.capacity() < 4096 ? 4096 : store.values.capacity() * 2;
+            size_t total = grown;
+            for (int i = 0; i < 3; i++) {
+                if (i != which) total += attributes.stores[i].values.capacity();
+            }
+            if (total * sizeof(float) > attributes.budget) {
+                if (!spillOBJAttributes(attributes)) return false;
+            } else {
+                store.values.reserve(grown);
+            }
+        }
+    }
+    store.values.insert(store.values.end(), record, record + store.components);
+    store.count++;
+    return true;
+}
+
+// Make every store's records addressable through data
+bool finishOBJAttributes(OBJAttributes& attributes) {
+    for (int i = 0; i < 3; i++) {
+        OBJAttributeStore& store = attributes.stores[i];
+        if (!store.spill) {
+            store.data = store.values.empty() ? NULL : &store.values[0];
+            continue;
+        }
+        bool ok = flushOBJAttributeStore(store);
+        ok = (fclose(store.spill) == 0) && ok;
+        store.spill = NULL;
+        ModelArray<float>().swap(store.values);
+        if (ok && store.count > 0) {
+            ok = mapFile(store.spillPath.c_str(), store.mapped);
+            store.data = ok ? (const float*)store.mapped.data : NULL;
+        }
+        if (!ok) {
+            printf("Error: Could not read back spilled OBJ attributes: %s\n", store.spillPath.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void releaseOBJAttributes(OBJAttributes& attributes) {
+    for (int i = 0; i < 3; i++) {
+        OBJAttributeStore& store = attributes.stores[i];
+        if (store.mapped.data) unmapFile(store.mapped);
+        if (store.spill) fclose(store.spill);
+        store.spill = NULL;
+        store.data = NULL;
+        ModelArray<float>().swap(store.values);
+        if (attributes.spilled) remove(store.spillPath.c_str());
+    }
+}
+
+// Batch buffers, allocated once per stream
+struct OBJBatchBuilder {
+    ModelArray<OBJCorner> corners;
+    ModelArray<GLuint> indices;
+    ModelArray<int> cornerTable;
+    size_t tableMask;
+    ModelArray<unsigned char> vertices;
+    int batches;
+    int vertexCount, indexCount;  // Totals over all emitted batches
+};
+
+// Pack the current batch, hand it to the callback and start a new one
+bool emitOBJBatch(OBJBatchBuilder& builder, const OBJAttributes& attributes,
+                  OBJBatchCallback callback, void* user) {
+    if (builder.indices.empty()) return true;
+    const float* positions = attributes.stores[OBJ_POSITIONS].data;
+    const float* texCoords = attributes.stores[OBJ_TEXCOORDS].data;
+    const float* normals = attributes.stores[OBJ_NORMALS].data;
+    SourceVertex v;
+    for (size_t i = 0; i < builder.corners.size(); i++) {
+        const OBJCorner& c = builder.corners[i];
+        const float* p = positions + (size_t)(c.position - 1) * 3;
+        v.position = Vector3(p[0], p[1], p[2]);
+        if (c.normal) {
+            const float* n = normals + (size_t)(c.normal - 1) * 3;
+            v.normal = Vector3(n[0], n[1], n[2]);
+        } else {
+            v.normal = Vector3(0, 1, 0);
+        }
+        v.u = c.texCoord ? texCoords[(size_t)(c.texCoord - 1) * 2] : 0.0f;
+        v.v = c.texCoord ? texCoords[(size_t)(c.texCoord - 1) * 2 + 1] : 0.0f;
+        ModelVertex::pack(&builder.vertices[i * ModelVertex::STRIDE], v);
+    }
+    
+    OBJBatch batch;
+    batch.vertices = &builder.vertices[0];
+    batch.vertexCount = (int)builder.corners.size();
+    batch.indices = &builder.indices[0];
+    batch.indexCount = (int)builder.indices.size();
+    builder.batches++;
+    builder.vertexCount += batch.vertexCount;
+    builder.indexCount += batch.indexCount;
+    
+    builder.corners.clear();
+    builder.indices.clear();
+    std::fill(builder.cornerTable.begin(), builder.cornerTable.end(), -1);
+    return callback(batch, user);
+}
+
+bool streamOBJ(const char* filename, const OBJStreamOptions& options, OBJBatchCallback callback, void* user) {
+    printf("Streaming OBJ model: %s\n", filename);
+    
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        printf("Error: Could not open OBJ file: %s\n", filename);
+        return false;
+    }
+    
+    // Batch buffers come out of the budget first; attributes get the rest
+    size_t batchCorners = (size_t)(options.batchTriangles > 0 ? options.batchTriangles : 1) * 3;
+    size_t tableSize = 1;
+    while (tableSize < batchCorners * 2) tableSize <<= 1;
+    size_t batchBytes = batchCorners * (sizeof(OBJCorner) + sizeof(GLuint) + ModelVertex::STRIDE) +
+                        tableSize * sizeof(int);
+    OBJAttributes attributes;
+    initOBJAttributes(attributes, filename, options.memoryBudget > batchBytes ? options.memoryBudget - batchBytes : 0);
+    
+    // Pass 1: attribute records
+    char line[MAX_LINE_LENGTH];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        float r[3];
+        if (strncmp(line, "v ", 2) == 0) {
+            if (sscanf(line + 2, "%f %f %f", &r[0], &r[1], &r[2]) == 3) ok = appendOBJAttribute(attributes, OBJ_POSITIONS, r);
+        } else if (strncmp(line, "vn ", 3) == 0) {
+            if (sscanf(line + 3, "%f %f %f", &r[0], &r[1], &r[2]) == 3) ok = appendOBJAttribute(attributes, OBJ_NORMALS, r);
+        } else if (strncmp(line, "vt ", 3) == 0) {
+            if (sscanf(line + 3, "%f %f", &r[0], &r[1]) == 2) ok = appendOBJAttribute(attributes, OBJ_TEXCOORDS, r);
+        }
+    }
+    ok = ok && finishOBJAttributes(attributes);
+    
+    // Pass 2: faces, validated against the records defined before them
+    OBJBatchBuilder builder;
+    builder.corners.reserve(batchCorners);
+    builder.indices.reserve(batchCorners);
+    builder.cornerTable.assign(tableSize, -1);
+    builder.tableMask = tableSize - 1;
+    builder.vertices.resize(batchCorners * ModelVertex::STRIDE);
+    builder.batches = builder.vertexCount = builder.indexCount = 0;
+    int seen[3] = { 0, 0, 0 };
+    rewind(file);
+    while (ok && fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "v ", 2) == 0) seen[OBJ_POSITIONS]++;
+        else if (strncmp(line, "vn ", 3) == 0) seen[OBJ_NORMALS]++;
+        else if (strncmp(line, "vt ", 3) == 0) seen[OBJ_TEXCOORDS]++;
+        else if (strncmp(line, "f ", 2) == 0) {
+            int v[3], vt[3], vn[3];
+            if (!parseOBJFace(line + 2, std::min(seen[OBJ_POSITIONS], attributes.stores[OBJ_POSITIONS].count),
+                              std::min(seen[OBJ_TEXCOORDS], attributes.stores[OBJ_TEXCOORDS].count),
+                              std::min(seen[OBJ_NORMALS], attributes.stores[OBJ_NORMALS].count), v, vt, vn)) {
+                continue;
+            }
+            if (builder.indices.size() + 3 > batchCorners) {
+                ok = emitOBJBatch(builder, attributes, callback, user);
+            }
+            for (int k = 0; k < 3; k++) {
+                builder.indices.push_back(addOBJCorner(builder.cornerTable, builder.tableMask, builder.corners,
+                                                       v[k], vt[k], vn[k]));
+            }
+        }
+    }
+    ok = ok && emitOBJBatch(builder, attributes, callback, user);
+    fclose(file);
+    releaseOBJAttributes(attributes);
+    
+    if (ok) {
+        printf("Streamed OBJ: %s (%d batches, %d vertices, %d indices%s)\n", filename, builder.batches,
+               builder.vertexCount, builder.indexCount, attributes.spilled ? ", attributes spilled to disk" : "");
+    }
+    return ok;
+}
+
+bool writeOBJBatchToCache(const OBJBatch& batch, void* user) {
+    return addModelCacheMesh(*(ModelCacheWriter*)user, batch.vertices, batch.vertexCount,
+                             batch.indices, batch.indexCount);
+}
+
+// Stream an OBJ file into its model cache without ever holding the whole model
+bool streamOBJToCache(const char* filename, const OBJStreamOptions& options) {
+    ModelCacheWriter writer;
+    if (!beginModelCache(writer, filename)) return false;
+    bool ok = streamOBJ(filename, options, writeOBJBatchToCache, &writer);
+    return finishModelCache(writer, ok);
+}
+
+// Vertex and index buffers by the hash of the arena they hold (see AssetDedupStats)
+struct SharedModelBuffers {
+    GLuint vertexBuffer, indexBuffer;
+};
+
+std::map<unsigned long long, SharedModelBuffers> modelBuffersByContent;
+
+unsigned long long hashModelBuffers(const Model& model, const unsigned char* vertices, const GLuint* indices) {
+    int counts[2] = { model.vertexCount, model.indexCount };
+    unsigned long long hash = hashAssetBytes(counts, sizeof(counts));
+    hash = hashAssetBytes(vertices, (size_t)model.vertexCount * ModelVertex::STRIDE, hash);
+    return hashAssetBytes(indices, (size_t)model.indexCount * sizeof(GLuint), hash);
+}
+
+// Buffers already holding the model's data, if any (counts the request)
+bool findSharedModelBuffers(const Model& model, unsigned long long hash, SharedModelBuffers& buffers) {
+    std::lock_guard<std::mutex> lock(sharedGPUResourceMutex);
+    assetDedupStats.modelBuffers++;
+    std::map<unsigned long long, SharedModelBuffers>::const_iterator shared = modelBuffersByContent.find(hash);
+    if (shared == modelBuffersByContent.end()) return false;
+    buffers = shared->second;
+    assetDedupStats.sharedModelBuffers++;
+    assetDedupStats.modelBytesSaved += (size_t)model.vertexCount * ModelVertex::STRIDE +
+                                       (size_t)model.indexCount * sizeof(GLuint);
+    printf("Model %s has the same geometry as one already uploaded, sharing its buffers\n",
+           model.sourcePath.c_str());
+    return true;
+}
+
+// Register new buffers; like addTextureByContent, hands back the registered
+// pair and returns false if identical data got there first
+bool addSharedModelBuffers(const Model& model, unsigned long long hash, SharedModelBuffers& buffers) {
+    std::lock_guard<std::mutex> lock(sharedGPUResourceMutex);
+    std::pair<std::map<unsigned long long, SharedModelBuffers>::iterator, bool> added =
+        modelBuffersByContent.insert(std::make_pair(hash, buffers));
+    if (added.second) return true;
+    buffers = added.first->second;
+    assetDedupStats.sharedModelBuffers++;
+    assetDedupStats.modelBytesSaved += (size_t)model.vertexCount * ModelVertex::STRIDE +
+                                       (size_t)model.indexCount * sizeof(GLuint);
+    return false;
+}
+
+// Create a model's GPU buffers from vertex and index data laid out like the
+// arena, or reuse the buffers of a model with identical data
+void uploadModelBuffers(Model& model, const unsigned char* vertices, const GLuint* indices) {
+    size_t vertexBytes = (size_t)model.vertexCount * ModelVertex::STRIDE;
+    size_t indexBytes = (size_t)model.indexCount * sizeof(GLuint);
+    unsigned long long hash = hashModelBuffers(model, vertices, indices);
+    SharedModelBuffers shared;
+    if (findSharedModelBuffers(model, hash, shared)) {
+        model.vertexBuffer = shared.vertexBuffer;
+        model.indexBuffer = shared.indexBuffer;
+        return;
+    }
+    
+    pglGenBuffers(1, &model.vertexBuffer);
+    pglGenBuffers(1, &model.indexBuffer);
+    cachedBindBuffer(GL_ARRAY_BUFFER, model.vertexBuffer);
+    pglBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices, GL_STATIC_DRAW);
+    cachedBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.indexBuffer);
+    pglBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW);
+    cachedBindBuffer(GL_ARRAY_BUFFER, 0);
+    cachedBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    SharedModelBuffers buffers = { model.vertexBuffer, model.indexBuffer };
+    if (!addSharedModelBuffers(model, hash, buffers)) {
+        pglDeleteBuffers(1, &model.vertexBuffer);
+        pglDeleteBuffers(1, &model.indexBuffer);
+        model.vertexBuffer = buffers.vertexBuffer;
+        model.indexBuffer = buffers.indexBuffer;
+    }
+}
+
+// Forget every shared GPU resource (their names die with the GL context)
+void clearSharedGPUResources() {
+    std::lock_guard<std::mutex> lock(sharedGPUResourceMutex);
+    textureCache.clear();
+    texturesByContent.clear();
+    modelBuffersByContent.clear();
+}
+
+void printAssetDedupReport() {
+    std::lock_guard<std::mutex> lock(sharedGPUResourceMutex);
+    printf("Asset dedup: %d of %d textures shared (%.1f KB saved), %d of %d model buffers shared (%.1f KB saved)\n",
+           assetDedupStats.sharedTextures, assetDedupStats.textures, assetDedupStats.textureBytesSaved / 1024.0,
+           assetDedupStats.sharedModelBuffers, assetDedupStats.modelBuffers,
+           assetDedupStats.modelBytesSaved / 1024.0);
+}
+
+// Copy a loaded model's arena into GPU buffers (needs a GL context; without
+// buffer support the meshes keep drawing from client memory)
+void uploadModel(Model& model) {
+    if (!glBuffersSupported || model.indexCount == 0 || model.vertexBuffer != 0) return;
+    const Model& data = model;  // The arena, or the model's range of the pak
+    uploadModelBuffers(model, getModelVertices(data), getModelIndices(data));
+}
+
+// Weld the arena's positions (exact matches) into the compact collision copy
+void buildModelCollision(Model& model) {
+    const Model& data = model;
+    const unsigned char* vertices = getModelVertices(data);
+    const GLuint* indices = getModelIndices(data);
+    size_t tableSize = 1;
+    while (tableSize < (size_t)model.vertexCount * 2) tableSize <<= 1;
+    ModelArray<int> table(tableSize, -1);  // Slot -> first vertex with that position
+    ModelArray<GLuint> remap(model.vertexCount);
+    
+    // First pass finds the unique positions, so the kept array is sized exactly
+    int uniqueCount = 0;
+    for (int i = 0; i < model.vertexCount; i++) {
+        const unsigned char* p = vertices + (size_t)i * ModelVertex::STRIDE + VertexOffset<Pos3f, ModelVertex>::VALUE;
+        float position[3];
+        memcpy(position, p, sizeof(position));
+        size_t slot = hashWeldKey(position, 3) & (tableSize - 1);
+        while (table[slot] >= 0) {
+            const unsigned char* q = vertices + (size_t)table[slot] * ModelVertex::STRIDE +
+                                     VertexOffset<Pos3f, ModelVertex>::VALUE;
+            if (memcmp(p, q, sizeof(position)) == 0) break;
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if (table[slot] < 0) {
+            table[slot] = i;
+            remap[i] = uniqueCount++;
+        } else {
+            remap[i] = remap[table[slot]];
+        }
+    }
+    
+    model.collisionPositions.resize(uniqueCount);
+    for (int i = 0; i < model.vertexCount; i++) {
+        const unsigned char* p = vertices + (size_t)i * ModelVertex::STRIDE + VertexOffset<Pos3f, ModelVertex>::VALUE;
+        memcpy(&model.collisionPositions[remap[i]], p, sizeof(Vector3));
+    }
+    model.collisionIndices.resize(model.indexCount);
+    for (size_t m = 0; m < model.meshes.size(); m++) {
+        const Mesh& mesh = model.meshes[m];
+        for (int i = 0; i < mesh.indexCount; i++) {
+            model.collisionIndices[mesh.firstIndex + i] = remap[mesh.firstVertex + indices[mesh.firstIndex + i]];
+        }
+    }
+}
+
+// Drop the CPU data the model's residency does not keep. Only models drawn
+// from GPU buffers can let go of their arena.
+void applyModelResidency(Model& model) {
+    if (model.residency == MODEL_RESIDENCY_FULL || (model.arena.empty() && !model.mappedArena)) return;
+    if (model.vertexBuffer == 0) return;
+    if (model.residency == MODEL_RESIDENCY_COLLISION) {
+        buildModelCollision(model);
+    }
+    ModelArray<unsigned char>().swap(model.arena);
+    model.mappedArena = NULL;
+    model.cacheMapping.release();
+}
+
+// Use a model cooked into the asset pak. Nothing is copied: the arena stays in
+// the mapping and only the mesh table is read out.
+bool loadModelFromPak(const char* filename, Model& model) {
+    const AssetPakEntry* entry = findAsset(filename, ASSET_MODEL);
+    if (!entry) return false;
+    int vertexCount = entry->info[0], indexCount = entry->info[1], meshCount = entry->info[2];
+    size_t arenaSize = (size_t)vertexCount * ModelVertex::STRIDE + (size_t)indexCount * sizeof(GLuint);
+    if (vertexCount < 0 || indexCount < 0 || meshCount <= 0 ||
+        (size_t)entry->size != arenaSize + (size_t)meshCount * sizeof(ModelCacheMesh)) {
+        printf("Warning: Bad asset pak entry for %s\n", filename);
+        return false;
+    }
+    
+    model.mappedArena = getAssetData(entry);
+    model.vertexCount = vertexCount;
+    model.indexCount = indexCount;
+    const ModelCacheMesh* entries = (const ModelCacheMesh*)(model.mappedArena + arenaSize);
+    model.meshes.reserve(meshCount);
+    for (int m = 0; m < meshCount; m++) {
+        Mesh mesh;
+        mesh.firstVertex = entries[m].firstVertex;
+        mesh.vertexCount = entries[m].vertexCount;
+        mesh.firstIndex = entries[m].firstIndex;
+        mesh.indexCount = entries[m].indexCount;
+        model.meshes.push_back(std::move(mesh));
+    }
+    printf("Loaded model from asset pak: %s (%d meshes, %d vertices, %d indices)\n",
+           filename, meshCount, vertexCount, indexCount);
+    return true;
+}
+
+// OBJ files too large to parse in memory, which go through streamOBJToCache
+bool isStreamedModel(const char* filename) {
+    const char* ext = strrchr(filename, '.');
+    long long sourceSize, sourceTime;
+    return ext && strcasecmp(ext, ".obj") == 0 && getModelSourceStamp(filename, sourceSize, sourceTime) &&
+           sourceSize > OBJ_STREAM_THRESHOLD;
+}
+
+// Run the parser for the file's format
+bool parseModelFile(const char* filename, Model& model) {
     const char* ext = strrchr(filename, '.');
     if (!ext) {
         printf("Error: No file extension found in: %s\n", filename);
         return false;
     }
+    if (strcasecmp(ext, ".obj") == 0) return loadOBJ(filename, model);
+    if (strcasecmp(ext, ".3ds") == 0) return load3DS(filename, model);
+    if (strcasecmp(ext, ".ply") == 0) return loadPLY(filename, model);
+    if (strcasecmp(ext, ".stl") == 0) return loadSTL(filename, model);
+    printf("Error: Unsupported file format: %s\n", ext);
+    return false;
+}
+
+// Parse a source (or stream it, if large) and write its cache
+bool cookModelCache(const char* filename) {
+    if (isStreamedModel(filename)) return streamOBJToCache(filename, OBJStreamOptions());
+    Model model;
+    return parseModelFile(filename, model) && saveModelCache(filename, model);
+}
+
+// Load model - uses the asset pak if it has the model, then the binary cache
+// when it is current, otherwise detects the format, runs the appropriate
+// parser and writes a new cache
+bool loadModel(const char* filename, Model& model) {
+    PROFILE_FUNCTION();
+    int allocationsBefore = modelLoadStats.allocations;
+    size_t bytesBefore = modelLoadStats.liveBytes;
+    modelLoadStats.peakBytes = bytesBefore;
+    model.sourcePath = filename;
     
-    // Load based on extension
-    if (strcasecmp(ext, ".obj") == 0) {
-        return loadOBJ(filename, model);
-    } else if (strcasecmp(ext, ".3ds") == 0 || strcasecmp(ext, ".3DS") == 0) {
-        return load3DS(filename, model);
-    } else {
-        printf("Error: Unsupported file format: %s\n", ext);
-        return false;
+    bool loaded = loadModelFromPak(filename, model) || loadModelCache(filename, model);
+    if (!loaded && assetManifest.models.count(filename)) {
+        printf("  %s changed since the last asset build\n", filename);
+    }
+    if (!loaded && isStreamedModel(filename)) {
+        // Too large to parse in memory: stream it into the cache, then load that
+        loaded = streamOBJToCache(filename, OBJStreamOptions()) && loadModelCache(filename, model);
+    } else if (!loaded) {
+        loaded = parseModelFile(filename, model);
+        if (loaded) {
+            saveModelCache(filename, model);
+        }
     }
+    
+    printf("  Load memory: %d allocations, %.1f KB peak, %.1f KB kept\n",
+           modelLoadStats.allocations - allocationsBefore,
+           (modelLoadStats.peakBytes - bytesBefore) / 1024.0,
+           (modelLoadStats.liveBytes - bytesBefore) / 1024.0);
+    return loaded;
 }
 
-// Render a loaded model
-void renderModel(const Model& model) {
-    glPushMatrix();
-    glTranslatef(model.offset.x, model.offset.y, model.offset.z);
-    glScalef(model.scale, model.scale, model.scale);
+// Recreate a model's GPU buffers after the GL context was lost. The data comes
+// from the arena if it is resident, else straight from the asset pak or the
+// mapped cache file, else from reparsing the source. Call
+// clearSharedGPUResources once before restoring, so models are not handed
+// buffer names from the old context.
+bool restoreModelBuffers(Model& model) {
+    model.vertexBuffer = 0;  // Names from the old context are gone
+    model.indexBuffer = 0;
+    if (!glBuffersSupported || model.indexCount == 0) return false;
+    if (!model.arena.empty() || model.mappedArena) {
+        uploadModel(model);
+        return true;
+    }
+    
+    const AssetPakEntry* entry = findAsset(model.sourcePath.c_str(), ASSET_MODEL);
+    if (entry && entry->info[0] == model.vertexCount && entry->info[1] == model.indexCount) {
+        const unsigned char* vertices = getAssetData(entry);
+        uploadModelBuffers(model, vertices, (const GLuint*)(vertices + (size_t)model.vertexCount * ModelVertex::STRIDE));
+        return true;
+    }
+    
+    MappedFile cache;
+    if (mapFile(getModelCachePath(model.sourcePath).c_str(), cache)) {
+        const ModelCacheHeader* header = getValidModelCache(model.sourcePath.c_str(), cache);
+        if (header && header->vertexCount == model.vertexCount && header->indexCount == model.indexCount) {
+            const unsigned char* vertices = cache.data + MODEL_CACHE_ARENA_OFFSET;
+            uploadModelBuffers(model, vertices,
+                               (const GLuint*)(vertices + (size_t)model.vertexCount * ModelVertex::STRIDE));
+            unmapFile(cache);
+            return true;
+        }
+        unmapFile(cache);
+    }
     
+    Model reloaded;
+    if (!loadModel(model.sourcePath.c_str(), reloaded) ||
+        reloaded.vertexCount != model.vertexCount || reloaded.indexCount != model.indexCount) {
+        printf("Error: Could not restore buffers for %s\n", model.sourcePath.c_str());
+        return false;
+    }
+    uploadModelBuffers(model, getModelVertices(reloaded), getModelIndices(reloaded));
+    return true;
+}
+
+// Draw a model's meshes in the current model space, without its offset/scale
+// (for callers that have already folded those into a cached transform)
+void renderModelMeshes(const Model& model) {
     for (size_t m = 0; m < model.meshes.size(); m++) {
         const Mesh& mesh = model.meshes[m];
         
-        if (mesh.textureID != 0) {
-            glEnable(GL_TEXTURE_2D);
-            glBindTexture(GL_TEXTURE_2D, mesh.textureID);
-        }
+        // Texture state goes through the cache, so consecutive meshes sharing
+        // a texture (or untextured meshes) do not toggle GL_TEXTURE_2D
+        cachedUseTexture(mesh.textureID);
+        if (mesh.indexCount == 0) continue;
+        enableVertexFormatArrays<ModelVertex>();
         
-        glBegin(GL_TRIANGLES);
-        for (size_t i = 0; i < mesh.vertices.size(); i++) {
-            if (i < mesh.normals.size()) {
-                glNormal3f(mesh.normals[i].x, mesh.normals[i].y, mesh.normals[i].z);
-            }
-            if (i < mesh.texCoords.size() && mesh.textureID != 0) {
-                glTexCoord2f(mesh.texCoords[i].u, mesh.texCoords[i].v);
+        // Array pointers only need to be set when the source mesh changes
+        size_t vertexOffset = (size_t)mesh.firstVertex * ModelVertex::STRIDE;
+        if (glState.arraySource != &mesh) {
+            if (model.vertexBuffer != 0) {
+                cachedBindBuffer(GL_ARRAY_BUFFER, model.vertexBuffer);
+                setVertexFormatPointers<ModelVertex>((const unsigned char*)vertexOffset);
+            } else {
+                if (glBuffersSupported) cachedBindBuffer(GL_ARRAY_BUFFER, 0);
+                setVertexFormatPointers<ModelVertex>(getModelVertices(model) + vertexOffset);
             }
-            glVertex3f(mesh.vertices[i].x, mesh.vertices[i].y, mesh.vertices[i].z);
+            glState.arraySource = &mesh;
+            renderStats.stateChanges++;
         }
-        glEnd();
         
-        if (mesh.textureID != 0) {
-            glDisable(GL_TEXTURE_2D);
+        if (model.indexBuffer != 0) {
+            cachedBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.indexBuffer);
+            glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT,
+                           (const void*)((size_t)mesh.firstIndex * sizeof(GLuint)));
+        } else {
+            if (glBuffersSupported) cachedBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, getModelIndices(model) + mesh.firstIndex);
         }
+        renderStats.drawCalls++;
     }
     
+    // Other array users (primitives, terrain) do not manage texture coordinates
+    cachedEnable(GL_TEXTURE_COORD_ARRAY, false);
+}
+
+// Render a loaded model
+void renderModel(const Model& model) {
+    glPushMatrix();
+    glTranslatef(model.offset.x, model.offset.y, model.offset.z);
+    glScalef(model.scale, model.scale, model.scale);
+    renderModelMeshes(model);
     glPopMatrix();
 }
 
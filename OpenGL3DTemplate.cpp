@@ -9,22 +9,53 @@
 #include <math.h>
 #include <time.h>
 #include "ModelLoader.h"
+#include "Level.h"
+#include "Visibility.h"
+#include "Primitives.h"
+#include "Terrain.h"
+#include "Lighting.h"
+#include "Shadows.h"
+#include "Sky.h"
+#include "SceneGraph.h"
+#include "BakedLighting.h"
+#include "UploadThread.h"
+#include "JobSystem.h"
+#include "SimThread.h"
 
 // Constants
-#define PI 3.14159265359f
 #define MAX_PITCH 89.0f
 #define MIN_PITCH -89.0f
 
-// Camera and player state (mailman at center of scene)
+// Camera and player state (mailman at center of scene). This and the time,
+// animation and package state below belong to the simulation; the renderer
+// reads them from GameSnapshot.
 float playerX = 0.0f, playerY = 1.5f, playerZ = 0.0f;
 float cameraYaw = 0.0f, cameraPitch = 0.0f;
 float playerVelY = 0.0f;
 bool isJumping = false;
 bool isCrouching = false;
 bool thirdPerson = false;
+bool showRenderStats = false;
+int renderFrameCount = 0;  // Frames drawn (frameCount counts simulation steps)
 
-// Movement keys state
-bool keyW = false, keyA = false, keyS = false, keyD = false;
+// Frame time, averaged over the render stats interval
+int lastFrameTime = 0;
+int frameTimeTotal = 0;
+int frameTimeSamples = 0;
+
+// Extra street lamps for the lighting stress scene (--stress-lamps)
+int stressLampCount = 0;
+
+// Threads for the job system, including the main one (--threads; 0 = one per core)
+int jobThreadCount = 0;
+
+// Frame pacing: vsync (--no-vsync turns it off) and a frame cap (--fps; 0 = none)
+bool vsyncEnabled = true;
+int frameRateCap = 0;
+
+// Record profiler scopes from startup, loading included, and write the
+// trace at exit (--profile)
+bool profileFromStart = false;
 
 // Mouse state
 int lastMouseX = 400, lastMouseY = 300;
@@ -35,18 +66,24 @@ float sunAngle = 0.0f;
 float lampFlicker = 0.0f;
 int frameCount = 0;
 
+// Rates per second of simulation time (tuned as per-frame amounts at 60 fps)
+const float PLAYER_WALK_SPEED = 6.0f;
+const float PLAYER_CROUCH_SPEED = 3.0f;
+const float PLAYER_JUMP_SPEED = 18.0f;
+const float GRAVITY = 72.0f;
+const float SUN_SPEED = 3.0f;            // Degrees
+const float LAMP_FLICKER_RATE = 6.0f;    // Radians
+const float PACKAGE_SPIN_SPEED = 30.0f;  // Degrees
+
 // Collected packages
 int packagesCollected = 0;
 const int TOTAL_PACKAGES = 5;
 
-// Crop field dimensions
-const int NORTH_FIELD_CROP_COLUMNS = 6;
-const int SOUTH_FIELD_CROP_COLUMNS = 5;
-
 // Package positions
 struct Package {
     float x, y, z;
     bool collected;
+    int node;  // Scene graph node, built in main
 };
 
 // Package positions (spread out across the rural landscape)
@@ -58,6 +95,43 @@ Package packages[TOTAL_PACKAGES] = {
     {28.0f, 0.5f, -18.0f, false}     // Near northeast area
 };
 
+// What the renderer needs from one simulation step
+struct GameSnapshot {
+    float playerX, playerY, playerZ;
+    float cameraYaw, cameraPitch;
+    bool isCrouching;
+    float sunAngle, lampFlicker;
+    int frameCount;                    // Simulation steps so far
+    float time;                        // Simulation seconds so far
+    double stepTime;                   // Clock time the step ends at
+    bool collected[TOTAL_PACKAGES];
+};
+
+// The last two steps, which the renderer blends between
+struct GameFrame {
+    GameSnapshot previous, current;
+};
+
+// Player input from the GLUT callbacks, for the simulation
+struct GameInput {
+    bool keyW, keyA, keyS, keyD;
+    bool crouching;
+    int jumps;                         // Jump presses so far
+    float cameraYaw, cameraPitch;
+};
+
+// Snapshots go from the simulation to the renderer, input the other way
+TripleBuffer<GameFrame> snapshots;
+TripleBuffer<GameInput> inputs;
+GameInput input = { false, false, false, false, false, 0, 0.0f, 0.0f };  // Owned by the callbacks
+int jumpsHandled = 0;
+GameSnapshot lastSnapshot;   // The simulation's last published step
+GameSnapshot renderView;     // The blended state the current frame draws
+
+// Run the simulation steps in the idle callback instead of on their own
+// thread (--serial-sim, for comparison)
+bool serialSimulation = false;
+
 // 3D Models
 Model mailmanModel;
 Model treeModel;
@@ -73,88 +147,142 @@ Model grassBlockModel;
 
 // Model loading flags
 bool modelsLoaded = false;
-
-// Model file paths - Using .obj and .3ds formats (Assimp no longer needed)
-// Note: Some models may need to be exported from .blend to .obj using Blender if not available
-const char* MODEL_PATH_PLAYER = "models/98-hikerbasemesh/Player.obj";  // Export from Player.blend if needed
-const char* MODEL_PATH_TREE = "models/tree/tree1_3ds/Tree1.3ds";
-const char* MODEL_PATH_ROCK1 = "models/1elmla01hh-Rock1_BYTyroSmith/Rock1/Rock1.obj";
-const char* MODEL_PATH_ROCKSET = "models/xvs3wxwo2o-RockSet_MadeByTyroSmith/RockSet/RockSet.obj";
-const char* MODEL_PATH_FARMHOUSE = "models/4vd2sk31doow-farmhouse_maya16/Farmhouse Maya 2016 Updated/farmhouse_obj.obj";
-const char* MODEL_PATH_STREETLAMP = "models/s3duldjjt9fk-StreetLampByTyroSmith/Street Lamp/StreetLamp.obj";
-const char* MODEL_PATH_FENCE = "models/6od9waw1za0w-fence/fence/cerca.obj";  // Export from cerca.blend if needed
-const char* MODEL_PATH_WHEAT = "models/10458_Wheat_Field_v1_L3.123c5ecd0518-ae16-4fee-bf80-4177de196237/10458_Wheat_Field_v1_L3.123c5ecd0518-ae16-4fee-bf80-4177de196237/10458_Wheat_Field_v1_max2010_it2.obj";
-const char* MODEL_PATH_CARROT = "models/Carrot_v01_l3.123c059c383a-f43b-48c0-b28a-bec318013e17/Carrot_v01_l3.123c059c383a-f43b-48c0-b28a-bec318013e17/10170_Carrot_v01_L3.obj";
-const char* MODEL_PATH_GRASSBLOCK = "models/grass-block/grass-block.3DS";
-const char* MODEL_PATH_TREE_ALT = "models/15od5xhlv2jc-Tree_02/Tree 02/Tree.obj";
-
+size_t modelBytesBeforeUpload = 0;
+bool modelUploadsReported = false;
 
 // Forward declarations
 void loadAllModels();
+void reportModelUploads();
 void drawPlayer();
 void drawMailBag();
-void drawTerrain();
-void drawHouse(float x, float z, float scale);
-void drawTree(float x, float z, float height);
-void drawFence(float x, float z, float length, float rotation);
-void drawRock(float x, float z, float size);
-void drawCrop(float x, float z);
-void drawGrassBlock(float x, float z);
-void drawStreetLamp(float x, float z);
-void drawPackage(float x, float y, float z);
+void drawHouse(float scale);
+void drawTree(float height);
+void drawFence(float length);
+void drawRock(float size);
+void drawCrop();
+void drawGrassBlock();
+void drawStreetLamp();
+void drawPackage();
+void drawLevelObject(const LevelObject& obj);
 void setupLighting();
-void updateSunLight();
-void updateLampLights();
+void updateSunLight(float sunAngle);
+
+// A model for loadModels to load, and whether it did
+struct ModelLoadJob {
+    const char* path;
+    Model* model;
+    bool loaded;
+    size_t keptBytes;     // Model memory the load left allocated
+};
+
+// Load models [begin, end) of a ModelLoadJob array (a parallelFor range)
+void loadModelRange(void* data, int begin, int end) {
+    ModelLoadJob* loads = (ModelLoadJob*)data;
+    for (int i = begin; i < end; i++) {
+        size_t bytesBefore = modelLoadStats.liveBytes;
+        loads[i].loaded = loadModel(loads[i].path, *loads[i].model);
+        loads[i].keptBytes = modelLoadStats.liveBytes - bytesBefore;
+        modelLoadStats.liveBytes = bytesBefore;
+    }
+}
+
+// Load several models at once on the job threads. Loading only touches the
+// model it fills (and per-thread allocation totals), so the files are parsed
+// or mapped side by side. The models are freed on the main thread later, so
+// the memory they keep is moved into its totals.
+void loadModels(ModelLoadJob* loads, int count) {
+    parallelFor(count, 1, loadModelRange, loads);
+    for (int i = 0; i < count; i++) {
+        modelLoadStats.liveBytes += loads[i].keptBytes;
+    }
+}
 
 // Load all 3D models from the models directory (now using native .obj and .3ds parsers!)
 void loadAllModels() {
+    PROFILE_FUNCTION();
     printf("Loading 3D models with native OBJ/3DS parsers...\n");
     
     // Seed random number generator for model variation
     srand((unsigned int)time(NULL));
     
+    // Cooked models come from the asset pak when it has been built (make pak);
+    // anything it lacks falls back to the loose files below
+    if (!openAssetPak(ASSET_PAK_PATH, ModelVertex::STRIDE)) {
+        printf("No asset pak (%s), loading loose model files\n", ASSET_PAK_PATH);
+    }
+    // The asset build (make assets) leaves every model's cache current
+    if (loadAssetManifest(ASSET_MANIFEST_PATH, assetManifest)) {
+        printf("Asset manifest: %d models cooked by the last asset build\n", (int)assetManifest.models.size());
+    }
+    
+    // Every model loads at once; each one's settings are applied below
+    ModelLoadJob loads[] = {
+        { MODEL_PATH_PLAYER, &mailmanModel, false, 0 },
+        { MODEL_PATH_TREE, &treeModel, false, 0 },
+        { MODEL_PATH_ROCK1, &rockModel, false, 0 },
+        { MODEL_PATH_ROCKSET, &rockSetModel, false, 0 },
+        { MODEL_PATH_FARMHOUSE, &houseModel, false, 0 },
+        { MODEL_PATH_STREETLAMP, &streetLampModel, false, 0 },
+        { MODEL_PATH_FENCE, &fenceModel, false, 0 },
+    };
+    int loadCount = sizeof(loads) / sizeof(loads[0]);
+    loadModels(loads, loadCount);
+    auto loaded = [&](const Model& model) {
+        for (int i = 0; i < loadCount; i++) {
+            if (loads[i].model == &model) return loads[i].loaded;
+        }
+        return false;
+    };
+    
     // Load mailman model from Player.obj (exported from Player.blend using Blender)
-    if (loadModel(MODEL_PATH_PLAYER, mailmanModel)) {
+    if (loaded(mailmanModel)) {
         mailmanModel.scale = 0.02f;  // Increased scale for better visibility
         mailmanModel.offset = Vector3(0, 0, 0);
+        mailmanModel.residency = MODEL_RESIDENCY_NONE;
         printf("  Mailman model loaded from .obj file!\n");
     } else {
         printf("  Mailman .obj model not available, using primitives\n");
     }
     
     // Load tree model
-    if (loadModel(MODEL_PATH_TREE, treeModel)) {
+    if (loaded(treeModel)) {
         treeModel.scale = 0.05f;  // Increased scale for better visibility
         treeModel.offset = Vector3(0, 0, 0);
+        treeModel.residency = MODEL_RESIDENCY_NONE;
     }
     
     // Load rock models (now using .obj files)
-    if (loadModel(MODEL_PATH_ROCK1, rockModel)) {
+    if (loaded(rockModel)) {
         rockModel.scale = 0.02f;  // Increased for better visibility
         rockModel.offset = Vector3(0, 0, 0);
+        rockModel.residency = MODEL_RESIDENCY_COLLISION;
     }
     
-    if (loadModel(MODEL_PATH_ROCKSET, rockSetModel)) {
+    if (loaded(rockSetModel)) {
         rockSetModel.scale = 0.02f;  // Increased for better visibility
         rockSetModel.offset = Vector3(0, 0, 0);
+        rockSetModel.residency = MODEL_RESIDENCY_COLLISION;
     }
     
     // Load house model from OBJ (Maya export)
-    if (loadModel(MODEL_PATH_FARMHOUSE, houseModel)) {
-        houseModel.scale = 0.015f;  // Adjusted scale for proper sizing
+    if (loaded(houseModel)) {
+        houseModel.scale = LEVEL_HOUSE_MODEL_SCALE;  // Adjusted scale for proper sizing
         houseModel.offset = Vector3(0, 0, 0);
+        houseModel.residency = MODEL_RESIDENCY_COLLISION;
     }
     
     // Load street lamp model (now using .obj file)
-    if (loadModel(MODEL_PATH_STREETLAMP, streetLampModel)) {
+    if (loaded(streetLampModel)) {
         streetLampModel.scale = 0.02f;  // Increased for better visibility
         streetLampModel.offset = Vector3(0, 0, 0);
+        streetLampModel.residency = MODEL_RESIDENCY_COLLISION;
     }
     
     // Load fence model (now using .obj file exported from cerca.blend)
-    if (loadModel(MODEL_PATH_FENCE, fenceModel)) {
+    if (loaded(fenceModel)) {
         fenceModel.scale = 0.02f;  // Increased for better visibility
         fenceModel.offset = Vector3(0, 0, 0);
+        fenceModel.residency = MODEL_RESIDENCY_COLLISION;
     }
     
     // Load wheat model - DISABLED due to high poly count causing rendering issues
@@ -163,6 +291,7 @@ void loadAllModels() {
     if (loadModel(MODEL_PATH_WHEAT, wheatModel)) {
         wheatModel.scale = 0.001f;  // Very small scale for high-poly model
         wheatModel.offset = Vector3(0, 0, 0);
+        wheatModel.residency = MODEL_RESIDENCY_NONE;
     }
     */
     
@@ -172,6 +301,7 @@ void loadAllModels() {
     if (loadModel(MODEL_PATH_CARROT, carrotModel)) {
         carrotModel.scale = 0.001f;  // Very small scale for high-poly model
         carrotModel.offset = Vector3(0, 0, 0);
+        carrotModel.residency = MODEL_RESIDENCY_NONE;
     }
     */
     
@@ -181,54 +311,89 @@ void loadAllModels() {
     if (loadModel(MODEL_PATH_GRASSBLOCK, grassBlockModel)) {
         grassBlockModel.scale = 0.01f;  // Much smaller scale
         grassBlockModel.offset = Vector3(0, 0, 0);
+        grassBlockModel.residency = MODEL_RESIDENCY_NONE;
     }
     */
     
+    // Packed vertices go to GPU buffers once; drawing then only binds them.
+    // The copies run on the upload thread, and models draw from their CPU
+    // data until theirs land. Solid objects keep a welded collision copy, the
+    // rest drop their CPU data once uploaded.
+    Model* loadedModels[] = { &mailmanModel, &treeModel, &fenceModel, &rockModel, &rockSetModel, &houseModel,
+                              &cottageModel, &streetLampModel, &wheatModel, &carrotModel, &grassBlockModel };
+    modelBytesBeforeUpload = modelLoadStats.liveBytes;
+    for (size_t i = 0; i < sizeof(loadedModels) / sizeof(loadedModels[0]); i++) {
+        queueModelUpload(*loadedModels[i]);
+    }
+    if (pollUploads() == 0) {
+        reportModelUploads();
+    }
+    
     modelsLoaded = true;
     printf("Models loaded successfully!\n");
 }
 
+// Once every queued model upload has been published, report what the models
+// still keep in RAM
+void reportModelUploads() {
+    if (modelUploadsReported) return;
+    modelUploadsReported = true;
+    printf("Model CPU memory: %.1f KB resident (%.1f KB before GPU upload)\n",
+           modelLoadStats.liveBytes / 1024.0, modelBytesBeforeUpload / 1024.0);
+    printAssetDedupReport();
+}
+
+// Player scene nodes: the body follows the player every frame, and the model
+// node under it holds the model's scale and file offset
+int playerNode = SCENE_NO_NODE;
+int playerModelNode = SCENE_NO_NODE;
+
 void drawPlayer() {
-    glPushMatrix();
-    
+    PROFILE_FUNCTION();
     // Try to use loaded mailman model from Player.obj
+    bool modelRendered = false;
     if (modelsLoaded && mailmanModel.meshes.size() > 0) {
         // Render the loaded Player.obj model
         glPushMatrix();
-        glScalef(2.0f, 2.0f, 2.0f);  // Scale up the model if needed
-        renderModel(mailmanModel);
+        glMultMatrixf(getSceneNodeWorld(playerModelNode));
+        renderModelMeshes(mailmanModel);
         glPopMatrix();
-        
+        modelRendered = true;
+    }
+    
+    glPushMatrix();
+    glMultMatrixf(getSceneNodeWorld(playerNode));
+    if (modelRendered) {
         // Still add the mail bag and postal items as primitives on top
         drawMailBag();
     } else {
         // Fallback to primitives if model didn't load
         // Body (torso)
-        glColor3f(0.2f, 0.3f, 0.8f); // Blue uniform
+        cachedColor3f(0.2f, 0.3f, 0.8f); // Blue uniform
         glPushMatrix();
         glTranslatef(0, 0.8f, 0);
         glScalef(0.6f, 1.0f, 0.4f);
-        glutSolidCube(1.0f);
+        drawPrimitiveCube(1.0f);
         glPopMatrix();
         
         // Head
-        glColor3f(0.9f, 0.7f, 0.6f); // Skin tone
+        cachedColor3f(0.9f, 0.7f, 0.6f); // Skin tone
         glPushMatrix();
         glTranslatef(0, 1.6f, 0);
-        glutSolidSphere(0.3f, 20, 20);
+        drawPrimitiveSphere(0.3f);
         glPopMatrix();
         
         // Mail bag on back
         drawMailBag();
         
         // Arms
-        glColor3f(0.2f, 0.3f, 0.8f);
+        cachedColor3f(0.2f, 0.3f, 0.8f);
         // Left arm
         glPushMatrix();
         glTranslatef(-0.4f, 0.7f, 0);
         glRotatef(20, 0, 0, 1);
         glScalef(0.15f, 0.8f, 0.15f);
-        glutSolidCube(1.0f);
+        drawPrimitiveCube(1.0f);
         glPopMatrix();
         
         // Right arm
@@ -236,46 +401,46 @@ void drawPlayer() {
         glTranslatef(0.4f, 0.7f, 0);
         glRotatef(-20, 0, 0, 1);
         glScalef(0.15f, 0.8f, 0.15f);
-        glutSolidCube(1.0f);
+        drawPrimitiveCube(1.0f);
         glPopMatrix();
         
         // Legs
-        glColor3f(0.15f, 0.15f, 0.15f); // Dark pants
+        cachedColor3f(0.15f, 0.15f, 0.15f); // Dark pants
         // Left leg
         glPushMatrix();
         glTranslatef(-0.15f, 0.0f, 0);
         glScalef(0.2f, 0.8f, 0.2f);
-        glutSolidCube(1.0f);
+        drawPrimitiveCube(1.0f);
         glPopMatrix();
         
         // Right leg
         glPushMatrix();
         glTranslatef(0.15f, 0.0f, 0);
         glScalef(0.2f, 0.8f, 0.2f);
-        glutSolidCube(1.0f);
+        drawPrimitiveCube(1.0f);
         glPopMatrix();
         
         // Cap
-        glColor3f(0.2f, 0.3f, 0.8f);
+        cachedColor3f(0.2f, 0.3f, 0.8f);
         glPushMatrix();
         glTranslatef(0, 1.85f, 0);
         glScalef(1.2f, 0.3f, 1.2f);
-        glutSolidSphere(0.3f, 20, 20);
+        drawPrimitiveSphere(0.3f);
         glPopMatrix();
         
         // Cap visor
         glPushMatrix();
         glTranslatef(0, 1.75f, 0.3f);
         glScalef(0.35f, 0.05f, 0.2f);
-        glutSolidCube(1.0f);
+        drawPrimitiveCube(1.0f);
         glPopMatrix();
         
         // Postal badge on chest
-        glColor3f(0.9f, 0.8f, 0.1f); // Gold badge
+        cachedColor3f(0.9f, 0.8f, 0.1f); // Gold badge
         glPushMatrix();
         glTranslatef(0, 1.0f, 0.21f);
         glScalef(0.15f, 0.15f, 0.02f);
-        glutSolidCube(1.0f);
+        drawPrimitiveCube(1.0f);
         glPopMatrix();
     }
     
@@ -283,50 +448,51 @@ void drawPlayer() {
 }
 
 void drawMailBag() {
+    PROFILE_FUNCTION();
     glPushMatrix();
     glTranslatef(0, 0.9f, -0.3f);
     
     // Main bag body
-    glColor3f(0.6f, 0.4f, 0.2f); // Brown leather
+    cachedColor3f(0.6f, 0.4f, 0.2f); // Brown leather
     glPushMatrix();
     glScalef(0.4f, 0.5f, 0.2f);
-    glutSolidCube(1.0f);
+    drawPrimitiveCube(1.0f);
     glPopMatrix();
     
     // Bag flap
-    glColor3f(0.55f, 0.35f, 0.15f);
+    cachedColor3f(0.55f, 0.35f, 0.15f);
     glPushMatrix();
     glTranslatef(0, 0.26f, 0.05f);
     glRotatef(-10, 1, 0, 0);
     glScalef(0.42f, 0.08f, 0.22f);
-    glutSolidCube(1.0f);
+    drawPrimitiveCube(1.0f);
     glPopMatrix();
     
     // Bag strap
-    glColor3f(0.5f, 0.3f, 0.1f);
+    cachedColor3f(0.5f, 0.3f, 0.1f);
     glPushMatrix();
     glTranslatef(-0.2f, 0.3f, 0);
     glRotatef(45, 0, 0, 1);
     glScalef(0.05f, 0.8f, 0.05f);
-    glutSolidCube(1.0f);
+    drawPrimitiveCube(1.0f);
     glPopMatrix();
     
     // Metal buckle on strap
-    glColor3f(0.7f, 0.7f, 0.7f);
+    cachedColor3f(0.7f, 0.7f, 0.7f);
     glPushMatrix();
     glTranslatef(-0.1f, 0.6f, 0);
     glScalef(0.08f, 0.08f, 0.03f);
-    glutSolidCube(1.0f);
+    drawPrimitiveCube(1.0f);
     glPopMatrix();
     
     // Letters/envelopes sticking out of bag
-    glColor3f(0.95f, 0.95f, 0.9f); // White paper
+    cachedColor3f(0.95f, 0.95f, 0.9f); // White paper
     // Envelope 1
     glPushMatrix();
     glTranslatef(-0.05f, 0.15f, 0.1f);
     glRotatef(15, 0, 0, 1);
     glScalef(0.15f, 0.2f, 0.02f);
-    glutSolidCube(1.0f);
+    drawPrimitiveCube(1.0f);
     glPopMatrix();
     
     // Envelope 2
@@ -334,385 +500,415 @@ void drawMailBag() {
     glTranslatef(0.05f, 0.18f, 0.12f);
     glRotatef(-10, 0, 0, 1);
     glScalef(0.12f, 0.18f, 0.02f);
-    glutSolidCube(1.0f);
+    drawPrimitiveCube(1.0f);
     glPopMatrix();
     
     glPopMatrix();
 }
 
-void drawTerrain() {
-    // Ground plane
-    glColor3f(0.4f, 0.6f, 0.3f); // Green grass
-    glBegin(GL_QUADS);
-    glNormal3f(0, 1, 0);
-    glVertex3f(-100, 0, -100);
-    glVertex3f(100, 0, -100);
-    glVertex3f(100, 0, 100);
-    glVertex3f(-100, 0, 100);
-    glEnd();
-    
-    // Add some terrain variation with smaller patches
-    glColor3f(0.45f, 0.65f, 0.35f);
-    for (int i = -10; i < 10; i++) {
-        for (int j = -10; j < 10; j++) {
-            if ((i + j) % 3 == 0) {
-                glBegin(GL_QUADS);
-                float x = i * 10.0f;
-                float z = j * 10.0f;
-                glVertex3f(x, 0.01f, z);
-                glVertex3f(x + 8, 0.01f, z);
-                glVertex3f(x + 8, 0.01f, z + 8);
-                glVertex3f(x, 0.01f, z + 8);
-                glEnd();
-            }
-        }
-    }
-}
-
-void drawHouse(float x, float z, float scale) {
+// Primitive fallbacks for level objects without a loaded model. Each draws in
+// its object's node space: anchored on the ground, fence rotation applied.
+void drawHouse(float scale) {
+    PROFILE_FUNCTION();
     glPushMatrix();
-    glTranslatef(x, 0, z);
     glScalef(scale, scale, scale);
     
-    // Try to use loaded model
-    if (modelsLoaded && houseModel.meshes.size() > 0) {
-        glPushMatrix();
-        glScalef(2.5f, 2.5f, 2.5f);  // Adjusted for better visibility
-        renderModel(houseModel);
-        glPopMatrix();
-    } else {
-        // Fallback to primitives
-        // House base
-        glColor3f(0.8f, 0.7f, 0.6f); // Beige walls
-        glPushMatrix();
-        glTranslatef(0, 2.5f, 0);
-        glScalef(4.0f, 3.0f, 4.0f);
-        glutSolidCube(1.0f);
-        glPopMatrix();
-        
-        // Roof
-        glColor3f(0.6f, 0.2f, 0.1f); // Red roof
-        glPushMatrix();
-        glTranslatef(0, 4.5f, 0);
-        glRotatef(-90, 1, 0, 0);
-        glutSolidCone(3.0f, 2.0f, 4, 10);
-        glPopMatrix();
-        
-        // Door
-        glColor3f(0.4f, 0.2f, 0.1f);
-        glPushMatrix();
-        glTranslatef(0, 1.0f, 2.01f);
-        glScalef(0.8f, 1.5f, 0.1f);
-        glutSolidCube(1.0f);
-        glPopMatrix();
-        
-        // Windows
-        glColor3f(0.6f, 0.8f, 1.0f); // Blue windows
-        glPushMatrix();
-        glTranslatef(-1.0f, 2.5f, 2.01f);
-        glScalef(0.6f, 0.6f, 0.05f);
-        glutSolidCube(1.0f);
-        glPopMatrix();
-        
-        glPushMatrix();
-        glTranslatef(1.0f, 2.5f, 2.01f);
-        glScalef(0.6f, 0.6f, 0.05f);
-        glutSolidCube(1.0f);
-        glPopMatrix();
-    }
+    // House base
+    cachedColor3f(0.8f, 0.7f, 0.6f); // Beige walls
+    glPushMatrix();
+    glTranslatef(0, 2.5f, 0);
+    glScalef(4.0f, 3.0f, 4.0f);
+    drawPrimitiveCube(1.0f);
+    glPopMatrix();
+    
+    // Roof
+    cachedColor3f(0.6f, 0.2f, 0.1f); // Red roof
+    glPushMatrix();
+    glTranslatef(0, 4.5f, 0);
+    glRotatef(-90, 1, 0, 0);
+    drawPrimitiveCone(3.0f, 2.0f, 4);
+    glPopMatrix();
+    
+    // Door
+    cachedColor3f(0.4f, 0.2f, 0.1f);
+    glPushMatrix();
+    glTranslatef(0, 1.0f, 2.01f);
+    glScalef(0.8f, 1.5f, 0.1f);
+    drawPrimitiveCube(1.0f);
+    glPopMatrix();
+    
+    // Windows
+    cachedColor3f(0.6f, 0.8f, 1.0f); // Blue windows
+    glPushMatrix();
+    glTranslatef(-1.0f, 2.5f, 2.01f);
+    glScalef(0.6f, 0.6f, 0.05f);
+    drawPrimitiveCube(1.0f);
+    glPopMatrix();
+    
+    glPushMatrix();
+    glTranslatef(1.0f, 2.5f, 2.01f);
+    glScalef(0.6f, 0.6f, 0.05f);
+    drawPrimitiveCube(1.0f);
+    glPopMatrix();
     
     glPopMatrix();
 }
 
-void drawTree(float x, float z, float height) {
+void drawTree(float height) {
+    PROFILE_FUNCTION();
+    // Trunk
+    cachedColor3f(0.4f, 0.25f, 0.1f); // Brown
     glPushMatrix();
-    glTranslatef(x, 0, z);
+    glTranslatef(0, height * 0.3f, 0);
+    glRotatef(-90, 1, 0, 0);
+    drawPrimitiveCylinder(0.3f, 0.5f, height * 0.6f);
+    glPopMatrix();
     
-    // Try to use loaded model
-    if (modelsLoaded && treeModel.meshes.size() > 0) {
-        glPushMatrix();
-        glScalef(height / 4.0f, height / 4.0f, height / 4.0f);
-        renderModel(treeModel);
-        glPopMatrix();
-    } else {
-        // Fallback to primitives
-        // Trunk
-        glColor3f(0.4f, 0.25f, 0.1f); // Brown
-        glPushMatrix();
-        glTranslatef(0, height * 0.3f, 0);
-        glRotatef(-90, 1, 0, 0);
-        GLUquadric* quad = gluNewQuadric();
-        if (quad) {
-            gluCylinder(quad, 0.3f, 0.5f, height * 0.6f, 10, 10);
-            gluDeleteQuadric(quad);
-        }
-        glPopMatrix();
-        
-        // Foliage
-        glColor3f(0.1f, 0.5f, 0.1f); // Dark green
-        glPushMatrix();
-        glTranslatef(0, height * 0.7f, 0);
-        glutSolidSphere(height * 0.4f, 15, 15);
-        glPopMatrix();
-        
-        glPushMatrix();
-        glTranslatef(0, height * 0.85f, 0);
-        glutSolidSphere(height * 0.35f, 15, 15);
-        glPopMatrix();
-    }
+    // Foliage
+    cachedColor3f(0.1f, 0.5f, 0.1f); // Dark green
+    glPushMatrix();
+    glTranslatef(0, height * 0.7f, 0);
+    drawPrimitiveSphere(height * 0.4f);
+    glPopMatrix();
     
+    glPushMatrix();
+    glTranslatef(0, height * 0.85f, 0);
+    drawPrimitiveSphere(height * 0.35f);
     glPopMatrix();
 }
 
-void drawFence(float x, float z, float length, float rotation) {
-    glPushMatrix();
-    glTranslatef(x, 0, z);
-    glRotatef(rotation, 0, 1, 0);
+void drawFence(float length) {
+    PROFILE_FUNCTION();
+    cachedColor3f(0.5f, 0.35f, 0.2f); // Wood color
     
-    // Try to use loaded fence model from .obj file
-    if (modelsLoaded && fenceModel.meshes.size() > 0) {
-        // Render the loaded fence model
+    // Fence posts
+    for (float i = 0; i < length; i += 2.0f) {
         glPushMatrix();
-        glScalef(length / 10.0f, 1.0f, 1.0f);  // Scale to match requested length
-        renderModel(fenceModel);
-        glPopMatrix();
-    } else {
-        // Fallback to primitives if model didn't load
-        glColor3f(0.5f, 0.35f, 0.2f); // Wood color
-        
-        // Fence posts
-        for (float i = 0; i < length; i += 2.0f) {
-            glPushMatrix();
-            glTranslatef(i, 0.75f, 0);
-            glScalef(0.15f, 1.5f, 0.15f);
-            glutSolidCube(1.0f);
-            glPopMatrix();
-        }
-        
-        // Horizontal rails
-        glPushMatrix();
-        glTranslatef(length / 2, 1.0f, 0);
-        glScalef(length, 0.1f, 0.1f);
-        glutSolidCube(1.0f);
-        glPopMatrix();
-        
-        glPushMatrix();
-        glTranslatef(length / 2, 0.5f, 0);
-        glScalef(length, 0.1f, 0.1f);
-        glutSolidCube(1.0f);
+        glTranslatef(i, 0.75f, 0);
+        glScalef(0.15f, 1.5f, 0.15f);
+        drawPrimitiveCube(1.0f);
         glPopMatrix();
     }
     
+    // Horizontal rails
+    glPushMatrix();
+    glTranslatef(length / 2, 1.0f, 0);
+    glScalef(length, 0.1f, 0.1f);
+    drawPrimitiveCube(1.0f);
     glPopMatrix();
+    
+    glPushMatrix();
+    glTranslatef(length / 2, 0.5f, 0);
+    glScalef(length, 0.1f, 0.1f);
+    drawPrimitiveCube(1.0f);
+    glPopMatrix();
+}
+
+// Select between rock models if both are available
+const Model* selectRockModel(float x, float z) {
+    if (!modelsLoaded) return NULL;
+    if (rockModel.meshes.size() > 0 && rockSetModel.meshes.size() > 0) {
+        // Use position-based deterministic selection for consistency
+        return ((int)(x + z) % 2 == 0) ? &rockModel : &rockSetModel;
+    } else if (rockModel.meshes.size() > 0) {
+        return &rockModel;
+    } else if (rockSetModel.meshes.size() > 0) {
+        return &rockSetModel;
+    }
+    return NULL;
+}
+
+// Select between wheat and carrot based on position for deterministic placement
+const Model* selectCropModel(float x, float z) {
+    if (!modelsLoaded) return NULL;
+    if (wheatModel.meshes.size() > 0 && carrotModel.meshes.size() > 0) {
+        return ((int)(x + z) % 2 == 0) ? &wheatModel : &carrotModel;
+    } else if (wheatModel.meshes.size() > 0) {
+        return &wheatModel;
+    } else if (carrotModel.meshes.size() > 0) {
+        return &carrotModel;
+    }
+    return NULL;
 }
 
-void drawRock(float x, float z, float size) {
+void drawRock(float size) {
+    PROFILE_FUNCTION();
+    cachedColor3f(0.5f, 0.5f, 0.5f); // Gray
     glPushMatrix();
-    glTranslatef(x, size * 0.3f, z);
-    
-    // Try to use loaded model
-    bool modelRendered = false;
-    if (modelsLoaded) {
-        // Select between rock models if both are available
-        Model* selectedModel = NULL;
-        if (rockModel.meshes.size() > 0 && rockSetModel.meshes.size() > 0) {
-            // Use position-based deterministic selection for consistency
-            selectedModel = ((int)(x + z) % 2 == 0) ? &rockModel : &rockSetModel;
-        } else if (rockModel.meshes.size() > 0) {
-            selectedModel = &rockModel;
-        } else if (rockSetModel.meshes.size() > 0) {
-            selectedModel = &rockSetModel;
-        }
-        
-        if (selectedModel) {
+    glTranslatef(0, size * 0.3f, 0);
+    glScalef(size, size * 0.6f, size * 0.8f);
+    drawPrimitiveSphere(1.0f);
+    glPopMatrix();
+}
+
+void drawCrop() {
+    PROFILE_FUNCTION();
+    // Wheat/carrot stalks
+    cachedColor3f(0.8f, 0.7f, 0.2f); // Golden wheat
+    for (int i = -2; i <= 2; i++) {
+        for (int j = -2; j <= 2; j++) {
             glPushMatrix();
-            glScalef(size, size, size);
-            renderModel(*selectedModel);
+            glTranslatef(i * 0.3f, 0.3f, j * 0.3f);
+            glScalef(0.05f, 0.6f, 0.05f);
+            drawPrimitiveCube(1.0f);
             glPopMatrix();
-            modelRendered = true;
         }
     }
-    
-    if (!modelRendered) {
-        // Fallback to primitive
-        glColor3f(0.5f, 0.5f, 0.5f); // Gray
-        glPushMatrix();
-        glScalef(size, size * 0.6f, size * 0.8f);
-        glutSolidSphere(1.0f, 8, 8);
-        glPopMatrix();
-    }
-    
-    glPopMatrix();
 }
 
-void drawCrop(float x, float z) {
+void drawGrassBlock() {
+    PROFILE_FUNCTION();
     glPushMatrix();
-    glTranslatef(x, 0, z);
+    glTranslatef(0, 0.5f, 0);
     
-    // Try to use loaded models (wheat or carrot)
-    bool modelRendered = false;
-    if (modelsLoaded) {
-        // Select between wheat and carrot based on position for deterministic placement
-        Model* selectedModel = NULL;
-        if (wheatModel.meshes.size() > 0 && carrotModel.meshes.size() > 0) {
-            selectedModel = ((int)(x + z) % 2 == 0) ? &wheatModel : &carrotModel;
-        } else if (wheatModel.meshes.size() > 0) {
-            selectedModel = &wheatModel;
-        } else if (carrotModel.meshes.size() > 0) {
-            selectedModel = &carrotModel;
-        }
-        
-        if (selectedModel) {
-            renderModel(*selectedModel);
-            modelRendered = true;
-        }
-    }
+    // Top (grass)
+    cachedColor3f(0.3f, 0.7f, 0.3f);
+    glBegin(GL_QUADS);
+    glNormal3f(0, 1, 0);
+    glVertex3f(-0.5f, 0.5f, -0.5f);
+    glVertex3f(0.5f, 0.5f, -0.5f);
+    glVertex3f(0.5f, 0.5f, 0.5f);
+    glVertex3f(-0.5f, 0.5f, 0.5f);
+    glEnd();
     
-    if (!modelRendered) {
-        // Fallback to primitives - Wheat/carrot stalks
-        glColor3f(0.8f, 0.7f, 0.2f); // Golden wheat
-        for (int i = -2; i <= 2; i++) {
-            for (int j = -2; j <= 2; j++) {
-                glPushMatrix();
-                glTranslatef(i * 0.3f, 0.3f, j * 0.3f);
-                glScalef(0.05f, 0.6f, 0.05f);
-                glutSolidCube(1.0f);
-                glPopMatrix();
-            }
-        }
-    }
+    // Sides (dirt)
+    cachedColor3f(0.55f, 0.4f, 0.3f);
+    glBegin(GL_QUADS);
+    // Front
+    glNormal3f(0, 0, 1);
+    glVertex3f(-0.5f, -0.5f, 0.5f);
+    glVertex3f(0.5f, -0.5f, 0.5f);
+    glVertex3f(0.5f, 0.5f, 0.5f);
+    glVertex3f(-0.5f, 0.5f, 0.5f);
+    // Back
+    glNormal3f(0, 0, -1);
+    glVertex3f(-0.5f, -0.5f, -0.5f);
+    glVertex3f(-0.5f, 0.5f, -0.5f);
+    glVertex3f(0.5f, 0.5f, -0.5f);
+    glVertex3f(0.5f, -0.5f, -0.5f);
+    // Left
+    glNormal3f(-1, 0, 0);
+    glVertex3f(-0.5f, -0.5f, -0.5f);
+    glVertex3f(-0.5f, -0.5f, 0.5f);
+    glVertex3f(-0.5f, 0.5f, 0.5f);
+    glVertex3f(-0.5f, 0.5f, -0.5f);
+    // Right
+    glNormal3f(1, 0, 0);
+    glVertex3f(0.5f, -0.5f, -0.5f);
+    glVertex3f(0.5f, 0.5f, -0.5f);
+    glVertex3f(0.5f, 0.5f, 0.5f);
+    glVertex3f(0.5f, -0.5f, 0.5f);
+    glEnd();
     
     glPopMatrix();
 }
 
-void drawGrassBlock(float x, float z) {
+void drawStreetLamp() {
+    PROFILE_FUNCTION();
+    // Lamp post
+    cachedColor3f(0.2f, 0.2f, 0.2f); // Dark gray metal
     glPushMatrix();
-    glTranslatef(x, 0.5f, z);
+    glTranslatef(0, 2.5f, 0);
+    glRotatef(-90, 1, 0, 0);
+    drawPrimitiveCylinder(0.1f, 0.15f, 5.0f);
+    glPopMatrix();
     
-    // Try to use loaded model
-    if (modelsLoaded && grassBlockModel.meshes.size() > 0) {
-        renderModel(grassBlockModel);
-    } else {
-        // Fallback to primitives
-        // Top (grass)
-        glColor3f(0.3f, 0.7f, 0.3f);
-        glBegin(GL_QUADS);
-        glNormal3f(0, 1, 0);
-        glVertex3f(-0.5f, 0.5f, -0.5f);
-        glVertex3f(0.5f, 0.5f, -0.5f);
-        glVertex3f(0.5f, 0.5f, 0.5f);
-        glVertex3f(-0.5f, 0.5f, 0.5f);
-        glEnd();
-        
-        // Sides (dirt)
-        glColor3f(0.55f, 0.4f, 0.3f);
-        glBegin(GL_QUADS);
-        // Front
-        glNormal3f(0, 0, 1);
-        glVertex3f(-0.5f, -0.5f, 0.5f);
-        glVertex3f(0.5f, -0.5f, 0.5f);
-        glVertex3f(0.5f, 0.5f, 0.5f);
-        glVertex3f(-0.5f, 0.5f, 0.5f);
-        // Back
-        glNormal3f(0, 0, -1);
-        glVertex3f(-0.5f, -0.5f, -0.5f);
-        glVertex3f(-0.5f, 0.5f, -0.5f);
-        glVertex3f(0.5f, 0.5f, -0.5f);
-        glVertex3f(0.5f, -0.5f, -0.5f);
-        // Left
-        glNormal3f(-1, 0, 0);
-        glVertex3f(-0.5f, -0.5f, -0.5f);
-        glVertex3f(-0.5f, -0.5f, 0.5f);
-        glVertex3f(-0.5f, 0.5f, 0.5f);
-        glVertex3f(-0.5f, 0.5f, -0.5f);
-        // Right
-        glNormal3f(1, 0, 0);
-        glVertex3f(0.5f, -0.5f, -0.5f);
-        glVertex3f(0.5f, 0.5f, -0.5f);
-        glVertex3f(0.5f, 0.5f, 0.5f);
-        glVertex3f(0.5f, -0.5f, 0.5f);
-        glEnd();
-    }
+    // Lamp head
+    glPushMatrix();
+    glTranslatef(0, 5.0f, 0);
     
-    glPopMatrix();
-}
-
-void drawStreetLamp(float x, float z) {
+    // Lamp housing
+    cachedColor3f(0.3f, 0.3f, 0.3f);
     glPushMatrix();
-    glTranslatef(x, 0, z);
+    glScalef(0.6f, 0.4f, 0.6f);
+    drawPrimitiveCube(1.0f);
+    glPopMatrix();
     
-    // Try to use loaded model
-    if (modelsLoaded && streetLampModel.meshes.size() > 0) {
-        glPushMatrix();
-        renderModel(streetLampModel);
-        glPopMatrix();
+    // Light bulb (glowing effect)
+    const GameSnapshot& view = renderView;
+    if (isSkyDark(view.sunAngle)) { // Night time
+        cachedColor3f(1.0f, 1.0f, 0.9f + view.lampFlicker * 0.1f); // White with flicker
     } else {
-        // Fallback to primitives
-        // Lamp post
-        glColor3f(0.2f, 0.2f, 0.2f); // Dark gray metal
-        glPushMatrix();
-        glTranslatef(0, 2.5f, 0);
-        glRotatef(-90, 1, 0, 0);
-        GLUquadric* quad = gluNewQuadric();
-        if (quad) {
-            gluCylinder(quad, 0.1f, 0.15f, 5.0f, 12, 12);
-            gluDeleteQuadric(quad);
-        }
-        glPopMatrix();
-        
-        // Lamp head
-        glPushMatrix();
-        glTranslatef(0, 5.0f, 0);
-        
-        // Lamp housing
-        glColor3f(0.3f, 0.3f, 0.3f);
-        glPushMatrix();
-        glScalef(0.6f, 0.4f, 0.6f);
-        glutSolidCube(1.0f);
-        glPopMatrix();
-        
-        // Light bulb (glowing effect)
-        if (sunAngle > 90 && sunAngle < 270) { // Night time
-            glColor3f(1.0f, 1.0f, 0.9f + lampFlicker * 0.1f); // White with flicker
-        } else {
-            glColor3f(0.9f, 0.9f, 0.8f); // Dim during day
-        }
-        glPushMatrix();
-        glTranslatef(0, -0.3f, 0);
-        glutSolidSphere(0.2f, 12, 12);
-        glPopMatrix();
-        
-        glPopMatrix();
+        cachedColor3f(0.9f, 0.9f, 0.8f); // Dim during day
     }
+    glPushMatrix();
+    glTranslatef(0, -0.3f, 0);
+    drawPrimitiveSphere(0.2f);
+    glPopMatrix();
     
     glPopMatrix();
 }
 
-void drawPackage(float x, float y, float z) {
-    glPushMatrix();
-    glTranslatef(x, y, z);
-    
-    // Rotate the package for visual effect
-    glRotatef(frameCount * 0.5f, 0, 1, 0);
-    
+void drawPackage() {
+    PROFILE_FUNCTION();
     // Box
-    glColor3f(0.7f, 0.5f, 0.3f); // Cardboard color
-    glutSolidCube(0.8f);
+    cachedColor3f(0.7f, 0.5f, 0.3f); // Cardboard color
+    drawPrimitiveCube(0.8f);
     
     // Tape cross
-    glColor3f(0.8f, 0.7f, 0.5f);
+    cachedColor3f(0.8f, 0.7f, 0.5f);
     glPushMatrix();
     glTranslatef(0, 0.41f, 0);
     glScalef(0.85f, 0.01f, 0.2f);
-    glutSolidCube(1.0f);
+    drawPrimitiveCube(1.0f);
     glPopMatrix();
     
     glPushMatrix();
     glTranslatef(0, 0.41f, 0);
     glScalef(0.2f, 0.01f, 0.85f);
-    glutSolidCube(1.0f);
+    drawPrimitiveCube(1.0f);
     glPopMatrix();
+}
+
+// Render queue materials (the material field of the draw key)
+#define MATERIAL_TERRAIN 1
+#define MATERIAL_PLAYER 2
+#define MATERIAL_PACKAGE 3
+#define MATERIAL_LEVEL_BASE 16  // + LevelObjectType
+
+float distanceXZ(float x1, float z1, float x2, float z2) {
+    float dx = x2 - x1;
+    float dz = z2 - z1;
+    return sqrt(dx * dx + dz * dz);
+}
+
+// Texture used for sorting a model's draw (its first mesh's texture)
+unsigned int getModelTexture(const Model* model) {
+    return (model && model->meshes.size() > 0) ? model->meshes[0].textureID : 0;
+}
+
+// Model a level object will render with, or NULL for the primitive fallback
+const Model* getLevelObjectModel(const LevelObject& obj) {
+    const Model* model = NULL;
+    switch (obj.type) {
+        case LEVEL_HOUSE:       model = &houseModel; break;
+        case LEVEL_TREE:        model = &treeModel; break;
+        case LEVEL_FENCE:       model = &fenceModel; break;
+        case LEVEL_ROCK:        return selectRockModel(obj.x, obj.z);
+        case LEVEL_CROP:        return selectCropModel(obj.x, obj.z);
+        case LEVEL_GRASS_BLOCK: model = &grassBlockModel; break;
+        case LEVEL_STREET_LAMP: model = &streetLampModel; break;
+    }
+    return (modelsLoaded && model && model->meshes.size() > 0) ? model : NULL;
+}
+
+// Per-type model placement relative to the object's node, followed by the
+// model's own file offset and scale
+mat4 getLevelObjectModelTransform(const LevelObject& obj, const Model* model) {
+    mat4 place;
+    switch (obj.type) {
+        case LEVEL_HOUSE:       place = mat4Scale(vec3(1, 1, 1) * (obj.size * LEVEL_HOUSE_MODEL_PLACEMENT)); break;
+        case LEVEL_TREE:        place = mat4Scale(vec3(1, 1, 1) * (obj.size / 4.0f)); break;
+        case LEVEL_FENCE:       place = mat4Scale(vec3(obj.size / 10.0f, 1, 1)); break;
+        case LEVEL_ROCK:        place = mat4TRSY(vec3(0, obj.size * 0.3f, 0), 0, vec3(1, 1, 1) * obj.size); break;
+        case LEVEL_GRASS_BLOCK: place = mat4Translation(vec3(0, 0.5f, 0)); break;
+        default:                place = mat4Identity(); break;
+    }
+    if (!model) return place;
+    return place * mat4TRSY(model->offset, 0, vec3(1, 1, 1) * model->scale);
+}
+
+void drawLevelObject(const LevelObject& obj) {
+    PROFILE_FUNCTION();
+    const Model* model = getLevelObjectModel(obj);
+    glPushMatrix();
+    if (model) {
+        glMultMatrixf(getSceneNodeWorld(obj.modelNode));
+        renderModelMeshes(*model);
+    } else {
+        glMultMatrixf(getSceneNodeWorld(obj.node));
+        switch (obj.type) {
+            case LEVEL_HOUSE:       drawHouse(obj.size); break;
+            case LEVEL_TREE:        drawTree(obj.size); break;
+            case LEVEL_FENCE:       drawFence(obj.size); break;
+            case LEVEL_ROCK:        drawRock(obj.size); break;
+            case LEVEL_CROP:        drawCrop(); break;
+            case LEVEL_GRASS_BLOCK: drawGrassBlock(); break;
+            case LEVEL_STREET_LAMP: drawStreetLamp(); break;
+        }
+    }
+    glPopMatrix();
+}
+
+// Scene nodes for everything drawn with a transform. Level objects never move,
+// so after the first update only the player and the packages are recomputed.
+void buildSceneNodes() {
+    clearSceneGraph();
+    
+    for (size_t i = 0; i < levelObjects.size(); i++) {
+        LevelObject& obj = levelObjects[i];
+        
+        // Object bounds in its own space: the same shape, placed at the origin
+        LevelObject origin = obj;
+        origin.x = origin.z = origin.y = origin.rotation = 0.0f;
+        Vector3 bmin, bmax;
+        getLevelObjectBounds(origin, bmin, bmax);
+        
+        obj.node = addSceneNode(SCENE_NO_NODE, mat4TRSY(vec3(obj.x, obj.y, obj.z), obj.rotation, vec3(1, 1, 1)),
+                                bmin, bmax);
+        obj.modelNode = addSceneNode(obj.node, getLevelObjectModelTransform(obj, getLevelObjectModel(obj)));
+    }
+    
+    playerNode = addSceneNode(SCENE_NO_NODE, mat4Identity(), Vector3(-1.0f, -1.6f, -1.0f), Vector3(1.0f, 1.0f, 1.0f));
+    playerModelNode = addSceneNode(playerNode, mat4TRSY(mailmanModel.offset, 0, vec3(1, 1, 1) * (2.0f * mailmanModel.scale)));
+    
+    for (int i = 0; i < TOTAL_PACKAGES; i++) {
+        packages[i].node = addSceneNode(SCENE_NO_NODE, mat4Translation(vec3(packages[i].x, packages[i].y, packages[i].z)),
+                                        Vector3(-0.6f, -0.6f, -0.6f), Vector3(0.6f, 0.6f, 0.6f));
+    }
+    updateSceneGraph();
+}
+
+// Frustum test results per scene node, refilled each frame
+std::vector<unsigned char> sceneNodeVisible;
+
+// Frustum test for scene nodes [begin, end) (a parallelFor range)
+void cullSceneNodes(void* data, int begin, int end) {
+    PROFILE_FUNCTION();
+    const Frustum& frustum = *(const Frustum*)data;
+    const SceneGraph& sg = sceneGraph;
+    cullAABBs(frustum.planes, &sg.worldBoundsMin[begin], &sg.worldBoundsMax[begin], end - begin,
+              &sceneNodeVisible[begin]);
+}
+
+// Move the dynamic nodes to this frame's state and refresh the dirty subtrees
+void updateSceneNodes(const GameSnapshot& view) {
+    PROFILE_FUNCTION();
+    setSceneNodeLocal(playerNode, mat4TRSY(vec3(view.playerX, view.playerY, view.playerZ), -view.cameraYaw,
+                                           vec3(1.0f, view.isCrouching ? 0.7f : 1.0f, 1.0f)));
     
+    // Packages spin in place until collected
+    for (int i = 0; i < TOTAL_PACKAGES; i++) {
+        if (view.collected[i]) continue;
+        setSceneNodeLocal(packages[i].node, mat4TRSY(vec3(packages[i].x, packages[i].y, packages[i].z),
+                                                     view.time * PACKAGE_SPIN_SPEED, vec3(1, 1, 1)));
+    }
+    updateSceneGraph();
+}
+
+// Render queue callbacks
+void drawTerrainItem(const void* data) {
+    drawTerrainChunk(*(const TerrainChunk*)data);
+}
+
+void drawPlayerItem(const void* data) {
+    drawPlayer();
+}
+
+// Prelit geometry skips the sun; everything else is lit as usual
+void beginRenderPass(unsigned int pass) {
+    setPrelitLighting(pass == RENDER_PASS_PRELIT, BAKE_TERRAIN_ALBEDO);
+}
+
+void drawLevelObjectItem(const void* data) {
+    drawLevelObject(*(const LevelObject*)data);
+}
+
+void drawPackageItem(const void* data) {
+    const Package* package = (const Package*)data;
+    glPushMatrix();
+    glMultMatrixf(getSceneNodeWorld(package->node));
+    drawPackage();
     glPopMatrix();
 }
 
@@ -722,11 +918,8 @@ void setupLighting() {
     glEnable(GL_COLOR_MATERIAL);
     glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
     
-    // Enable additional lights for street lamps
-    glEnable(GL_LIGHT1);
-    glEnable(GL_LIGHT2);
-    glEnable(GL_LIGHT3);
-    glEnable(GL_LIGHT4);
+    // Additional lights for the street lamps nearest to the camera
+    setupFixedLampLights();
     
     // Set up material properties
     GLfloat mat_specular[] = { 0.3f, 0.3f, 0.3f, 1.0f };
@@ -735,90 +928,63 @@ void setupLighting() {
     glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
 }
 
-void updateSunLight() {
+void updateSunLight(float sunAngle) {
     // Calculate sun position
-    float sunX = cos(sunAngle * PI / 180.0f) * 50.0f;
-    float sunY = sin(sunAngle * PI / 180.0f) * 50.0f;
+    float sunX = cos(degToRad(sunAngle)) * 50.0f;
+    float sunY = sin(degToRad(sunAngle)) * 50.0f;
     float sunZ = 0.0f;
     
     GLfloat light_position[] = { sunX, sunY, sunZ, 0.0f }; // Directional light
     
-    // Change sun color based on angle
-    GLfloat light_ambient[] = { 0.3f, 0.3f, 0.35f, 1.0f };
-    GLfloat light_diffuse[4];
-    
-    if (sunAngle < 80 || sunAngle > 280) { // Day
-        light_diffuse[0] = 1.0f; // Yellow
-        light_diffuse[1] = 0.95f;
-        light_diffuse[2] = 0.8f;
-        light_diffuse[3] = 1.0f;
-    } else if (sunAngle < 100 || sunAngle > 260) { // Sunset/sunrise
-        light_diffuse[0] = 1.0f; // Orange
-        light_diffuse[1] = 0.6f;
-        light_diffuse[2] = 0.3f;
-        light_diffuse[3] = 1.0f;
-    } else { // Night
-        light_ambient[0] = 0.1f;
-        light_ambient[1] = 0.1f;
-        light_ambient[2] = 0.15f;
-        light_diffuse[0] = 0.2f;
-        light_diffuse[1] = 0.2f;
-        light_diffuse[2] = 0.3f;
-        light_diffuse[3] = 1.0f;
-    }
+    // Sunlight through the atmosphere, and the sky's ambient light
+    GLfloat light_ambient[] = { sky.ambientColor[0], sky.ambientColor[1], sky.ambientColor[2], 1.0f };
+    GLfloat light_diffuse[] = { sky.sunColor[0], sky.sunColor[1], sky.sunColor[2], 1.0f };
     
     glLightfv(GL_LIGHT0, GL_POSITION, light_position);
     glLightfv(GL_LIGHT0, GL_AMBIENT, light_ambient);
     glLightfv(GL_LIGHT0, GL_DIFFUSE, light_diffuse);
+    
+    // Prelit terrain follows the same sun
+    updateBakedLighting(sunAngle, light_ambient, light_diffuse);
 }
 
-void updateLampLights() {
-    // Only light up lamps at night
-    if (sunAngle > 90 && sunAngle < 270) {
-        // Lamp 1
-        GLfloat lamp1_pos[] = { -10.0f, 5.0f, -10.0f, 1.0f };
-        GLfloat lamp_diffuse[] = { 0.9f + lampFlicker * 0.1f, 0.9f + lampFlicker * 0.1f, 0.8f, 1.0f };
-        GLfloat lamp_ambient[] = { 0.2f, 0.2f, 0.15f, 1.0f };
-        glLightfv(GL_LIGHT1, GL_POSITION, lamp1_pos);
-        glLightfv(GL_LIGHT1, GL_DIFFUSE, lamp_diffuse);
-        glLightfv(GL_LIGHT1, GL_AMBIENT, lamp_ambient);
-        glLightf(GL_LIGHT1, GL_CONSTANT_ATTENUATION, 1.0f);
-        glLightf(GL_LIGHT1, GL_LINEAR_ATTENUATION, 0.1f);
-        
-        // Lamp 2
-        GLfloat lamp2_pos[] = { 10.0f, 5.0f, -10.0f, 1.0f };
-        glLightfv(GL_LIGHT2, GL_POSITION, lamp2_pos);
-        glLightfv(GL_LIGHT2, GL_DIFFUSE, lamp_diffuse);
-        glLightfv(GL_LIGHT2, GL_AMBIENT, lamp_ambient);
-        glLightf(GL_LIGHT2, GL_CONSTANT_ATTENUATION, 1.0f);
-        glLightf(GL_LIGHT2, GL_LINEAR_ATTENUATION, 0.1f);
-        
-        // Lamp 3
-        GLfloat lamp3_pos[] = { -10.0f, 5.0f, 10.0f, 1.0f };
-        glLightfv(GL_LIGHT3, GL_POSITION, lamp3_pos);
-        glLightfv(GL_LIGHT3, GL_DIFFUSE, lamp_diffuse);
-        glLightfv(GL_LIGHT3, GL_AMBIENT, lamp_ambient);
-        glLightf(GL_LIGHT3, GL_CONSTANT_ATTENUATION, 1.0f);
-        glLightf(GL_LIGHT3, GL_LINEAR_ATTENUATION, 0.1f);
-        
-        // Lamp 4
-        GLfloat lamp4_pos[] = { 10.0f, 5.0f, 10.0f, 1.0f };
-        glLightfv(GL_LIGHT4, GL_POSITION, lamp4_pos);
-        glLightfv(GL_LIGHT4, GL_DIFFUSE, lamp_diffuse);
-        glLightfv(GL_LIGHT4, GL_AMBIENT, lamp_ambient);
-        glLightf(GL_LIGHT4, GL_CONSTANT_ATTENUATION, 1.0f);
-        glLightf(GL_LIGHT4, GL_LINEAR_ATTENUATION, 0.1f);
-    } else {
-        // Turn off lamps during day
-        GLfloat off[] = { 0.0f, 0.0f, 0.0f, 1.0f };
-        glLightfv(GL_LIGHT1, GL_DIFFUSE, off);
-        glLightfv(GL_LIGHT2, GL_DIFFUSE, off);
-        glLightfv(GL_LIGHT3, GL_DIFFUSE, off);
-        glLightfv(GL_LIGHT4, GL_DIFFUSE, off);
-    }
+// The state t of the way from step a to step b. Discrete state (crouching,
+// collected packages, step count) is taken from b.
+void blendSnapshots(const GameSnapshot& a, const GameSnapshot& b, float t, GameSnapshot& out) {
+    out = b;
+    out.playerX = lerpf(a.playerX, b.playerX, t);
+    out.playerY = lerpf(a.playerY, b.playerY, t);
+    out.playerZ = lerpf(a.playerZ, b.playerZ, t);
+    out.cameraYaw = lerpf(a.cameraYaw, b.cameraYaw, t);
+    out.cameraPitch = lerpf(a.cameraPitch, b.cameraPitch, t);
+    out.lampFlicker = lerpf(a.lampFlicker, b.lampFlicker, t);
+    out.time = lerpf(a.time, b.time, t);
+    // The sun wraps from 360 back to 0
+    float sunTo = b.sunAngle < a.sunAngle - 180.0f ? b.sunAngle + 360.0f : b.sunAngle;
+    out.sunAngle = lerpf(a.sunAngle, sunTo, t);
+    if (out.sunAngle >= 360.0f) out.sunAngle -= 360.0f;
 }
 
 void Display(void) {
+    profilerBeginFrame();
+    PROFILE_FUNCTION();
+    
+    // Draw between the newest two simulation steps
+    snapshots.update();
+    const GameFrame& steps = snapshots.read();
+    blendSnapshots(steps.previous, steps.current, simulationBlend(steps.current.stepTime), renderView);
+    const GameSnapshot& view = renderView;
+    // Local copies: the globals of the same names belong to the simulation
+    float sunAngle = view.sunAngle;
+    float playerX = view.playerX, playerY = view.playerY, playerZ = view.playerZ;
+    renderFrameCount++;
+    
+    // This frame's dynamic uploads go to its own region of the frame ring
+    beginFrameRing();
+    
+    // Sky tables and light colors for this frame's sun, before anything draws
+    updateSky(sunAngle);
+    glClearColor(sky.horizonColor[0], sky.horizonColor[1], sky.horizonColor[2], 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     
     glLoadIdentity();
@@ -826,180 +992,229 @@ void Display(void) {
     // Set up camera
     float camX, camY, camZ;
     float lookX, lookY, lookZ;
+    vec3 forward = yawForward(view.cameraYaw);
     
     if (thirdPerson) {
         // Third-person camera
-        float distance = isCrouching ? 4.0f : 5.0f;
-        camX = playerX - sin(cameraYaw * PI / 180.0f) * distance;
+        float distance = view.isCrouching ? 4.0f : 5.0f;
+        camX = playerX - forward.x * distance;
         camY = playerY + 2.5f;
-        camZ = playerZ - cos(cameraYaw * PI / 180.0f) * distance;
+        camZ = playerZ - forward.z * distance;
         lookX = playerX;
         lookY = playerY + 1.0f;
         lookZ = playerZ;
     } else {
         // First-person camera
-        float eyeHeight = isCrouching ? 0.8f : 1.5f;
+        float eyeHeight = view.isCrouching ? 0.8f : 1.5f;
         camX = playerX;
         camY = playerY + eyeHeight;
         camZ = playerZ;
-        lookX = playerX + sin(cameraYaw * PI / 180.0f);
-        lookY = playerY + eyeHeight + tan(cameraPitch * PI / 180.0f);
-        lookZ = playerZ + cos(cameraYaw * PI / 180.0f);
+        lookX = playerX + forward.x;
+        lookY = playerY + eyeHeight + tan(degToRad(view.cameraPitch));
+        lookZ = playerZ + forward.z;
     }
     
     gluLookAt(camX, camY, camZ, lookX, lookY, lookZ, 0.0f, 1.0f, 0.0f);
     
-    // Update lighting
-    updateSunLight();
-    updateLampLights();
-    
-    // Draw terrain
-    drawTerrain();
+    // Update lighting (lamps only shine at night)
+    updateSunLight(sunAngle);
+    bool lampsOn = isSkyDark(sunAngle);
+    float lampIntensity = 0.9f + view.lampFlicker * 0.1f;
+    if (lightingMode == LIGHTING_FIXED) {
+        updateFixedLampLights(camX, camZ, lampsOn, lampIntensity);
+    }
     
-    // Draw player (only in third-person)
-    if (thirdPerson) {
-        glPushMatrix();
-        glTranslatef(playerX, playerY, playerZ);
-        glRotatef(-cameraYaw, 0, 1, 0);
-        if (isCrouching) {
-            glScalef(1.0f, 0.7f, 1.0f);
+    // World transforms for whatever moved since the last frame
+    updateSceneNodes(view);
+    
+    // Build this frame's render queue
+    resetGLStateCache();
+    clearRenderQueue(renderQueue);
+    
+    // Sun shadows (shader lighting only): the player and packages move, the
+    // cascades redraw their static casters only when the sun or camera says so
+    const SceneGraph& sg = sceneGraph;
+    if (lightingMode != LIGHTING_FIXED) {
+        clearDynamicShadowCasters();
+        submitDynamicShadowCaster(drawPlayerItem, NULL, sg.worldBoundsMin[playerNode], sg.worldBoundsMax[playerNode]);
+        for (int i = 0; i < TOTAL_PACKAGES; i++) {
+            if (view.collected[i]) continue;
+            const Package& p = packages[i];
+            submitDynamicShadowCaster(drawPackageItem, &p, sg.worldBoundsMin[p.node], sg.worldBoundsMax[p.node]);
         }
-        drawPlayer();
-        glPopMatrix();
+        updateShadowMaps(sunAngle, camX, camY, camZ);
     }
     
-    // Draw houses (farmhouses scattered at proper distances around the scene)
-    drawHouse(-30.0f, -25.0f, 1.0f);  // Northwest house
-    drawHouse(25.0f, -30.0f, 1.0f);   // Northeast house  
-    drawHouse(-20.0f, 30.0f, 1.0f);   // Southwest house
-    drawHouse(35.0f, 20.0f, 1.0f);    // Southeast house
-    
-    // Draw trees (scattered naturally around the rural scene)
-    drawTree(-8.0f, -18.0f, 4.0f);
-    drawTree(12.0f, -12.0f, 3.5f);
-    drawTree(-15.0f, 8.0f, 4.5f);
-    drawTree(18.0f, 10.0f, 3.8f);
-    drawTree(-25.0f, -8.0f, 4.2f);
-    drawTree(28.0f, -20.0f, 3.9f);
-    drawTree(-10.0f, 25.0f, 4.1f);
-    drawTree(22.0f, 28.0f, 3.7f);
-    drawTree(5.0f, -25.0f, 4.3f);
-    drawTree(-18.0f, 18.0f, 3.6f);
-    
-    // Draw fences (around properties and fields)
-    drawFence(-20.0f, -28.0f, 12.0f, 0);    // North fence
-    drawFence(18.0f, -25.0f, 10.0f, 45);    // Northeast fence
-    drawFence(-15.0f, 20.0f, 15.0f, 90);    // West fence
-    drawFence(25.0f, 15.0f, 12.0f, 0);      // East fence
-    drawFence(-8.0f, -35.0f, 20.0f, 0);     // Crop field fence
-    
-    // Draw rocks (scattered naturally)
-    drawRock(8.0f, -8.0f, 0.8f);
-    drawRock(-12.0f, -15.0f, 1.0f);
-    drawRock(15.0f, 5.0f, 0.7f);
-    drawRock(-22.0f, 12.0f, 0.9f);
-    drawRock(25.0f, -12.0f, 1.1f);
-    drawRock(-5.0f, 20.0f, 0.8f);
-    
-    // Draw crops (wheat and carrots in organized fields)
-    // North field
-    for (int i = 0; i < NORTH_FIELD_CROP_COLUMNS; i++) {
-        drawCrop(-8.0f + i * 3, -32.0f);
-        drawCrop(-8.0f + i * 3, -35.0f);
-    }
-    // South field  
-    for (int i = 0; i < SOUTH_FIELD_CROP_COLUMNS; i++) {
-        drawCrop(12.0f + i * 3, 32.0f);
+    Frustum frustum;
+    extractFrustum(frustum);
+    
+    // Terrain chunks: pick LODs for this camera, then submit the visible ones
+    // (PVS, then frustum). The terrain sorts first (prelit pass or lowest
+    // material), so chunks draw front-to-back before everything else.
+    selectTerrainLODs(camX, camY, camZ, primitivePixelsPerUnit);
+    unsigned int terrainPass = bakedLighting.loaded ? RENDER_PASS_PRELIT : RENDER_PASS_OPAQUE;
+    const unsigned int* visibleBits = pvsLoaded ? getPVSCellBits(levelPVS, camX, camZ) : NULL;
+    for (size_t i = 0; i < terrain.chunks.size(); i++) {
+        const TerrainChunk& chunk = terrain.chunks[i];
+        if (!isPVSChunkVisible(levelPVS, visibleBits, (int)i)) continue;
+        if (!isBoxInFrustum(frustum, chunk.boundsMin, chunk.boundsMax)) continue;
+        float dist = distanceXZ(camX, camZ, (chunk.boundsMin.x + chunk.boundsMax.x) * 0.5f,
+                                (chunk.boundsMin.z + chunk.boundsMax.z) * 0.5f);
+        submitRenderItem(renderQueue, makeRenderKey(terrainPass, MATERIAL_TERRAIN, 0, dist),
+                         drawTerrainItem, &chunk, dist);
     }
     
-    // Draw grass blocks (reduced density to avoid clutter)
-    for (int i = -2; i <= 2; i++) {
-        for (int j = -2; j <= 2; j++) {
-            // Skip center area where player and main objects are
-            if (abs(i) <= 1 && abs(j) <= 1) continue;
-            if ((i + j) % 2 == 0) {
-                drawGrassBlock(i * 8.0f, j * 8.0f);
-            }
-        }
+    // Player (only in third-person)
+    if (thirdPerson) {
+        const Model* model = (modelsLoaded && mailmanModel.meshes.size() > 0) ? &mailmanModel : NULL;
+        float dist = distanceXZ(camX, camZ, playerX, playerZ);
+        submitRenderItem(renderQueue, makeRenderKey(RENDER_PASS_OPAQUE, MATERIAL_PLAYER, getModelTexture(model), dist),
+                         drawPlayerItem, NULL, dist);
     }
     
-    // Draw street lamps (positioned at corners around central area)
-    drawStreetLamp(-10.0f, -10.0f);  // Northwest
-    drawStreetLamp(10.0f, -10.0f);   // Northeast
-    drawStreetLamp(-10.0f, 10.0f);   // Southwest
-    drawStreetLamp(10.0f, 10.0f);    // Southeast
+    // Static level objects: PVS lookup for the camera cell, then the frustum
+    // test, done for all scene nodes' world bounds in one batch
+    int nodeCount = (int)sg.parent.size();
+    sceneNodeVisible.resize(nodeCount);
+    parallelFor(nodeCount, 256, cullSceneNodes, &frustum);
+    for (size_t i = 0; i < levelObjects.size(); i++) {
+        if (!isPVSBitSet(visibleBits, (int)i)) continue;
+        const LevelObject& obj = levelObjects[i];
+        if (!sceneNodeVisible[obj.node]) continue;
+        float dist = distanceXZ(camX, camZ, obj.x, obj.z);
+        RenderKey key = makeRenderKey(RENDER_PASS_OPAQUE, MATERIAL_LEVEL_BASE + obj.type,
+                                      getModelTexture(getLevelObjectModel(obj)), dist);
+        submitRenderItem(renderQueue, key, drawLevelObjectItem, &obj, dist);
+    }
     
-    // Draw packages (collectibles)
+    // Packages (collectibles)
     for (int i = 0; i < TOTAL_PACKAGES; i++) {
-        if (!packages[i].collected) {
-            drawPackage(packages[i].x, packages[i].y, packages[i].z);
+        if (!view.collected[i]) {
+            float dist = distanceXZ(camX, camZ, packages[i].x, packages[i].z);
+            submitRenderItem(renderQueue, makeRenderKey(RENDER_PASS_OPAQUE, MATERIAL_PACKAGE, 0, dist),
+                             drawPackageItem, &packages[i], dist);
         }
     }
     
-    // Draw sky color based on time of day
-    if (sunAngle > 90 && sunAngle < 270) {
-        glClearColor(0.05f, 0.05f, 0.15f, 1.0f); // Night sky
-    } else if (sunAngle < 100 || sunAngle > 260) {
-        glClearColor(1.0f, 0.5f, 0.3f, 1.0f); // Sunset/sunrise
-    } else {
-        glClearColor(0.6f, 0.8f, 1.0f, 1.0f); // Day sky
+    sortRenderQueue(renderQueue);
+    drawSky(camX, camY, camZ);
+    {
+        PROFILE_GPU_SCOPE("Scene");
+        if (lightingMode != LIGHTING_FIXED) {
+            beginShadedLighting(lampsOn, lampIntensity);
+        }
+        executeRenderQueue(renderQueue);
+        if (lightingMode != LIGHTING_FIXED) {
+            endShadedLighting();
+        }
     }
     
+    // Time between frames, for comparing lighting modes
+    int now = glutGet(GLUT_ELAPSED_TIME);
+    if (lastFrameTime > 0) {
+        frameTimeTotal += now - lastFrameTime;
+        frameTimeSamples++;
+    }
+    lastFrameTime = now;
+    
+    if (showRenderStats && renderFrameCount % 60 == 0) {
+        printRenderStats(renderFrameCount);
+        printf("  Lighting: %s, %d lamps, %.2f ms/frame\n", getLightingModeName(lightingMode),
+               lampsOn ? (int)pointLights.size() : 0,
+               frameTimeSamples > 0 ? (float)frameTimeTotal / frameTimeSamples : 0.0f);
+        printf("  Shadows: %s, %d static cascade renders, %d composites, %d caster draws\n",
+               shadowMaps.active ? "on" : "off", shadowStats.staticRenders, shadowStats.composites,
+               shadowStats.casterDraws);
+        resetShadowStats();
+        printf("  Scene: %d nodes, %d world transforms updated\n", (int)sg.parent.size(), sg.updatedNodes);
+        if (isJobSystemParallel()) {
+            int jobsRun, jobsStolen;
+            getJobStats(jobsRun, jobsStolen);
+            printf("  Jobs: %d run, %d stolen across %d threads\n", jobsRun, jobsStolen, jobSystem.workerCount);
+            resetJobStats();
+        }
+        if (frameRing.active) {
+            printf("  Frame ring: %.1f KB peak per frame, %d waits for the GPU\n",
+                   frameRing.peakBytes / 1024.0, frameRing.waits);
+            resetFrameRingStats();
+        }
+        frameTimeTotal = 0;
+        frameTimeSamples = 0;
+    }
+    resetRenderStats();
+    
+    drawProfilerOverlay();
+    endFrameRing();
     glutSwapBuffers();
 }
 
-void updatePlayer() {
+// The simulation's current state
+void captureSnapshot(GameSnapshot& snapshot) {
+    snapshot.playerX = playerX;
+    snapshot.playerY = playerY;
+    snapshot.playerZ = playerZ;
+    snapshot.cameraYaw = cameraYaw;
+    snapshot.cameraPitch = cameraPitch;
+    snapshot.isCrouching = isCrouching;
+    snapshot.sunAngle = sunAngle;
+    snapshot.lampFlicker = lampFlicker;
+    snapshot.frameCount = frameCount;
+    snapshot.time = frameCount * (float)SIMULATION_STEP_SECONDS;
+    snapshot.stepTime = simulationThread.stepTime;
+    for (int i = 0; i < TOTAL_PACKAGES; i++) {
+        snapshot.collected[i] = packages[i].collected;
+    }
+}
+
+// Hand the renderer the step just taken, with the one before it
+void publishSnapshot() {
+    GameFrame& frame = snapshots.writeSlot();
+    frame.previous = lastSnapshot;
+    captureSnapshot(lastSnapshot);
+    frame.current = lastSnapshot;
+    snapshots.publish();
+}
+
+void updatePlayer(const GameInput& in, float dt) {
+    PROFILE_FUNCTION();
     // Movement
-    float moveSpeed = isCrouching ? 0.05f : 0.1f;
-    float moveDirX = 0, moveDirZ = 0;
+    float moveSpeed = (isCrouching ? PLAYER_CROUCH_SPEED : PLAYER_WALK_SPEED) * dt;
+    vec3 forward = yawForward(cameraYaw);
+    vec3 left(-forward.z, 0, forward.x);
+    vec3 moveDir;
     
-    if (keyW) {
-        moveDirX += sin(cameraYaw * PI / 180.0f);
-        moveDirZ += cos(cameraYaw * PI / 180.0f);
-    }
-    if (keyS) {
-        moveDirX -= sin(cameraYaw * PI / 180.0f);
-        moveDirZ -= cos(cameraYaw * PI / 180.0f);
-    }
-    if (keyA) {
-        moveDirX -= cos(cameraYaw * PI / 180.0f);
-        moveDirZ += sin(cameraYaw * PI / 180.0f);
-    }
-    if (keyD) {
-        moveDirX += cos(cameraYaw * PI / 180.0f);
-        moveDirZ -= sin(cameraYaw * PI / 180.0f);
-    }
+    if (in.keyW) moveDir += forward;
+    if (in.keyS) moveDir -= forward;
+    if (in.keyA) moveDir += left;
+    if (in.keyD) moveDir -= left;
     
     // Normalize movement
-    float len = sqrt(moveDirX * moveDirX + moveDirZ * moveDirZ);
-    if (len > 0) {
-        moveDirX = (moveDirX / len) * moveSpeed;
-        moveDirZ = (moveDirZ / len) * moveSpeed;
-    }
+    moveDir = normalize(moveDir) * moveSpeed;
     
-    playerX += moveDirX;
-    playerZ += moveDirZ;
+    playerX += moveDir.x;
+    playerZ += moveDir.z;
     
-    // Jumping physics
+    // Jumping physics (the player stands 1.5 above the terrain)
+    float groundY = getTerrainHeight(playerX, playerZ) + 1.5f;
     if (isJumping) {
-        playerVelY -= 0.02f; // Gravity
-        playerY += playerVelY;
+        playerVelY -= GRAVITY * dt;
+        playerY += playerVelY * dt;
         
-        if (playerY <= 1.5f) {
-            playerY = 1.5f;
+        if (playerY <= groundY) {
+            playerY = groundY;
             playerVelY = 0;
             isJumping = false;
         }
+    } else {
+        playerY = groundY;
     }
     
     // Check package collection
     for (int i = 0; i < TOTAL_PACKAGES; i++) {
         if (!packages[i].collected) {
-            float dx = playerX - packages[i].x;
-            float dz = playerZ - packages[i].z;
-            float dist = sqrt(dx * dx + dz * dz);
+            vec3 offset(playerX - packages[i].x, 0, playerZ - packages[i].z);
             
-            if (dist < 2.0f) {
+            if (dot(offset, offset) < 2.0f * 2.0f) {
                 packages[i].collected = true;
                 packagesCollected++;
                 printf("Package collected! %d/%d\n", packagesCollected, TOTAL_PACKAGES);
@@ -1008,79 +1223,137 @@ void updatePlayer() {
     }
 }
 
-void Anim() {
+// One fixed step of the game: input, sun, lamps and the player, then a
+// snapshot of the result for the renderer. Runs on the simulation thread.
+void simulateStep() {
+    PROFILE_FUNCTION();
+    const float dt = (float)SIMULATION_STEP_SECONDS;
+    inputs.update();
+    const GameInput& in = inputs.read();
     frameCount++;
     
-    // Update sun rotation
-    sunAngle += 0.05f;
-    if (sunAngle >= 360.0f) sunAngle = 0.0f;
+    cameraYaw = in.cameraYaw;
+    cameraPitch = in.cameraPitch;
+    isCrouching = in.crouching;
+    if (in.jumps != jumpsHandled) {
+        jumpsHandled = in.jumps;
+        if (!isJumping) {
+            isJumping = true;
+            playerVelY = PLAYER_JUMP_SPEED;
+        }
+    }
+    
+    // Update sun rotation (the lamp stress scene stays at midnight)
+    if (stressLampCount == 0) {
+        sunAngle += SUN_SPEED * dt;
+        if (sunAngle >= 360.0f) sunAngle -= 360.0f;
+    }
     
     // Update lamp flicker
-    lampFlicker = sin(frameCount * 0.1f) * 0.5f + 0.5f;
+    lampFlicker = sin(frameCount * dt * LAMP_FLICKER_RATE) * 0.5f + 0.5f;
     
     // Update player
-    updatePlayer();
+    updatePlayer(in, dt);
+    
+    publishSnapshot();
+}
+
+void Anim() {
+    // Pick up models and textures the upload thread has finished
+    if (pollUploads() == 0) {
+        reportModelUploads();
+    }
+    
+    if (serialSimulation) {
+        runSimulationSteps();
+    }
     
+    // Sleep off the rest of the frame instead of spinning (--fps)
+    limitFrameRate();
     glutPostRedisplay();
 }
 
+// Hand the callbacks' input to the simulation
+void publishInput() {
+    inputs.writeSlot() = input;
+    inputs.publish();
+}
+
 void Keyboard(unsigned char key, int x, int y) {
     switch (key) {
         case 'w':
         case 'W':
-            keyW = true;
+            input.keyW = true;
             break;
         case 's':
         case 'S':
-            keyS = true;
+            input.keyS = true;
             break;
         case 'a':
         case 'A':
-            keyA = true;
+            input.keyA = true;
             break;
         case 'd':
         case 'D':
-            keyD = true;
+            input.keyD = true;
             break;
         case ' ':
-            if (!isJumping) {
-                isJumping = true;
-                playerVelY = 0.3f;
-            }
+            input.jumps++;
             break;
         case 'c':
         case 'C':
-            isCrouching = !isCrouching;
+            input.crouching = !input.crouching;
             break;
         case 'v':
         case 'V':
             thirdPerson = !thirdPerson;
             break;
+        case 'r':
+        case 'R':
+            showRenderStats = !showRenderStats;
+            printf("Render stats %s\n", showRenderStats ? "enabled" : "disabled");
+            break;
+        case 'l':
+        case 'L':
+            cycleLightingMode();
+            break;
+        case 'p':
+        case 'P':
+            // Recording follows the overlay unless --profile keeps it on
+            profiler.overlay = !profiler.overlay;
+            setProfilerEnabled(profiler.overlay || profileFromStart);
+            break;
+        case 't':
+        case 'T':
+            writeProfilerTrace(PROFILER_TRACE_DEFAULT_PATH);
+            break;
         case 27: // ESC
             exit(0);
             break;
     }
+    publishInput();
 }
 
 void KeyboardUp(unsigned char key, int x, int y) {
     switch (key) {
         case 'w':
         case 'W':
-            keyW = false;
+            input.keyW = false;
             break;
         case 's':
         case 'S':
-            keyS = false;
+            input.keyS = false;
             break;
         case 'a':
         case 'A':
-            keyA = false;
+            input.keyA = false;
             break;
         case 'd':
         case 'D':
-            keyD = false;
+            input.keyD = false;
             break;
     }
+    publishInput();
 }
 
 void Mouse(int x, int y) {
@@ -1099,12 +1372,12 @@ void Mouse(int x, int y) {
     xoffset *= sensitivity;
     yoffset *= sensitivity;
     
-    cameraYaw += xoffset;
-    cameraPitch += yoffset;
+    input.cameraYaw += xoffset;
+    input.cameraPitch += yoffset;
     
     // Constrain pitch
-    if (cameraPitch > MAX_PITCH) cameraPitch = MAX_PITCH;
-    if (cameraPitch < MIN_PITCH) cameraPitch = MIN_PITCH;
+    input.cameraPitch = clampf(input.cameraPitch, MIN_PITCH, MAX_PITCH);
+    publishInput();
 }
 
 void Reshape(int width, int height) {
@@ -1112,12 +1385,51 @@ void Reshape(int width, int height) {
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
     gluPerspective(45.0f, (float)width / (float)height, 0.1f, 300.0f);
+    setPrimitiveProjection(height, 45.0f);
+    setClusterProjection(width, height, 45.0f, 0.1f, 300.0f);
     glMatrixMode(GL_MODELVIEW);
 }
 
+void writeProfilerTraceAtExit() {
+    writeProfilerTrace(PROFILER_TRACE_DEFAULT_PATH);
+}
+
 int main(int argc, char** argv) {
+    initUploadThreadSupport();
     glutInit(&argc, argv);
     
+    // Optional lighting stress scene: --stress-lamps [count]
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stress-lamps") == 0) {
+            stressLampCount = (i + 1 < argc) ? atoi(argv[i + 1]) : 0;
+            if (stressLampCount <= 0) stressLampCount = 256;
+            sunAngle = 270.0f;
+        }
+        // Job threads, to compare scaling: --threads count
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            jobThreadCount = atoi(argv[i + 1]);
+        }
+        if (strcmp(argv[i], "--serial-sim") == 0) {
+            serialSimulation = true;
+        }
+        // Frame pacing: --fps cap (0 = none), --no-vsync
+        if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            frameRateCap = atoi(argv[i + 1]);
+        }
+        if (strcmp(argv[i], "--no-vsync") == 0) {
+            vsyncEnabled = false;
+        }
+        if (strcmp(argv[i], "--profile") == 0) {
+            profileFromStart = true;
+        }
+    }
+    setProfilerThreadName("Main");
+    if (profileFromStart) {
+        setProfilerEnabled(true);
+        atexit(writeProfilerTraceAtExit);
+    }
+    initJobSystem(jobThreadCount);
+    
     glutInitWindowSize(800, 600);
     glutInitWindowPosition(100, 100);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
@@ -1139,22 +1451,78 @@ int main(int argc, char** argv) {
     glEnable(GL_NORMALIZE);
     glShadeModel(GL_SMOOTH);
     
+    // Fetch post-1.1 GL entry points and build the fallback primitive meshes
+    loadGLExtensions();
+    if (!setSwapInterval(vsyncEnabled ? 1 : 0) && vsyncEnabled) {
+        // Without vsync nothing would stop the idle loop spinning
+        printf("Vsync not available\n");
+        if (frameRateCap == 0) frameRateCap = 60;
+    }
+    initFrameLimiter(frameRateCap);
+    startUploadThread();
+    initFrameRing();
+    initPrimitives();
+    initClusteredLighting();
+    initShadowMaps();
+    initSky();
+    
     // Set up lighting
     setupLighting();
     
     // Load 3D models
     loadAllModels();
     
+    // Static level layout on the heightmap terrain, and its precomputed visibility
+    loadTerrain(TERRAIN_DEFAULT_PATH);
+    buildTerrainChunks();
+    buildLevel();
+    if (stressLampCount > 0) {
+        addStressLamps(stressLampCount);
+    }
+    placeLevelOnTerrain();
+    buildLampLights();
+    for (int i = 0; i < TOTAL_PACKAGES; i++) {
+        packages[i].y = getTerrainHeight(packages[i].x, packages[i].z) + 0.5f;
+    }
+    buildSceneNodes();
+    for (size_t i = 0; i < levelObjects.size(); i++) {
+        const LevelObject& obj = levelObjects[i];
+        addStaticShadowCaster(drawLevelObjectItem, &obj, sceneGraph.worldBoundsMin[obj.node],
+                              sceneGraph.worldBoundsMax[obj.node]);
+    }
+    for (size_t i = 0; i < terrain.chunks.size(); i++) {
+        growShadowSceneBounds(terrain.chunks[i].boundsMin, terrain.chunks[i].boundsMax);
+    }
+    loadBakedLighting(BAKE_DEFAULT_PATH);
+    renderPassBegin = beginRenderPass;
+    playerY = getTerrainHeight(playerX, playerZ) + 1.5f;
+    loadLevelPVS(PVS_DEFAULT_PATH, houseModel.meshes.size() > 0, (int)terrain.chunks.size());
+    
     printf("BlitzMail - Rural Level Scene\n");
     printf("Controls:\n");
     printf("  WASD - Move\n");
     printf("  Space - Jump\n");
     printf("  C - Crouch\n");
     printf("  V - Toggle camera (first/third person)\n");
+    printf("  R - Toggle render stats (draw calls, state changes, binds)\n");
+    printf("  L - Cycle lighting (clustered / fixed-function / forward)\n");
+    printf("  P - Toggle profiler overlay\n");
+    printf("  T - Write profiler trace (%s)\n", PROFILER_TRACE_DEFAULT_PATH);
     printf("  Mouse - Look around\n");
     printf("  ESC - Exit\n");
     printf("\nCollect all %d packages!\n", TOTAL_PACKAGES);
     
+    // The renderer starts from the initial state; the simulation takes over
+    // the game state from here, with its fixed-step clock starting now
+    initSimulation(simulateStep);
+    captureSnapshot(lastSnapshot);
+    snapshots.reset(GameFrame());
+    inputs.reset(input);
+    publishSnapshot();
+    if (!serialSimulation) {
+        startSimulationThread();
+    }
+    
     glutMainLoop();
     
     return 0;
@@ -0,0 +1,298 @@
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+#include <math.h>
+#include <map>
+#include <vector>
+
+#include "GLExtensions.h"
+#include "RenderQueue.h"
+
+// Prebuilt meshes for the primitive fallbacks (cube, sphere, cylinder, cone).
+//
+// Each shape is generated once per tessellation level and kept in GPU buffers
+// (or client-side arrays when buffer objects are unavailable). They replace
+// glutSolid* and gluCylinder, which rebuild their geometry in immediate mode
+// on every call. Spheres and cylinders pick a tessellation level from their
+// projected size on screen.
+
+#define PRIMITIVE_CUBE 0
+#define PRIMITIVE_SPHERE 1
+#define PRIMITIVE_CYLINDER 2
+#define PRIMITIVE_CONE 3
+
+#define PRIMITIVE_LOD_COUNT 3
+
+// Tessellation per level of detail (low, medium, high)
+const int SPHERE_SLICES[PRIMITIVE_LOD_COUNT] = { 8, 14, 20 };
+const int SPHERE_STACKS[PRIMITIVE_LOD_COUNT] = { 6, 10, 16 };
+const int CYLINDER_SLICES[PRIMITIVE_LOD_COUNT] = { 6, 10, 16 };
+
+// Projected diameter in pixels at which the next level is used
+const float PRIMITIVE_LOD_PIXELS[PRIMITIVE_LOD_COUNT - 1] = { 24.0f, 96.0f };
+
+struct PrimitiveMesh {
+    std::vector<float> vertices;           // Interleaved position (3) + normal (3)
+    std::vector<unsigned short> indices;
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+
+    PrimitiveMesh() : vertexBuffer(0), indexBuffer(0) {}
+};
+
+#define PRIMITIVE_STRIDE (6 * sizeof(float))
+
+std::map<unsigned int, PrimitiveMesh> primitiveCache;
+
+// Pixels covered by one world unit at distance 1 (set from the projection in Reshape)
+float primitivePixelsPerUnit = 600.0f;
+
+void setPrimitiveProjection(int viewportHeight, float fovYDegrees) {
+    primitivePixelsPerUnit = viewportHeight / (2.0f * tan(fovYDegrees * 3.14159265359f / 360.0f));
+}
+
+int selectPrimitiveLOD(float radius) {
+    float distance = renderItemDistance > 0.5f ? renderItemDistance : 0.5f;
+    float pixels = 2.0f * radius * primitivePixelsPerUnit / distance;
+    int lod = 0;
+    while (lod < PRIMITIVE_LOD_COUNT - 1 && pixels >= PRIMITIVE_LOD_PIXELS[lod]) {
+        lod++;
+    }
+    return lod;
+}
+
+void addPrimitiveVertex(PrimitiveMesh& mesh, float x, float y, float z, float nx, float ny, float nz) {
+    float len = sqrt(nx * nx + ny * ny + nz * nz);
+    if (len > 0) { nx /= len; ny /= len; nz /= len; }
+    mesh.vertices.push_back(x);
+    mesh.vertices.push_back(y);
+    mesh.vertices.push_back(z);
+    mesh.vertices.push_back(nx);
+    mesh.vertices.push_back(ny);
+    mesh.vertices.push_back(nz);
+}
+
+unsigned short primitiveVertexCount(const PrimitiveMesh& mesh) {
+    return (unsigned short)(mesh.vertices.size() / 6);
+}
+
+void addPrimitiveQuad(PrimitiveMesh& mesh, unsigned short a, unsigned short b, unsigned short c, unsigned short d) {
+    mesh.indices.push_back(a); mesh.indices.push_back(b); mesh.indices.push_back(c);
+    mesh.indices.push_back(a); mesh.indices.push_back(c); mesh.indices.push_back(d);
+}
+
+// Unit cube centered on the origin (same extents as glutSolidCube(1.0))
+void buildPrimitiveCube(PrimitiveMesh& mesh) {
+    static const float normals[6][3] = {
+        { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+    };
+    for (int f = 0; f < 6; f++) {
+        const float* n = normals[f];
+        // Two axes spanning the face, chosen so the corners wind counter-clockwise
+        float u[3] = { n[1], n[2], n[0] };
+        float v[3] = { n[1] * u[2] - n[2] * u[1], n[2] * u[0] - n[0] * u[2], n[0] * u[1] - n[1] * u[0] };
+        unsigned short base = primitiveVertexCount(mesh);
+        static const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+        for (int c = 0; c < 4; c++) {
+            float su = corners[c][0], sv = corners[c][1];
+            addPrimitiveVertex(mesh,
+                               0.5f * (n[0] + su * u[0] + sv * v[0]),
+                               0.5f * (n[1] + su * u[1] + sv * v[1]),
+                               0.5f * (n[2] + su * u[2] + sv * v[2]),
+                               n[0], n[1], n[2]);
+        }
+        addPrimitiveQuad(mesh, base, base + 1, base + 2, base + 3);
+    }
+}
+
+// Unit sphere centered on the origin
+void buildPrimitiveSphere(PrimitiveMesh& mesh, int slices, int stacks) {
+    for (int i = 0; i <= stacks; i++) {
+        float phi = 3.14159265359f * i / stacks;
+        for (int j = 0; j <= slices; j++) {
+            float theta = 2.0f * 3.14159265359f * j / slices;
+            float x = sin(phi) * cos(theta);
+            float y = sin(phi) * sin(theta);
+            float z = cos(phi);
+            addPrimitiveVertex(mesh, x, y, z, x, y, z);
+        }
+    }
+    for (int i = 0; i < stacks; i++) {
+        for (int j = 0; j < slices; j++) {
+            unsigned short a = (unsigned short)(i * (slices + 1) + j);
+            unsigned short b = (unsigned short)(a + slices + 1);
+            addPrimitiveQuad(mesh, a, b, b + 1, a + 1);
+        }
+    }
+}
+
+// Open cylinder along +Z from baseRadius at z=0 to topRadius at z=1
+// (same layout as gluCylinder, no caps)
+void buildPrimitiveCylinder(PrimitiveMesh& mesh, int slices, float baseRadius, float topRadius) {
+    for (int j = 0; j <= slices; j++) {
+        float theta = 2.0f * 3.14159265359f * j / slices;
+        float c = cos(theta), s = sin(theta);
+        addPrimitiveVertex(mesh, c * baseRadius, s * baseRadius, 0.0f, c, s, baseRadius - topRadius);
+        addPrimitiveVertex(mesh, c * topRadius, s * topRadius, 1.0f, c, s, baseRadius - topRadius);
+    }
+    for (int j = 0; j < slices; j++) {
+        unsigned short a = (unsigned short)(j * 2);
+        addPrimitiveQuad(mesh, a, a + 2, a + 3, a + 1);
+    }
+}
+
+// Cone along +Z with a unit-radius base at z=0 and apex at z=1
+// (same layout as glutSolidCone, base cap included)
+void buildPrimitiveCone(PrimitiveMesh& mesh, int slices) {
+    for (int j = 0; j < slices; j++) {
+        float t0 = 2.0f * 3.14159265359f * j / slices;
+        float t1 = 2.0f * 3.14159265359f * (j + 1) / slices;
+        float tm = 0.5f * (t0 + t1);
+        unsigned short base = primitiveVertexCount(mesh);
+        addPrimitiveVertex(mesh, cos(t0), sin(t0), 0.0f, cos(t0), sin(t0), 1.0f);
+        addPrimitiveVertex(mesh, cos(t1), sin(t1), 0.0f, cos(t1), sin(t1), 1.0f);
+        addPrimitiveVertex(mesh, 0.0f, 0.0f, 1.0f, cos(tm), sin(tm), 1.0f);
+        mesh.indices.push_back(base);
+        mesh.indices.push_back(base + 1);
+        mesh.indices.push_back(base + 2);
+    }
+
+    // Base cap facing -Z
+    unsigned short center = primitiveVertexCount(mesh);
+    addPrimitiveVertex(mesh, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f);
+    for (int j = 0; j <= slices; j++) {
+        float theta = 2.0f * 3.14159265359f * j / slices;
+        addPrimitiveVertex(mesh, cos(theta), sin(theta), 0.0f, 0.0f, 0.0f, -1.0f);
+    }
+    for (int j = 0; j < slices; j++) {
+        mesh.indices.push_back(center);
+        mesh.indices.push_back((unsigned short)(center + 2 + j));
+        mesh.indices.push_back((unsigned short)(center + 1 + j));
+    }
+}
+
+void uploadPrimitiveMesh(PrimitiveMesh& mesh) {
+    if (!glBuffersSupported) return;
+
+    pglGenBuffers(1, &mesh.vertexBuffer);
+    pglGenBuffers(1, &mesh.indexBuffer);
+    cachedBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    pglBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(float), &mesh.vertices[0], GL_STATIC_DRAW);
+    cachedBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    pglBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned short), &mesh.indices[0], GL_STATIC_DRAW);
+}
+
+// Fetch a primitive mesh, generating and uploading it on first use.
+// param is the tessellation level, or the cone's slice count. For cylinders
+// taper is topRadius / baseRadius; the cached mesh is normalized so its wider
+// end has radius 1.
+PrimitiveMesh& getPrimitiveMesh(int type, int param, float taper) {
+    // 7 bits of narrow/wide ratio plus a bit telling which end is narrower
+    bool topNarrower = taper < 1.0f;
+    float ratio = topNarrower ? taper : (taper > 0.0f ? 1.0f / taper : 0.0f);
+    unsigned int taperKey = ((unsigned int)(ratio * 127.0f + 0.5f) & 0x7F) | (topNarrower ? 0x80 : 0);
+    unsigned int key = ((unsigned int)type << 24) | (((unsigned int)param & 0xFFFF) << 8) | taperKey;
+
+    std::map<unsigned int, PrimitiveMesh>::iterator it = primitiveCache.find(key);
+    if (it != primitiveCache.end()) {
+        return it->second;
+    }
+
+    PrimitiveMesh& mesh = primitiveCache[key];
+    switch (type) {
+        case PRIMITIVE_CUBE:     buildPrimitiveCube(mesh); break;
+        case PRIMITIVE_SPHERE:   buildPrimitiveSphere(mesh, SPHERE_SLICES[param], SPHERE_STACKS[param]); break;
+        case PRIMITIVE_CYLINDER: {
+            float narrow = (taperKey & 0x7F) / 127.0f;
+            buildPrimitiveCylinder(mesh, CYLINDER_SLICES[param],
+                                   topNarrower ? 1.0f : narrow, topNarrower ? narrow : 1.0f);
+            break;
+        }
+        case PRIMITIVE_CONE:     buildPrimitiveCone(mesh, param); break;
+    }
+    uploadPrimitiveMesh(mesh);
+    return mesh;
+}
+
+// Build the shapes every frame needs up front, so the first frame does not stall
+void initPrimitives() {
+    getPrimitiveMesh(PRIMITIVE_CUBE, 0, 0.0f);
+    for (int lod = 0; lod < PRIMITIVE_LOD_COUNT; lod++) {
+        getPrimitiveMesh(PRIMITIVE_SPHERE, lod, 0.0f);
+    }
+
+    int vertexCount = 0;
+    std::map<unsigned int, PrimitiveMesh>::iterator it;
+    for (it = primitiveCache.begin(); it != primitiveCache.end(); ++it) {
+        vertexCount += primitiveVertexCount(it->second);
+    }
+    printf("Primitive meshes ready: %d meshes, %d vertices (%s)\n", (int)primitiveCache.size(),
+           vertexCount, glBuffersSupported ? "GPU buffers" : "client arrays");
+}
+
+void drawPrimitiveMesh(const PrimitiveMesh& mesh) {
+    cachedEnable(GL_VERTEX_ARRAY, true);
+    cachedEnable(GL_NORMAL_ARRAY, true);
+
+    // Array pointers only need to be set when the source mesh changes
+    if (glState.arraySource != &mesh) {
+        if (mesh.vertexBuffer != 0) {
+            cachedBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+            glVertexPointer(3, GL_FLOAT, PRIMITIVE_STRIDE, (const void*)0);
+            glNormalPointer(GL_FLOAT, PRIMITIVE_STRIDE, (const void*)(3 * sizeof(float)));
+        } else {
+            if (glBuffersSupported) cachedBindBuffer(GL_ARRAY_BUFFER, 0);
+            glVertexPointer(3, GL_FLOAT, PRIMITIVE_STRIDE, &mesh.vertices[0]);
+            glNormalPointer(GL_FLOAT, PRIMITIVE_STRIDE, &mesh.vertices[3]);
+        }
+        glState.arraySource = &mesh;
+        renderStats.stateChanges++;
+    }
+
+    if (mesh.indexBuffer != 0) {
+        cachedBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+        glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_SHORT, (const void*)0);
+    } else {
+        if (glBuffersSupported) cachedBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_SHORT, &mesh.indices[0]);
+    }
+    renderStats.drawCalls++;
+}
+
+// Drop-in replacements for the GLUT/GLU primitives
+
+void drawPrimitiveCube(float size) {
+    if (size != 1.0f) {
+        glPushMatrix();
+        glScalef(size, size, size);
+        drawPrimitiveMesh(getPrimitiveMesh(PRIMITIVE_CUBE, 0, 0.0f));
+        glPopMatrix();
+    } else {
+        drawPrimitiveMesh(getPrimitiveMesh(PRIMITIVE_CUBE, 0, 0.0f));
+    }
+}
+
+void drawPrimitiveSphere(float radius) {
+    glPushMatrix();
+    glScalef(radius, radius, radius);
+    drawPrimitiveMesh(getPrimitiveMesh(PRIMITIVE_SPHERE, selectPrimitiveLOD(radius), 0.0f));
+    glPopMatrix();
+}
+
+void drawPrimitiveCylinder(float baseRadius, float topRadius, float height) {
+    float radius = baseRadius > topRadius ? baseRadius : topRadius;
+    float taper = baseRadius > 0.0f ? topRadius / baseRadius : 1000.0f;
+    glPushMatrix();
+    glScalef(radius, radius, height);
+    drawPrimitiveMesh(getPrimitiveMesh(PRIMITIVE_CYLINDER, selectPrimitiveLOD(radius), taper));
+    glPopMatrix();
+}
+
+void drawPrimitiveCone(float baseRadius, float height, int slices) {
+    glPushMatrix();
+    glScalef(baseRadius, baseRadius, height);
+    drawPrimitiveMesh(getPrimitiveMesh(PRIMITIVE_CONE, slices, 0.0f));
+    glPopMatrix();
+}
+
+#endif // PRIMITIVES_H
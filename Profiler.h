@@ -0,0 +1,528 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#include "GLExtensions.h"
+
+// Hierarchical CPU/GPU frame profiler.
+//
+// PROFILE_SCOPE(name) and PROFILE_FUNCTION() time the rest of the enclosing
+// block on whichever thread runs it. Every thread records its finished scopes
+// (name, start, end, nesting depth) into a ring of its own, so recording takes
+// no locks. The render thread reads the rings for the overlay and the trace
+// export, copying at most half of another thread's ring so the writer cannot
+// lap the copy. Until the profiler is enabled a scope costs one relaxed atomic
+// load; defining BLITZ_NO_PROFILER compiles the scopes out entirely.
+//
+// PROFILE_GPU_SCOPE(name) times a render pass on the GPU with a
+// GL_TIME_ELAPSED query. These queries cannot nest, so a GPU scope opened
+// inside another one is ignored. Results are read PROFILER_GPU_LATENCY frames
+// later, when the GPU has long finished them, so reading them never stalls.
+//
+// profilerBeginFrame() marks frame boundaries on the render thread. The last
+// PROFILER_FRAMES frames are kept for the overlay (drawProfilerOverlay, with
+// averages over PROFILER_OVERLAY_FRAMES) and written as frame markers by
+// writeProfilerTrace, which exports everything still in the rings as Chrome
+// trace JSON (chrome://tracing or ui.perfetto.dev).
+#define PROFILER_THREAD_EVENTS 65536   // Per thread; a power of two
+#define PROFILER_FRAMES 240
+#define PROFILER_GPU_PASSES 16         // Per frame
+#define PROFILER_GPU_LATENCY 4         // Frames before GPU results are read
+#define PROFILER_OVERLAY_FRAMES 30
+#define PROFILER_OVERLAY_ROWS 32
+#define PROFILER_NAME_LENGTH 32
+#define PROFILER_TRACE_DEFAULT_PATH "blitzmail_trace.json"
+
+struct ProfileEvent {
+    const char* name;
+    long long start, end;      // Nanoseconds since startup
+    int depth;                 // Scopes open around it on its thread
+};
+
+struct ProfilerThread {
+    char name[PROFILER_NAME_LENGTH];
+    int id;
+    std::atomic<unsigned int> count;   // Events recorded; the next goes to count % PROFILER_THREAD_EVENTS
+    ProfileEvent events[PROFILER_THREAD_EVENTS];
+};
+
+struct ProfileGpuPass {
+    const char* name;
+    long long cpuStart;        // When the pass was issued
+    long long gpuTime;         // Nanoseconds, or -1 until the query is read
+    GLuint query;
+};
+
+struct ProfileFrame {
+    int index;
+    long long start, end;      // end is -1 while the frame is open
+    int gpuPassCount;
+    ProfileGpuPass gpuPasses[PROFILER_GPU_PASSES];
+};
+
+struct Profiler {
+    std::atomic<bool> enabled;
+    bool overlay;
+    std::mutex threadsMutex;
+    std::vector<ProfilerThread*> threads;
+    ProfileFrame frames[PROFILER_FRAMES];
+    int frameCount;            // Frames begun; frame f is frames[f % PROFILER_FRAMES]
+    bool frameOpen;            // The last frame begun is still being recorded
+    GLuint queries[PROFILER_GPU_LATENCY][PROFILER_GPU_PASSES];
+    bool queriesCreated;
+    bool gpuPassActive;
+};
+
+Profiler profiler;
+
+const std::chrono::steady_clock::time_point profilerEpoch = std::chrono::steady_clock::now();
+
+thread_local ProfilerThread* profilerThread = NULL;
+thread_local int profilerDepth = 0;
+thread_local char profilerThreadName[PROFILER_NAME_LENGTH] = "";
+
+long long profilerTicks() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profilerEpoch)
+        .count();
+}
+
+// Label the calling thread in the overlay and trace ("Job", 2 -> "Job 2")
+void setProfilerThreadName(const char* name, int index = -1) {
+    if (index >= 0) {
+        snprintf(profilerThreadName, sizeof(profilerThreadName), "%s %d", name, index);
+    } else {
+        snprintf(profilerThreadName, sizeof(profilerThreadName), "%s", name);
+    }
+    if (profilerThread) {
+        memcpy(profilerThread->name, profilerThreadName, sizeof(profilerThreadName));
+    }
+}
+
+// The calling thread's ring, created on its first event
+ProfilerThread* getProfilerThread() {
+    if (profilerThread) return profilerThread;
+    ProfilerThread* thread = new ProfilerThread;
+    thread->count.store(0);
+    std::lock_guard<std::mutex> lock(profiler.threadsMutex);
+    thread->id = (int)profiler.threads.size();
+    if (profilerThreadName[0]) {
+        memcpy(thread->name, profilerThreadName, sizeof(profilerThreadName));
+    } else {
+        snprintf(thread->name, sizeof(thread->name), "Thread %d", thread->id);
+    }
+    profiler.threads.push_back(thread);
+    profilerThread = thread;
+    return thread;
+}
+
+long long beginProfileScope() {
+    profilerDepth++;
+    return profilerTicks();
+}
+
+void endProfileScope(const char* name, long long start) {
+    long long end = profilerTicks();
+    profilerDepth--;
+    ProfilerThread* thread = getProfilerThread();
+    unsigned int n = thread->count.load(std::memory_order_relaxed);
+    ProfileEvent& event = thread->events[n % PROFILER_THREAD_EVENTS];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    event.depth = profilerDepth;
+    thread->count.store(n + 1, std::memory_order_release);
+}
+
+struct ProfileScope {
+    const char* name;
+    long long start;           // -1 when the profiler was off at entry
+
+    explicit ProfileScope(const char* scopeName)
+        : name(scopeName), start(profiler.enabled.load(std::memory_order_relaxed) ? beginProfileScope() : -1) {}
+    ~ProfileScope() {
+        if (start >= 0) endProfileScope(name, start);
+    }
+};
+
+// Start timing a GPU pass in the current frame; false if it cannot be timed
+bool beginGpuPass(const char* name) {
+    Profiler& p = profiler;
+    if (!p.enabled.load(std::memory_order_relaxed) || !glTimerQueriesSupported || p.gpuPassActive ||
+        !p.frameOpen) {
+        return false;
+    }
+    ProfileFrame& frame = p.frames[(p.frameCount - 1) % PROFILER_FRAMES];
+    if (frame.gpuPassCount == PROFILER_GPU_PASSES) return false;
+    if (!p.queriesCreated) {
+        pglGenQueries(PROFILER_GPU_LATENCY * PROFILER_GPU_PASSES, &p.queries[0][0]);
+        p.queriesCreated = true;
+    }
+    ProfileGpuPass& pass = frame.gpuPasses[frame.gpuPassCount];
+    pass.name = name;
+    pass.cpuStart = profilerTicks();
+    pass.gpuTime = -1;
+    pass.query = p.queries[(p.frameCount - 1) % PROFILER_GPU_LATENCY][frame.gpuPassCount];
+    frame.gpuPassCount++;
+    pglBeginQuery(GL_TIME_ELAPSED, pass.query);
+    p.gpuPassActive = true;
+    return true;
+}
+
+void endGpuPass() {
+    pglEndQuery(GL_TIME_ELAPSED);
+    profiler.gpuPassActive = false;
+}
+
+struct GpuProfileScope {
+    bool active;
+
+    explicit GpuProfileScope(const char* name) : active(beginGpuPass(name)) {}
+    ~GpuProfileScope() {
+        if (active) endGpuPass();
+    }
+};
+
+#ifdef BLITZ_NO_PROFILER
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_GPU_SCOPE(name)
+#else
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_JOIN(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope PROFILE_JOIN(gpuProfileScope, __LINE__)(name)
+#endif
+
+// Read the GPU times of a finished frame (blocks only if the GPU is more than
+// PROFILER_GPU_LATENCY frames behind)
+void resolveGpuPasses(ProfileFrame& frame) {
+    for (int i = 0; i < frame.gpuPassCount; i++) {
+        ProfileGpuPass& pass = frame.gpuPasses[i];
+        if (pass.gpuTime >= 0) continue;
+        unsigned long long elapsed = 0;
+        pglGetQueryObjectui64v(pass.query, GL_QUERY_RESULT, &elapsed);
+        pass.gpuTime = (long long)elapsed;
+    }
+}
+
+// Start recording scopes, or stop (what was recorded stays for export)
+void setProfilerEnabled(bool enabled) {
+    profiler.enabled.store(enabled, std::memory_order_relaxed);
+    if (!enabled) {
+        // The open frame is left unfinished; overlay averages skip it
+        profiler.frameOpen = false;
+    }
+}
+
+// Close the previous frame and open the next; call on the render thread at
+// the start of each frame
+void profilerBeginFrame() {
+    Profiler& p = profiler;
+    if (!p.enabled.load(std::memory_order_relaxed)) return;
+    long long now = profilerTicks();
+    if (p.frameOpen) {
+        p.frames[(p.frameCount - 1) % PROFILER_FRAMES].end = now;
+    }
+    // This frame reuses the queries of the frame PROFILER_GPU_LATENCY back
+    if (p.frameCount >= PROFILER_GPU_LATENCY) {
+        resolveGpuPasses(p.frames[(p.frameCount - PROFILER_GPU_LATENCY) % PROFILER_FRAMES]);
+    }
+    ProfileFrame& frame = p.frames[p.frameCount % PROFILER_FRAMES];
+    frame.index = p.frameCount;
+    frame.start = now;
+    frame.end = -1;
+    frame.gpuPassCount = 0;
+    p.frameCount++;
+    p.frameOpen = true;
+}
+
+// Copy a thread's recorded events, oldest first
+void copyProfileEvents(ProfilerThread* thread, std::vector<ProfileEvent>& events) {
+    unsigned int count = thread->count.load(std::memory_order_acquire);
+    unsigned int available = (thread == profilerThread) ? PROFILER_THREAD_EVENTS : PROFILER_THREAD_EVENTS / 2;
+    if (count < available) available = count;
+    events.clear();
+    events.reserve(available);
+    for (unsigned int i = count - available; i != count; i++) {
+        events.push_back(thread->events[i % PROFILER_THREAD_EVENTS]);
+    }
+}
+
+std::vector<ProfilerThread*> getProfilerThreads() {
+    std::lock_guard<std::mutex> lock(profiler.threadsMutex);
+    return profiler.threads;
+}
+
+// Consecutive finished frames, newest last: [first, last]; false if none
+bool getFinishedProfileFrames(int maxFrames, int& first, int& last) {
+    Profiler& p = profiler;
+    last = p.frameCount - 1;
+    if (last >= 0 && p.frames[last % PROFILER_FRAMES].end < 0) last--;
+    first = last + 1;
+    while (first > 0 && last - first + 1 < maxFrames && p.frameCount - first < PROFILER_FRAMES &&
+           p.frames[(first - 1) % PROFILER_FRAMES].end >= 0) {
+        first--;
+    }
+    return first <= last;
+}
+
+// One line of the overlay: a scope name under a given parent row
+struct ProfileRow {
+    const char* name;
+    int parent;                // Row index, or -1 at the top
+    int depth;
+    long long total;           // Over the averaged frames
+    int calls;
+};
+
+int findProfileRow(std::vector<ProfileRow>& rows, const char* name, int parent, int depth) {
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (rows[i].parent == parent && strcmp(rows[i].name, name) == 0) return (int)i;
+    }
+    ProfileRow added = { name, parent, depth, 0, 0 };
+    rows.push_back(added);
+    return (int)rows.size() - 1;
+}
+
+// Rows depth-first, children in the order they were first seen
+void orderProfileRows(const std::vector<ProfileRow>& rows, int parent, std::vector<int>& order) {
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (rows[i].parent != parent) continue;
+        order.push_back((int)i);
+        orderProfileRows(rows, (int)i, order);
+    }
+}
+
+bool compareProfileEventStart(const ProfileEvent& a, const ProfileEvent& b) {
+    return a.start < b.start || (a.start == b.start && a.depth < b.depth);
+}
+
+void drawProfilerText(int x, int y, const char* text) {
+    glRasterPos2i(x, y);
+    for (const char* c = text; *c; c++) {
+        glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+    }
+}
+
+// Averages over the last PROFILER_OVERLAY_FRAMES frames, drawn in the top
+// left corner: frame time, GPU passes, the render thread's scopes in call
+// order and how busy the other threads were
+void drawProfilerOverlay() {
+    Profiler& p = profiler;
+    int first, last;
+    if (!p.overlay || !getFinishedProfileFrames(PROFILER_OVERLAY_FRAMES, first, last)) return;
+    PROFILE_GPU_SCOPE("Profiler overlay");
+    int frames = last - first + 1;
+    long long windowStart = p.frames[first % PROFILER_FRAMES].start;
+    long long windowEnd = p.frames[last % PROFILER_FRAMES].end;
+
+    char lines[PROFILER_OVERLAY_ROWS + 8][96];
+    int lineCount = 0;
+    snprintf(lines[lineCount++], sizeof(lines[0]), "Frame %.2f ms (%d frames averaged)",
+             (windowEnd - windowStart) / 1e6 / frames, frames);
+
+    // GPU passes of the frames whose queries have been read
+    std::vector<ProfileRow> gpuRows;
+    int gpuFrames = 0;
+    for (int f = first; f <= last; f++) {
+        const ProfileFrame& frame = p.frames[f % PROFILER_FRAMES];
+        if (frame.gpuPassCount == 0 || frame.gpuPasses[0].gpuTime < 0) continue;
+        gpuFrames++;
+        for (int i = 0; i < frame.gpuPassCount; i++) {
+            int row = findProfileRow(gpuRows, frame.gpuPasses[i].name, -1, 0);
+            gpuRows[row].total += frame.gpuPasses[i].gpuTime;
+            gpuRows[row].calls++;
+        }
+    }
+    if (gpuFrames > 0) {
+        long long gpuTotal = 0;
+        for (size_t i = 0; i < gpuRows.size(); i++) gpuTotal += gpuRows[i].total;
+        snprintf(lines[lineCount++], sizeof(lines[0]), "GPU %.2f ms", gpuTotal / 1e6 / gpuFrames);
+        for (size_t i = 0; i < gpuRows.size() && lineCount < 6; i++) {
+            snprintf(lines[lineCount++], sizeof(lines[0]), "  %-26s %7.2f ms", gpuRows[i].name,
+                     gpuRows[i].total / 1e6 / gpuFrames);
+        }
+    } else if (!glTimerQueriesSupported) {
+        snprintf(lines[lineCount++], sizeof(lines[0]), "GPU timer queries not available");
+    }
+
+    // This thread's scopes as a call tree. Sorted by start, the last scope
+    // seen one level up encloses each event, unless it ended first (its
+    // parent was not recorded).
+    std::vector<ProfileEvent> events;
+    std::vector<ProfileRow> rows;
+    std::vector<int> openRow;
+    std::vector<long long> openEnd;
+    copyProfileEvents(getProfilerThread(), events);
+    std::sort(events.begin(), events.end(), compareProfileEventStart);
+    for (size_t i = 0; i < events.size(); i++) {
+        const ProfileEvent& e = events[i];
+        if (e.start < windowStart || e.start >= windowEnd) continue;
+        int parent = -1;
+        if (e.depth > 0 && e.depth <= (int)openRow.size() && openEnd[e.depth - 1] >= e.end) {
+            parent = openRow[e.depth - 1];
+        }
+        int depth = parent < 0 ? 0 : rows[parent].depth + 1;
+        int row = findProfileRow(rows, e.name, parent, depth);
+        rows[row].total += e.end - e.start;
+        rows[row].calls++;
+        if ((int)openRow.size() <= e.depth) {
+            openRow.resize(e.depth + 1);
+            openEnd.resize(e.depth + 1);
+        }
+        openRow[e.depth] = row;
+        openEnd[e.depth] = e.end;
+    }
+    std::vector<int> order;
+    orderProfileRows(rows, -1, order);
+    snprintf(lines[lineCount++], sizeof(lines[0]), "%-28s %7s %6s", getProfilerThread()->name, "ms", "calls");
+    for (size_t i = 0; i < order.size() && lineCount < PROFILER_OVERLAY_ROWS; i++) {
+        const ProfileRow& row = rows[order[i]];
+        char label[64];
+        int indent = row.depth < 8 ? row.depth * 2 : 16;
+        snprintf(label, sizeof(label), "%*s%s", indent + 2, "", row.name);
+        snprintf(lines[lineCount++], sizeof(lines[0]), "%-28.28s %7.2f %6.1f", label, row.total / 1e6 / frames,
+                 (float)row.calls / frames);
+    }
+
+    // Other threads: time inside their outermost scopes during the window
+    std::vector<ProfilerThread*> threads = getProfilerThreads();
+    for (size_t t = 0; t < threads.size() && lineCount < PROFILER_OVERLAY_ROWS + 8; t++) {
+        if (threads[t] == profilerThread) continue;
+        copyProfileEvents(threads[t], events);
+        long long busy = 0;
+        for (size_t i = 0; i < events.size(); i++) {
+            const ProfileEvent& e = events[i];
+            if (e.depth != 0) continue;
+            long long start = std::max(e.start, windowStart);
+            long long end = std::min(e.end, windowEnd);
+            if (end > start) busy += end - start;
+        }
+        if (busy == 0) continue;
+        snprintf(lines[lineCount++], sizeof(lines[0]), "%-28s %7.2f ms busy", threads[t]->name,
+                 busy / 1e6 / frames);
+    }
+
+    // Dark panel with the text on top, in window coordinates
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    int lineHeight = 14;
+    int width = 8 * 48 + 12;
+    int height = lineCount * lineHeight + 10;
+    int top = viewport[3] - 8;
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0, viewport[2], 0, viewport[3], -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_COLOR_BUFFER_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_FOG);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glColor4f(0.0f, 0.0f, 0.0f, 0.6f);
+    glBegin(GL_QUADS);
+    glVertex2i(8, top);
+    glVertex2i(8 + width, top);
+    glVertex2i(8 + width, top - height);
+    glVertex2i(8, top - height);
+    glEnd();
+    glColor3f(1.0f, 1.0f, 1.0f);
+    for (int i = 0; i < lineCount; i++) {
+        drawProfilerText(14, top - 16 - i * lineHeight, lines[i]);
+    }
+    glPopAttrib();
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+void writeTraceString(FILE* file, const char* text) {
+    fputc('"', file);
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') fputc('\\', file);
+        if ((unsigned char)*c >= 0x20) fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+void writeTraceEvent(FILE* file, bool& firstEvent, const char* name, int tid, long long start, long long duration) {
+    fprintf(file, "%s\n{\"name\":", firstEvent ? "" : ",");
+    writeTraceString(file, name);
+    fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", tid, start / 1e3, duration / 1e3);
+    firstEvent = false;
+}
+
+void writeTraceThreadName(FILE* file, bool& firstEvent, const char* name, int tid) {
+    fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+            firstEvent ? "" : ",", tid);
+    writeTraceString(file, name);
+    fprintf(file, "}}");
+    firstEvent = false;
+}
+
+// Write every recorded scope, the kept frames and their GPU passes as a
+// Chrome trace. GPU passes go on their own track, placed at the time they
+// were issued with their GPU duration.
+bool writeProfilerTrace(const char* filename) {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        printf("Could not write profiler trace %s\n", filename);
+        return false;
+    }
+    Profiler& p = profiler;
+    std::vector<ProfilerThread*> threads = getProfilerThreads();
+    int gpuTrack = (int)threads.size();
+    int frameTrack = gpuTrack + 1;
+    int written = 0;
+    bool firstEvent = true;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    std::vector<ProfileEvent> events;
+    for (size_t t = 0; t < threads.size(); t++) {
+        writeTraceThreadName(file, firstEvent, threads[t]->name, threads[t]->id);
+        copyProfileEvents(threads[t], events);
+        for (size_t i = 0; i < events.size(); i++) {
+            writeTraceEvent(file, firstEvent, events[i].name, threads[t]->id, events[i].start,
+                            events[i].end - events[i].start);
+        }
+        written += (int)events.size();
+    }
+
+    writeTraceThreadName(file, firstEvent, "GPU", gpuTrack);
+    writeTraceThreadName(file, firstEvent, "Frames", frameTrack);
+    int oldest = std::max(0, p.frameCount - PROFILER_FRAMES);
+    for (int f = oldest; f < p.frameCount; f++) {
+        const ProfileFrame& frame = p.frames[f % PROFILER_FRAMES];
+        if (frame.end < 0) continue;
+        char name[32];
+        snprintf(name, sizeof(name), "Frame %d", frame.index);
+        writeTraceEvent(file, firstEvent, name, frameTrack, frame.start, frame.end - frame.start);
+        written++;
+        for (int i = 0; i < frame.gpuPassCount; i++) {
+            const ProfileGpuPass& pass = frame.gpuPasses[i];
+            if (pass.gpuTime < 0) continue;
+            writeTraceEvent(file, firstEvent, pass.name, gpuTrack, pass.cpuStart, pass.gpuTime);
+            written++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    printf("Profiler trace: %d events written to %s\n", written, filename);
+    return true;
+}
+
+#endif // PROFILER_H
@@ -0,0 +1,299 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#ifdef _WIN32
+#include <glut.h>
+#else
+#include <GL/glut.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "GLExtensions.h"
+#include "Profiler.h"
+
+// Render queue with state-sorted draw keys.
+//
+// Every draw is submitted as a 64-bit sort key plus a callback. Once per frame
+// the queue is radix-sorted by key and executed, so draws sharing a material
+// and texture run back to back. All texture/enable/color changes go through
+// the GL state cache below, which drops redundant calls and counts the rest.
+//
+// Key layout (most significant first):
+//   [63..60] pass       - prelit, then lit opaque, then transparent draws
+//   [59..44] material   - object kind / primitive material
+//   [43..24] texture    - GL texture name (0 = untextured)
+//   [23..0]  depth      - quantized view distance (front-to-back for opaque)
+
+typedef unsigned long long RenderKey;
+
+#define RENDER_PASS_PRELIT 0       // Opaque static geometry with baked lighting
+#define RENDER_PASS_OPAQUE 1
+#define RENDER_PASS_TRANSPARENT 2
+
+#define RENDER_DEPTH_BITS 24
+#define RENDER_DEPTH_MAX 300.0f  // Matches the far plane in Reshape
+
+RenderKey makeRenderKey(unsigned int pass, unsigned int material, unsigned int texture, float depth) {
+    if (depth < 0.0f) depth = 0.0f;
+    if (depth > RENDER_DEPTH_MAX) depth = RENDER_DEPTH_MAX;
+    unsigned int depthBits = (unsigned int)(depth / RENDER_DEPTH_MAX * ((1 << RENDER_DEPTH_BITS) - 1));
+    if (pass == RENDER_PASS_TRANSPARENT) {
+        // Back-to-front for blending
+        depthBits = ((1 << RENDER_DEPTH_BITS) - 1) - depthBits;
+    }
+    return ((RenderKey)(pass & 0xF) << 60) |
+           ((RenderKey)(material & 0xFFFF) << 44) |
+           ((RenderKey)(texture & 0xFFFFF) << 24) |
+           (RenderKey)depthBits;
+}
+
+// Per-frame counters
+struct RenderStats {
+    int drawCalls;     // Draw items executed plus mesh batches inside them
+    int stateChanges;  // glEnable/glDisable/glColor calls that reached GL
+    int binds;         // glBindTexture/glBindBuffer calls that reached GL
+    int skipped;       // Redundant calls dropped by the state cache
+};
+
+RenderStats renderStats;
+
+// GL state cache - mirrors the state it has set so repeated requests are free
+struct GLStateCache {
+    bool texture2D;
+    bool lighting;
+    GLuint boundTexture;
+    GLuint boundArrayBuffer;
+    GLuint boundElementBuffer;
+    bool vertexArray;
+    bool normalArray;
+    bool colorArray;
+    bool texCoordArray;
+    const void* arraySource;  // Mesh the vertex array pointers were last set up for
+    float color[3];
+    bool colorValid;
+    GLuint untexturedTexture;  // Bound instead of "no texture" while a shader samples unconditionally
+};
+
+GLStateCache glState;
+
+// Force the cached state and GL into a known baseline at the start of a frame
+void resetGLStateCache() {
+    glDisable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glEnable(GL_LIGHTING);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    if (glBuffersSupported) {
+        pglBindBuffer(GL_ARRAY_BUFFER, 0);
+        pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+    glState.texture2D = false;
+    glState.lighting = true;
+    glState.boundTexture = 0;
+    glState.boundArrayBuffer = 0;
+    glState.boundElementBuffer = 0;
+    glState.vertexArray = false;
+    glState.normalArray = false;
+    glState.colorArray = false;
+    glState.texCoordArray = false;
+    glState.arraySource = NULL;
+    glState.colorValid = false;
+}
+
+void cachedEnable(GLenum cap, bool enable) {
+    bool* cached = NULL;
+    bool clientState = false;
+    if (cap == GL_TEXTURE_2D) cached = &glState.texture2D;
+    else if (cap == GL_LIGHTING) cached = &glState.lighting;
+    else if (cap == GL_VERTEX_ARRAY) { cached = &glState.vertexArray; clientState = true; }
+    else if (cap == GL_NORMAL_ARRAY) { cached = &glState.normalArray; clientState = true; }
+    else if (cap == GL_COLOR_ARRAY) { cached = &glState.colorArray; clientState = true; }
+    else if (cap == GL_TEXTURE_COORD_ARRAY) { cached = &glState.texCoordArray; clientState = true; }
+
+    if (cached && *cached == enable) {
+        renderStats.skipped++;
+        return;
+    }
+    if (clientState) {
+        if (enable) glEnableClientState(cap);
+        else glDisableClientState(cap);
+    } else {
+        if (enable) glEnable(cap);
+        else glDisable(cap);
+    }
+    if (cached) *cached = enable;
+    renderStats.stateChanges++;
+}
+
+void cachedBindBuffer(GLenum target, GLuint buffer) {
+    GLuint* cached = (target == GL_ELEMENT_ARRAY_BUFFER) ? &glState.boundElementBuffer : &glState.boundArrayBuffer;
+    if (*cached == buffer) {
+        renderStats.skipped++;
+        return;
+    }
+    pglBindBuffer(target, buffer);
+    *cached = buffer;
+    renderStats.binds++;
+}
+
+void cachedBindTexture(GLuint texture) {
+    if (glState.boundTexture == texture) {
+        renderStats.skipped++;
+        return;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glState.boundTexture = texture;
+    renderStats.binds++;
+}
+
+// Enable texturing with the given texture, or disable it for texture 0
+void cachedUseTexture(GLuint texture) {
+    if (texture == 0 && glState.untexturedTexture != 0) {
+        cachedBindTexture(glState.untexturedTexture);
+    } else if (texture != 0) {
+        cachedEnable(GL_TEXTURE_2D, true);
+        cachedBindTexture(texture);
+    } else {
+        cachedEnable(GL_TEXTURE_2D, false);
+    }
+}
+
+void cachedColor3f(float r, float g, float b) {
+    if (glState.colorValid && glState.color[0] == r && glState.color[1] == g && glState.color[2] == b) {
+        renderStats.skipped++;
+        return;
+    }
+    glColor3f(r, g, b);
+    glState.color[0] = r;
+    glState.color[1] = g;
+    glState.color[2] = b;
+    glState.colorValid = true;
+    renderStats.stateChanges++;
+}
+
+// Draw callback; data points at whatever the submitter needs (must outlive the frame)
+typedef void (*RenderFunc)(const void* data);
+
+struct RenderItem {
+    RenderKey key;
+    RenderFunc draw;
+    const void* data;
+    float distance;  // Unquantized view distance
+};
+
+struct RenderQueue {
+    std::vector<RenderItem> items;
+    std::vector<RenderItem> scratch;  // Radix sort ping-pong buffer
+};
+
+RenderQueue renderQueue;
+
+void clearRenderQueue(RenderQueue& queue) {
+    queue.items.clear();
+}
+
+void submitRenderItem(RenderQueue& queue, RenderKey key, RenderFunc draw, const void* data, float distance) {
+    RenderItem item;
+    item.key = key;
+    item.draw = draw;
+    item.data = data;
+    item.distance = distance;
+    queue.items.push_back(item);
+}
+
+// LSD radix sort on the 64-bit key, 8 bits per pass. Passes where every key
+// has the same byte are skipped, which is most of them for a typical frame.
+// Stable, so equal keys keep submission order.
+void sortRenderQueue(RenderQueue& queue) {
+    PROFILE_FUNCTION();
+    size_t count = queue.items.size();
+    if (count < 2) return;
+    queue.scratch.resize(count);
+
+    RenderItem* src = &queue.items[0];
+    RenderItem* dst = &queue.scratch[0];
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256];
+        memset(histogram, 0, sizeof(histogram));
+        for (size_t i = 0; i < count; i++) {
+            histogram[(src[i].key >> shift) & 0xFF]++;
+        }
+        if (histogram[(src[0].key >> shift) & 0xFF] == count) {
+            continue;  // All keys share this byte
+        }
+
+        size_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t n = histogram[b];
+            histogram[b] = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < count; i++) {
+            dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+        }
+
+        RenderItem* tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != &queue.items[0]) {
+        memcpy(&queue.items[0], src, count * sizeof(RenderItem));
+    }
+}
+
+// Distance of the item being executed, for level-of-detail decisions in draw callbacks
+float renderItemDistance = 0.0f;
+
+// Optional per-pass setup, called whenever the pass of the executed items
+// changes and once more with RENDER_PASS_OPAQUE after the last item
+typedef void (*RenderPassFunc)(unsigned int pass);
+RenderPassFunc renderPassBegin = NULL;
+
+void executeRenderQueue(const RenderQueue& queue) {
+    PROFILE_FUNCTION();
+    unsigned int currentPass = RENDER_PASS_OPAQUE;
+    for (size_t i = 0; i < queue.items.size(); i++) {
+        const RenderItem& item = queue.items[i];
+        unsigned int pass = (unsigned int)(item.key >> 60);
+        if (renderPassBegin && (i == 0 || pass != currentPass)) {
+            renderPassBegin(pass);
+        }
+        currentPass = pass;
+        cachedUseTexture((GLuint)((item.key >> 24) & 0xFFFFF));
+        renderItemDistance = item.distance;
+        item.draw(item.data);
+        renderStats.drawCalls++;
+    }
+
+    // Leave no buffers or arrays bound, and the default pass state, for code outside the queue
+    if (renderPassBegin && currentPass != RENDER_PASS_OPAQUE) {
+        renderPassBegin(RENDER_PASS_OPAQUE);
+    }
+    if (glBuffersSupported) {
+        cachedBindBuffer(GL_ARRAY_BUFFER, 0);
+        cachedBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+    cachedEnable(GL_VERTEX_ARRAY, false);
+    cachedEnable(GL_NORMAL_ARRAY, false);
+    cachedEnable(GL_COLOR_ARRAY, false);
+    cachedEnable(GL_TEXTURE_COORD_ARRAY, false);
+}
+
+void resetRenderStats() {
+    memset(&renderStats, 0, sizeof(renderStats));
+}
+
+void printRenderStats(int frame) {
+    printf("Frame %d: %d draw calls, %d state changes, %d binds, %d redundant calls skipped\n",
+           frame, renderStats.drawCalls, renderStats.stateChanges,
+           renderStats.binds, renderStats.skipped);
+}
+
+#endif // RENDER_QUEUE_H
@@ -0,0 +1,143 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+
+#include "ModelLoader.h"
+#include "MathLib.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+// Flat transform hierarchy stored as parallel arrays.
+//
+// Nodes are appended depth-first, so every parent comes before its children
+// and a node's subtree is the contiguous range [node, subtreeEnd[node]).
+// Changing a node's local matrix marks it dirty; updateSceneGraph() walks only
+// the dirty subtrees, recomputing world matrices and world-space bounds in
+// order. Nodes that never move are computed once and cost nothing per frame.
+// Dirty subtrees do not overlap, so they are updated in parallel.
+
+#define SCENE_NO_NODE -1
+
+struct SceneGraph {
+    std::vector<int> parent;
+    std::vector<int> subtreeEnd;            // One past the node's last descendant
+    std::vector<mat4> local;
+    std::vector<mat4> world;                // Parent world * local
+    std::vector<Vector3> localBoundsMin, localBoundsMax;  // Node-space AABB (may be empty)
+    std::vector<Vector3> worldBoundsMin, worldBoundsMax;
+    std::vector<unsigned char> dirty;
+    std::vector<int> dirtyNodes;            // Nodes marked since the last update
+    std::vector<int> updateRoots;           // Disjoint dirty subtrees of the current update
+    int updatedNodes;                       // World matrices recomputed by the last update
+};
+
+SceneGraph sceneGraph;
+
+void clearSceneGraph() {
+    SceneGraph& sg = sceneGraph;
+    sg.parent.clear();
+    sg.subtreeEnd.clear();
+    sg.local.clear();
+    sg.world.clear();
+    sg.localBoundsMin.clear();
+    sg.localBoundsMax.clear();
+    sg.worldBoundsMin.clear();
+    sg.worldBoundsMax.clear();
+    sg.dirty.clear();
+    sg.dirtyNodes.clear();
+    sg.updateRoots.clear();
+    sg.updatedNodes = 0;
+}
+
+void markSceneNodeDirty(int node) {
+    if (sceneGraph.dirty[node]) return;
+    sceneGraph.dirty[node] = 1;
+    sceneGraph.dirtyNodes.push_back(node);
+}
+
+// Append a node under parent (or SCENE_NO_NODE for a root). Children must be
+// added while their parent's subtree is still the last one in the graph.
+int addSceneNode(int parent, const mat4& local, const Vector3& boundsMin, const Vector3& boundsMax) {
+    SceneGraph& sg = sceneGraph;
+    int node = (int)sg.parent.size();
+    if (parent != SCENE_NO_NODE && sg.subtreeEnd[parent] != node) {
+        printf("Scene node %d added out of depth-first order under %d\n", node, parent);
+        return SCENE_NO_NODE;
+    }
+
+    sg.parent.push_back(parent);
+    sg.subtreeEnd.push_back(node + 1);
+    sg.local.push_back(local);
+    sg.world.push_back(local);
+    sg.localBoundsMin.push_back(boundsMin);
+    sg.localBoundsMax.push_back(boundsMax);
+    sg.worldBoundsMin.push_back(boundsMin);
+    sg.worldBoundsMax.push_back(boundsMax);
+    sg.dirty.push_back(0);
+    for (int p = parent; p != SCENE_NO_NODE; p = sg.parent[p]) {
+        sg.subtreeEnd[p] = node + 1;
+    }
+    markSceneNodeDirty(node);
+    return node;
+}
+
+int addSceneNode(int parent, const mat4& local) {
+    return addSceneNode(parent, local, Vector3(0, 0, 0), Vector3(0, 0, 0));
+}
+
+void setSceneNodeLocal(int node, const mat4& local) {
+    sceneGraph.local[node] = local;
+    markSceneNodeDirty(node);
+}
+
+const float* getSceneNodeWorld(int node) {
+    return sceneGraph.world[node].m;
+}
+
+// World matrices and bounds of the subtrees under updateRoots[begin, end)
+void updateSceneSubtrees(void* data, int begin, int end) {
+    PROFILE_FUNCTION();
+    SceneGraph& sg = *(SceneGraph*)data;
+    for (int r = begin; r < end; r++) {
+        int first = sg.updateRoots[r];
+        int last = sg.subtreeEnd[first];
+        for (int i = first; i < last; i++) {
+            if (sg.parent[i] == SCENE_NO_NODE) {
+                sg.world[i] = sg.local[i];
+            } else {
+                multiplyMatrices(sg.world[sg.parent[i]].m, sg.local[i].m, sg.world[i].m);
+            }
+            transformAABB(sg.world[i].m, sg.localBoundsMin[i], sg.localBoundsMax[i],
+                          sg.worldBoundsMin[i], sg.worldBoundsMax[i]);
+            sg.dirty[i] = 0;
+        }
+    }
+}
+
+// Recompute world matrices and bounds for every dirty node and its subtree
+void updateSceneGraph() {
+    PROFILE_FUNCTION();
+    SceneGraph& sg = sceneGraph;
+    sg.updatedNodes = 0;
+    if (sg.dirtyNodes.empty()) return;
+
+    // Ascending order visits parents before their dirty descendants, which are
+    // then already covered by the parent's range
+    std::sort(sg.dirtyNodes.begin(), sg.dirtyNodes.end());
+    sg.updateRoots.clear();
+    int updatedUntil = 0;
+    for (size_t d = 0; d < sg.dirtyNodes.size(); d++) {
+        int first = sg.dirtyNodes[d];
+        if (first < updatedUntil) continue;
+        sg.updateRoots.push_back(first);
+        sg.updatedNodes += sg.subtreeEnd[first] - first;
+        updatedUntil = sg.subtreeEnd[first];
+    }
+    parallelFor((int)sg.updateRoots.size(), 64, updateSceneSubtrees, &sg);
+    sg.dirtyNodes.clear();
+}
+
+#endif // SCENE_GRAPH_H
@@ -0,0 +1,445 @@
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "GLExtensions.h"
+#include "RenderQueue.h"
+#include "Visibility.h"
+#include "Profiler.h"
+
+// Cascaded shadow maps for the sun, cached across frames.
+//
+// SHADOW_CASCADES square cascades of growing size are centered on the camera
+// in light space. They are not fitted to the view frustum, so turning the
+// camera never invalidates them. Each cascade keeps two depth maps:
+//
+//   static map - static casters only. Re-rendered when the cascade's snapped
+//                center scrolls one step, or when the sun has moved past the
+//                cascade's SHADOW_SUN_THRESHOLD since the last render. Sun
+//                updates are spread out, at most one cascade (the stalest)
+//                per frame.
+//   shadow map - what the shaders sample: the static map blitted in with the
+//                dynamic casters (player, packages) drawn on top. Only redone
+//                for cascades whose static map changed, or that need dynamic
+//                casters this frame or held some last frame.
+//
+// The shadow of a caster lands at the caster's own light-space position, and
+// the shaders use the smallest cascade covering a fragment, so a dynamic
+// caster is only drawn into the smallest cascade that holds it whole. In
+// steady state a frame costs one blit and a few small draws for the cascade
+// around the player. Shadows need GLSL and framebuffer objects; the
+// fixed-function lighting path draws without them.
+
+#define SHADOW_CASCADES 3            // The lighting shader has one sampler per cascade
+#define SHADOW_MAP_SIZE 1024
+#define SHADOW_SCROLL_FRACTION 0.25f // Center snaps in steps of this fraction of the radius
+#define SHADOW_MIN_SUN_HEIGHT 0.1f   // Sine of the sun elevation below which nothing casts
+#define SHADOW_FIRST_UNIT 4          // Cascade i is bound to texture unit SHADOW_FIRST_UNIT + i
+#define SHADOW_SLOPE_BIAS 2.0f       // glPolygonOffset while rendering depth
+#define SHADOW_CONSTANT_BIAS 4.0f
+
+// Radius around the camera each cascade must cover
+const float SHADOW_CASCADE_RADIUS[SHADOW_CASCADES] = { 12.0f, 36.0f, 110.0f };
+// Degrees the sun may move before a cascade's static casters are re-rendered;
+// coarser cascades have bigger texels and hide more
+const float SHADOW_SUN_THRESHOLD[SHADOW_CASCADES] = { 0.5f, 1.0f, 2.0f };
+
+struct ShadowCaster {
+    RenderFunc draw;
+    const void* data;
+    Vector3 boundsMin, boundsMax;
+};
+
+struct ShadowCascade {
+    float halfExtent;                // Ortho half-size: radius plus one scroll step
+    float step;                      // Center snapping step, a whole number of texels
+    float centerX, centerY;          // Light-space center of the static map
+    float sunAngle;                  // Sun angle of the static map
+    bool staticValid;
+    bool hadDynamic;                 // Shadow map holds dynamic casters from last frame
+    float view[16], projection[16];  // Light matrices of the static map
+    Frustum frustum;
+    GLuint staticTexture, texture;
+    GLuint staticFramebuffer, framebuffer;
+};
+
+struct ShadowStats {
+    int staticRenders;   // Cascades whose static casters were re-rendered
+    int composites;      // Static-to-shadow map blits with dynamic casters
+    int casterDraws;     // Caster draw calls across both
+};
+
+struct ShadowMaps {
+    ShadowCascade cascades[SHADOW_CASCADES];
+    std::vector<ShadowCaster> staticCasters;
+    std::vector<ShadowCaster> dynamicCasters;  // Resubmitted every frame
+    Vector3 sceneMin, sceneMax;                // Everything that casts or receives
+    bool ready;
+    bool active;                               // Sun high enough to cast this frame
+};
+
+ShadowMaps shadowMaps;
+ShadowStats shadowStats;
+
+void growShadowSceneBounds(const Vector3& bmin, const Vector3& bmax) {
+    Vector3& lo = shadowMaps.sceneMin;
+    Vector3& hi = shadowMaps.sceneMax;
+    if (bmin.x < lo.x) lo.x = bmin.x;
+    if (bmin.y < lo.y) lo.y = bmin.y;
+    if (bmin.z < lo.z) lo.z = bmin.z;
+    if (bmax.x > hi.x) hi.x = bmax.x;
+    if (bmax.y > hi.y) hi.y = bmax.y;
+    if (bmax.z > hi.z) hi.z = bmax.z;
+}
+
+// Static casters are registered once; data must stay valid while shadows are drawn
+void addStaticShadowCaster(RenderFunc draw, const void* data, const Vector3& bmin, const Vector3& bmax) {
+    ShadowCaster caster;
+    caster.draw = draw;
+    caster.data = data;
+    caster.boundsMin = bmin;
+    caster.boundsMax = bmax;
+    shadowMaps.staticCasters.push_back(caster);
+    growShadowSceneBounds(bmin, bmax);
+}
+
+void clearDynamicShadowCasters() {
+    shadowMaps.dynamicCasters.clear();
+}
+
+void submitDynamicShadowCaster(RenderFunc draw, const void* data, const Vector3& bmin, const Vector3& bmax) {
+    ShadowCaster caster;
+    caster.draw = draw;
+    caster.data = data;
+    caster.boundsMin = bmin;
+    caster.boundsMax = bmax;
+    shadowMaps.dynamicCasters.push_back(caster);
+}
+
+GLuint createShadowTexture(GLuint& framebuffer) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    // Linear filtering of the depth comparison gives 2x2 PCF for free
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0,
+                 GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    pglGenFramebuffers(1, &framebuffer);
+    pglBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    pglFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    return texture;
+}
+
+// Create the cascade textures and framebuffers. Call after loadGLExtensions.
+bool initShadowMaps() {
+    ShadowMaps& sm = shadowMaps;
+    sm.ready = false;
+    sm.active = false;
+    sm.sceneMin = Vector3(1e30f, 1e30f, 1e30f);
+    sm.sceneMax = Vector3(-1e30f, -1e30f, -1e30f);
+    if (!glShadersSupported || !glFramebuffersSupported) {
+        printf("Shadow maps not available (need GLSL and framebuffer objects)\n");
+        return false;
+    }
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    bool complete = true;
+    for (int i = 0; i < SHADOW_CASCADES; i++) {
+        ShadowCascade& c = sm.cascades[i];
+        float radius = SHADOW_CASCADE_RADIUS[i];
+        c.halfExtent = radius * (1.0f + SHADOW_SCROLL_FRACTION);
+        float texel = 2.0f * c.halfExtent / SHADOW_MAP_SIZE;
+        c.step = texel * floor(radius * SHADOW_SCROLL_FRACTION / texel);
+        c.staticValid = false;
+        c.hadDynamic = false;
+        c.staticTexture = createShadowTexture(c.staticFramebuffer);
+        complete = complete && pglCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        c.texture = createShadowTexture(c.framebuffer);
+        complete = complete && pglCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+    pglBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    if (!complete) {
+        printf("Error: Shadow map framebuffers are incomplete, shadows disabled\n");
+        return false;
+    }
+
+    sm.ready = true;
+    printf("Shadow maps ready: %d cascades of %dx%d\n", SHADOW_CASCADES, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    return true;
+}
+
+// Light-space axes for a sun angle. The sun moves in the XY plane, so Z is
+// always perpendicular to it: u = +Z, v = dir x u, and dir points at the sun.
+void getShadowBasis(float sunAngle, float u[3], float v[3], float dir[3]) {
+    float a = sunAngle * 3.14159265359f / 180.0f;
+    dir[0] = cos(a); dir[1] = sin(a); dir[2] = 0.0f;
+    u[0] = 0.0f;     u[1] = 0.0f;     u[2] = 1.0f;
+    v[0] = dir[1];   v[1] = -dir[0];  v[2] = 0.0f;
+}
+
+float snapShadowCenter(float value, float step) {
+    return floor(value / step + 0.5f) * step;
+}
+
+// Camera position in the cascade's light space, snapped to its scroll step
+void getShadowCascadeCenter(const ShadowCascade& c, float sunAngle, float camX, float camY, float camZ,
+                            float& centerX, float& centerY) {
+    float u[3], v[3], dir[3];
+    getShadowBasis(sunAngle, u, v, dir);
+    centerX = snapShadowCenter(u[0] * camX + u[1] * camY + u[2] * camZ, c.step);
+    centerY = snapShadowCenter(v[0] * camX + v[1] * camY + v[2] * camZ, c.step);
+}
+
+// View and orthographic projection for the cascade's center and sun angle.
+// The depth range spans the whole scene, so every caster toward the sun is kept.
+void buildShadowMatrices(ShadowCascade& c) {
+    float u[3], v[3], dir[3];
+    getShadowBasis(c.sunAngle, u, v, dir);
+
+    memset(c.view, 0, sizeof(c.view));
+    for (int k = 0; k < 3; k++) {
+        c.view[k * 4 + 0] = u[k];
+        c.view[k * 4 + 1] = v[k];
+        c.view[k * 4 + 2] = dir[k];
+    }
+    c.view[15] = 1.0f;
+
+    const Vector3& lo = shadowMaps.sceneMin;
+    const Vector3& hi = shadowMaps.sceneMax;
+    float minDepth = 1e30f, maxDepth = -1e30f;
+    for (int corner = 0; corner < 8; corner++) {
+        float x = (corner & 1) ? hi.x : lo.x;
+        float y = (corner & 2) ? hi.y : lo.y;
+        float z = (corner & 4) ? hi.z : lo.z;
+        float depth = dir[0] * x + dir[1] * y + dir[2] * z;
+        if (depth < minDepth) minDepth = depth;
+        if (depth > maxDepth) maxDepth = depth;
+    }
+    // Eye space looks down -dir: the sunward end of the scene is the near plane
+    float n = -maxDepth - 1.0f, f = -minDepth + 1.0f;
+    float h = c.halfExtent;
+    memset(c.projection, 0, sizeof(c.projection));
+    c.projection[0] = 1.0f / h;
+    c.projection[5] = 1.0f / h;
+    c.projection[10] = -2.0f / (f - n);
+    c.projection[12] = -c.centerX / h;
+    c.projection[13] = -c.centerY / h;
+    c.projection[14] = -(f + n) / (f - n);
+    c.projection[15] = 1.0f;
+}
+
+int drawShadowCasters(const std::vector<ShadowCaster>& casters, const Frustum& frustum) {
+    int drawn = 0;
+    for (size_t i = 0; i < casters.size(); i++) {
+        const ShadowCaster& caster = casters[i];
+        if (!isBoxInFrustum(frustum, caster.boundsMin, caster.boundsMax)) continue;
+        caster.draw(caster.data);
+        drawn++;
+    }
+    shadowStats.casterDraws += drawn;
+    return drawn;
+}
+
+// Whether the box's light-space footprint lies inside the part of the
+// cascade the shaders sample (they skip a border of two texels)
+bool isBoxInsideShadowCascade(const ShadowCascade& c, const Vector3& bmin, const Vector3& bmax) {
+    float u[3], v[3], dir[3];
+    getShadowBasis(c.sunAngle, u, v, dir);
+    float limit = c.halfExtent * (1.0f - 4.0f / SHADOW_MAP_SIZE);
+    for (int corner = 0; corner < 8; corner++) {
+        float x = (corner & 1) ? bmax.x : bmin.x;
+        float y = (corner & 2) ? bmax.y : bmin.y;
+        float z = (corner & 4) ? bmax.z : bmin.z;
+        if (fabs(u[0] * x + u[1] * y + u[2] * z - c.centerX) > limit ||
+            fabs(v[0] * x + v[1] * y + v[2] * z - c.centerY) > limit) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether cascade index needs any dynamic caster: one that touches it and is
+// not already held whole by a smaller cascade
+bool needsDynamicShadowCasters(int index) {
+    const std::vector<ShadowCaster>& casters = shadowMaps.dynamicCasters;
+    for (size_t i = 0; i < casters.size(); i++) {
+        const ShadowCaster& caster = casters[i];
+        if (!isBoxInFrustum(shadowMaps.cascades[index].frustum, caster.boundsMin, caster.boundsMax)) continue;
+        bool covered = false;
+        for (int j = 0; j < index && !covered; j++) {
+            covered = isBoxInsideShadowCascade(shadowMaps.cascades[j], caster.boundsMin, caster.boundsMax);
+        }
+        if (!covered) return true;
+    }
+    return false;
+}
+
+float getSunAngleDelta(float a, float b) {
+    float delta = fabs(a - b);
+    return delta > 180.0f ? 360.0f - delta : delta;
+}
+
+// Bring the cascades up to date for this frame. Submit the dynamic casters
+// first; the GL state cache must be valid (called inside a frame).
+void updateShadowMaps(float sunAngle, float camX, float camY, float camZ) {
+    PROFILE_FUNCTION();
+    PROFILE_GPU_SCOPE("Shadow maps");
+    ShadowMaps& sm = shadowMaps;
+    sm.active = sm.ready && sin(sunAngle * 3.14159265359f / 180.0f) > SHADOW_MIN_SUN_HEIGHT;
+    if (!sm.active) return;
+
+    // Scrolled or never rendered cascades must be redone now; of the ones the
+    // sun has moved past their threshold, only the stalest
+    bool renderStatic[SHADOW_CASCADES];
+    int stalest = -1;
+    float stalestDelta = 0.0f;
+    for (int i = 0; i < SHADOW_CASCADES; i++) {
+        ShadowCascade& c = sm.cascades[i];
+        renderStatic[i] = !c.staticValid;
+        if (c.staticValid) {
+            float centerX, centerY;
+            getShadowCascadeCenter(c, c.sunAngle, camX, camY, camZ, centerX, centerY);
+            renderStatic[i] = centerX != c.centerX || centerY != c.centerY;
+        }
+        float delta = getSunAngleDelta(sunAngle, c.sunAngle) / SHADOW_SUN_THRESHOLD[i];
+        if (!renderStatic[i] && delta > 1.0f && delta > stalestDelta) {
+            stalest = i;
+            stalestDelta = delta;
+        }
+    }
+    if (stalest >= 0) renderStatic[stalest] = true;
+
+    // New light matrices (and culling frustum) for the re-rendered cascades
+    for (int i = 0; i < SHADOW_CASCADES; i++) {
+        ShadowCascade& c = sm.cascades[i];
+        if (renderStatic[i]) {
+            c.sunAngle = sunAngle;
+            getShadowCascadeCenter(c, sunAngle, camX, camY, camZ, c.centerX, c.centerY);
+            buildShadowMatrices(c);
+            glMatrixMode(GL_PROJECTION);
+            glPushMatrix();
+            glLoadMatrixf(c.projection);
+            glMatrixMode(GL_MODELVIEW);
+            glPushMatrix();
+            glLoadMatrixf(c.view);
+            extractFrustum(c.frustum);
+            glMatrixMode(GL_PROJECTION);
+            glPopMatrix();
+            glMatrixMode(GL_MODELVIEW);
+            glPopMatrix();
+        }
+    }
+
+    bool composite[SHADOW_CASCADES];
+    bool anyWork = false;
+    for (int i = 0; i < SHADOW_CASCADES; i++) {
+        ShadowCascade& c = sm.cascades[i];
+        bool dynamic = needsDynamicShadowCasters(i);
+        composite[i] = renderStatic[i] || dynamic || c.hadDynamic;
+        c.hadDynamic = dynamic;
+        anyWork = anyWork || composite[i];
+    }
+    if (!anyWork) return;
+
+    GLint previousFramebuffer = 0, viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(SHADOW_SLOPE_BIAS, SHADOW_CONSTANT_BIAS);
+    cachedEnable(GL_LIGHTING, false);
+
+    for (int i = 0; i < SHADOW_CASCADES; i++) {
+        ShadowCascade& c = sm.cascades[i];
+        if (!composite[i]) continue;
+        glMatrixMode(GL_PROJECTION);
+        glLoadMatrixf(c.projection);
+        glMatrixMode(GL_MODELVIEW);
+        glLoadMatrixf(c.view);
+
+        if (renderStatic[i]) {
+            pglBindFramebuffer(GL_FRAMEBUFFER, c.staticFramebuffer);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            drawShadowCasters(sm.staticCasters, c.frustum);
+            c.staticValid = true;
+            shadowStats.staticRenders++;
+        }
+
+        pglBindFramebuffer(GL_READ_FRAMEBUFFER, c.staticFramebuffer);
+        pglBindFramebuffer(GL_DRAW_FRAMEBUFFER, c.framebuffer);
+        pglBlitFramebuffer(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE,
+                           GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        pglBindFramebuffer(GL_FRAMEBUFFER, c.framebuffer);
+        drawShadowCasters(sm.dynamicCasters, c.frustum);
+        shadowStats.composites++;
+    }
+
+    cachedEnable(GL_LIGHTING, true);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+    pglBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+}
+
+// Hand the cascades to a lighting program: eye-to-shadow-texture matrices for
+// the current camera (modelview must hold it) and the shadow maps.
+void bindShadowMaps(GLuint program) {
+    ShadowMaps& sm = shadowMaps;
+    pglUniform1f(pglGetUniformLocation(program, "shadowsOn"), sm.active ? 1.0f : 0.0f);
+    if (!sm.active) return;
+
+    // The camera matrix is rigid: its inverse is the transposed rotation
+    // with the translation rotated back
+    float mv[16], inverse[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+    memset(inverse, 0, sizeof(inverse));
+    for (int r = 0; r < 3; r++) {
+        for (int k = 0; k < 3; k++) inverse[k * 4 + r] = mv[r * 4 + k];
+        inverse[12 + r] = -(mv[r * 4 + 0] * mv[12] + mv[r * 4 + 1] * mv[13] + mv[r * 4 + 2] * mv[14]);
+    }
+    inverse[15] = 1.0f;
+
+    // Clip space [-1, 1] to texture space [0, 1]
+    static const float bias[16] = { 0.5f, 0, 0, 0, 0, 0.5f, 0, 0, 0, 0, 0.5f, 0, 0.5f, 0.5f, 0.5f, 1.0f };
+    float matrices[SHADOW_CASCADES * 16];
+    for (int i = 0; i < SHADOW_CASCADES; i++) {
+        const ShadowCascade& c = sm.cascades[i];
+        float lightClip[16], textureSpace[16];
+        multiplyMatrices(c.projection, c.view, lightClip);
+        multiplyMatrices(bias, lightClip, textureSpace);
+        multiplyMatrices(textureSpace, inverse, &matrices[i * 16]);
+
+        pglActiveTexture(GL_TEXTURE0 + SHADOW_FIRST_UNIT + i);
+        glBindTexture(GL_TEXTURE_2D, c.texture);
+    }
+    pglActiveTexture(GL_TEXTURE0);
+    pglUniformMatrix4fv(pglGetUniformLocation(program, "shadowMatrix"), SHADOW_CASCADES, GL_FALSE, matrices);
+}
+
+void resetShadowStats() {
+    memset(&shadowStats, 0, sizeof(shadowStats));
+}
+
+#endif // SHADOWS_H
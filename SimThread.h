@@ -0,0 +1,231 @@
+#ifndef SIM_THREAD_H
+#define SIM_THREAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include "Profiler.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <mmsystem.h>  // timeBeginPeriod (winmm)
+#endif
+
+// Simulation on its own thread, stepping at a fixed rate and handing the
+// renderer finished snapshots.
+//
+// TripleBuffer passes a value from one writer thread to one reader thread
+// without locks: the writer fills its back slot and swaps it with the middle
+// one, the reader swaps the middle slot with its front one when a fresh value
+// is there. Neither ever waits for the other or sees a half-written value;
+// the reader always gets the newest one.
+//
+// The simulation advances in fixed steps of SIMULATION_STEP_SECONDS whatever
+// the frame rate: elapsed time goes into an accumulator and is spent one
+// whole step at a time, so the game plays the same at 30 or 300 fps. Each
+// step publishes a snapshot stamped with the clock time it ends at; the
+// renderer draws one step behind, blending the last two steps by how far the
+// clock has got into the next one, so motion stays smooth when frames and
+// steps don't line up. After a stall (loading, a debugger) at most
+// SIMULATION_MAX_CATCH_UP steps are run and the rest of the time is dropped.
+//
+// The frame limiter caps the render rate by sleeping until each frame's
+// slot; see sleepUntilClock for how it stays precise without spinning.
+#define TRIPLE_BUFFER_FRESH 4  // Set in middle when the writer has published since the last read
+
+#define SIMULATION_STEP_RATE 120
+#define SIMULATION_STEP_SECONDS (1.0 / SIMULATION_STEP_RATE)
+#define SIMULATION_MAX_CATCH_UP 30  // Steps run at most per update (a quarter second) before time is dropped
+
+#define FRAME_OVERSLEEP_DECAY 0.99   // Per frame, so one late wakeup does not keep the limiter spinning
+#define FRAME_OVERSLEEP_MAX 0.004    // Never spin for more than this per frame
+
+template <typename T>
+struct TripleBuffer {
+    T slots[3];
+    std::atomic<int> middle;   // Slot index, plus TRIPLE_BUFFER_FRESH
+    int back;                  // Only touched by the writer
+    int front;                 // Only touched by the reader
+
+    // Start with value in every slot (before either thread uses the buffer)
+    void reset(const T& value) {
+        slots[0] = slots[1] = slots[2] = value;
+        back = 0;
+        middle.store(1);
+        front = 2;
+    }
+
+    // Writer: fill this, then publish it
+    T& writeSlot() { return slots[back]; }
+
+    void publish() {
+        back = middle.exchange(back | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel) & 3;
+    }
+
+    // Reader: move to the newest published value; false if there is none
+    // since the last call
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH)) return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+        return true;
+    }
+
+    const T& read() const { return slots[front]; }
+};
+
+// Seconds since startup, on a clock that never jumps
+const std::chrono::steady_clock::time_point simulationClockStart = std::chrono::steady_clock::now();
+
+double simulationClock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - simulationClockStart).count();
+}
+
+std::chrono::steady_clock::time_point simulationClockPoint(double seconds) {
+    return simulationClockStart +
+           std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+struct SimulationThread {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    bool running;        // Only changed on the render thread
+    void (*step)();
+    double stepTime;     // Clock time the steps so far reach; owned by whoever runs them
+    int droppedSteps;    // Steps skipped after stalls
+};
+
+SimulationThread simulationThread;
+
+// Run the steps that are due; returns how many ran
+int runSimulationSteps() {
+    SimulationThread& sim = simulationThread;
+    double now = simulationClock();
+    double accumulator = now - sim.stepTime;
+    if (accumulator > SIMULATION_MAX_CATCH_UP * SIMULATION_STEP_SECONDS) {
+        int dropped = (int)(accumulator / SIMULATION_STEP_SECONDS) - SIMULATION_MAX_CATCH_UP;
+        sim.droppedSteps += dropped;
+        sim.stepTime += dropped * SIMULATION_STEP_SECONDS;
+        accumulator -= dropped * SIMULATION_STEP_SECONDS;
+    }
+    int steps = 0;
+    while (accumulator >= SIMULATION_STEP_SECONDS) {
+        sim.stepTime += SIMULATION_STEP_SECONDS;
+        accumulator -= SIMULATION_STEP_SECONDS;
+        sim.step();
+        steps++;
+    }
+    return steps;
+}
+
+// How far to blend from the step before the one ending at stepTime to that
+// step, for drawing now (0..1; 1 holds the newest step if the next is late)
+float simulationBlend(double stepTime) {
+    double blend = (simulationClock() - stepTime) / SIMULATION_STEP_SECONDS;
+    if (blend < 0.0) return 0.0f;
+    if (blend > 1.0) return 1.0f;
+    return (float)blend;
+}
+
+void simulationThreadMain() {
+    SimulationThread& sim = simulationThread;
+    setProfilerThreadName("Simulation");
+    while (true) {
+        runSimulationSteps();
+        std::unique_lock<std::mutex> lock(sim.mutex);
+        sim.wake.wait_until(lock, simulationClockPoint(sim.stepTime + SIMULATION_STEP_SECONDS),
+                            []() { return simulationThread.stopping; });
+        if (sim.stopping) return;
+    }
+}
+
+// Stop after the current step; called at exit
+void stopSimulationThread() {
+    if (!simulationThread.running) return;
+    {
+        std::lock_guard<std::mutex> lock(simulationThread.mutex);
+        simulationThread.stopping = true;
+    }
+    simulationThread.wake.notify_one();
+    simulationThread.thread.join();
+    simulationThread.running = false;
+}
+
+// Start the fixed-step clock now. step must only touch state the render
+// thread does not, and publish what the renderer needs. Without
+// startSimulationThread, call runSimulationSteps once per frame instead.
+void initSimulation(void (*step)()) {
+    simulationThread.step = step;
+    simulationThread.stepTime = simulationClock();
+    simulationThread.droppedSteps = 0;
+}
+
+// Run the steps on the simulation thread until exit
+void startSimulationThread() {
+    if (simulationThread.running) return;
+    simulationThread.stopping = false;
+    simulationThread.running = true;
+    simulationThread.thread = std::thread(simulationThreadMain);
+    static bool stopRegistered = false;
+    if (!stopRegistered) {
+        atexit(stopSimulationThread);
+        stopRegistered = true;
+    }
+    printf("Simulation thread started (%d steps per second)\n", SIMULATION_STEP_RATE);
+}
+
+struct FrameLimiter {
+    int fps;             // 0 = no cap
+    double nextFrame;    // Clock time the next frame may start
+    double oversleep;    // Recent worst lateness of the OS sleep
+};
+
+FrameLimiter frameLimiter = { 0, 0.0, 0.001 };
+
+// Sleep until the clock reaches time. The OS can wake a sleeper late (up to
+// a scheduler tick), so the sleep stops short by the worst recent lateness
+// and the last fraction of a millisecond is spent yielding: precise to a few
+// microseconds while the thread stays asleep for nearly all of the wait.
+void sleepUntilClock(double time) {
+    FrameLimiter& fl = frameLimiter;
+    double wakeTime = time - fl.oversleep;
+    if (wakeTime > simulationClock()) {
+        std::this_thread::sleep_until(simulationClockPoint(wakeTime));
+        double late = simulationClock() - wakeTime;
+        fl.oversleep *= FRAME_OVERSLEEP_DECAY;
+        if (late > fl.oversleep) fl.oversleep = late;
+        if (fl.oversleep > FRAME_OVERSLEEP_MAX) fl.oversleep = FRAME_OVERSLEEP_MAX;
+    }
+    while (simulationClock() < time) {
+        std::this_thread::yield();
+    }
+}
+
+// Cap the frame rate at fps (0 = no cap)
+void initFrameLimiter(int fps) {
+    frameLimiter.fps = fps;
+    frameLimiter.nextFrame = simulationClock();
+#ifdef _WIN32
+    // The default 15.6 ms timer tick is longer than a 60 fps frame
+    if (fps > 0) timeBeginPeriod(1);
+#endif
+}
+
+// Call once per frame, before drawing: waits for the frame's slot
+void limitFrameRate() {
+    FrameLimiter& fl = frameLimiter;
+    if (fl.fps <= 0) return;
+    sleepUntilClock(fl.nextFrame);
+    // A frame that ran long moves the schedule rather than making the next
+    // ones rush to catch up
+    double now = simulationClock();
+    fl.nextFrame += 1.0 / fl.fps;
+    if (fl.nextFrame < now) fl.nextFrame = now;
+}
+
+#endif // SIM_THREAD_H
@@ -0,0 +1,359 @@
+#ifndef SKY_H
+#define SKY_H
+
+#include <math.h>
+#include <vector>
+
+#include "GLExtensions.h"
+#include "RenderQueue.h"
+#include "FrameRing.h"
+#include "Profiler.h"
+
+// Physically based sky: single Rayleigh and Mie scattering plus ozone
+// absorption, from precomputed tables.
+//
+//   transmittance table - fraction of sunlight that survives from a point in
+//                         the atmosphere to space, by altitude and the cosine
+//                         of the ray's zenith angle. Built once at startup.
+//   sky view table      - tone-mapped sky color by view azimuth and elevation
+//                         for the current sun. Rebuilt lazily when sunAngle
+//                         crosses a SKY_SUN_STEP boundary (a few ms), using
+//                         the transmittance table for the light reaching
+//                         each sample along the view ray.
+//
+// The sky is a textured dome around the camera, so a pixel costs one texture
+// fetch. The sun's light color (transmittance at the ground), the sky ambient
+// and the clear color come from the same tables, which gives a smooth day and
+// night instead of fixed colors per time of day.
+
+#define SKY_TRANSMITTANCE_WIDTH 64   // Cosine of the ray's zenith angle, -1..1
+#define SKY_TRANSMITTANCE_HEIGHT 32  // Altitude, ground to top of atmosphere
+#define SKY_VIEW_WIDTH 64            // Azimuth around +Y, starting at +X
+#define SKY_VIEW_HEIGHT 32           // Elevation, denser near the horizon
+#define SKY_TRANSMITTANCE_STEPS 40
+#define SKY_SCATTER_STEPS 24
+#define SKY_SUN_STEP 0.5f            // Degrees of sun movement between sky rebuilds
+#define SKY_DOME_SLICES 48
+#define SKY_DOME_STACKS 32
+#define SKY_DOME_RADIUS 50.0f        // Drawn without depth, so any size inside the far plane
+
+// Earth-like atmosphere, in meters
+#define SKY_GROUND_RADIUS 6360000.0f
+#define SKY_TOP_RADIUS 6460000.0f
+#define SKY_VIEWER_ALTITUDE 200.0f
+#define SKY_RAYLEIGH_HEIGHT 8000.0f
+#define SKY_MIE_HEIGHT 1200.0f
+#define SKY_MIE_G 0.8f
+#define SKY_OZONE_CENTER 25000.0f
+#define SKY_OZONE_WIDTH 15000.0f
+
+#define SKY_SUN_INTENSITY 20.0f      // Sun illuminance in sky radiance units
+#define SKY_EXPOSURE 1.5f
+#define SKY_AMBIENT_SCALE 0.45f      // Sky color to GL ambient light
+#define SKY_DARK_SUN_HEIGHT 0.05f    // Sine of the sun elevation below which it is night
+
+const float SKY_RAYLEIGH_SCATTERING[3] = { 5.802e-6f, 13.558e-6f, 33.1e-6f };
+const float SKY_MIE_SCATTERING = 3.996e-6f;
+const float SKY_MIE_EXTINCTION = 4.40e-6f;
+const float SKY_OZONE_ABSORPTION[3] = { 0.650e-6f, 1.881e-6f, 0.085e-6f };
+const float SKY_NIGHT_COLOR[3] = { 0.02f, 0.02f, 0.06f };     // Floor of the sky color
+const float SKY_NIGHT_AMBIENT[3] = { 0.1f, 0.1f, 0.15f };     // Floor of the ambient light
+
+struct SkyDomeVertex {
+    float x, y, z;
+    float u, v;
+};
+
+struct Sky {
+    std::vector<float> transmittance;        // RGB per texel
+    std::vector<unsigned char> view;         // RGB per texel, tone-mapped
+    std::vector<SkyDomeVertex> domeVertices;
+    std::vector<unsigned short> domeIndices;
+    GLuint texture;
+    float sunAngle;                          // Quantized angle the view table is for
+    float sunColor[3];                       // Direct sunlight at the ground
+    float ambientColor[3];
+    float horizonColor[3];
+    bool valid;
+};
+
+Sky sky;
+
+// Distance along a ray from radius r (cosine mu to the zenith) to a sphere,
+// or -1 if it misses
+float skyRaySphere(float r, float mu, float radius) {
+    float b = r * mu;
+    float c = r * r - radius * radius;
+    float disc = b * b - c;
+    if (disc < 0.0f) return -1.0f;
+    float s = sqrt(disc);
+    float t = -b - s;
+    if (t < 0.0f) t = -b + s;
+    return t;
+}
+
+// Extinction per meter at an altitude
+void getSkyExtinction(float altitude, float extinction[3]) {
+    float rayleigh = exp(-altitude / SKY_RAYLEIGH_HEIGHT);
+    float mie = exp(-altitude / SKY_MIE_HEIGHT);
+    float ozone = 1.0f - fabs(altitude - SKY_OZONE_CENTER) / SKY_OZONE_WIDTH;
+    if (ozone < 0.0f) ozone = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        extinction[k] = SKY_RAYLEIGH_SCATTERING[k] * rayleigh + SKY_MIE_EXTINCTION * mie +
+                        SKY_OZONE_ABSORPTION[k] * ozone;
+    }
+}
+
+void buildSkyTransmittance() {
+    sky.transmittance.resize(SKY_TRANSMITTANCE_WIDTH * SKY_TRANSMITTANCE_HEIGHT * 3);
+    for (int y = 0; y < SKY_TRANSMITTANCE_HEIGHT; y++) {
+        float r = SKY_GROUND_RADIUS + (SKY_TOP_RADIUS - SKY_GROUND_RADIUS) * y / (SKY_TRANSMITTANCE_HEIGHT - 1);
+        for (int x = 0; x < SKY_TRANSMITTANCE_WIDTH; x++) {
+            float mu = -1.0f + 2.0f * x / (SKY_TRANSMITTANCE_WIDTH - 1);
+            float* out = &sky.transmittance[(y * SKY_TRANSMITTANCE_WIDTH + x) * 3];
+            // Rays into the ground never reach space
+            float ground = skyRaySphere(r, mu, SKY_GROUND_RADIUS);
+            if (ground > 0.0f && mu < 0.0f) {
+                out[0] = out[1] = out[2] = 0.0f;
+                continue;
+            }
+            float length = skyRaySphere(r, mu, SKY_TOP_RADIUS);
+            float ds = length / SKY_TRANSMITTANCE_STEPS;
+            float depth[3] = { 0.0f, 0.0f, 0.0f };
+            for (int i = 0; i < SKY_TRANSMITTANCE_STEPS; i++) {
+                float t = (i + 0.5f) * ds;
+                float altitude = sqrt(r * r + t * t + 2.0f * r * mu * t) - SKY_GROUND_RADIUS;
+                float extinction[3];
+                getSkyExtinction(altitude, extinction);
+                for (int k = 0; k < 3; k++) depth[k] += extinction[k] * ds;
+            }
+            for (int k = 0; k < 3; k++) out[k] = exp(-depth[k]);
+        }
+    }
+}
+
+// Bilinear lookup in the transmittance table
+void getSkyTransmittance(float r, float mu, float out[3]) {
+    float fx = (mu + 1.0f) * 0.5f * (SKY_TRANSMITTANCE_WIDTH - 1);
+    float fy = (r - SKY_GROUND_RADIUS) / (SKY_TOP_RADIUS - SKY_GROUND_RADIUS) * (SKY_TRANSMITTANCE_HEIGHT - 1);
+    if (fx < 0.0f) fx = 0.0f;
+    if (fy < 0.0f) fy = 0.0f;
+    if (fx > SKY_TRANSMITTANCE_WIDTH - 1) fx = (float)(SKY_TRANSMITTANCE_WIDTH - 1);
+    if (fy > SKY_TRANSMITTANCE_HEIGHT - 1) fy = (float)(SKY_TRANSMITTANCE_HEIGHT - 1);
+    int x0 = (int)fx, y0 = (int)fy;
+    int x1 = x0 < SKY_TRANSMITTANCE_WIDTH - 1 ? x0 + 1 : x0;
+    int y1 = y0 < SKY_TRANSMITTANCE_HEIGHT - 1 ? y0 + 1 : y0;
+    float tx = fx - x0, ty = fy - y0;
+    const float* t = &sky.transmittance[0];
+    for (int k = 0; k < 3; k++) {
+        float a = t[(y0 * SKY_TRANSMITTANCE_WIDTH + x0) * 3 + k] * (1.0f - tx) + t[(y0 * SKY_TRANSMITTANCE_WIDTH + x1) * 3 + k] * tx;
+        float b = t[(y1 * SKY_TRANSMITTANCE_WIDTH + x0) * 3 + k] * (1.0f - tx) + t[(y1 * SKY_TRANSMITTANCE_WIDTH + x1) * 3 + k] * tx;
+        out[k] = a * (1.0f - ty) + b * ty;
+    }
+}
+
+// The view table squeezes elevation toward the horizon, where the sky
+// changes fastest: v = 0.5 +- 0.5 * sqrt(|elevation| / 90 degrees)
+float getSkyViewElevation(float v) {
+    float s = 2.0f * v - 1.0f;
+    return (s < 0.0f ? -1.0f : 1.0f) * s * s * 1.57079632679f;
+}
+
+// Sky radiance along a view direction from the viewer, sun of unit illuminance
+void integrateSkyScattering(const float dir[3], const float sunDir[3], float radiance[3]) {
+    float r = SKY_GROUND_RADIUS + SKY_VIEWER_ALTITUDE;
+    float mu = dir[1];
+    float length = skyRaySphere(r, mu, SKY_GROUND_RADIUS);
+    if (length < 0.0f || mu >= 0.0f) length = skyRaySphere(r, mu, SKY_TOP_RADIUS);
+
+    float cosTheta = dir[0] * sunDir[0] + dir[1] * sunDir[1] + dir[2] * sunDir[2];
+    float rayleighPhase = 3.0f / (16.0f * 3.14159265f) * (1.0f + cosTheta * cosTheta);
+    float g2 = SKY_MIE_G * SKY_MIE_G;
+    float miePhase = 3.0f / (8.0f * 3.14159265f) * (1.0f - g2) * (1.0f + cosTheta * cosTheta) /
+                     ((2.0f + g2) * pow(1.0f + g2 - 2.0f * SKY_MIE_G * cosTheta, 1.5f));
+
+    float ds = length / SKY_SCATTER_STEPS;
+    float viewTransmittance[3] = { 1.0f, 1.0f, 1.0f };
+    radiance[0] = radiance[1] = radiance[2] = 0.0f;
+    for (int i = 0; i < SKY_SCATTER_STEPS; i++) {
+        float t = (i + 0.5f) * ds;
+        // Sample point relative to the planet center, viewer straight up
+        float px = dir[0] * t, py = r + dir[1] * t, pz = dir[2] * t;
+        float pr = sqrt(px * px + py * py + pz * pz);
+        float altitude = pr - SKY_GROUND_RADIUS;
+        float sunMu = (px * sunDir[0] + py * sunDir[1] + pz * sunDir[2]) / pr;
+
+        float extinction[3], sunTransmittance[3];
+        getSkyExtinction(altitude, extinction);
+        getSkyTransmittance(pr, sunMu, sunTransmittance);
+        float rayleigh = exp(-altitude / SKY_RAYLEIGH_HEIGHT);
+        float mie = exp(-altitude / SKY_MIE_HEIGHT) * SKY_MIE_SCATTERING * miePhase;
+        for (int k = 0; k < 3; k++) {
+            float step = exp(-extinction[k] * ds);
+            float scattering = SKY_RAYLEIGH_SCATTERING[k] * rayleigh * rayleighPhase + mie;
+            // Midpoint of this step's view transmittance
+            radiance[k] += viewTransmittance[k] * sqrt(step) * sunTransmittance[k] * scattering * ds;
+            viewTransmittance[k] *= step;
+        }
+    }
+}
+
+unsigned char toneMapSky(float radiance, float floor) {
+    float c = 1.0f - exp(-radiance * SKY_EXPOSURE);
+    c = pow(c, 1.0f / 2.2f);
+    c = c + floor * (1.0f - c);
+    return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+// Rebuild the view table and light colors for a sun angle (degrees, sun
+// direction (cos, sin, 0) as for GL_LIGHT0)
+void buildSkyView(float sunAngle) {
+    float a = sunAngle * 3.14159265f / 180.0f;
+    float sunDir[3] = { cos(a), sin(a), 0.0f };
+    sky.view.resize(SKY_VIEW_WIDTH * SKY_VIEW_HEIGHT * 3);
+
+    float ambient[3] = { 0.0f, 0.0f, 0.0f }, horizon[3] = { 0.0f, 0.0f, 0.0f };
+    float ambientWeight = 0.0f;
+    for (int y = 0; y < SKY_VIEW_HEIGHT; y++) {
+        float elevation = getSkyViewElevation((y + 0.5f) / SKY_VIEW_HEIGHT);
+        for (int x = 0; x < SKY_VIEW_WIDTH; x++) {
+            float azimuth = (x + 0.5f) / SKY_VIEW_WIDTH * 6.28318531f;
+            float dir[3] = { cos(elevation) * cos(azimuth), sin(elevation), cos(elevation) * sin(azimuth) };
+            float radiance[3];
+            integrateSkyScattering(dir, sunDir, radiance);
+            unsigned char* texel = &sky.view[(y * SKY_VIEW_WIDTH + x) * 3];
+            for (int k = 0; k < 3; k++) {
+                texel[k] = toneMapSky(radiance[k] * SKY_SUN_INTENSITY, SKY_NIGHT_COLOR[k]);
+            }
+            // Cosine-weighted upper hemisphere for the ambient light
+            if (elevation > 0.0f) {
+                float weight = sin(elevation) * cos(elevation);
+                for (int k = 0; k < 3; k++) ambient[k] += texel[k] / 255.0f * weight;
+                ambientWeight += weight;
+            }
+            if (y == SKY_VIEW_HEIGHT / 2) {
+                for (int k = 0; k < 3; k++) horizon[k] += texel[k] / 255.0f / SKY_VIEW_WIDTH;
+            }
+        }
+    }
+
+    float transmittance[3];
+    getSkyTransmittance(SKY_GROUND_RADIUS + SKY_VIEWER_ALTITUDE, sunDir[1], transmittance);
+    for (int k = 0; k < 3; k++) {
+        sky.sunColor[k] = transmittance[k];
+        float light = ambient[k] / ambientWeight * SKY_AMBIENT_SCALE;
+        sky.ambientColor[k] = light > SKY_NIGHT_AMBIENT[k] ? light : SKY_NIGHT_AMBIENT[k];
+        sky.horizonColor[k] = horizon[k];
+    }
+}
+
+// Unit sphere dome whose stacks are evenly spaced in the view table's
+// elevation coordinate, so interpolated texture coordinates stay exact
+void buildSkyDome() {
+    sky.domeVertices.clear();
+    sky.domeIndices.clear();
+    for (int j = 0; j <= SKY_DOME_STACKS; j++) {
+        float v = (float)j / SKY_DOME_STACKS;
+        float elevation = getSkyViewElevation(v);
+        for (int i = 0; i <= SKY_DOME_SLICES; i++) {
+            float u = (float)i / SKY_DOME_SLICES;
+            float azimuth = u * 6.28318531f;
+            SkyDomeVertex vertex;
+            vertex.x = cos(elevation) * cos(azimuth);
+            vertex.y = sin(elevation);
+            vertex.z = cos(elevation) * sin(azimuth);
+            vertex.u = u;
+            vertex.v = v;
+            sky.domeVertices.push_back(vertex);
+        }
+    }
+    int row = SKY_DOME_SLICES + 1;
+    for (int j = 0; j < SKY_DOME_STACKS; j++) {
+        for (int i = 0; i < SKY_DOME_SLICES; i++) {
+            unsigned short a = (unsigned short)(j * row + i);
+            unsigned short b = (unsigned short)(a + row);
+            sky.domeIndices.push_back(a);
+            sky.domeIndices.push_back(b);
+            sky.domeIndices.push_back((unsigned short)(a + 1));
+            sky.domeIndices.push_back((unsigned short)(a + 1));
+            sky.domeIndices.push_back(b);
+            sky.domeIndices.push_back((unsigned short)(b + 1));
+        }
+    }
+}
+
+// Precompute the transmittance table and create the sky texture. Needs a GL context.
+void initSky() {
+    PROFILE_FUNCTION();
+    buildSkyTransmittance();
+    buildSkyDome();
+
+    glGenTextures(1, &sky.texture);
+    glBindTexture(GL_TEXTURE_2D, sky.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SKY_VIEW_WIDTH, SKY_VIEW_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    sky.valid = false;
+    printf("Sky ready: %dx%d transmittance table, %dx%d view table\n", SKY_TRANSMITTANCE_WIDTH,
+           SKY_TRANSMITTANCE_HEIGHT, SKY_VIEW_WIDTH, SKY_VIEW_HEIGHT);
+}
+
+// Bring the sky up to date with the sun. Returns true when it was rebuilt.
+bool updateSky(float sunAngle) {
+    PROFILE_FUNCTION();
+    float quantized = floor(sunAngle / SKY_SUN_STEP + 0.5f) * SKY_SUN_STEP;
+    if (sky.valid && quantized == sky.sunAngle) return false;
+
+    buildSkyView(quantized);
+    glBindTexture(GL_TEXTURE_2D, sky.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    streamTexSubImage2D(0, 0, SKY_VIEW_WIDTH, SKY_VIEW_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, &sky.view[0], sky.view.size());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    sky.sunAngle = quantized;
+    sky.valid = true;
+    return true;
+}
+
+bool isSkyDark(float sunAngle) {
+    return sin(sunAngle * 3.14159265f / 180.0f) < SKY_DARK_SUN_HEIGHT;
+}
+
+// Draw the dome around the camera, behind everything. Goes through the GL
+// state cache, so call it inside a frame.
+void drawSky(float camX, float camY, float camZ) {
+    PROFILE_FUNCTION();
+    PROFILE_GPU_SCOPE("Sky");
+    cachedEnable(GL_LIGHTING, false);
+    cachedUseTexture(sky.texture);
+    cachedColor3f(1.0f, 1.0f, 1.0f);
+    glDisable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+
+    if (glBuffersSupported) cachedBindBuffer(GL_ARRAY_BUFFER, 0);
+    cachedEnable(GL_VERTEX_ARRAY, true);
+    cachedEnable(GL_NORMAL_ARRAY, false);
+    glVertexPointer(3, GL_FLOAT, sizeof(SkyDomeVertex), &sky.domeVertices[0].x);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(SkyDomeVertex), &sky.domeVertices[0].u);
+    cachedEnable(GL_TEXTURE_COORD_ARRAY, true);
+    glState.arraySource = &sky;
+
+    glPushMatrix();
+    glTranslatef(camX, camY, camZ);
+    glScalef(SKY_DOME_RADIUS, SKY_DOME_RADIUS, SKY_DOME_RADIUS);
+    if (glBuffersSupported) cachedBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glDrawElements(GL_TRIANGLES, (GLsizei)sky.domeIndices.size(), GL_UNSIGNED_SHORT, &sky.domeIndices[0]);
+    glPopMatrix();
+
+    cachedEnable(GL_TEXTURE_COORD_ARRAY, false);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_DEPTH_TEST);
+    cachedEnable(GL_LIGHTING, true);
+    renderStats.drawCalls++;
+}
+
+#endif // SKY_H
@@ -0,0 +1,504 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <math.h>
+#include <vector>
+
+#include "GLExtensions.h"
+#include "RenderQueue.h"
+#include "Level.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+// Chunked heightmap terrain with geomipmapping.
+//
+// The heightmap (binary PGM, 8 or 16 bit) is stretched over the level area
+// and split into chunks of TERRAIN_CHUNK_QUADS x TERRAIN_CHUNK_QUADS quads.
+// Every chunk keeps one full-resolution vertex buffer; its levels of detail
+// only differ in which vertices the index buffer references. Index buffers
+// are shared by all chunks: one per LOD and per combination of coarser
+// neighbours. On an edge next to a coarser chunk the odd vertices are folded
+// onto their even neighbours, so both sides of the seam share the same edge
+// and no cracks appear. Neighbouring LODs never differ by more than one.
+
+#define TERRAIN_DEFAULT_PATH "levels/rural_height.pgm"
+#define TERRAIN_CHUNK_QUADS 32
+#define TERRAIN_CHUNK_VERTS (TERRAIN_CHUNK_QUADS + 1)
+#define TERRAIN_LOD_COUNT 5          // Steps 1, 2, 4, 8, 16
+#define TERRAIN_HEIGHT_SCALE 12.0f   // World height of the heightmap's max value
+#define TERRAIN_PIXEL_ERROR 2.0f     // Allowed screen-space error in pixels
+
+// Neighbour sides (bit flags in the stitching mask)
+#define TERRAIN_SIDE_NORTH 1  // -Z
+#define TERRAIN_SIDE_SOUTH 2  // +Z
+#define TERRAIN_SIDE_WEST 4   // -X
+#define TERRAIN_SIDE_EAST 8   // +X
+
+struct TerrainVertex {
+    float x, y, z;
+    signed char nx, ny, nz, pad;
+    unsigned char r, g, b, a;
+};
+
+struct TerrainChunk {
+    int sampleX, sampleZ;                // First heightmap sample of the chunk
+    Vector3 boundsMin, boundsMax;
+    float lodError[TERRAIN_LOD_COUNT];   // Max height error of each LOD (world units)
+    std::vector<TerrainVertex> vertices; // Kept only when buffer objects are unavailable
+    GLuint vertexBuffer;
+    GLuint colorBuffer;                  // Baked lighting colors (see BakedLighting.h), 0 if none
+    const unsigned char* bakedColors;    // Client-side baked colors when buffer objects are unavailable
+    int lod;
+    int stitchMask;
+};
+
+struct Terrain {
+    int width, depth;              // Heightmap samples
+    std::vector<float> heights;    // World-space heights, row-major
+    float originX, originZ;        // World position of sample (0, 0)
+    float spacing;                 // World distance between samples
+    int chunksX, chunksZ;
+    std::vector<TerrainChunk> chunks;
+    std::vector<unsigned short> indices[TERRAIN_LOD_COUNT][16];
+    GLuint indexBuffers[TERRAIN_LOD_COUNT][16];
+    bool ready;                    // Chunks built and uploaded
+};
+
+Terrain terrain;
+
+// Read a binary PGM (P5). Values are normalized to 0..1.
+bool loadHeightmapPGM(const char* filename, int& width, int& depth, std::vector<float>& values) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        printf("Warning: Could not open heightmap: %s\n", filename);
+        return false;
+    }
+
+    char magic[3] = { 0 };
+    int header[3];  // width, height, maxval
+    bool ok = fread(magic, 1, 2, file) == 2 && magic[0] == 'P' && magic[1] == '5';
+    for (int i = 0; ok && i < 3; i++) {
+        // Skip whitespace and comment lines between header fields
+        int c = fgetc(file);
+        while (c == '#' || c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+            if (c == '#') {
+                while (c != '\n' && c != EOF) c = fgetc(file);
+            }
+            c = fgetc(file);
+        }
+        ungetc(c, file);
+        ok = fscanf(file, "%d", &header[i]) == 1;
+    }
+    ok = ok && fgetc(file) != EOF;  // Single whitespace before the pixel data
+    if (!ok || header[0] < 2 || header[1] < 2 || header[2] <= 0 || header[2] > 65535) {
+        printf("Error: Invalid PGM heightmap: %s\n", filename);
+        fclose(file);
+        return false;
+    }
+
+    width = header[0];
+    depth = header[1];
+    int bytesPerSample = header[2] > 255 ? 2 : 1;
+    std::vector<unsigned char> raw((size_t)width * depth * bytesPerSample);
+    if (fread(&raw[0], 1, raw.size(), file) != raw.size()) {
+        printf("Error: Truncated PGM heightmap: %s\n", filename);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+
+    values.resize((size_t)width * depth);
+    for (size_t i = 0; i < values.size(); i++) {
+        unsigned int v = bytesPerSample == 2 ? (raw[i * 2] << 8) | raw[i * 2 + 1] : raw[i];  // PGM is big-endian
+        values[i] = (float)v / header[2];
+    }
+    return true;
+}
+
+// Load heights only (no GL). Falls back to a flat ground when the file is missing,
+// so the rest of the game always has a terrain to query.
+bool loadTerrain(const char* filename) {
+    PROFILE_FUNCTION();
+    std::vector<float> values;
+    bool loaded = loadHeightmapPGM(filename, terrain.width, terrain.depth, values);
+    if (!loaded) {
+        terrain.width = TERRAIN_CHUNK_VERTS;
+        terrain.depth = TERRAIN_CHUNK_VERTS;
+        values.assign((size_t)terrain.width * terrain.depth, 0.0f);
+    }
+
+    terrain.heights.resize(values.size());
+    for (size_t i = 0; i < values.size(); i++) {
+        terrain.heights[i] = values[i] * TERRAIN_HEIGHT_SCALE;
+    }
+
+    int largest = terrain.width > terrain.depth ? terrain.width : terrain.depth;
+    terrain.spacing = 2.0f * LEVEL_HALF_EXTENT / (largest - 1);
+    terrain.originX = -LEVEL_HALF_EXTENT;
+    terrain.originZ = -LEVEL_HALF_EXTENT;
+    terrain.chunksX = (terrain.width - 2) / TERRAIN_CHUNK_QUADS + 1;
+    terrain.chunksZ = (terrain.depth - 2) / TERRAIN_CHUNK_QUADS + 1;
+    terrain.ready = false;
+
+    if (loaded) {
+        printf("Loaded heightmap: %s (%dx%d samples, %dx%d chunks)\n", filename,
+               terrain.width, terrain.depth, terrain.chunksX, terrain.chunksZ);
+    }
+    return loaded;
+}
+
+// Height sample with coordinates clamped to the map
+float getTerrainSample(int x, int z) {
+    if (x < 0) x = 0;
+    if (z < 0) z = 0;
+    if (x >= terrain.width) x = terrain.width - 1;
+    if (z >= terrain.depth) z = terrain.depth - 1;
+    return terrain.heights[(size_t)z * terrain.width + x];
+}
+
+// Height of the full-detail surface under (x, z), using the same triangle
+// split as the mesh. Returns 0 before a terrain is loaded.
+float getTerrainHeight(float x, float z) {
+    if (terrain.heights.empty()) return 0.0f;
+
+    float gx = (x - terrain.originX) / terrain.spacing;
+    float gz = (z - terrain.originZ) / terrain.spacing;
+    int ix = (int)floor(gx);
+    int iz = (int)floor(gz);
+    float fx = gx - ix;
+    float fz = gz - iz;
+
+    float h00 = getTerrainSample(ix, iz);
+    float h10 = getTerrainSample(ix + 1, iz);
+    float h01 = getTerrainSample(ix, iz + 1);
+    float h11 = getTerrainSample(ix + 1, iz + 1);
+
+    // Quads are split along the (0,0)-(1,1) diagonal
+    if (fx >= fz) {
+        return h00 + (h10 - h00) * fx + (h11 - h10) * fz;
+    }
+    return h00 + (h01 - h00) * fz + (h11 - h01) * fx;
+}
+
+// Sit every static object on the ground and refresh its bounds
+void placeLevelOnTerrain() {
+    for (size_t i = 0; i < levelObjects.size(); i++) {
+        LevelObject& obj = levelObjects[i];
+        obj.y = getTerrainHeight(obj.x, obj.z);
+        getLevelObjectBounds(obj, obj.boundsMin, obj.boundsMax);
+    }
+}
+
+// Index of vertex (x, z) in a chunk, folding odd edge vertices onto their even
+// neighbour on sides that border a coarser chunk
+unsigned short terrainStitchedIndex(int x, int z, int step, int stitchMask) {
+    int coarse = step * 2;
+    if ((stitchMask & TERRAIN_SIDE_NORTH) && z == 0 && x % coarse != 0) x -= step;
+    if ((stitchMask & TERRAIN_SIDE_SOUTH) && z == TERRAIN_CHUNK_QUADS && x % coarse != 0) x -= step;
+    if ((stitchMask & TERRAIN_SIDE_WEST) && x == 0 && z % coarse != 0) z -= step;
+    if ((stitchMask & TERRAIN_SIDE_EAST) && x == TERRAIN_CHUNK_QUADS && z % coarse != 0) z -= step;
+    return (unsigned short)(z * TERRAIN_CHUNK_VERTS + x);
+}
+
+void buildTerrainIndices(std::vector<unsigned short>& indices, int lod, int stitchMask) {
+    int step = 1 << lod;
+    indices.clear();
+    for (int z = 0; z < TERRAIN_CHUNK_QUADS; z += step) {
+        for (int x = 0; x < TERRAIN_CHUNK_QUADS; x += step) {
+            unsigned short i00 = terrainStitchedIndex(x, z, step, stitchMask);
+            unsigned short i10 = terrainStitchedIndex(x + step, z, step, stitchMask);
+            unsigned short i01 = terrainStitchedIndex(x, z + step, step, stitchMask);
+            unsigned short i11 = terrainStitchedIndex(x + step, z + step, step, stitchMask);
+            // Counter-clockwise seen from above (+Y), split along the 00-11 diagonal
+            if (i00 != i11 && i11 != i10 && i10 != i00) {
+                indices.push_back(i00); indices.push_back(i11); indices.push_back(i10);
+            }
+            if (i00 != i01 && i01 != i11 && i11 != i00) {
+                indices.push_back(i00); indices.push_back(i01); indices.push_back(i11);
+            }
+        }
+    }
+}
+
+// Largest height difference between the full-detail surface and the surface
+// of the given LOD, sampled at every full-detail vertex of the chunk
+float computeTerrainLODError(const TerrainChunk& chunk, int lod) {
+    int step = 1 << lod;
+    float maxError = 0.0f;
+    for (int z = 0; z <= TERRAIN_CHUNK_QUADS; z++) {
+        for (int x = 0; x <= TERRAIN_CHUNK_QUADS; x++) {
+            int x0 = (x / step) * step, z0 = (z / step) * step;
+            if (x0 == TERRAIN_CHUNK_QUADS) x0 -= step;
+            if (z0 == TERRAIN_CHUNK_QUADS) z0 -= step;
+            float fx = (float)(x - x0) / step, fz = (float)(z - z0) / step;
+            int sx = chunk.sampleX + x0, sz = chunk.sampleZ + z0;
+            float h00 = getTerrainSample(sx, sz);
+            float h10 = getTerrainSample(sx + step, sz);
+            float h01 = getTerrainSample(sx, sz + step);
+            float h11 = getTerrainSample(sx + step, sz + step);
+            float approx = fx >= fz ? h00 + (h10 - h00) * fx + (h11 - h10) * fz
+                                    : h00 + (h01 - h00) * fz + (h11 - h01) * fx;
+            float error = fabs(approx - getTerrainSample(chunk.sampleX + x, chunk.sampleZ + z));
+            if (error > maxError) maxError = error;
+        }
+    }
+    return maxError;
+}
+
+// Central-difference normal at a heightmap sample
+Vector3 getTerrainNormal(int sx, int sz) {
+    float dx = getTerrainSample(sx + 1, sz) - getTerrainSample(sx - 1, sz);
+    float dz = getTerrainSample(sx, sz + 1) - getTerrainSample(sx, sz - 1);
+    float nx = -dx, ny = 2.0f * terrain.spacing, nz = -dz;
+    float len = sqrt(nx * nx + ny * ny + nz * nz);
+    return Vector3(nx / len, ny / len, nz / len);
+}
+
+// Grass with the lighter patches of the old flat ground (8x8 every 10 units)
+void getTerrainAlbedo(float x, float z, unsigned char rgb[3]) {
+    int patchX = (int)floor(x / 10.0f), patchZ = (int)floor(z / 10.0f);
+    float inPatchX = x - patchX * 10.0f, inPatchZ = z - patchZ * 10.0f;
+    bool patch = (patchX + patchZ) % 3 == 0 && inPatchX <= 8.0f && inPatchZ <= 8.0f;
+    rgb[0] = patch ? 115 : 102;
+    rgb[1] = patch ? 166 : 153;
+    rgb[2] = patch ? 89 : 77;
+}
+
+void buildTerrainChunkVertices(TerrainChunk& chunk) {
+    chunk.vertices.resize(TERRAIN_CHUNK_VERTS * TERRAIN_CHUNK_VERTS);
+
+    for (int z = 0; z < TERRAIN_CHUNK_VERTS; z++) {
+        for (int x = 0; x < TERRAIN_CHUNK_VERTS; x++) {
+            int sx = chunk.sampleX + x, sz = chunk.sampleZ + z;
+            TerrainVertex& v = chunk.vertices[z * TERRAIN_CHUNK_VERTS + x];
+            v.x = terrain.originX + sx * terrain.spacing;
+            v.y = getTerrainSample(sx, sz);
+            v.z = terrain.originZ + sz * terrain.spacing;
+
+            Vector3 normal = getTerrainNormal(sx, sz);
+            v.nx = (signed char)(normal.x * 127.0f);
+            v.ny = (signed char)(normal.y * 127.0f);
+            v.nz = (signed char)(normal.z * 127.0f);
+            v.pad = 0;
+
+            unsigned char albedo[3];
+            getTerrainAlbedo(v.x, v.z, albedo);
+            v.r = albedo[0];
+            v.g = albedo[1];
+            v.b = albedo[2];
+            v.a = 255;
+        }
+    }
+}
+
+// Lay out the chunk grid with each chunk's bounds and LOD errors, without
+// building vertices or touching GL (the PVS builder stops here)
+void layoutTerrainChunks() {
+    terrain.chunks.resize((size_t)terrain.chunksX * terrain.chunksZ);
+    for (int cz = 0; cz < terrain.chunksZ; cz++) {
+        for (int cx = 0; cx < terrain.chunksX; cx++) {
+            TerrainChunk& chunk = terrain.chunks[(size_t)cz * terrain.chunksX + cx];
+            chunk.sampleX = cx * TERRAIN_CHUNK_QUADS;
+            chunk.sampleZ = cz * TERRAIN_CHUNK_QUADS;
+            chunk.vertexBuffer = 0;
+            chunk.colorBuffer = 0;
+            chunk.bakedColors = NULL;
+            chunk.lod = 0;
+            chunk.stitchMask = 0;
+
+            float minY = 1e30f, maxY = -1e30f;
+            for (int z = 0; z < TERRAIN_CHUNK_VERTS; z++) {
+                for (int x = 0; x < TERRAIN_CHUNK_VERTS; x++) {
+                    float y = getTerrainSample(chunk.sampleX + x, chunk.sampleZ + z);
+                    if (y < minY) minY = y;
+                    if (y > maxY) maxY = y;
+                }
+            }
+            chunk.boundsMin = Vector3(terrain.originX + chunk.sampleX * terrain.spacing, minY,
+                                      terrain.originZ + chunk.sampleZ * terrain.spacing);
+            chunk.boundsMax = Vector3(terrain.originX + (chunk.sampleX + TERRAIN_CHUNK_QUADS) * terrain.spacing, maxY,
+                                      terrain.originZ + (chunk.sampleZ + TERRAIN_CHUNK_QUADS) * terrain.spacing);
+
+            for (int lod = 0; lod < TERRAIN_LOD_COUNT; lod++) {
+                chunk.lodError[lod] = computeTerrainLODError(chunk, lod);
+                // Coarser levels never claim to be more accurate than finer ones
+                if (lod > 0 && chunk.lodError[lod] < chunk.lodError[lod - 1]) {
+                    chunk.lodError[lod] = chunk.lodError[lod - 1];
+                }
+            }
+        }
+    }
+}
+
+// Chunk under (x, z), clamped to the grid
+int getTerrainChunkIndex(float x, float z) {
+    int cx = (int)floor((x - terrain.originX) / (terrain.spacing * TERRAIN_CHUNK_QUADS));
+    int cz = (int)floor((z - terrain.originZ) / (terrain.spacing * TERRAIN_CHUNK_QUADS));
+    if (cx < 0) cx = 0;
+    if (cz < 0) cz = 0;
+    if (cx >= terrain.chunksX) cx = terrain.chunksX - 1;
+    if (cz >= terrain.chunksZ) cz = terrain.chunksZ - 1;
+    return cz * terrain.chunksX + cx;
+}
+
+// Build chunk vertices, LOD errors and the shared index buffers, and upload
+// everything to the GPU. Needs a GL context.
+void buildTerrainChunks() {
+    PROFILE_FUNCTION();
+    layoutTerrainChunks();
+    size_t vertexBytes = 0;
+
+    for (int cz = 0; cz < terrain.chunksZ; cz++) {
+        for (int cx = 0; cx < terrain.chunksX; cx++) {
+            TerrainChunk& chunk = terrain.chunks[(size_t)cz * terrain.chunksX + cx];
+            buildTerrainChunkVertices(chunk);
+
+            if (glBuffersSupported) {
+                pglGenBuffers(1, &chunk.vertexBuffer);
+                cachedBindBuffer(GL_ARRAY_BUFFER, chunk.vertexBuffer);
+                pglBufferData(GL_ARRAY_BUFFER, chunk.vertices.size() * sizeof(TerrainVertex),
+                              &chunk.vertices[0], GL_STATIC_DRAW);
+                vertexBytes += chunk.vertices.size() * sizeof(TerrainVertex);
+                // The GPU copy is all we need from now on
+                std::vector<TerrainVertex>().swap(chunk.vertices);
+            }
+        }
+    }
+
+    for (int lod = 0; lod < TERRAIN_LOD_COUNT; lod++) {
+        for (int mask = 0; mask < 16; mask++) {
+            buildTerrainIndices(terrain.indices[lod][mask], lod, mask);
+            terrain.indexBuffers[lod][mask] = 0;
+            if (glBuffersSupported) {
+                pglGenBuffers(1, &terrain.indexBuffers[lod][mask]);
+                cachedBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrain.indexBuffers[lod][mask]);
+                pglBufferData(GL_ELEMENT_ARRAY_BUFFER, terrain.indices[lod][mask].size() * sizeof(unsigned short),
+                              &terrain.indices[lod][mask][0], GL_STATIC_DRAW);
+            }
+        }
+    }
+
+    terrain.ready = true;
+    printf("Terrain ready: %d chunks, %d KB of vertex buffers\n",
+           (int)terrain.chunks.size(), (int)(vertexBytes / 1024));
+}
+
+struct TerrainLODView {
+    float camX, camY, camZ, pixelsPerUnit;
+};
+
+// Each chunk's own LOD from its screen-space error (a parallelFor range)
+void pickTerrainChunkLODs(void* data, int begin, int end) {
+    PROFILE_FUNCTION();
+    const TerrainLODView& view = *(const TerrainLODView*)data;
+    float camX = view.camX, camY = view.camY, camZ = view.camZ, pixelsPerUnit = view.pixelsPerUnit;
+    for (int i = begin; i < end; i++) {
+        TerrainChunk& chunk = terrain.chunks[i];
+        // Distance from the camera to the chunk's bounding box
+        float dx = camX < chunk.boundsMin.x ? chunk.boundsMin.x - camX : (camX > chunk.boundsMax.x ? camX - chunk.boundsMax.x : 0);
+        float dy = camY < chunk.boundsMin.y ? chunk.boundsMin.y - camY : (camY > chunk.boundsMax.y ? camY - chunk.boundsMax.y : 0);
+        float dz = camZ < chunk.boundsMin.z ? chunk.boundsMin.z - camZ : (camZ > chunk.boundsMax.z ? camZ - chunk.boundsMax.z : 0);
+        float distance = sqrt(dx * dx + dy * dy + dz * dz);
+        if (distance < 1.0f) distance = 1.0f;
+
+        int lod = 0;
+        while (lod + 1 < TERRAIN_LOD_COUNT &&
+               chunk.lodError[lod + 1] * pixelsPerUnit / distance <= TERRAIN_PIXEL_ERROR) {
+            lod++;
+        }
+        chunk.lod = lod;
+    }
+}
+
+// Pick each chunk's LOD from its screen-space error, then limit neighbouring
+// chunks to one level of difference and record which sides need stitching
+void selectTerrainLODs(float camX, float camY, float camZ, float pixelsPerUnit) {
+    PROFILE_FUNCTION();
+    TerrainLODView view = { camX, camY, camZ, pixelsPerUnit };
+    parallelFor((int)terrain.chunks.size(), 64, pickTerrainChunkLODs, &view);
+
+    // Relax until no neighbour is more than one level coarser
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int cz = 0; cz < terrain.chunksZ; cz++) {
+            for (int cx = 0; cx < terrain.chunksX; cx++) {
+                TerrainChunk& chunk = terrain.chunks[(size_t)cz * terrain.chunksX + cx];
+                int neighbours[4][2] = { { cx, cz - 1 }, { cx, cz + 1 }, { cx - 1, cz }, { cx + 1, cz } };
+                for (int n = 0; n < 4; n++) {
+                    int nx = neighbours[n][0], nz = neighbours[n][1];
+                    if (nx < 0 || nz < 0 || nx >= terrain.chunksX || nz >= terrain.chunksZ) continue;
+                    int limit = terrain.chunks[(size_t)nz * terrain.chunksX + nx].lod + 1;
+                    if (chunk.lod > limit) {
+                        chunk.lod = limit;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int cz = 0; cz < terrain.chunksZ; cz++) {
+        for (int cx = 0; cx < terrain.chunksX; cx++) {
+            TerrainChunk& chunk = terrain.chunks[(size_t)cz * terrain.chunksX + cx];
+            int sides[4] = { TERRAIN_SIDE_NORTH, TERRAIN_SIDE_SOUTH, TERRAIN_SIDE_WEST, TERRAIN_SIDE_EAST };
+            int neighbours[4][2] = { { cx, cz - 1 }, { cx, cz + 1 }, { cx - 1, cz }, { cx + 1, cz } };
+            chunk.stitchMask = 0;
+            for (int n = 0; n < 4; n++) {
+                int nx = neighbours[n][0], nz = neighbours[n][1];
+                if (nx < 0 || nz < 0 || nx >= terrain.chunksX || nz >= terrain.chunksZ) continue;
+                if (terrain.chunks[(size_t)nz * terrain.chunksX + nx].lod > chunk.lod) {
+                    chunk.stitchMask |= sides[n];
+                }
+            }
+        }
+    }
+}
+
+void drawTerrainChunk(const TerrainChunk& chunk) {
+    PROFILE_FUNCTION();
+    cachedEnable(GL_VERTEX_ARRAY, true);
+    cachedEnable(GL_NORMAL_ARRAY, true);
+    cachedEnable(GL_COLOR_ARRAY, true);
+
+    if (glState.arraySource != &chunk) {
+        const char* base = chunk.vertexBuffer != 0 ? NULL : (const char*)&chunk.vertices[0];
+        // Baked lighting replaces the albedo colors with lit ones
+        if (chunk.colorBuffer != 0) {
+            cachedBindBuffer(GL_ARRAY_BUFFER, chunk.colorBuffer);
+            glColorPointer(4, GL_UNSIGNED_BYTE, 0, (const void*)0);
+        } else if (chunk.bakedColors != NULL) {
+            if (glBuffersSupported) cachedBindBuffer(GL_ARRAY_BUFFER, 0);
+            glColorPointer(4, GL_UNSIGNED_BYTE, 0, chunk.bakedColors);
+        }
+        if (chunk.vertexBuffer != 0) {
+            cachedBindBuffer(GL_ARRAY_BUFFER, chunk.vertexBuffer);
+        } else if (glBuffersSupported) {
+            cachedBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        glVertexPointer(3, GL_FLOAT, sizeof(TerrainVertex), base + offsetof(TerrainVertex, x));
+        glNormalPointer(GL_BYTE, sizeof(TerrainVertex), base + offsetof(TerrainVertex, nx));
+        if (chunk.colorBuffer == 0 && chunk.bakedColors == NULL) {
+            glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(TerrainVertex), base + offsetof(TerrainVertex, r));
+        }
+        glState.arraySource = &chunk;
+        renderStats.stateChanges++;
+    }
+
+    const std::vector<unsigned short>& indices = terrain.indices[chunk.lod][chunk.stitchMask];
+    GLuint indexBuffer = terrain.indexBuffers[chunk.lod][chunk.stitchMask];
+    if (indexBuffer != 0) {
+        cachedBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_SHORT, (const void*)0);
+    } else {
+        if (glBuffersSupported) cachedBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_SHORT, &indices[0]);
+    }
+
+    // Drawing with a color array leaves the current color undefined
+    cachedEnable(GL_COLOR_ARRAY, false);
+    glState.colorValid = false;
+    renderStats.drawCalls++;
+}
+
+#endif // TERRAIN_H
@@ -0,0 +1,81 @@
+#ifndef TEST_BMP_H
+#define TEST_BMP_H
+
+#include "ModelLoader.h"
+
+// The BMP fixtures in tests/bmp, for test_textures and bench_textures. Every
+// good fixture stores B, G, R (and A) of pixel (x, y), y counted from the
+// bottom row, as (x * 37 + y * 11 + channel * 101) & 255, with rows padded
+// by 0xEE bytes. The bad ones are damaged or unsupported and must be
+// rejected.
+
+#define TEST_BMP_DIRECTORY "tests/bmp/"
+
+struct TestBMP {
+    const char* file;
+    int width, height, bits;
+    bool topDown;
+};
+
+const TestBMP testBMPs[] = {
+    { "w1_24.bmp", 1, 5, 24, false },
+    { "w2_24.bmp", 2, 5, 24, false },
+    { "w3_24.bmp", 3, 5, 24, false },
+    { "w5_24.bmp", 5, 5, 24, false },
+    { "w7_24.bmp", 7, 5, 24, false },
+    { "w13_24.bmp", 13, 5, 24, false },
+    { "w31_24.bmp", 31, 5, 24, false },
+    { "w1_24_topdown.bmp", 1, 4, 24, true },
+    { "w2_24_topdown.bmp", 2, 4, 24, true },
+    { "w3_24_topdown.bmp", 3, 4, 24, true },
+    { "w5_24_topdown.bmp", 5, 4, 24, true },
+    { "w7_24_topdown.bmp", 7, 4, 24, true },
+    { "w13_24_topdown.bmp", 13, 4, 24, true },
+    { "w31_24_topdown.bmp", 31, 4, 24, true },
+    { "w5_32.bmp", 5, 3, 32, false },
+    { "w7_32_topdown.bmp", 7, 6, 32, true },
+    { "w9_32_bitfields.bmp", 9, 4, 32, false },   // BI_BITFIELDS, BGRA masks
+    { "w6_32_v4header.bmp", 6, 5, 32, false },    // BI_BITFIELDS in a V4 header
+};
+
+const char* const badTestBMPs[] = {
+    "bad_truncated.bmp",   // Pixel data cut short
+    "bad_rle.bmp",         // RLE compressed
+    "bad_planes.bmp",      // Two planes
+    "bad_masks.bmp",       // BI_BITFIELDS in RGBA order
+    "bad_16bit.bmp",
+    "bad_offset.bmp",      // Pixel offset past the end of the file
+    "bad_huge.bmp",        // Wider than BMP_MAX_DIMENSION
+    "bad_magic.bmp",
+    "bad_short.bmp",       // Shorter than the headers
+};
+
+#define TEST_BMP_COUNT (int)(sizeof(testBMPs) / sizeof(testBMPs[0]))
+#define BAD_TEST_BMP_COUNT (int)(sizeof(badTestBMPs) / sizeof(badTestBMPs[0]))
+
+unsigned char testBMPPixel(int x, int y, int channel) {
+    return (unsigned char)((x * 37 + y * 11 + channel * 101) & 255);
+}
+
+// Copy a fixture, so the same pixels can be loaded under another path
+bool copyTestBMP(const std::string& from, const std::string& to) {
+    FILE* in = fopen(from.c_str(), "rb");
+    if (!in) return false;
+    FILE* out = fopen(to.c_str(), "wb");
+    bool ok = out != NULL;
+    char buffer[4096];
+    size_t read;
+    while (ok && (read = fread(buffer, 1, sizeof(buffer), in)) > 0) ok = fwrite(buffer, 1, read, out) == read;
+    fclose(in);
+    if (out && fclose(out) != 0) ok = false;
+    return ok;
+}
+
+// Fixture directory from the command line, with a trailing separator
+std::string testBMPDirectory(int argc, char** argv) {
+    std::string directory = argc > 1 ? argv[1] : TEST_BMP_DIRECTORY;
+    if (!directory.empty() && directory[directory.size() - 1] != '/') directory += '/';
+    return directory;
+}
+
+#endif // TEST_BMP_H
@@ -0,0 +1,123 @@
+#ifndef TEST_GRID_H
+#define TEST_GRID_H
+
+#include "ModelLoader.h"
+
+// Generated model files for test_loaders and bench_loaders: one grid mesh
+// written as OBJ, PLY (ASCII and both binary byte orders) and binary STL.
+
+std::string tempPath(const char* name) {
+    return getTempDirectory() + name;
+}
+
+// A bumpy grid with positions, texture coordinates and normals. Every value
+// is exactly representable, so text and binary files of it load identically.
+struct TestGrid {
+    std::vector<float> positions, normals, texCoords;
+    std::vector<int> triangles;
+};
+
+void buildGrid(TestGrid& grid, int size) {
+    int n = size + 1;
+    for (int z = 0; z < n; z++) {
+        for (int x = 0; x < n; x++) {
+            float p[3] = { (float)x, ((x * 7 + z * 3) % 11) * 0.25f, (float)z };
+            float nn[3] = { ((x % 3) - 1) * 0.5f, 1.0f, ((z % 5) - 2) * 0.25f };
+            float t[2] = { x * 0.125f, z * 0.0625f };
+            grid.positions.insert(grid.positions.end(), p, p + 3);
+            grid.normals.insert(grid.normals.end(), nn, nn + 3);
+            grid.texCoords.insert(grid.texCoords.end(), t, t + 2);
+        }
+    }
+    for (int z = 0; z < size; z++) {
+        for (int x = 0; x < size; x++) {
+            int a = z * n + x, b = a + 1, c = a + n, d = c + 1;
+            int quad[6] = { a, c, b, b, c, d };
+            grid.triangles.insert(grid.triangles.end(), quad, quad + 6);
+        }
+    }
+}
+
+bool writeGridOBJ(const TestGrid& grid, const std::string& path) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) return false;
+    size_t count = grid.positions.size() / 3;
+    for (size_t i = 0; i < count; i++) {
+        fprintf(file, "v %.9g %.9g %.9g\n", grid.positions[i * 3], grid.positions[i * 3 + 1], grid.positions[i * 3 + 2]);
+    }
+    for (size_t i = 0; i < count; i++) fprintf(file, "vt %.9g %.9g\n", grid.texCoords[i * 2], grid.texCoords[i * 2 + 1]);
+    for (size_t i = 0; i < count; i++) {
+        fprintf(file, "vn %.9g %.9g %.9g\n", grid.normals[i * 3], grid.normals[i * 3 + 1], grid.normals[i * 3 + 2]);
+    }
+    for (size_t t = 0; t < grid.triangles.size(); t += 3) {
+        int a = grid.triangles[t] + 1, b = grid.triangles[t + 1] + 1, c = grid.triangles[t + 2] + 1;
+        fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c);
+    }
+    return fclose(file) == 0;
+}
+
+// Binary values in the given byte order
+void writeValue(FILE* file, const void* value, int size, bool bigEndian) {
+    unsigned char b[4];
+    copyEndian(b, (const unsigned char*)value, size, bigEndian == hostIsLittleEndian());
+    fwrite(b, 1, size, file);
+}
+
+// format is "ascii", "binary_little_endian" or "binary_big_endian". The
+// vertices carry an extra property the loader does not use, which it must skip.
+bool writeGridPLY(const TestGrid& grid, const std::string& path, const char* format) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    size_t count = grid.positions.size() / 3, triangles = grid.triangles.size() / 3;
+    fprintf(file, "ply\nformat %s 1.0\ncomment BlitzMail test grid\nelement vertex %d\n", format, (int)count);
+    fprintf(file, "property float x\nproperty float y\nproperty float z\nproperty uchar quality\n");
+    fprintf(file, "property float nx\nproperty float ny\nproperty float nz\nproperty float s\nproperty float t\n");
+    fprintf(file, "element face %d\nproperty list uchar int vertex_indices\nend_header\n", (int)triangles);
+    bool ascii = strcmp(format, "ascii") == 0, bigEndian = strcmp(format, "binary_big_endian") == 0;
+    for (size_t i = 0; i < count; i++) {
+        const float* p = &grid.positions[i * 3];
+        const float* n = &grid.normals[i * 3];
+        const float* t = &grid.texCoords[i * 2];
+        if (ascii) {
+            fprintf(file, "%.9g %.9g %.9g 7 %.9g %.9g %.9g %.9g %.9g\n", p[0], p[1], p[2], n[0], n[1], n[2], t[0], t[1]);
+            continue;
+        }
+        unsigned char quality = 7;
+        for (int k = 0; k < 3; k++) writeValue(file, &p[k], 4, bigEndian);
+        fwrite(&quality, 1, 1, file);
+        for (int k = 0; k < 3; k++) writeValue(file, &n[k], 4, bigEndian);
+        for (int k = 0; k < 2; k++) writeValue(file, &t[k], 4, bigEndian);
+    }
+    for (size_t t = 0; t < triangles; t++) {
+        const int* tri = &grid.triangles[t * 3];
+        if (ascii) {
+            fprintf(file, "3 %d %d %d\n", tri[0], tri[1], tri[2]);
+            continue;
+        }
+        unsigned char three = 3;
+        fwrite(&three, 1, 1, file);
+        for (int k = 0; k < 3; k++) writeValue(file, &tri[k], 4, bigEndian);
+    }
+    return fclose(file) == 0;
+}
+
+bool writeGridSTL(const TestGrid& grid, const std::string& path) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    unsigned char header[80] = { 0 };
+    unsigned int triangles = (unsigned int)(grid.triangles.size() / 3);
+    fwrite(header, 1, sizeof(header), file);
+    writeValue(file, &triangles, 4, false);
+    for (size_t t = 0; t < grid.triangles.size(); t += 3) {
+        float zero[3] = { 0, 0, 0 };  // Recomputed by the loader
+        unsigned short attributes = 0;
+        for (int k = 0; k < 3; k++) writeValue(file, &zero[k], 4, false);
+        for (int c = 0; c < 3; c++) {
+            for (int k = 0; k < 3; k++) writeValue(file, &grid.positions[grid.triangles[t + c] * 3 + k], 4, false);
+        }
+        fwrite(&attributes, 2, 1, file);
+    }
+    return fclose(file) == 0;
+}
+
+#endif // TEST_GRID_H
@@ -0,0 +1,609 @@
+#ifndef UPLOAD_THREAD_H
+#define UPLOAD_THREAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#if defined(__APPLE__)
+#include <OpenGL/OpenGL.h>
+#elif !defined(_WIN32)
+#include <dlfcn.h>
+#endif
+
+#include "GLExtensions.h"
+#include "ModelLoader.h"
+#include "Profiler.h"
+
+// Background GPU uploads.
+//
+// A worker thread owns a second GL context that shares objects with the
+// render context. Model buffers queued from the render thread are created
+// there: data is copied into mapped buffers, each upload ends with a fence,
+// and pollUploads, called once a frame, hands the buffers to the game only
+// after their fence has signalled. Until then a model keeps drawing from its
+// arena (or the pak mapping), so a large model arriving mid-game never stalls
+// a frame on the copy. For queued textures the worker also reads the file
+// and copies its rows into a pixel unpack buffer; the render thread defines
+// the texture from that buffer once the fence has signalled, so glTexImage2D
+// never waits on the file or the row copy.
+//
+// The shared context comes from whichever window system the render context
+// was made with: WGL on Windows, CGL on macOS, and GLX or EGL (detected at
+// runtime) elsewhere. Without one, or without sync objects, queued uploads
+// happen immediately on the render thread, as before.
+
+enum UploadType { UPLOAD_MODEL, UPLOAD_TEXTURE };
+
+struct UploadRequest {
+    UploadType type;
+    Model* model;                // UPLOAD_MODEL
+    std::string textureName;     // UPLOAD_TEXTURE: file or pak name, the textureCache key
+    GLuint* textureTarget;       // Also receives the texture when published, if not NULL
+    TextureImage image;          // Read by the worker; only its shape is kept
+    unsigned long long hash;     // Content hash the result is shared under
+    bool shared;                 // Result is an already published resource
+    GLuint vertexBuffer, indexBuffer;
+    GLuint pixelBuffer;          // Texture rows staged by the worker
+    GLuint texture;              // Set if shared, otherwise made when published
+    GLsyncType fence;            // NULL if there is nothing to wait for
+};
+
+// Handles of the worker's context
+struct UploadContext {
+#if defined(_WIN32)
+    HDC dc;
+    HGLRC context;
+#elif defined(__APPLE__)
+    CGLContextObj context;
+#else
+    bool egl;
+    void* display;
+    void* context;
+    unsigned long drawable;      // GLX: a 1x1 pbuffer
+    void* surface;               // EGL: a 1x1 pbuffer, or none if surfaceless contexts work
+    unsigned int api;            // EGL client API of the render context
+#endif
+};
+
+struct UploadQueue {
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<UploadRequest*> pending;     // Waiting for the worker
+    std::vector<UploadRequest*> finished;   // Issued, waiting for their fences
+    int state;                              // 0 starting, 1 running, -1 failed
+    bool stopping;
+    bool running;                           // Only changed on the render thread
+    int outstanding;                        // Queued and not yet published
+    UploadContext context;
+};
+
+UploadQueue uploadQueue;
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+// GLX and EGL are looked up at runtime and used through opaque handles, so
+// neither library has to be linked and no X11 header is included (see
+// GLExtensions.h)
+#define UPLOAD_GLX_SCREEN 0x800C
+#define UPLOAD_GLX_FBCONFIG_ID 0x8013
+#define UPLOAD_GLX_RGBA_TYPE 0x8014
+#define UPLOAD_GLX_DRAWABLE_TYPE 0x8010
+#define UPLOAD_GLX_PBUFFER_BIT 0x0004
+#define UPLOAD_GLX_PBUFFER_HEIGHT 0x8040
+#define UPLOAD_GLX_PBUFFER_WIDTH 0x8041
+#define UPLOAD_EGL_CONFIG_ID 0x3028
+#define UPLOAD_EGL_NONE 0x3038
+#define UPLOAD_EGL_HEIGHT 0x3056
+#define UPLOAD_EGL_WIDTH 0x3057
+#define UPLOAD_EGL_EXTENSIONS 0x3055
+#define UPLOAD_EGL_CONTEXT_CLIENT_TYPE 0x3097
+#define UPLOAD_EGL_OPENGL_API 0x30A2
+
+typedef void* (*GLXGetCurrentDisplayProc)(void);
+typedef void* (*GLXGetCurrentContextProc)(void);
+typedef int (*GLXQueryContextProc)(void* display, void* context, int attribute, int* value);
+typedef void** (*GLXChooseFBConfigProc)(void* display, int screen, const int* attributes, int* count);
+typedef int (*GLXGetFBConfigAttribProc)(void* display, void* config, int attribute, int* value);
+typedef void* (*GLXCreateNewContextProc)(void* display, void* config, int renderType, void* share, int direct);
+typedef unsigned long (*GLXCreatePbufferProc)(void* display, void* config, const int* attributes);
+typedef void (*GLXDestroyPbufferProc)(void* display, unsigned long pbuffer);
+typedef int (*GLXMakeContextCurrentProc)(void* display, unsigned long draw, unsigned long read, void* context);
+typedef void (*GLXDestroyContextProc)(void* display, void* context);
+typedef int (*XFreeProc)(void* data);
+typedef int (*XInitThreadsProc)(void);
+
+typedef void* (*EGLGetCurrentDisplayProc)(void);
+typedef void* (*EGLGetCurrentContextProc)(void);
+typedef unsigned int (*EGLQueryContextProc)(void* display, void* context, int attribute, int* value);
+typedef unsigned int (*EGLChooseConfigProc)(void* display, const int* attributes, void** configs, int size, int* count);
+typedef void* (*EGLCreateContextProc)(void* display, void* config, void* share, const int* attributes);
+typedef void* (*EGLCreatePbufferSurfaceProc)(void* display, void* config, const int* attributes);
+typedef unsigned int (*EGLMakeCurrentProc)(void* display, void* draw, void* read, void* context);
+typedef unsigned int (*EGLBindAPIProc)(unsigned int api);
+typedef unsigned int (*EGLQueryAPIProc)(void);
+typedef const char* (*EGLQueryStringProc)(void* display, int name);
+typedef unsigned int (*EGLDestroyContextProc)(void* display, void* context);
+typedef unsigned int (*EGLDestroySurfaceProc)(void* display, void* surface);
+
+void* getWindowSystemProc(const char* name) {
+    return dlsym(RTLD_DEFAULT, name);
+}
+
+// Share lists with the current GLX context, drawing into a 1x1 pbuffer
+bool createGLXUploadContext(UploadContext& upload) {
+    GLXGetCurrentDisplayProc getCurrentDisplay = (GLXGetCurrentDisplayProc)getWindowSystemProc("glXGetCurrentDisplay");
+    GLXGetCurrentContextProc getCurrentContext = (GLXGetCurrentContextProc)getWindowSystemProc("glXGetCurrentContext");
+    GLXQueryContextProc queryContext = (GLXQueryContextProc)getWindowSystemProc("glXQueryContext");
+    GLXChooseFBConfigProc chooseFBConfig = (GLXChooseFBConfigProc)getWindowSystemProc("glXChooseFBConfig");
+    GLXGetFBConfigAttribProc getFBConfigAttrib = (GLXGetFBConfigAttribProc)getWindowSystemProc("glXGetFBConfigAttrib");
+    GLXCreateNewContextProc createNewContext = (GLXCreateNewContextProc)getWindowSystemProc("glXCreateNewContext");
+    GLXCreatePbufferProc createPbuffer = (GLXCreatePbufferProc)getWindowSystemProc("glXCreatePbuffer");
+    GLXDestroyContextProc destroyContext = (GLXDestroyContextProc)getWindowSystemProc("glXDestroyContext");
+    XFreeProc xFree = (XFreeProc)getWindowSystemProc("XFree");
+    if (!getCurrentDisplay || !getCurrentContext || !queryContext || !chooseFBConfig || !getFBConfigAttrib ||
+        !createNewContext || !createPbuffer || !destroyContext || !xFree) {
+        return false;
+    }
+    void* display = getCurrentDisplay();
+    void* renderContext = getCurrentContext();
+    if (!display || !renderContext) return false;
+
+    // The worker uses the render context's framebuffer config, which has to
+    // support pbuffers (X errors from a mismatch would end the process)
+    int configID = 0, screen = 0;
+    if (queryContext(display, renderContext, UPLOAD_GLX_FBCONFIG_ID, &configID) != 0 ||
+        queryContext(display, renderContext, UPLOAD_GLX_SCREEN, &screen) != 0) {
+        return false;
+    }
+    int configAttributes[] = { UPLOAD_GLX_FBCONFIG_ID, configID, 0 };
+    int count = 0;
+    void** configs = chooseFBConfig(display, screen, configAttributes, &count);
+    if (!configs) return false;
+    void* config = count > 0 ? configs[0] : NULL;
+    xFree(configs);
+    int drawableTypes = 0;
+    if (!config || getFBConfigAttrib(display, config, UPLOAD_GLX_DRAWABLE_TYPE, &drawableTypes) != 0 ||
+        !(drawableTypes & UPLOAD_GLX_PBUFFER_BIT)) {
+        printf("Upload thread: the window's GLX config has no pbuffer support\n");
+        return false;
+    }
+
+    void* context = createNewContext(display, config, UPLOAD_GLX_RGBA_TYPE, renderContext, 1);
+    if (!context) return false;
+    int pbufferAttributes[] = { UPLOAD_GLX_PBUFFER_WIDTH, 1, UPLOAD_GLX_PBUFFER_HEIGHT, 1, 0 };
+    unsigned long pbuffer = createPbuffer(display, config, pbufferAttributes);
+    if (!pbuffer) {
+        destroyContext(display, context);
+        return false;
+    }
+    upload.egl = false;
+    upload.display = display;
+    upload.context = context;
+    upload.drawable = pbuffer;
+    upload.surface = NULL;
+    return true;
+}
+
+// Share with the current EGL context; surfaceless if the display allows it
+bool createEGLUploadContext(UploadContext& upload) {
+    EGLGetCurrentDisplayProc getCurrentDisplay = (EGLGetCurrentDisplayProc)getWindowSystemProc("eglGetCurrentDisplay");
+    EGLGetCurrentContextProc getCurrentContext = (EGLGetCurrentContextProc)getWindowSystemProc("eglGetCurrentContext");
+    EGLQueryContextProc queryContext = (EGLQueryContextProc)getWindowSystemProc("eglQueryContext");
+    EGLChooseConfigProc chooseConfig = (EGLChooseConfigProc)getWindowSystemProc("eglChooseConfig");
+    EGLCreateContextProc createContext = (EGLCreateContextProc)getWindowSystemProc("eglCreateContext");
+    EGLCreatePbufferSurfaceProc createPbufferSurface =
+        (EGLCreatePbufferSurfaceProc)getWindowSystemProc("eglCreatePbufferSurface");
+    EGLBindAPIProc bindAPI = (EGLBindAPIProc)getWindowSystemProc("eglBindAPI");
+    EGLQueryAPIProc queryAPI = (EGLQueryAPIProc)getWindowSystemProc("eglQueryAPI");
+    EGLQueryStringProc queryString = (EGLQueryStringProc)getWindowSystemProc("eglQueryString");
+    EGLDestroyContextProc destroyContext = (EGLDestroyContextProc)getWindowSystemProc("eglDestroyContext");
+    if (!getCurrentDisplay || !getCurrentContext || !queryContext || !chooseConfig || !createContext ||
+        !createPbufferSurface || !bindAPI || !queryAPI || !queryString || !destroyContext) {
+        return false;
+    }
+    void* display = getCurrentDisplay();
+    void* renderContext = getCurrentContext();
+    if (!display || !renderContext) return false;
+
+    int configID = 0, api = 0, count = 0;
+    void* config = NULL;
+    if (!queryContext(display, renderContext, UPLOAD_EGL_CONTEXT_CLIENT_TYPE, &api)) api = UPLOAD_EGL_OPENGL_API;
+    if (queryContext(display, renderContext, UPLOAD_EGL_CONFIG_ID, &configID) && configID != 0) {
+        int configAttributes[] = { UPLOAD_EGL_CONFIG_ID, configID, UPLOAD_EGL_NONE };
+        if (!chooseConfig(display, configAttributes, &config, 1, &count) || count < 1) config = NULL;
+    }
+    const char* extensions = queryString(display, UPLOAD_EGL_EXTENSIONS);
+    bool surfaceless = extensions && strstr(extensions, "EGL_KHR_surfaceless_context");
+    if (!config && !(extensions && strstr(extensions, "EGL_KHR_no_config_context"))) return false;
+    if (!config && !surfaceless) return false;
+
+    // Contexts are created for the thread's bound API
+    unsigned int previousAPI = queryAPI();
+    bindAPI(api);
+    void* context = createContext(display, config, renderContext, NULL);
+    bindAPI(previousAPI);
+    if (!context) return false;
+    void* surface = NULL;
+    if (!surfaceless) {
+        int pbufferAttributes[] = { UPLOAD_EGL_WIDTH, 1, UPLOAD_EGL_HEIGHT, 1, UPLOAD_EGL_NONE };
+        surface = createPbufferSurface(display, config, pbufferAttributes);
+        if (!surface) {
+            destroyContext(display, context);
+            return false;
+        }
+    }
+    upload.egl = true;
+    upload.display = display;
+    upload.context = context;
+    upload.drawable = 0;
+    upload.surface = surface;
+    upload.api = api;
+    return true;
+}
+#endif
+
+// Call first thing in main, before GLUT opens the display: the worker makes
+// its context current through the same X connection as the render thread
+void initUploadThreadSupport() {
+#if !defined(_WIN32) && !defined(__APPLE__)
+    XInitThreadsProc initThreads = (XInitThreadsProc)getWindowSystemProc("XInitThreads");
+    if (initThreads) initThreads();
+#endif
+}
+
+// Create the worker's context, sharing with the render context (render thread)
+bool createUploadContext(UploadContext& upload) {
+#if defined(_WIN32)
+    upload.dc = wglGetCurrentDC();
+    HGLRC renderContext = wglGetCurrentContext();
+    if (!upload.dc || !renderContext) return false;
+    upload.context = wglCreateContext(upload.dc);
+    if (upload.context && !wglShareLists(renderContext, upload.context)) {
+        wglDeleteContext(upload.context);
+        upload.context = NULL;
+    }
+    return upload.context != NULL;
+#elif defined(__APPLE__)
+    CGLContextObj renderContext = CGLGetCurrentContext();
+    upload.context = NULL;
+    return renderContext &&
+           CGLCreateContext(CGLGetPixelFormat(renderContext), renderContext, &upload.context) == kCGLNoError;
+#else
+    return createGLXUploadContext(upload) || createEGLUploadContext(upload);
+#endif
+}
+
+// Worker thread side
+bool makeUploadContextCurrent(UploadContext& upload) {
+#if defined(_WIN32)
+    return wglMakeCurrent(upload.dc, upload.context) != FALSE;
+#elif defined(__APPLE__)
+    return CGLSetCurrentContext(upload.context) == kCGLNoError;
+#else
+    if (upload.egl) {
+        EGLBindAPIProc bindAPI = (EGLBindAPIProc)getWindowSystemProc("eglBindAPI");
+        EGLMakeCurrentProc makeCurrent = (EGLMakeCurrentProc)getWindowSystemProc("eglMakeCurrent");
+        return bindAPI(upload.api) && makeCurrent(upload.display, upload.surface, upload.surface, upload.context);
+    }
+    GLXMakeContextCurrentProc makeCurrent = (GLXMakeContextCurrentProc)getWindowSystemProc("glXMakeContextCurrent");
+    return makeCurrent && makeCurrent(upload.display, upload.drawable, upload.drawable, upload.context);
+#endif
+}
+
+// Worker thread side: unbind and destroy the context and its drawable
+void destroyUploadContext(UploadContext& upload) {
+#if defined(_WIN32)
+    wglMakeCurrent(NULL, NULL);
+    wglDeleteContext(upload.context);
+#elif defined(__APPLE__)
+    CGLSetCurrentContext(NULL);
+    CGLDestroyContext(upload.context);
+#else
+    if (upload.egl) {
+        EGLMakeCurrentProc makeCurrent = (EGLMakeCurrentProc)getWindowSystemProc("eglMakeCurrent");
+        EGLDestroyContextProc destroyContext = (EGLDestroyContextProc)getWindowSystemProc("eglDestroyContext");
+        EGLDestroySurfaceProc destroySurface = (EGLDestroySurfaceProc)getWindowSystemProc("eglDestroySurface");
+        makeCurrent(upload.display, NULL, NULL, NULL);
+        if (upload.surface) destroySurface(upload.display, upload.surface);
+        destroyContext(upload.display, upload.context);
+    } else {
+        GLXMakeContextCurrentProc makeCurrent = (GLXMakeContextCurrentProc)getWindowSystemProc("glXMakeContextCurrent");
+        GLXDestroyPbufferProc destroyPbuffer = (GLXDestroyPbufferProc)getWindowSystemProc("glXDestroyPbuffer");
+        GLXDestroyContextProc destroyContext = (GLXDestroyContextProc)getWindowSystemProc("glXDestroyContext");
+        makeCurrent(upload.display, 0, 0, NULL);
+        if (destroyPbuffer) destroyPbuffer(upload.display, upload.drawable);
+        destroyContext(upload.display, upload.context);
+    }
+#endif
+}
+
+// Fill a buffer by mapping it and copying the data in, so the driver does not
+// have to hold on to a copy of its own (worker thread, raw binds)
+void stageBufferData(GLenum target, GLuint buffer, size_t size, const void* data, GLenum usage) {
+    pglBindBuffer(target, buffer);
+    if (glMapBufferRangeSupported && size > 0) {
+        pglBufferData(target, size, NULL, usage);
+        void* mapped = pglMapBufferRange(target, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped) {
+            memcpy(mapped, data, size);
+            if (pglUnmapBuffer(target)) return;  // False: the contents were lost, upload them again
+        }
+    }
+    pglBufferData(target, size, data, usage);
+}
+
+void runModelUpload(UploadRequest& request) {
+    PROFILE_FUNCTION();
+    const Model& model = *request.model;
+    const unsigned char* vertices = getModelVertices(model);
+    const GLuint* indices = getModelIndices(model);
+    request.hash = hashModelBuffers(model, vertices, indices);
+    SharedModelBuffers shared;
+    request.shared = findSharedModelBuffers(model, request.hash, shared);
+    if (request.shared) {
+        request.vertexBuffer = shared.vertexBuffer;
+        request.indexBuffer = shared.indexBuffer;
+        return;
+    }
+    pglGenBuffers(1, &request.vertexBuffer);
+    pglGenBuffers(1, &request.indexBuffer);
+    stageBufferData(GL_ARRAY_BUFFER, request.vertexBuffer, (size_t)model.vertexCount * ModelVertex::STRIDE,
+                    vertices, GL_STATIC_DRAW);
+    stageBufferData(GL_ELEMENT_ARRAY_BUFFER, request.indexBuffer, (size_t)model.indexCount * sizeof(GLuint),
+                    indices, GL_STATIC_DRAW);
+    pglBindBuffer(GL_ARRAY_BUFFER, 0);
+    pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// Read a texture and stage its rows in a pixel buffer of its own; several
+// can be in flight, and each is only read by glTexImage2D once published
+void runTextureUpload(UploadRequest& request) {
+    PROFILE_FUNCTION();
+    const char* name = request.textureName.c_str();
+    const AssetPakEntry* entry = findAsset(name, ASSET_TEXTURE);
+    const char* ext = strrchr(name, '.');
+    if (entry) {
+        getPakTextureImage(entry, request.image);
+    } else if (!ext || strcasecmp(ext, ".bmp") != 0 || !readBMPImage(name, request.image)) {
+        return;  // Published as 0, like loadTexture
+    }
+    request.hash = hashTextureContent(request.image);
+    request.texture = findTextureByContent(request.hash, request.image.bytes);
+    request.shared = request.texture != 0;
+    if (!request.shared) {
+        pglGenBuffers(1, &request.pixelBuffer);
+        if (!fillTexturePixelBuffer(request.image, request.pixelBuffer)) {
+            // The mapping was lost; hand GL a copy of the rows instead
+            std::vector<unsigned char> rows(request.image.bytes);
+            copyTextureRows(request.image, &rows[0]);
+            pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, request.pixelBuffer);
+            pglBufferData(GL_PIXEL_UNPACK_BUFFER, rows.size(), &rows[0], GL_STREAM_DRAW);
+            pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+    releaseTextureImage(request.image);
+}
+
+void uploadThreadMain() {
+    setProfilerThreadName("Upload");
+    bool ready = makeUploadContextCurrent(uploadQueue.context);
+    {
+        std::lock_guard<std::mutex> lock(uploadQueue.mutex);
+        uploadQueue.state = ready ? 1 : -1;
+    }
+    uploadQueue.wake.notify_all();
+    if (!ready) return;
+
+    for (;;) {
+        UploadRequest* request;
+        {
+            std::unique_lock<std::mutex> lock(uploadQueue.mutex);
+            uploadQueue.wake.wait(lock, []() { return !uploadQueue.pending.empty() || uploadQueue.stopping; });
+            if (uploadQueue.stopping) break;
+            request = uploadQueue.pending.front();
+            uploadQueue.pending.pop_front();
+        }
+        if (request->type == UPLOAD_MODEL) runModelUpload(*request);
+        else runTextureUpload(*request);
+        if (!request->shared && (request->vertexBuffer != 0 || request->pixelBuffer != 0)) {
+            // Flushed so the fence (and the upload before it) reach the GPU
+            // without waiting for more work on this context
+            request->fence = pglFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+        }
+        std::lock_guard<std::mutex> lock(uploadQueue.mutex);
+        uploadQueue.finished.push_back(request);
+    }
+
+    destroyUploadContext(uploadQueue.context);
+}
+
+// Finish the worker (registered with atexit by startUploadThread). Uploads
+// still queued are dropped.
+void stopUploadThread() {
+    if (!uploadQueue.running) return;
+    {
+        std::lock_guard<std::mutex> lock(uploadQueue.mutex);
+        uploadQueue.stopping = true;
+    }
+    uploadQueue.wake.notify_all();
+    uploadQueue.worker.join();
+    uploadQueue.running = false;
+    for (size_t i = 0; i < uploadQueue.pending.size(); i++) delete uploadQueue.pending[i];
+    for (size_t i = 0; i < uploadQueue.finished.size(); i++) {
+        if (uploadQueue.finished[i]->fence) pglDeleteSync(uploadQueue.finished[i]->fence);
+        if (uploadQueue.finished[i]->pixelBuffer) pglDeleteBuffers(1, &uploadQueue.finished[i]->pixelBuffer);
+        delete uploadQueue.finished[i];
+    }
+    uploadQueue.pending.clear();
+    uploadQueue.finished.clear();
+    uploadQueue.outstanding = 0;
+}
+
+// Start the worker once the render context is current and the extensions are
+// loaded. Returns false (uploads then stay on the render thread) if the
+// driver or window system cannot give it a shared context.
+bool startUploadThread() {
+    if (uploadQueue.running) return true;
+    if (!glBuffersSupported || !glSyncSupported) {
+        printf("Upload thread: needs buffer and sync objects, uploading on the render thread\n");
+        return false;
+    }
+    if (!createUploadContext(uploadQueue.context)) {
+        printf("Upload thread: no shared GL context available, uploading on the render thread\n");
+        return false;
+    }
+    uploadQueue.state = 0;
+    uploadQueue.stopping = false;
+    uploadQueue.outstanding = 0;
+    uploadQueue.worker = std::thread(uploadThreadMain);
+
+    std::unique_lock<std::mutex> lock(uploadQueue.mutex);
+    uploadQueue.wake.wait(lock, []() { return uploadQueue.state != 0; });
+    if (uploadQueue.state < 0) {
+        lock.unlock();
+        uploadQueue.worker.join();
+        printf("Upload thread: could not make the shared context current, uploading on the render thread\n");
+        return false;
+    }
+    uploadQueue.running = true;
+    static bool stopRegistered = false;
+    if (!stopRegistered) {
+        atexit(stopUploadThread);
+        stopRegistered = true;
+    }
+    printf("Upload thread started (%s staging)\n", glMapBufferRangeSupported ? "mapped buffer" : "direct");
+    return true;
+}
+
+void pushUploadRequest(UploadRequest* request) {
+    request->hash = 0;
+    request->shared = false;
+    request->vertexBuffer = 0;
+    request->indexBuffer = 0;
+    request->pixelBuffer = 0;
+    request->texture = 0;
+    request->fence = NULL;
+    uploadQueue.outstanding++;
+    {
+        std::lock_guard<std::mutex> lock(uploadQueue.mutex);
+        uploadQueue.pending.push_back(request);
+    }
+    uploadQueue.wake.notify_one();
+}
+
+// Give a loaded model its GPU buffers in the background, then apply its
+// residency. The model must not move until the upload is published; it draws
+// from its CPU data until then. Without the worker this is uploadModel.
+void queueModelUpload(Model& model) {
+    if (!uploadQueue.running || !glBuffersSupported || model.indexCount == 0 || model.vertexBuffer != 0) {
+        uploadModel(model);
+        applyModelResidency(model);
+        return;
+    }
+    UploadRequest* request = new UploadRequest();
+    request->type = UPLOAD_MODEL;
+    request->model = &model;
+    request->textureTarget = NULL;
+    pushUploadRequest(request);
+}
+
+// Read and stage a texture in the background; *target (if given) and the
+// texture cache receive it once it is published. Without the worker or pixel
+// buffers this is loadTexture.
+void queueTextureUpload(const char* filename, GLuint* target) {
+    std::map<std::string, GLuint>::const_iterator cached = textureCache.find(filename);
+    if (!uploadQueue.running || !texturePixelBuffersSupported() || cached != textureCache.end()) {
+        GLuint texture = cached != textureCache.end() ? cached->second : loadTexture(filename);
+        if (target) *target = texture;
+        return;
+    }
+    UploadRequest* request = new UploadRequest();
+    request->type = UPLOAD_TEXTURE;
+    request->model = NULL;
+    request->textureName = filename;
+    request->textureTarget = target;
+    pushUploadRequest(request);
+}
+
+// Define a staged texture from its pixel buffer, which is then released
+void publishTexture(UploadRequest& request) {
+    PROFILE_FUNCTION();
+    GLuint texture = request.texture;
+    if (request.pixelBuffer != 0) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        setTextureFromPixelBuffer(request.image, request.pixelBuffer);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glState.boundTexture = 0;
+        pglDeleteBuffers(1, &request.pixelBuffer);
+        GLuint own = texture;
+        if (!addTextureByContent(request.hash, texture, request.image.bytes)) {
+            // Identical pixels were published while this one was in flight
+            glDeleteTextures(1, &own);
+        }
+        printf("Loaded texture on the upload thread: %s (%dx%d)\n", request.textureName.c_str(),
+               request.image.width, request.image.height);
+    }
+    if (texture != 0) textureCache[request.textureName] = texture;
+    if (request.textureTarget) *request.textureTarget = texture;
+}
+
+// Hand a finished upload to the game (render thread)
+void publishUpload(UploadRequest& request) {
+    if (request.type == UPLOAD_TEXTURE) {
+        publishTexture(request);
+        return;
+    }
+    Model& model = *request.model;
+    SharedModelBuffers buffers = { request.vertexBuffer, request.indexBuffer };
+    if (!request.shared && !addSharedModelBuffers(model, request.hash, buffers)) {
+        // Identical data was published while this one was in flight
+        pglDeleteBuffers(1, &request.vertexBuffer);
+        pglDeleteBuffers(1, &request.indexBuffer);
+    }
+    model.vertexBuffer = buffers.vertexBuffer;
+    model.indexBuffer = buffers.indexBuffer;
+    glState.arraySource = NULL;  // Its meshes' array pointers still point at the arena
+    applyModelResidency(model);
+}
+
+// Publish every upload whose fence has signalled, without waiting for the
+// rest. Call once a frame on the render thread; returns how many uploads are
+// still outstanding.
+int pollUploads() {
+    PROFILE_FUNCTION();
+    if (!uploadQueue.running) return 0;
+    std::vector<UploadRequest*> done;
+    {
+        std::lock_guard<std::mutex> lock(uploadQueue.mutex);
+        std::vector<UploadRequest*>& finished = uploadQueue.finished;
+        size_t kept = 0;
+        for (size_t i = 0; i < finished.size(); i++) {
+            GLenum status = finished[i]->fence ? pglClientWaitSync(finished[i]->fence, 0, 0) : GL_ALREADY_SIGNALED;
+            // A failed wait will never succeed; publish rather than hold the resource forever
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED) {
+                done.push_back(finished[i]);
+            } else {
+                finished[kept++] = finished[i];
+            }
+        }
+        finished.resize(kept);
+    }
+    for (size_t i = 0; i < done.size(); i++) {
+        if (done[i]->fence) pglDeleteSync(done[i]->fence);
+        publishUpload(*done[i]);
+        delete done[i];
+        uploadQueue.outstanding--;
+    }
+    return uploadQueue.outstanding;
+}
+
+#endif // UPLOAD_THREAD_H
@@ -0,0 +1,138 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <string.h>
+
+#include "RenderQueue.h"
+#include "MathLib.h"
+
+// Compile-time vertex layouts. A format such as Vertex<Pos3f, Norm8x4, UV2f>
+// is a list of attribute descriptors; the template derives the interleaved
+// stride, each attribute's offset, the packing code used by the loaders and the
+// GL array pointer setup from that one list. Everything unrolls at compile
+// time, so the per-vertex packing loop has no per-attribute branches.
+//
+// The renderer uses the fixed-function client arrays (the GLSL lighting
+// shaders read gl_Vertex/gl_Normal/gl_MultiTexCoord0), so "attribute setup"
+// means glVertexPointer/glNormalPointer/glTexCoordPointer.
+
+// Unpacked vertex as the loaders produce it
+struct SourceVertex {
+    vec3 position;
+    vec3 normal;
+    float u, v;
+};
+
+// Client arrays a format feeds
+#define VERTEX_ARRAY_POSITION 0x1
+#define VERTEX_ARRAY_NORMAL   0x2
+#define VERTEX_ARRAY_TEXCOORD 0x4
+
+// Attribute descriptors: SIZE bytes in the vertex, the array they feed, how to
+// pack one source vertex and how to point GL at the packed data
+
+struct Pos3f {
+    enum { SIZE = 12, ARRAY = VERTEX_ARRAY_POSITION };
+    static void pack(unsigned char* dst, const SourceVertex& v) {
+        float p[3] = { v.position.x, v.position.y, v.position.z };
+        memcpy(dst, p, sizeof(p));
+    }
+    static void setPointer(GLsizei stride, const unsigned char* data) {
+        glVertexPointer(3, GL_FLOAT, stride, data);
+    }
+};
+
+struct Norm3f {
+    enum { SIZE = 12, ARRAY = VERTEX_ARRAY_NORMAL };
+    static void pack(unsigned char* dst, const SourceVertex& v) {
+        float n[3] = { v.normal.x, v.normal.y, v.normal.z };
+        memcpy(dst, n, sizeof(n));
+    }
+    static void setPointer(GLsizei stride, const unsigned char* data) {
+        glNormalPointer(GL_FLOAT, stride, data);
+    }
+};
+
+// Signed bytes, padded to 4 for alignment (GL maps GL_BYTE normals to [-1, 1])
+struct Norm8x4 {
+    enum { SIZE = 4, ARRAY = VERTEX_ARRAY_NORMAL };
+    static void pack(unsigned char* dst, const SourceVertex& v) {
+        signed char n[4] = { (signed char)(clampf(v.normal.x, -1.0f, 1.0f) * 127.0f),
+                             (signed char)(clampf(v.normal.y, -1.0f, 1.0f) * 127.0f),
+                             (signed char)(clampf(v.normal.z, -1.0f, 1.0f) * 127.0f), 0 };
+        memcpy(dst, n, sizeof(n));
+    }
+    static void setPointer(GLsizei stride, const unsigned char* data) {
+        glNormalPointer(GL_BYTE, stride, data);
+    }
+};
+
+struct UV2f {
+    enum { SIZE = 8, ARRAY = VERTEX_ARRAY_TEXCOORD };
+    static void pack(unsigned char* dst, const SourceVertex& v) {
+        float t[2] = { v.u, v.v };
+        memcpy(dst, t, sizeof(t));
+    }
+    static void setPointer(GLsizei stride, const unsigned char* data) {
+        glTexCoordPointer(2, GL_FLOAT, stride, data);
+    }
+};
+
+template <typename... Attributes> struct Vertex;
+
+template <> struct Vertex<> {
+    enum { STRIDE = 0, ARRAYS = 0 };
+    static void pack(unsigned char*, const SourceVertex&) {}
+    static void setPointers(GLsizei, const unsigned char*) {}
+};
+
+template <typename First, typename... Rest> struct Vertex<First, Rest...> {
+    enum {
+        STRIDE = First::SIZE + Vertex<Rest...>::STRIDE,
+        ARRAYS = First::ARRAY | Vertex<Rest...>::ARRAYS
+    };
+    static void pack(unsigned char* dst, const SourceVertex& v) {
+        First::pack(dst, v);
+        Vertex<Rest...>::pack(dst + First::SIZE, v);
+    }
+    // Only the top-level format's stride is meaningful, so it is passed down
+    static void setPointers(GLsizei stride, const unsigned char* data) {
+        First::setPointer(stride, data);
+        Vertex<Rest...>::setPointers(stride, data + First::SIZE);
+    }
+};
+
+// Byte offset of an attribute within a format (the stride if the format lacks it)
+template <typename Attribute, typename Format> struct VertexOffset;
+
+template <typename Attribute> struct VertexOffset<Attribute, Vertex<> > {
+    enum { VALUE = 0 };
+};
+
+template <typename Attribute, typename First, typename... Rest>
+struct VertexOffset<Attribute, Vertex<First, Rest...> > {
+    enum { VALUE = First::SIZE + VertexOffset<Attribute, Vertex<Rest...> >::VALUE };
+};
+
+template <typename Attribute, typename... Rest>
+struct VertexOffset<Attribute, Vertex<Attribute, Rest...> > {
+    enum { VALUE = 0 };
+};
+
+// Enable exactly the client arrays the format feeds
+template <typename Format>
+void enableVertexFormatArrays() {
+    cachedEnable(GL_VERTEX_ARRAY, (Format::ARRAYS & VERTEX_ARRAY_POSITION) != 0);
+    cachedEnable(GL_NORMAL_ARRAY, (Format::ARRAYS & VERTEX_ARRAY_NORMAL) != 0);
+    cachedEnable(GL_TEXTURE_COORD_ARRAY, (Format::ARRAYS & VERTEX_ARRAY_TEXCOORD) != 0);
+    cachedEnable(GL_COLOR_ARRAY, false);
+}
+
+// Point the format's arrays at data: a client pointer, or a buffer offset
+// while the buffer is bound
+template <typename Format>
+void setVertexFormatPointers(const unsigned char* data) {
+    Format::setPointers(Format::STRIDE, data);
+}
+
+#endif // VERTEX_FORMAT_H
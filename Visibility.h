@@ -0,0 +1,194 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+#include "Level.h"
+#include "Profiler.h"
+
+// Precomputed potentially-visible sets (PVS) for the static level.
+// The walkable area is split into square cells; every cell stores one bit per
+// static level object, followed by one per terrain chunk, telling whether it
+// can be seen from anywhere inside the cell. The bitsets are produced offline
+// by pvs_builder and looked up at runtime from the camera position in O(1).
+
+#define PVS_MAGIC 0x53565042   // "BPVS"
+#define PVS_VERSION 3   // 2: objects and eye samples sit on the terrain; 3: terrain chunk bits
+#define PVS_DEFAULT_PATH "levels/rural.pvs"
+
+// Header flags
+#define PVS_FLAG_HOUSE_MODEL 0x1  // Built with the farmhouse model (its solid box occludes)
+
+struct PVSHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int flags;
+    int cols, rows;
+    int objectCount;
+    int chunkCount;          // Terrain chunks, whose bits follow the objects'
+    int wordsPerCell;
+    float originX, originZ;  // World position of cell (0, 0)'s min corner
+    float cellSize;
+};
+
+struct PVSData {
+    PVSHeader header;
+    std::vector<unsigned int> bits;  // rows * cols * wordsPerCell words
+};
+
+PVSData levelPVS;
+bool pvsLoaded = false;
+
+int pvsWordsForBits(int bitCount) {
+    return (bitCount + 31) / 32;
+}
+
+bool savePVS(const char* filename, const PVSData& pvs) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        printf("Error: Could not write PVS file: %s\n", filename);
+        return false;
+    }
+
+    bool ok = fwrite(&pvs.header, sizeof(PVSHeader), 1, file) == 1;
+    if (ok && !pvs.bits.empty()) {
+        ok = fwrite(&pvs.bits[0], sizeof(unsigned int), pvs.bits.size(), file) == pvs.bits.size();
+    }
+    fclose(file);
+
+    if (!ok) {
+        printf("Error: Failed writing PVS file: %s\n", filename);
+    }
+    return ok;
+}
+
+bool loadPVS(const char* filename, PVSData& pvs) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        printf("Warning: Could not open PVS file: %s\n", filename);
+        return false;
+    }
+
+    PVSHeader header;
+    if (fread(&header, sizeof(PVSHeader), 1, file) != 1 ||
+        header.magic != PVS_MAGIC || header.version != PVS_VERSION ||
+        header.cols <= 0 || header.rows <= 0 || header.cellSize <= 0.0f ||
+        header.objectCount < 0 || header.chunkCount < 0 ||
+        header.wordsPerCell != pvsWordsForBits(header.objectCount + header.chunkCount)) {
+        printf("Warning: Invalid PVS file: %s\n", filename);
+        fclose(file);
+        return false;
+    }
+
+    size_t wordCount = (size_t)header.cols * header.rows * header.wordsPerCell;
+    pvs.bits.resize(wordCount);
+    if (wordCount > 0 && fread(&pvs.bits[0], sizeof(unsigned int), wordCount, file) != wordCount) {
+        printf("Warning: Truncated PVS file: %s\n", filename);
+        fclose(file);
+        pvs.bits.clear();
+        return false;
+    }
+    fclose(file);
+
+    pvs.header = header;
+    return true;
+}
+
+// Load the level PVS and make sure it matches the level that is actually
+// being rendered. A stale or mismatched file is ignored (everything visible).
+bool loadLevelPVS(const char* filename, bool houseModelLoaded, int chunkCount) {
+    PROFILE_FUNCTION();
+    pvsLoaded = false;
+    if (!loadPVS(filename, levelPVS)) {
+        return false;
+    }
+
+    if (levelPVS.header.objectCount != (int)levelObjects.size()) {
+        printf("Warning: PVS file %s was built for %d objects, level has %d - ignoring\n",
+               filename, levelPVS.header.objectCount, (int)levelObjects.size());
+        return false;
+    }
+
+    if (levelPVS.header.chunkCount != chunkCount) {
+        printf("Warning: PVS file %s was built for %d terrain chunks, terrain has %d - ignoring\n",
+               filename, levelPVS.header.chunkCount, chunkCount);
+        return false;
+    }
+
+    bool builtWithHouseModel = (levelPVS.header.flags & PVS_FLAG_HOUSE_MODEL) != 0;
+    if (builtWithHouseModel != houseModelLoaded) {
+        printf("Warning: PVS file %s was built for different house geometry - ignoring\n", filename);
+        return false;
+    }
+
+    pvsLoaded = true;
+    printf("Loaded PVS: %s (%dx%d cells, %d objects, %d terrain chunks)\n", filename,
+           levelPVS.header.cols, levelPVS.header.rows, levelPVS.header.objectCount, levelPVS.header.chunkCount);
+    return true;
+}
+
+// Returns the visibility bitset for the cell containing (x, z), or NULL when
+// no PVS is available or the point is outside the grid (treat all as visible).
+const unsigned int* getPVSCellBits(const PVSData& pvs, float x, float z) {
+    const PVSHeader& h = pvs.header;
+    int col = (int)floor((x - h.originX) / h.cellSize);
+    int row = (int)floor((z - h.originZ) / h.cellSize);
+    if (col < 0 || row < 0 || col >= h.cols || row >= h.rows) {
+        return NULL;
+    }
+    return &pvs.bits[((size_t)row * h.cols + col) * h.wordsPerCell];
+}
+
+bool isPVSBitSet(const unsigned int* bits, int index) {
+    return bits == NULL || (bits[index >> 5] & (1u << (index & 31))) != 0;
+}
+
+// Terrain chunk bits follow the level objects' in every cell
+bool isPVSChunkVisible(const PVSData& pvs, const unsigned int* bits, int chunk) {
+    return isPVSBitSet(bits, pvs.header.objectCount + chunk);
+}
+
+// View frustum in world space, extracted from the current GL matrices
+struct Frustum {
+    float planes[6][4];  // ax + by + cz + d >= 0 is inside
+};
+
+void extractFrustum(Frustum& frustum) {
+    GLfloat proj[16], modl[16], clip[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, proj);
+    glGetFloatv(GL_MODELVIEW_MATRIX, modl);
+
+    // clip = proj * modl
+    multiplyMatrices(proj, modl, clip);
+
+    // Gribb/Hartmann plane extraction: row 3 +/- rows 0, 1, 2
+    for (int i = 0; i < 3; i++) {
+        for (int k = 0; k < 4; k++) {
+            frustum.planes[i * 2 + 0][k] = clip[k * 4 + 3] + clip[k * 4 + i];
+            frustum.planes[i * 2 + 1][k] = clip[k * 4 + 3] - clip[k * 4 + i];
+        }
+    }
+
+    for (int p = 0; p < 6; p++) {
+        float len = sqrt(frustum.planes[p][0] * frustum.planes[p][0] +
+                         frustum.planes[p][1] * frustum.planes[p][1] +
+                         frustum.planes[p][2] * frustum.planes[p][2]);
+        if (len > 0) {
+            for (int k = 0; k < 4; k++) frustum.planes[p][k] /= len;
+        }
+    }
+}
+
+bool isBoxInFrustum(const Frustum& frustum, const Vector3& bmin, const Vector3& bmax) {
+    for (int p = 0; p < 6; p++) {
+        const float* pl = frustum.planes[p];
+        // Test the box corner furthest along the plane normal
+        float x = pl[0] >= 0 ? bmax.x : bmin.x;
+        float y = pl[1] >= 0 ? bmax.y : bmin.y;
+        float z = pl[2] >= 0 ? bmax.z : bmin.z;
+        if (pl[0] * x + pl[1] * y + pl[2] * z + pl[3] < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif // VISIBILITY_H
@@ -0,0 +1,298 @@
+// Incremental asset build for BlitzMail.
+//
+// Walks a models directory, follows each model's references (OBJ mtllib ->
+// MTL -> texture maps) and cooks every model whose inputs changed into its
+// binary cache (<model>.bmc, the file loadModel maps at runtime). Inputs are
+// identified by content hash: a file is only rehashed and rescanned when its
+// size or modification time moved, and a model is only recooked when the hash
+// over its own contents, everything it depends on and the cooker version
+// differs from the one recorded for its cache. Hashing and cooking run on all
+// cores. The results go to the asset manifest (see AssetManifest.h), which
+// the game reads at startup.
+//
+// Textures are tracked as inputs only: the engine loads them as they are, so
+// a changed texture marks its models stale but produces no cooked output.
+//
+// Usage: asset_builder [models directory] [manifest] [-j threads]
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <set>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "AssetManifest.h"
+#include "ModelLoader.h"
+
+// Bump when cooking changes in a way the cache header does not capture
+#define ASSET_BUILD_VERSION 1
+
+// Model sources the loaders handle
+const char* const MODEL_EXTENSIONS[] = { ".obj", ".3ds", ".ply", ".stl" };
+
+double getSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool isModelSource(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return false;
+    for (size_t i = 0; i < sizeof(MODEL_EXTENSIONS) / sizeof(MODEL_EXTENSIONS[0]); i++) {
+        if (strcasecmp(path.c_str() + dot, MODEL_EXTENSIONS[i]) == 0) return true;
+    }
+    return false;
+}
+
+// Every model source under directory, recursively ('/' separated)
+void findModelSources(const std::string& directory, std::vector<std::string>& sources) {
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA((directory + "/*").c_str(), &found);
+    if (search == INVALID_HANDLE_VALUE) return;
+    do {
+        std::string name = found.cFileName;
+        if (name == "." || name == "..") continue;
+        std::string path = directory + "/" + name;
+        if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) findModelSources(path, sources);
+        else if (isModelSource(path)) sources.push_back(path);
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        std::string path = directory + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) findModelSources(path, sources);
+        else if (isModelSource(path)) sources.push_back(path);
+    }
+    closedir(dir);
+#endif
+}
+
+// Run job(0) .. job(count - 1) on up to threadCount threads
+template <typename Job>
+void runJobs(int count, int threadCount, const Job& job) {
+    std::atomic<int> next(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < std::min(threadCount, count); t++) {
+        threads.push_back(std::thread([&]() {
+            for (int i = next++; i < count; i = next++) job(i);
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+}
+
+// The text between begin and end without surrounding whitespace
+std::string trim(const char* begin, const char* end) {
+    while (begin < end && (*begin == ' ' || *begin == '\t')) begin++;
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) end--;
+    return std::string(begin, end);
+}
+
+// References in an OBJ (mtllib) or MTL (map_*, bump, disp, decal, refl) file,
+// resolved against the file's directory. Map options ("-s 1 1 1") are not
+// handled; the rest of the line is taken as the file name, which keeps names
+// with spaces intact.
+void scanReferences(const std::string& path, const MappedFile& file, std::vector<std::string>& references) {
+    const char* ext = strrchr(path.c_str(), '.');
+    bool isOBJ = ext && strcasecmp(ext, ".obj") == 0;
+    bool isMTL = ext && strcasecmp(ext, ".mtl") == 0;
+    if (!isOBJ && !isMTL) return;
+
+    std::string directory = getDirectory(path);
+    const char* p = (const char*)file.data;
+    const char* end = p + file.size;
+    while (p < end) {
+        const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+        if (!lineEnd) lineEnd = end;
+        while (p < lineEnd && (*p == ' ' || *p == '\t')) p++;
+        const char* keyEnd = p;
+        while (keyEnd < lineEnd && *keyEnd != ' ' && *keyEnd != '\t') keyEnd++;
+        std::string key(p, keyEnd);
+        bool reference = isOBJ ? key == "mtllib"
+                               : key.compare(0, 4, "map_") == 0 || key == "bump" || key == "disp" ||
+                                 key == "decal" || key == "refl";
+        if (reference) {
+            std::string name = trim(keyEnd, lineEnd);
+            if (!name.empty()) {
+                std::replace(name.begin(), name.end(), '\\', '/');
+                std::string resolved = directory + name;
+                if (std::find(references.begin(), references.end(), resolved) == references.end()) {
+                    references.push_back(resolved);
+                }
+            }
+        }
+        p = lineEnd + 1;
+    }
+}
+
+// Rehash and rescan a file whose stamp changed (or that is new)
+void refreshInput(const std::string& path, ManifestFile& entry) {
+    entry.size = -1;
+    entry.time = 0;
+    entry.hash = 0;
+    entry.dependencies.clear();
+    MappedFile file;
+    long long size, time;
+    if (!getModelSourceStamp(path.c_str(), size, time)) return;
+    entry.size = size;
+    entry.time = time;
+    if (size == 0 || !mapFile(path.c_str(), file)) {
+        entry.hash = hashAssetBytes(NULL, 0);
+        return;
+    }
+    entry.hash = hashAssetBytes(file.data, file.size);
+    scanReferences(path, file, entry.dependencies);
+    unmapFile(file);
+}
+
+// Build key over the cooker and a model's inputs (the model, then its
+// dependencies depth-first)
+unsigned long long getModelKey(const std::string& source, const AssetManifest& manifest) {
+    unsigned long long key = manifest.cookerKey;
+    std::vector<std::string> stack(1, source);
+    std::set<std::string> visited;
+    while (!stack.empty()) {
+        std::string path = stack.back();
+        stack.pop_back();
+        if (!visited.insert(path).second) continue;
+        const ManifestFile& entry = manifest.files.find(path)->second;
+        key = hashAssetBytes(path.c_str(), path.size() + 1, key);
+        key = hashAssetBytes(&entry.hash, sizeof(entry.hash), key);
+        for (size_t d = entry.dependencies.size(); d-- > 0;) stack.push_back(entry.dependencies[d]);
+    }
+    return key;
+}
+
+// Bring a current cache's source stamp up to date after the source was
+// touched or copied without its contents changing
+bool restampModelCache(const char* sourcePath) {
+    std::string cachePath = getModelCachePath(sourcePath);
+    FILE* file = fopen(cachePath.c_str(), "r+b");
+    if (!file) return false;
+    ModelCacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == MODEL_CACHE_MAGIC &&
+              header.version == MODEL_CACHE_VERSION && header.vertexStride == (unsigned int)ModelVertex::STRIDE &&
+              getModelSourceStamp(sourcePath, header.sourceSize, header.sourceTime) &&
+              fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = (fclose(file) == 0) && ok;
+    return ok;
+}
+
+bool isModelCacheValid(const char* sourcePath) {
+    MappedFile cache;
+    if (!mapFile(getModelCachePath(sourcePath).c_str(), cache)) return false;
+    bool valid = getValidModelCache(sourcePath, cache) != NULL;
+    unmapFile(cache);
+    return valid;
+}
+
+int main(int argc, char** argv) {
+    const char* modelsDirectory = "models";
+    const char* manifestPath = ASSET_MANIFEST_PATH;
+    int threadCount = (int)std::thread::hardware_concurrency();
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) threadCount = atoi(argv[++i]);
+        else if (positional++ == 0) modelsDirectory = argv[i];
+        else manifestPath = argv[i];
+    }
+    if (threadCount < 1) threadCount = 1;
+    double start = getSeconds();
+
+    AssetManifest previous, manifest;
+    loadAssetManifest(manifestPath, previous);
+    unsigned int cookerVersion[3] = { ASSET_BUILD_VERSION, MODEL_CACHE_VERSION, ModelVertex::STRIDE };
+    manifest.cookerKey = hashAssetBytes(cookerVersion, sizeof(cookerVersion));
+
+    std::vector<std::string> sources;
+    findModelSources(modelsDirectory, sources);
+    std::sort(sources.begin(), sources.end());
+
+    // Stat every input reachable from the models, level by level (models,
+    // then MTLs, then textures); files whose stamp moved are rehashed and
+    // rescanned in parallel, the rest keep their recorded hash and references
+    std::vector<std::string> level = sources;
+    int rehashed = 0;
+    while (!level.empty()) {
+        std::vector<std::string> stale;
+        for (size_t i = 0; i < level.size(); i++) {
+            ManifestFile& entry = manifest.files[level[i]];
+            std::map<std::string, ManifestFile>::const_iterator old = previous.files.find(level[i]);
+            long long size = -1, time = 0;
+            getModelSourceStamp(level[i].c_str(), size, time);
+            if (old != previous.files.end() && old->second.size == size && old->second.time == time) {
+                entry = old->second;
+            } else {
+                stale.push_back(level[i]);
+            }
+        }
+        std::vector<ManifestFile*> staleEntries;
+        for (size_t i = 0; i < stale.size(); i++) staleEntries.push_back(&manifest.files[stale[i]]);
+        runJobs((int)stale.size(), threadCount, [&](int i) { refreshInput(stale[i], *staleEntries[i]); });
+        rehashed += (int)stale.size();
+
+        std::vector<std::string> next;
+        for (size_t i = 0; i < level.size(); i++) {
+            const std::vector<std::string>& dependencies = manifest.files[level[i]].dependencies;
+            for (size_t d = 0; d < dependencies.size(); d++) {
+                if (manifest.files.find(dependencies[d]) == manifest.files.end() &&
+                    std::find(next.begin(), next.end(), dependencies[d]) == next.end()) {
+                    next.push_back(dependencies[d]);
+                }
+            }
+        }
+        level.swap(next);
+    }
+
+    // Cook the models whose key changed or whose cache is missing or broken
+    std::vector<std::string> dirty;
+    std::vector<unsigned long long> dirtyKeys;
+    int restamped = 0;
+    for (size_t i = 0; i < sources.size(); i++) {
+        unsigned long long key = getModelKey(sources[i], manifest);
+        std::map<std::string, unsigned long long>::const_iterator old = previous.models.find(sources[i]);
+        bool current = old != previous.models.end() && old->second == key;
+        if (current && !isModelCacheValid(sources[i].c_str())) {
+            // Same contents under a new stamp: fix the stamp instead of recooking
+            current = restampModelCache(sources[i].c_str()) && isModelCacheValid(sources[i].c_str());
+            if (current) restamped++;
+        }
+        if (current) {
+            manifest.models[sources[i]] = key;
+        } else {
+            dirty.push_back(sources[i]);
+            dirtyKeys.push_back(key);
+        }
+    }
+
+    std::vector<char> cooked(dirty.size(), 0);
+    runJobs((int)dirty.size(), threadCount, [&](int i) {
+        printf("Cooking %s\n", dirty[i].c_str());
+        cooked[i] = cookModelCache(dirty[i].c_str());
+    });
+    int failed = 0;
+    for (size_t i = 0; i < dirty.size(); i++) {
+        if (cooked[i]) {
+            manifest.models[dirty[i]] = dirtyKeys[i];
+        } else {
+            printf("Error: Failed to cook %s\n", dirty[i].c_str());
+            failed++;
+        }
+    }
+
+    bool saved = saveAssetManifest(manifestPath, manifest);
+    printf("Asset build: %d models (%d cooked, %d restamped, %d failed), %d inputs (%d rehashed), "
+           "%d threads, %.1f ms\n", (int)sources.size(), (int)dirty.size() - failed, restamped, failed,
+           (int)manifest.files.size(), rehashed, threadCount, (getSeconds() - start) * 1000.0);
+    return saved && failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+// Offline asset packer for BlitzMail.
+//
+// Cooks the models the game loads (and any extra models or BMP textures named
+// on the command line) into one .blitzpak archive (see AssetPak.h). Models
+// are stored in the arena layout the loaders produce, textures as bottom-up
+// BGR/BGRA rows ready for glTexImage2D. Assets with identical cooked content
+// are stored once.
+//
+// Usage: asset_packer [output.blitzpak] [extra assets...]
+#include <algorithm>
+
+#include "Level.h"
+#include "ModelLoader.h"
+
+// The models loadAllModels loads, in its order, so the pak reads front to back
+const char* const PAK_MODELS[] = {
+    MODEL_PATH_PLAYER, MODEL_PATH_TREE, MODEL_PATH_ROCK1, MODEL_PATH_ROCKSET,
+    MODEL_PATH_FARMHOUSE, MODEL_PATH_STREETLAMP, MODEL_PATH_FENCE
+};
+const int PAK_MODEL_COUNT = sizeof(PAK_MODELS) / sizeof(PAK_MODELS[0]);
+
+struct CookedAsset {
+    std::string name;
+    unsigned int type;
+    std::vector<unsigned char> data;
+    int info[4];
+    long long sourceSize, sourceTime;
+    unsigned long long hash;
+    long long offset;
+};
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+bool cookModel(const char* path, CookedAsset& asset) {
+    Model model;
+    if (!loadModel(path, model)) return false;
+    // The arena may be the model's own or still in its mapped cache file
+    const Model& loaded = model;
+    const unsigned char* arena = getModelVertices(loaded);
+    if (!arena) return false;
+    size_t arenaSize = (size_t)model.vertexCount * ModelVertex::STRIDE + (size_t)model.indexCount * sizeof(GLuint);
+    asset.type = ASSET_MODEL;
+    asset.info[0] = model.vertexCount;
+    asset.info[1] = model.indexCount;
+    asset.info[2] = (int)model.meshes.size();
+    asset.info[3] = 0;
+    asset.data.assign(arena, arena + arenaSize);
+    for (size_t m = 0; m < model.meshes.size(); m++) {
+        const Mesh& mesh = model.meshes[m];
+        ModelCacheMesh entry = { mesh.firstVertex, mesh.vertexCount, mesh.firstIndex, mesh.indexCount };
+        const unsigned char* bytes = (const unsigned char*)&entry;
+        asset.data.insert(asset.data.end(), bytes, bytes + sizeof(entry));
+    }
+    return true;
+}
+
+// Uncompressed 24/32-bit BMP to bottom-up rows padded to 4 bytes
+bool cookBMP(const char* path, CookedAsset& asset) {
+    TextureImage image;
+    if (!readBMPImage(path, image)) return false;
+    asset.type = ASSET_TEXTURE;
+    asset.info[0] = image.width;
+    asset.info[1] = image.height;
+    asset.info[2] = image.format;
+    asset.info[3] = image.alignment;
+    asset.data.resize(image.bytes);
+    copyTextureRows(image, &asset.data[0]);
+    releaseTextureImage(image);
+    return true;
+}
+
+bool cookAsset(const char* path, CookedAsset& asset) {
+    asset.name = path;
+    if (!getModelSourceStamp(path, asset.sourceSize, asset.sourceTime)) {
+        printf("Error: Missing asset source: %s\n", path);
+        return false;
+    }
+    const char* ext = strrchr(path, '.');
+    if (ext && strcasecmp(ext, ".bmp") == 0) return cookBMP(path, asset);
+    return cookModel(path, asset);
+}
+
+bool nameLess(const CookedAsset* a, const CookedAsset* b) {
+    return a->name < b->name;
+}
+
+bool writePak(const char* outputPath, std::vector<CookedAsset>& assets) {
+    // Table of contents sorted by name; data stays in cook order
+    std::vector<CookedAsset*> toc;
+    for (size_t i = 0; i < assets.size(); i++) toc.push_back(&assets[i]);
+    std::sort(toc.begin(), toc.end(), nameLess);
+    for (size_t i = 1; i < toc.size(); i++) {
+        if (toc[i]->name == toc[i - 1]->name) {
+            printf("Error: Asset listed twice: %s\n", toc[i]->name.c_str());
+            return false;
+        }
+    }
+
+    std::vector<char> names;
+    std::vector<AssetPakEntry> entries(toc.size());
+    for (size_t i = 0; i < toc.size(); i++) {
+        entries[i].nameOffset = (unsigned int)names.size();
+        names.insert(names.end(), toc[i]->name.begin(), toc[i]->name.end());
+        names.push_back('\0');
+    }
+
+    AssetPakHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ASSET_PAK_MAGIC;
+    header.version = ASSET_PAK_VERSION;
+    header.vertexStride = ModelVertex::STRIDE;
+    header.entryCount = (int)entries.size();
+    header.tocOffset = alignUp(sizeof(header), ASSET_PAK_TOC_ALIGNMENT);
+    header.namesOffset = header.tocOffset + entries.size() * sizeof(AssetPakEntry);
+    header.namesSize = names.size();
+
+    // Lay out the data, pointing duplicates at the first copy
+    size_t cursor = alignUp(header.namesOffset + header.namesSize, ASSET_PAK_DATA_ALIGNMENT);
+    size_t dataStart = cursor, dedupedBytes = 0;
+    for (size_t i = 0; i < assets.size(); i++) {
+        CookedAsset& asset = assets[i];
+        asset.hash = hashAssetBytes(asset.data.empty() ? NULL : &asset.data[0], asset.data.size());
+        asset.offset = -1;
+        for (size_t j = 0; j < i && asset.offset < 0; j++) {
+            if (assets[j].hash == asset.hash && assets[j].data == asset.data) asset.offset = assets[j].offset;
+        }
+        if (asset.offset >= 0) {
+            dedupedBytes += asset.data.size();
+            continue;
+        }
+        asset.offset = cursor;
+        cursor = alignUp(cursor + asset.data.size(), ASSET_PAK_DATA_ALIGNMENT);
+    }
+    header.dataSize = cursor - dataStart;
+
+    for (size_t i = 0; i < toc.size(); i++) {
+        AssetPakEntry& entry = entries[i];
+        entry.type = toc[i]->type;
+        entry.offset = toc[i]->offset;
+        entry.size = toc[i]->data.size();
+        entry.contentHash = toc[i]->hash;
+        entry.sourceSize = toc[i]->sourceSize;
+        entry.sourceTime = toc[i]->sourceTime;
+        memcpy(entry.info, toc[i]->info, sizeof(entry.info));
+    }
+
+    FILE* file = fopen(outputPath, "wb");
+    if (!file) {
+        printf("Error: Could not write %s\n", outputPath);
+        return false;
+    }
+    // Everything before the data is assembled in memory and written at once
+    std::vector<unsigned char> front(dataStart, 0);
+    memcpy(&front[0], &header, sizeof(header));
+    if (!entries.empty()) memcpy(&front[header.tocOffset], &entries[0], entries.size() * sizeof(AssetPakEntry));
+    memcpy(&front[header.namesOffset], &names[0], names.size());
+    bool ok = fwrite(&front[0], 1, front.size(), file) == front.size();
+    static const unsigned char padding[ASSET_PAK_DATA_ALIGNMENT] = { 0 };
+    size_t written = dataStart;
+    for (size_t i = 0; ok && i < assets.size(); i++) {
+        const CookedAsset& asset = assets[i];
+        if ((size_t)asset.offset < written) continue;  // Deduplicated
+        ok = asset.data.empty() || fwrite(&asset.data[0], 1, asset.data.size(), file) == asset.data.size();
+        written += asset.data.size();
+        size_t padBytes = alignUp(written, ASSET_PAK_DATA_ALIGNMENT) - written;
+        ok = ok && (padBytes == 0 || fwrite(padding, 1, padBytes, file) == padBytes);
+        written += padBytes;
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok) {
+        printf("Error: Failed writing %s\n", outputPath);
+        remove(outputPath);
+        return false;
+    }
+
+    printf("Wrote asset pak: %s (%d assets, %.1f MB, %.1f KB deduplicated)\n", outputPath,
+           header.entryCount, written / (1024.0 * 1024.0), dedupedBytes / 1024.0);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* outputPath = argc > 1 ? argv[1] : ASSET_PAK_PATH;
+
+    std::vector<const char*> sources(PAK_MODELS, PAK_MODELS + PAK_MODEL_COUNT);
+    for (int i = 2; i < argc; i++) sources.push_back(argv[i]);
+
+    std::vector<CookedAsset> assets;
+    for (size_t i = 0; i < sources.size(); i++) {
+        CookedAsset asset;
+        if (!cookAsset(sources[i], asset)) {
+            printf("Skipping %s\n", sources[i]);
+            continue;
+        }
+        assets.push_back(std::move(asset));
+    }
+
+    return writePak(outputPath, assets) ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+// Job system scaling: three workloads timed at every thread count from 1 up
+// to the hardware threads, with the speedup over one thread. Culling 1M
+// boxes and transforming 200K matrices split evenly; the skewed workload
+// makes every 64th item 100 times the work of the others, so it only scales
+// if idle threads steal. Usage: bench_jobs [max threads]
+#include "JobSystem.h"
+#include "MathLib.h"
+#include <string.h>
+#include <chrono>
+
+#define BENCH_BOXES (1 << 20)
+#define BENCH_MATRICES 200000
+#define BENCH_SKEWED_ITEMS 16384
+#define BENCH_REPEATS 7   // The best of these is reported
+
+static double benchClock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::vector<vec3> boxMins, boxMaxs;
+static std::vector<unsigned char> boxVisible;
+static float cullPlanes[6][4];
+static std::vector<mat4> localMatrices, worldMatrices;
+static std::atomic<long long> skewedSum;
+
+static void cullBoxes(void*, int begin, int end) {
+    cullAABBs(cullPlanes, &boxMins[begin], &boxMaxs[begin], end - begin, &boxVisible[begin]);
+}
+
+// A chain of eight parents per matrix, like a deep scene graph
+static void transformMatrices(void*, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        mat4 world = localMatrices[i];
+        for (int k = 0; k < 8; k++) multiplyMatrices(world.m, localMatrices[i].m, world.m);
+        worldMatrices[i] = world;
+    }
+}
+
+static void skewedWork(void*, int begin, int end) {
+    long long sum = 0;
+    for (int i = begin; i < end; i++) {
+        int steps = i % 64 == 0 ? 20000 : 200;
+        for (int k = 0; k < steps; k++) sum += (k ^ i) & 7;
+    }
+    skewedSum.fetch_add(sum);
+}
+
+struct Workload {
+    const char* name;
+    int count, grain;
+    JobRangeFunc function;
+};
+
+int main(int argc, char** argv) {
+    int maxThreads = argc > 1 ? atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+    if (maxThreads < 1) maxThreads = 1;
+    if (maxThreads > JOB_MAX_THREADS) maxThreads = JOB_MAX_THREADS;
+    printf("Job system scaling, 1 to %d threads (%u hardware threads), best of %d runs\n", maxThreads,
+           std::thread::hardware_concurrency(), BENCH_REPEATS);
+
+    // A 1024 x 1024 field of boxes against a frustum that keeps part of it
+    boxMins.resize(BENCH_BOXES);
+    boxMaxs.resize(BENCH_BOXES);
+    boxVisible.resize(BENCH_BOXES);
+    for (int i = 0; i < BENCH_BOXES; i++) {
+        float x = (i % 1024) - 512.0f, z = (i / 1024) - 512.0f;
+        boxMins[i] = vec3(x, 0, z);
+        boxMaxs[i] = vec3(x + 1, 2, z + 1);
+    }
+    memset(cullPlanes, 0, sizeof(cullPlanes));
+    for (int p = 0; p < 6; p++) cullPlanes[p][3] = 300;
+    cullPlanes[0][0] = 1;
+    cullPlanes[1][1] = 0.1f;
+    cullPlanes[2][2] = 1;
+    localMatrices.resize(BENCH_MATRICES);
+    worldMatrices.resize(BENCH_MATRICES);
+    for (int i = 0; i < BENCH_MATRICES; i++) {
+        localMatrices[i] = mat4TRSY(vec3((float)i, 0, 0), i * 0.01f, vec3(1, 1, 1));
+    }
+
+    Workload workloads[] = {
+        { "cull 1M boxes", BENCH_BOXES, 4096, cullBoxes },
+        { "200K transforms", BENCH_MATRICES, 1024, transformMatrices },
+        { "skewed", BENCH_SKEWED_ITEMS, 64, skewedWork },
+    };
+    const int workloadCount = sizeof(workloads) / sizeof(workloads[0]);
+    double single[workloadCount];
+    printf("\nthreads");
+    for (int w = 0; w < workloadCount; w++) printf("  %-22s", workloads[w].name);
+    printf("  jobs / stolen\n");
+
+    for (int threads = 1; threads <= maxThreads; threads++) {
+        initJobSystem(threads);
+        resetJobStats();
+        printf("%7d", threads);
+        for (int w = 0; w < workloadCount; w++) {
+            double best = 1e30;
+            for (int r = 0; r < BENCH_REPEATS; r++) {
+                double start = benchClock();
+                parallelFor(workloads[w].count, workloads[w].grain, workloads[w].function, NULL);
+                double elapsed = benchClock() - start;
+                if (elapsed < best) best = elapsed;
+            }
+            if (threads == 1) single[w] = best;
+            printf("  %8.2f ms %6.2fx      ", best * 1e3, single[w] / best);
+        }
+        int executed, stolen;
+        getJobStats(executed, stolen);
+        printf("  %d / %d\n", executed, stolen);
+    }
+    shutdownJobSystem();
+    printf("(checksum %d %.1f %lld)\n", boxVisible[BENCH_BOXES / 2], worldMatrices[BENCH_MATRICES / 2].m[12],
+           skewedSum.load());
+    return 0;
+}
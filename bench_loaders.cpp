@@ -0,0 +1,75 @@
+// Load-time benchmark for the model formats: one grid mesh written as OBJ,
+// PLY (ASCII, binary little and big endian) and binary STL to the temp
+// directory, each parsed by its loader. The model cache is bypassed, so this
+// times the parsers themselves. Usage: bench_loaders [quads per side]
+#include "ModelLoader.h"
+#include "TestGrid.h"
+#include <chrono>
+
+#define BENCH_DEFAULT_GRID 600   // 720K triangles
+#define BENCH_REPEATS 3          // The best of these is reported
+
+static double benchClock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static long long fileSize(const std::string& path) {
+    long long size, time;
+    return getModelSourceStamp(path.c_str(), size, time) ? size : 0;
+}
+
+struct BenchFormat {
+    const char* name;
+    const char* file;
+    const char* plyFormat;   // NULL unless PLY
+    bool (*load)(const char*, Model&);
+};
+
+int main(int argc, char** argv) {
+    int size = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_GRID;
+    if (size <= 0) size = BENCH_DEFAULT_GRID;
+    TestGrid grid;
+    buildGrid(grid, size);
+
+    BenchFormat formats[] = {
+        { "OBJ", "blitzmail_bench.obj", NULL, loadOBJ },
+        { "PLY ASCII", "blitzmail_bench_ascii.ply", "ascii", loadPLY },
+        { "PLY binary LE", "blitzmail_bench_le.ply", "binary_little_endian", loadPLY },
+        { "PLY binary BE", "blitzmail_bench_be.ply", "binary_big_endian", loadPLY },
+        { "STL", "blitzmail_bench.stl", NULL, loadSTL },
+    };
+    int formatCount = sizeof(formats) / sizeof(formats[0]);
+    double best[8];
+    long long bytes[8];
+
+    for (int f = 0; f < formatCount; f++) {
+        std::string path = tempPath(formats[f].file);
+        bool written = formats[f].plyFormat ? writeGridPLY(grid, path, formats[f].plyFormat)
+                     : formats[f].load == loadOBJ ? writeGridOBJ(grid, path) : writeGridSTL(grid, path);
+        if (!written) {
+            printf("Error: Could not write %s\n", path.c_str());
+            return 1;
+        }
+        bytes[f] = fileSize(path);
+        best[f] = 1e30;
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            Model model;
+            double start = benchClock();
+            bool loaded = formats[f].load(path.c_str(), model);
+            double elapsed = benchClock() - start;
+            if (!loaded) {
+                printf("Error: Could not load %s\n", path.c_str());
+                return 1;
+            }
+            if (elapsed < best[f]) best[f] = elapsed;
+        }
+        remove(path.c_str());
+    }
+
+    printf("\n%d-triangle grid, best of %d loads:\n", (int)grid.triangles.size() / 3, BENCH_REPEATS);
+    for (int f = 0; f < formatCount; f++) {
+        printf("  %-14s %8.1f ms  %7.1f MB  %7.1f MB/s  %5.1fx OBJ\n", formats[f].name, best[f] * 1e3,
+               bytes[f] / 1048576.0, bytes[f] / 1048576.0 / best[f], best[0] / best[f]);
+    }
+    return 0;
+}
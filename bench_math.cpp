@@ -0,0 +1,139 @@
+// Microbenchmark for the MathLib.h batch routines the renderer relies on:
+// frustum culling and AABB transforms over many boxes, each timed against the
+// scalar code it replaced (isBoxInFrustum and the scene graph's per-box Arvo
+// transform). Usage: bench_math [boxes]
+#include "MathLib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+#define BENCH_DEFAULT_BOXES 100000
+#define BENCH_REPEATS 50   // The best of these is reported
+
+static double benchClock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static float randomFloat(float lo, float hi) {
+    return lo + (hi - lo) * (float)rand() / (float)RAND_MAX;
+}
+
+// Scalar code the batch routines replaced
+static bool scalarBoxVisible(const float planes[6][4], const vec3& bmin, const vec3& bmax) {
+    for (int p = 0; p < 6; p++) {
+        const float* pl = planes[p];
+        float x = pl[0] >= 0 ? bmax.x : bmin.x;
+        float y = pl[1] >= 0 ? bmax.y : bmin.y;
+        float z = pl[2] >= 0 ? bmax.z : bmin.z;
+        if (pl[0] * x + pl[1] * y + pl[2] * z + pl[3] < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void scalarTransformAABB(const float m[16], const vec3& bmin, const vec3& bmax, vec3& outMin, vec3& outMax) {
+    float lo[3] = { bmin.x, bmin.y, bmin.z };
+    float hi[3] = { bmax.x, bmax.y, bmax.z };
+    float rmin[3] = { m[12], m[13], m[14] };
+    float rmax[3] = { m[12], m[13], m[14] };
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 3; col++) {
+            float a = m[col * 4 + row] * lo[col];
+            float b = m[col * 4 + row] * hi[col];
+            rmin[row] += a < b ? a : b;
+            rmax[row] += a < b ? b : a;
+        }
+    }
+    outMin = vec3(rmin[0], rmin[1], rmin[2]);
+    outMax = vec3(rmax[0], rmax[1], rmax[2]);
+}
+
+// Best time of BENCH_REPEATS runs of fn, in nanoseconds per box
+template <typename F>
+static double timeBest(int count, F fn) {
+    double best = 1e30;
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        double start = benchClock();
+        fn();
+        double elapsed = benchClock() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    return best * 1e9 / count;
+}
+
+static void report(const char* name, double scalarNs, double batchNs) {
+    printf("%-16s scalar %6.2f ns/box   batch %6.2f ns/box   %.2fx\n", name, scalarNs, batchNs,
+           scalarNs / batchNs);
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_BOXES;
+    if (count <= 0) count = BENCH_DEFAULT_BOXES;
+#if MATH_SIMD_SSE
+    const char* path = "SSE";
+#elif MATH_SIMD_NEON
+    const char* path = "NEON";
+#else
+    const char* path = "plain floats";
+#endif
+    printf("MathLib batch routines (%s), %d boxes, best of %d runs\n", path, count, BENCH_REPEATS);
+
+    srand(12345);
+    std::vector<vec3> mins(count), maxs(count), outMins(count), outMaxs(count);
+    for (int i = 0; i < count; i++) {
+        vec3 c(randomFloat(-200, 200), randomFloat(-20, 20), randomFloat(-200, 200));
+        vec3 e(randomFloat(0.5f, 5), randomFloat(0.5f, 5), randomFloat(0.5f, 5));
+        mins[i] = c - e;
+        maxs[i] = c + e;
+    }
+    std::vector<unsigned char> visible(count);
+
+    // A 90 degree frustum looking down +Z from the origin, tilted by 30
+    // degrees of yaw so every plane has mixed-sign normals
+    float planes[6][4];
+    const float local[6][4] = {
+        { 1, 0, 1, 0 }, { -1, 0, 1, 0 }, { 0, 1, 1, 0 }, { 0, -1, 1, 0 }, { 0, 0, 1, -1 }, { 0, 0, -1, 500 }
+    };
+    quat yaw = quatFromAxisAngle(vec3(0, 1, 0), 30.0f);
+    for (int p = 0; p < 6; p++) {
+        vec3 n(local[p][0], local[p][1], local[p][2]);
+        float len = length(n);
+        n = rotate(yaw, n * (1.0f / len));
+        planes[p][0] = n.x; planes[p][1] = n.y; planes[p][2] = n.z; planes[p][3] = local[p][3] / len;
+    }
+
+    mat4 m = mat4TRS(vec3(10, 2, -5), quatFromAxisAngle(vec3(1, 2, 3), 40.0f), vec3(1.5f, 0.5f, 2.0f));
+
+    // Checksums keep the compiler from dropping the work
+    unsigned checksum = 0;
+    double cullScalar = timeBest(count, [&]() {
+        for (int i = 0; i < count; i++) visible[i] = scalarBoxVisible(planes, mins[i], maxs[i]) ? 1 : 0;
+        checksum += visible[count / 2];
+    });
+    int scalarVisible = 0;
+    for (int i = 0; i < count; i++) scalarVisible += visible[i];
+    double cullBatch = timeBest(count, [&]() {
+        cullAABBs(planes, &mins[0], &maxs[0], count, &visible[0]);
+        checksum += visible[count / 2];
+    });
+    int batchVisible = 0;
+    for (int i = 0; i < count; i++) batchVisible += visible[i];
+    report("cullAABBs", cullScalar, cullBatch);
+    printf("  visible: scalar %d, batch %d\n", scalarVisible, batchVisible);
+
+    float sink = 0;
+    double transformScalar = timeBest(count, [&]() {
+        for (int i = 0; i < count; i++) scalarTransformAABB(m.m, mins[i], maxs[i], outMins[i], outMaxs[i]);
+        sink += outMaxs[count / 2].x;
+    });
+    double transformBatch = timeBest(count, [&]() {
+        transformAABBs(m.m, &mins[0], &maxs[0], &outMins[0], &outMaxs[0], count);
+        sink += outMaxs[count / 2].x;
+    });
+    report("transformAABBs", transformScalar, transformBatch);
+
+    printf("(checksum %u %.1f)\n", checksum, sink);
+    return 0;
+}
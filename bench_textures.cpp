@@ -0,0 +1,258 @@
+// BMP texture uploads in a real GL context. Every fixture in tests/bmp (see
+// TestBMP.h) goes through loadBMPTexture, which uploads from the file mapping,
+// and through a pixel buffer filled the way the upload thread fills one; both
+// textures are read back and compared with the expected pixels, as are the
+// textures the upload thread stages when it can run. Then one large generated
+// BMP is timed: read into memory for glTexImage2D (the loader before file
+// mappings), uploaded from the mapping, and queued on the upload thread,
+// where the render thread only pays for defining the texture from the
+// staged pixel buffer.
+// Needs a display. Usage: bench_textures [fixture directory] [large width]
+#include "ModelLoader.h"
+#include "TestBMP.h"
+#include "UploadThread.h"
+#include <chrono>
+
+#define BENCH_DEFAULT_WIDTH 2048   // Square, 24-bit: 12 MB of pixels
+#define BENCH_REPEATS 5            // The best of these is reported
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static double benchClock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The bound texture matches the fixture, read back as RGBA
+static bool texturePixelsMatch(const TestBMP& bmp) {
+    GLint width = 0, height = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    if (width != bmp.width || height != bmp.height) return false;
+    std::vector<unsigned char> rgba((size_t)width * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &rgba[0]);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const unsigned char* p = &rgba[((size_t)y * width + x) * 4];
+            unsigned char alpha = bmp.bits == 32 ? testBMPPixel(x, y, 3) : 255;
+            if (p[0] != testBMPPixel(x, y, 2) || p[1] != testBMPPixel(x, y, 1) || p[2] != testBMPPixel(x, y, 0) ||
+                p[3] != alpha) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// A texture defined from a pixel buffer, filled as the upload thread fills
+// them (0 if the buffer could not be mapped)
+static GLuint createPixelBufferTexture(const TextureImage& image) {
+    GLuint pixelBuffer, texture = 0;
+    pglGenBuffers(1, &pixelBuffer);
+    if (fillTexturePixelBuffer(image, pixelBuffer)) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        setTextureFromPixelBuffer(image, pixelBuffer);
+    }
+    pglDeleteBuffers(1, &pixelBuffer);
+    return texture;
+}
+
+static void testFixtures(const std::string& directory) {
+    bool pixelBuffers = texturePixelBuffersSupported();
+    printf("\nFixtures (%s)\n", pixelBuffers ? "file mapping and pixel buffer" : "no pixel buffers, file mapping only");
+    for (int i = 0; i < TEST_BMP_COUNT; i++) {
+        const TestBMP& bmp = testBMPs[i];
+        std::string path = directory + bmp.file;
+        GLuint direct = loadBMPTexture(path.c_str());
+        glBindTexture(GL_TEXTURE_2D, direct);
+        check(direct != 0 && texturePixelsMatch(bmp), (std::string(bmp.file) + " through loadBMPTexture").c_str());
+
+        GLuint staged = 0;
+        if (pixelBuffers) {
+            TextureImage image;
+            staged = readBMPImage(path.c_str(), image) ? createPixelBufferTexture(image) : 0;
+            releaseTextureImage(image);
+            glBindTexture(GL_TEXTURE_2D, staged);
+            check(staged != 0 && texturePixelsMatch(bmp), (std::string(bmp.file) + " through a pixel buffer").c_str());
+        }
+
+        GLuint textures[2] = { direct, staged };
+        glDeleteTextures(2, textures);
+        clearSharedGPUResources();
+    }
+    for (int i = 0; i < BAD_TEST_BMP_COUNT; i++) {
+        std::string path = directory + badTestBMPs[i];
+        check(loadBMPTexture(path.c_str()) == 0, badTestBMPs[i]);
+    }
+
+    // The same image under a second path shares the first one's texture
+    std::string original = directory + testBMPs[0].file;
+    std::string copy = getTempDirectory() + "blitzmail_bench_copy.bmp";
+    check(copyTestBMP(original, copy), "fixture copied");
+    GLuint first = loadTexture(original.c_str());
+    GLuint second = loadTexture(copy.c_str());
+    GLuint other = loadTexture((directory + testBMPs[1].file).c_str());
+    check(first != 0 && second == first && other != first, "identical pixels under two paths share a texture");
+    glDeleteTextures(1, &first);
+    glDeleteTextures(1, &other);
+    clearSharedGPUResources();
+    remove(copy.c_str());
+    check(glGetError() == GL_NO_ERROR, "no GL errors");
+}
+
+// Every fixture queued at once: the worker reads and stages them, and each
+// texture appears once pollUploads has published it
+static void testQueuedFixtures(const std::string& directory) {
+    if (!startUploadThread() || !texturePixelBuffersSupported()) {
+        printf("\nQueued fixtures: no upload thread, skipped\n");
+        return;
+    }
+    printf("\nQueued fixtures\n");
+    GLuint textures[TEST_BMP_COUNT + 1] = { 0 };
+    for (int i = 0; i < TEST_BMP_COUNT; i++) queueTextureUpload((directory + testBMPs[i].file).c_str(), &textures[i]);
+    std::string copy = getTempDirectory() + "blitzmail_bench_copy.bmp";
+    check(copyTestBMP(directory + testBMPs[0].file, copy), "fixture copied");
+    queueTextureUpload(copy.c_str(), &textures[TEST_BMP_COUNT]);
+    double start = benchClock();
+    while (pollUploads() > 0 && benchClock() - start < 10) std::this_thread::yield();
+    check(uploadQueue.outstanding == 0, "every queued texture published");
+
+    for (int i = 0; i < TEST_BMP_COUNT; i++) {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        check(textures[i] != 0 && texturePixelsMatch(testBMPs[i]),
+              (std::string(testBMPs[i].file) + " through the upload thread").c_str());
+    }
+    check(textures[TEST_BMP_COUNT] == textures[0], "a queued copy shares the first texture");
+    check(textureCache[directory + testBMPs[1].file] == textures[1], "published into the texture cache");
+    glDeleteTextures(TEST_BMP_COUNT, textures);
+    clearSharedGPUResources();
+    remove(copy.c_str());
+    check(glGetError() == GL_NO_ERROR, "no GL errors");
+}
+
+static void writeLE32(unsigned char* p, unsigned int value) {
+    for (int b = 0; b < 4; b++) p[b] = (unsigned char)(value >> (b * 8));
+}
+
+// A bottom-up 24-bit BMP of the fixture pattern
+static bool writeLargeBMP(const std::string& path, int width) {
+    size_t rowSize = ((size_t)width * 3 + 3) / 4 * 4;
+    unsigned int dataPos = BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE;
+    unsigned char header[BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE] = { 'B', 'M' };
+    writeLE32(header + 0x02, dataPos + (unsigned int)(rowSize * width));
+    writeLE32(header + 0x0A, dataPos);
+    writeLE32(header + 0x0E, BMP_INFO_HEADER_SIZE);
+    writeLE32(header + 0x12, width);
+    writeLE32(header + 0x16, width);
+    header[0x1A] = 1;    // Planes
+    header[0x1C] = 24;   // Bits per pixel
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    fwrite(header, 1, sizeof(header), file);
+    std::vector<unsigned char> row(rowSize, 0xEE);
+    for (int y = 0; y < width; y++) {
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) row[(size_t)x * 3 + c] = testBMPPixel(x, y, c);
+        }
+        fwrite(&row[0], 1, rowSize, file);
+    }
+    return fclose(file) == 0;
+}
+
+// The loader before file mappings: read the whole file, upload from memory
+static GLuint freadBMPTexture(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) return 0;
+    fseek(file, 0, SEEK_END);
+    std::vector<unsigned char> data(ftell(file));
+    fseek(file, 0, SEEK_SET);
+    size_t read = fread(&data[0], 1, data.size(), file);
+    fclose(file);
+    if (read != data.size() || data.size() < BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE) return 0;
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, (int)readLE32(&data[0x12]), (int)readLE32(&data[0x16]), 0, GL_BGR,
+                 GL_UNSIGNED_BYTE, &data[readLE32(&data[0x0A])]);
+    return texture;
+}
+
+enum UploadPath { PATH_FREAD, PATH_MAPPED, PATH_UPLOAD_THREAD };
+
+// Best times of one path: spent on the render thread (the loading call, or
+// queueing plus the pollUploads calls), and until the GPU has the texture
+static void timeUploads(const char* name, const char* path, UploadPath upload) {
+    double bestRender = 1e30, bestFinish = 1e30;
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        glFinish();
+        double start = benchClock();
+        GLuint texture = 0;
+        double render;
+        if (upload == PATH_UPLOAD_THREAD) {
+            queueTextureUpload(path, &texture);
+            render = benchClock() - start;
+            for (int outstanding = 1; outstanding > 0 && benchClock() - start < 10;) {
+                std::this_thread::yield();
+                double poll = benchClock();
+                outstanding = pollUploads();
+                render += benchClock() - poll;
+            }
+        } else {
+            texture = upload == PATH_FREAD ? freadBMPTexture(path) : loadBMPTexture(path);
+            render = benchClock() - start;
+        }
+        glFinish();
+        double finished = benchClock();
+        check(texture != 0, name);
+        glDeleteTextures(1, &texture);
+        clearSharedGPUResources();  // Or the next run would share the deleted texture
+        if (render < bestRender) bestRender = render;
+        if (finished - start < bestFinish) bestFinish = finished - start;
+    }
+    printf("  %-22s %7.2f ms on the render thread  %7.2f ms until finished\n", name, bestRender * 1e3,
+           bestFinish * 1e3);
+}
+
+int main(int argc, char** argv) {
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_RGB);
+    glutInitWindowSize(64, 64);
+    glutCreateWindow("BlitzMail texture uploads");
+    loadGLExtensions();
+    std::string directory = testBMPDirectory(argc, argv);
+    int width = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_WIDTH;
+    if (width <= 0 || width > BMP_MAX_DIMENSION) width = BENCH_DEFAULT_WIDTH;
+    printf("BMP texture uploads on %s\n", (const char*)glGetString(GL_RENDERER));
+
+    testFixtures(directory);
+    testQueuedFixtures(directory);
+
+    std::string path = getTempDirectory() + "blitzmail_bench.bmp";
+    if (!writeLargeBMP(path, width)) {
+        printf("Error: Could not write %s\n", path.c_str());
+        return 1;
+    }
+    printf("\n%dx%d 24-bit BMP, best of %d uploads:\n", width, width, BENCH_REPEATS);
+    timeUploads("fread + glTexImage2D", path.c_str(), PATH_FREAD);
+    timeUploads("mapped, direct", path.c_str(), PATH_MAPPED);
+    if (uploadQueue.running && texturePixelBuffersSupported()) {
+        timeUploads("upload thread", path.c_str(), PATH_UPLOAD_THREAD);
+    }
+    remove(path.c_str());
+
+    if (failures > 0) {
+        printf("\nFAILED: %d checks\n", failures);
+        return 1;
+    }
+    printf("\nSUCCESS: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,386 @@
+// Offline lighting baker for the BlitzMail rural level.
+//
+// For every terrain vertex, traces rays against the terrain and the static
+// level objects to compute
+//   - ambient occlusion: the fraction of cosine-weighted hemisphere rays that
+//     escape within BAKE_AO_DISTANCE, and
+//   - the sun term for each of BAKE_KEYFRAMES sun angles: N.L times the
+//     fraction of rays toward the sun's disc that are unblocked, which gives
+//     soft shadow edges.
+// Rays are traced through a bounding volume hierarchy over all triangles and
+// the work is spread over all cores. Results go to a level file that the game
+// loads at startup (see BakedLighting.h).
+//
+// Level objects are approximated by boxes (see addObjectProxies).
+//
+// Usage: light_baker [output.bake]
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+#include "BakedLighting.h"
+
+#define BAKE_AO_RAYS 48
+#define BAKE_AO_DISTANCE 12.0f
+#define BAKE_SUN_RAYS 8
+#define BAKE_SUN_RADIUS 0.03f      // Angular radius of the sampled sun disc (radians)
+#define BAKE_RAY_OFFSET 0.05f      // Start rays slightly above the surface
+#define BVH_LEAF_SIZE 4
+#define LAMP_POST_HEIGHT 5.0f
+
+struct BakeTriangle {
+    Vector3 v0, e1, e2;            // First vertex and the two edges from it
+};
+
+struct BVHNode {
+    float bmin[3], bmax[3];
+    int first;                     // Leaf: first triangle; inner: left child (right is left + 1)
+    int count;                     // Triangles in a leaf, 0 for inner nodes
+};
+
+struct BVH {
+    std::vector<BVHNode> nodes;
+    std::vector<BakeTriangle> triangles;
+};
+
+void addTriangle(std::vector<BakeTriangle>& triangles, const Vector3& a, const Vector3& b, const Vector3& c) {
+    BakeTriangle tri;
+    tri.v0 = a;
+    tri.e1 = b - a;
+    tri.e2 = c - a;
+    triangles.push_back(tri);
+}
+
+void addBox(std::vector<BakeTriangle>& triangles, const Vector3& bmin, const Vector3& bmax) {
+    Vector3 c[8];
+    for (int i = 0; i < 8; i++) {
+        c[i] = Vector3(i & 1 ? bmax.x : bmin.x, i & 2 ? bmax.y : bmin.y, i & 4 ? bmax.z : bmin.z);
+    }
+    const int faces[6][4] = { { 0, 1, 3, 2 }, { 4, 6, 7, 5 }, { 0, 4, 5, 1 },
+                              { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 5, 7, 3 } };
+    for (int f = 0; f < 6; f++) {
+        addTriangle(triangles, c[faces[f][0]], c[faces[f][1]], c[faces[f][2]]);
+        addTriangle(triangles, c[faces[f][0]], c[faces[f][2]], c[faces[f][3]]);
+    }
+}
+
+// Shadow casters for a level object. Trees get a trunk and a raised canopy
+// so the ground under them is shaded but not black; lamps get their post.
+// Houses use the walls of the primitive house whichever geometry is drawn.
+void addObjectProxies(std::vector<BakeTriangle>& triangles, const LevelObject& obj) {
+    Vector3 bmin = obj.boundsMin, bmax = obj.boundsMax;
+    switch (obj.type) {
+        case LEVEL_HOUSE:
+            getLevelObjectOccluder(obj, NULL, bmin, bmax);
+            bmin.y = obj.y;
+            break;
+        case LEVEL_TREE: {
+            float trunk = 0.3f;
+            addBox(triangles, Vector3(obj.x - trunk, obj.y, obj.z - trunk),
+                   Vector3(obj.x + trunk, obj.y + obj.size * 0.6f, obj.z + trunk));
+            bmin.y = obj.y + obj.size * 0.5f;
+            break;
+        }
+        case LEVEL_STREET_LAMP:
+            bmin = Vector3(obj.x - 0.15f, obj.y, obj.z - 0.15f);
+            bmax = Vector3(obj.x + 0.15f, obj.y + LAMP_POST_HEIGHT, obj.z + 0.15f);
+            break;
+    }
+    addBox(triangles, bmin, bmax);
+}
+
+void getTriangleBounds(const BakeTriangle& tri, float bmin[3], float bmax[3]) {
+    Vector3 p[3] = { tri.v0, Vector3(tri.v0.x + tri.e1.x, tri.v0.y + tri.e1.y, tri.v0.z + tri.e1.z),
+                     Vector3(tri.v0.x + tri.e2.x, tri.v0.y + tri.e2.y, tri.v0.z + tri.e2.z) };
+    for (int k = 0; k < 3; k++) {
+        const float* first = &p[0].x;
+        bmin[k] = bmax[k] = first[k];
+    }
+    for (int i = 1; i < 3; i++) {
+        const float* v = &p[i].x;
+        for (int k = 0; k < 3; k++) {
+            if (v[k] < bmin[k]) bmin[k] = v[k];
+            if (v[k] > bmax[k]) bmax[k] = v[k];
+        }
+    }
+}
+
+float getTriangleCentroid(const BakeTriangle& tri, int axis) {
+    const float* v0 = &tri.v0.x;
+    const float* e1 = &tri.e1.x;
+    const float* e2 = &tri.e2.x;
+    return v0[axis] + (e1[axis] + e2[axis]) / 3.0f;
+}
+
+struct CentroidLess {
+    int axis;
+    bool operator()(const BakeTriangle& a, const BakeTriangle& b) const {
+        return getTriangleCentroid(a, axis) < getTriangleCentroid(b, axis);
+    }
+};
+
+// Median split along the longest axis of the centroid bounds
+void buildBVHNode(BVH& bvh, int nodeIndex, int first, int count) {
+    BVHNode& node = bvh.nodes[nodeIndex];
+    float cmin[3] = { 1e30f, 1e30f, 1e30f }, cmax[3] = { -1e30f, -1e30f, -1e30f };
+    for (int k = 0; k < 3; k++) {
+        node.bmin[k] = 1e30f;
+        node.bmax[k] = -1e30f;
+    }
+    for (int i = first; i < first + count; i++) {
+        float tmin[3], tmax[3];
+        getTriangleBounds(bvh.triangles[i], tmin, tmax);
+        for (int k = 0; k < 3; k++) {
+            if (tmin[k] < node.bmin[k]) node.bmin[k] = tmin[k];
+            if (tmax[k] > node.bmax[k]) node.bmax[k] = tmax[k];
+            float c = getTriangleCentroid(bvh.triangles[i], k);
+            if (c < cmin[k]) cmin[k] = c;
+            if (c > cmax[k]) cmax[k] = c;
+        }
+    }
+
+    if (count <= BVH_LEAF_SIZE) {
+        node.first = first;
+        node.count = count;
+        return;
+    }
+
+    CentroidLess less;
+    less.axis = 0;
+    for (int k = 1; k < 3; k++) {
+        if (cmax[k] - cmin[k] > cmax[less.axis] - cmin[less.axis]) less.axis = k;
+    }
+    int half = count / 2;
+    std::nth_element(bvh.triangles.begin() + first, bvh.triangles.begin() + first + half,
+                     bvh.triangles.begin() + first + count, less);
+
+    int left = (int)bvh.nodes.size();
+    node.first = left;
+    node.count = 0;
+    bvh.nodes.resize(bvh.nodes.size() + 2);  // Invalidates node
+    buildBVHNode(bvh, left, first, half);
+    buildBVHNode(bvh, left + 1, first + half, count - half);
+}
+
+void buildBVH(BVH& bvh) {
+    bvh.nodes.clear();
+    bvh.nodes.reserve(bvh.triangles.size() / BVH_LEAF_SIZE * 2 + 1);
+    bvh.nodes.resize(1);
+    buildBVHNode(bvh, 0, 0, (int)bvh.triangles.size());
+}
+
+bool rayHitsNode(const BVHNode& node, const float origin[3], const float invDir[3], float maxT) {
+    float tmin = 0.0f, tmax = maxT;
+    for (int k = 0; k < 3; k++) {
+        float t1 = (node.bmin[k] - origin[k]) * invDir[k];
+        float t2 = (node.bmax[k] - origin[k]) * invDir[k];
+        if (t1 > t2) { float t = t1; t1 = t2; t2 = t; }
+        if (t1 > tmin) tmin = t1;
+        if (t2 < tmax) tmax = t2;
+        if (tmin > tmax) return false;
+    }
+    return true;
+}
+
+// Moller-Trumbore, any hit closer than maxT
+bool rayHitsTriangle(const BakeTriangle& tri, const Vector3& origin, const Vector3& dir, float maxT) {
+    Vector3 p = cross(dir, tri.e2);
+    float det = dot(tri.e1, p);
+    if (fabs(det) < 1e-9f) return false;
+    float invDet = 1.0f / det;
+    Vector3 s = origin - tri.v0;
+    float u = dot(s, p) * invDet;
+    if (u < 0.0f || u > 1.0f) return false;
+    Vector3 q = cross(s, tri.e1);
+    float v = dot(dir, q) * invDet;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    float t = dot(tri.e2, q) * invDet;
+    return t > 1e-4f && t < maxT;
+}
+
+bool isRayOccluded(const BVH& bvh, const Vector3& origin, const Vector3& dir, float maxT) {
+    float o[3] = { origin.x, origin.y, origin.z };
+    float invDir[3] = { 1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z };
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const BVHNode& node = bvh.nodes[stack[--top]];
+        if (!rayHitsNode(node, o, invDir, maxT)) continue;
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                if (rayHitsTriangle(bvh.triangles[i], origin, dir, maxT)) return true;
+            }
+        } else {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+        }
+    }
+    return false;
+}
+
+// Van der Corput radical inverse, for stratified sample sets
+float radicalInverse(unsigned int bits) {
+    bits = (bits << 16) | (bits >> 16);
+    bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+    bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+    bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+    bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+    return bits * 2.3283064365386963e-10f;
+}
+
+// Deterministic per-vertex random rotation of the sample sets, so the output
+// does not depend on the number of threads
+float hashToUnit(unsigned int x) {
+    x ^= x >> 16; x *= 0x7feb352du;
+    x ^= x >> 15; x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return (x & 0xFFFFFF) / 16777216.0f;
+}
+
+void buildBasis(const Vector3& n, Vector3& t, Vector3& b) {
+    t = fabs(n.x) > 0.9f ? Vector3(0, 1, 0) : Vector3(1, 0, 0);
+    t = normalize(cross(t, n));
+    b = cross(n, t);
+}
+
+unsigned char toByte(float v) {
+    return (unsigned char)(clampUnit(v) * 255.0f + 0.5f);
+}
+
+void bakeVertex(const BVH& bvh, int sx, int sz, unsigned int seed, unsigned char* out) {
+    Vector3 normal = getTerrainNormal(sx, sz);
+    Vector3 origin(terrain.originX + sx * terrain.spacing + normal.x * BAKE_RAY_OFFSET,
+                   getTerrainSample(sx, sz) + normal.y * BAKE_RAY_OFFSET,
+                   terrain.originZ + sz * terrain.spacing + normal.z * BAKE_RAY_OFFSET);
+    Vector3 t, b;
+    buildBasis(normal, t, b);
+    float jitterU = hashToUnit(seed), jitterV = hashToUnit(seed ^ 0x9e3779b9u);
+
+    // Cosine-weighted hemisphere
+    int open = 0;
+    for (int i = 0; i < BAKE_AO_RAYS; i++) {
+        float u = fmod((i + 0.5f) / BAKE_AO_RAYS + jitterU, 1.0f);
+        float v = fmod(radicalInverse(i) + jitterV, 1.0f);
+        float r = sqrt(u), phi = 2.0f * 3.14159265359f * v;
+        float lx = r * cos(phi), ly = r * sin(phi), lz = sqrt(1.0f - u);
+        Vector3 dir(t.x * lx + b.x * ly + normal.x * lz,
+                    t.y * lx + b.y * ly + normal.y * lz,
+                    t.z * lx + b.z * ly + normal.z * lz);
+        if (!isRayOccluded(bvh, origin, dir, BAKE_AO_DISTANCE)) open++;
+    }
+    out[0] = toByte((float)open / BAKE_AO_RAYS);
+
+    // Sun disc, matching the direction set up by updateSunLight
+    for (int k = 0; k < BAKE_KEYFRAMES; k++) {
+        float angle = getBakeKeyframeAngle(k) * 3.14159265359f / 180.0f;
+        Vector3 sun(cos(angle), sin(angle), 0.0f);
+        float nDotL = dot(normal, sun);
+        if (nDotL <= 0.0f) {
+            out[1 + k] = 0;
+            continue;
+        }
+        Vector3 st, sb;
+        buildBasis(sun, st, sb);
+        int lit = 0;
+        for (int i = 0; i < BAKE_SUN_RAYS; i++) {
+            float u = fmod((i + 0.5f) / BAKE_SUN_RAYS + jitterU, 1.0f);
+            float v = fmod(radicalInverse(i) + jitterV, 1.0f);
+            float r = BAKE_SUN_RADIUS * sqrt(u), phi = 2.0f * 3.14159265359f * v;
+            Vector3 dir = normalize(Vector3(sun.x + (st.x * cos(phi) + sb.x * sin(phi)) * r,
+                                            sun.y + (st.y * cos(phi) + sb.y * sin(phi)) * r,
+                                            sun.z + (st.z * cos(phi) + sb.z * sin(phi)) * r));
+            if (!isRayOccluded(bvh, origin, dir, 1e30f)) lit++;
+        }
+        out[1 + k] = toByte(nDotL * lit / BAKE_SUN_RAYS);
+    }
+}
+
+void bakeWorker(const BVH* bvh, BakedLighting* bake, std::atomic<int>* nextChunk) {
+    int verts = bake->header.vertsPerChunk;
+    for (;;) {
+        int c = (*nextChunk)++;
+        if (c >= bake->header.chunkCount) return;
+        const TerrainChunk& chunk = terrain.chunks[c];
+        for (int v = 0; v < verts; v++) {
+            size_t index = (size_t)c * verts + v;
+            bakeVertex(*bvh, chunk.sampleX + v % TERRAIN_CHUNK_VERTS, chunk.sampleZ + v / TERRAIN_CHUNK_VERTS,
+                       (unsigned int)index, &bake->samples[index * BAKE_VERTEX_SIZE]);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* outputPath = argc > 1 ? argv[1] : BAKE_DEFAULT_PATH;
+
+    loadTerrain(TERRAIN_DEFAULT_PATH);
+    buildLevel();
+    placeLevelOnTerrain();
+
+    // Chunk layout only; no GL context here
+    terrain.chunks.resize((size_t)terrain.chunksX * terrain.chunksZ);
+    for (int cz = 0; cz < terrain.chunksZ; cz++) {
+        for (int cx = 0; cx < terrain.chunksX; cx++) {
+            TerrainChunk& chunk = terrain.chunks[(size_t)cz * terrain.chunksX + cx];
+            chunk.sampleX = cx * TERRAIN_CHUNK_QUADS;
+            chunk.sampleZ = cz * TERRAIN_CHUNK_QUADS;
+        }
+    }
+
+    // Scene triangles: full-resolution terrain plus object proxies
+    BVH bvh;
+    for (int z = 0; z + 1 < terrain.depth; z++) {
+        for (int x = 0; x + 1 < terrain.width; x++) {
+            Vector3 p00(terrain.originX + x * terrain.spacing, getTerrainSample(x, z), terrain.originZ + z * terrain.spacing);
+            Vector3 p10(p00.x + terrain.spacing, getTerrainSample(x + 1, z), p00.z);
+            Vector3 p01(p00.x, getTerrainSample(x, z + 1), p00.z + terrain.spacing);
+            Vector3 p11(p00.x + terrain.spacing, getTerrainSample(x + 1, z + 1), p00.z + terrain.spacing);
+            addTriangle(bvh.triangles, p00, p11, p10);
+            addTriangle(bvh.triangles, p00, p01, p11);
+        }
+    }
+    size_t terrainTriangles = bvh.triangles.size();
+    for (size_t i = 0; i < levelObjects.size(); i++) {
+        addObjectProxies(bvh.triangles, levelObjects[i]);
+    }
+    int objectTriangles = (int)(bvh.triangles.size() - terrainTriangles);
+    buildBVH(bvh);
+
+    BakedLighting bake;
+    bake.header.magic = BAKE_MAGIC;
+    bake.header.version = BAKE_VERSION;
+    bake.header.layoutHash = computeBakeLayoutHash();
+    bake.header.chunkCount = (int)terrain.chunks.size();
+    bake.header.vertsPerChunk = TERRAIN_CHUNK_VERTS * TERRAIN_CHUNK_VERTS;
+    bake.header.keyframes = BAKE_KEYFRAMES;
+    bake.samples.assign((size_t)bake.header.chunkCount * bake.header.vertsPerChunk * BAKE_VERTEX_SIZE, 0);
+
+    int threadCount = (int)std::thread::hardware_concurrency();
+    if (threadCount < 1) threadCount = 1;
+    printf("Baking lighting: %d vertices, %d keyframes, %d triangles (%d from objects), %d BVH nodes, %d threads\n",
+           bake.header.chunkCount * bake.header.vertsPerChunk, BAKE_KEYFRAMES, (int)bvh.triangles.size(),
+           objectTriangles, (int)bvh.nodes.size(), threadCount);
+
+    std::atomic<int> nextChunk(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; i++) {
+        threads.push_back(std::thread(bakeWorker, &bvh, &bake, &nextChunk));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+
+    long aoTotal = 0;
+    for (size_t i = 0; i < bake.samples.size(); i += BAKE_VERTEX_SIZE) {
+        aoTotal += bake.samples[i];
+    }
+    printf("Average ambient occlusion: %.2f\n",
+           aoTotal / 255.0f / (bake.samples.size() / BAKE_VERTEX_SIZE));
+
+    if (!saveBakedLighting(outputPath, bake)) {
+        return 1;
+    }
+    printf("Wrote baked lighting: %s (%d bytes)\n", outputPath,
+           (int)(sizeof(BakeHeader) + bake.samples.size()));
+    return 0;
+}
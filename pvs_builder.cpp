@@ -0,0 +1,419 @@
+// Offline PVS builder for the BlitzMail rural level.
+//
+// Splits the walkable area into square cells and, for every cell, shoots rays
+// from a grid of eye positions inside the cell to sample points on every
+// static object and terrain chunk. An object or chunk is visible from the
+// cell if at least one ray reaches it without hitting an occluder or passing
+// under the terrain. Occluders are the solid insides of houses: the fallback
+// wall cube, or a box found inside the farmhouse model. The resulting bitsets
+// are written to a level file that the game loads at startup (see
+// Visibility.h).
+//
+// Usage: pvs_builder [output.pvs] [cellSize]
+#include "Visibility.h"
+#include "Terrain.h"
+
+// Eye sample grid inside each cell (per axis) and the eye heights to test.
+// Heights are above the ground and cover crouching, standing, third-person
+// and the top of a jump.
+#define PVS_EYE_SAMPLES 4
+const float PVS_EYE_HEIGHTS[] = { 2.3f, 3.0f, 4.0f, 6.3f };
+const int PVS_EYE_HEIGHT_COUNT = sizeof(PVS_EYE_HEIGHTS) / sizeof(PVS_EYE_HEIGHTS[0]);
+
+// Target samples per object axis (corners, edge midpoints and interior)
+#define PVS_TARGET_SAMPLES 3
+
+// Target samples per terrain chunk axis, on the surface
+#define PVS_CHUNK_SAMPLES 9
+
+// Terrain ray-march step, in heightmap sample spacings
+#define PVS_TERRAIN_STEP 0.5f
+
+// The game picks terrain LODs whose error stays under TERRAIN_PIXEL_ERROR
+// pixels, so how far a drawn chunk can sink below the heightmap grows with
+// distance and shrinks with the viewport. Occlusion by terrain holds for
+// viewports at least this tall with the game's 45 degree field of view.
+#define PVS_MIN_VIEWPORT_HEIGHT 480
+#define PVS_FOV_Y_DEGREES 45.0f
+
+// Voxels along the longest axis of a model searched for a solid box
+#define PVS_SOLID_VOXELS 32
+
+struct Occluder {
+    Vector3 bmin, bmax;
+    int object;  // Index of the level object that owns this occluder
+};
+
+bool pointInBox(const Vector3& p, const Vector3& bmin, const Vector3& bmax) {
+    return p.x > bmin.x && p.x < bmax.x &&
+           p.y > bmin.y && p.y < bmax.y &&
+           p.z > bmin.z && p.z < bmax.z;
+}
+
+// Slab test for the open segment from a to b against an AABB
+bool segmentHitsBox(const Vector3& a, const Vector3& b, const Vector3& bmin, const Vector3& bmax) {
+    float tmin = 0.0f, tmax = 1.0f;
+    float o[3] = { a.x, a.y, a.z };
+    float d[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+    float lo[3] = { bmin.x, bmin.y, bmin.z };
+    float hi[3] = { bmax.x, bmax.y, bmax.z };
+
+    for (int i = 0; i < 3; i++) {
+        if (fabs(d[i]) < 1e-8f) {
+            if (o[i] <= lo[i] || o[i] >= hi[i]) return false;
+        } else {
+            float t1 = (lo[i] - o[i]) / d[i];
+            float t2 = (hi[i] - o[i]) / d[i];
+            if (t1 > t2) { float t = t1; t1 = t2; t2 = t; }
+            if (t1 > tmin) tmin = t1;
+            if (t2 < tmax) tmax = t2;
+            if (tmin > tmax) return false;
+        }
+    }
+    return tmax > 1e-4f && tmin < 1.0f - 1e-4f;
+}
+
+// Moller-Trumbore test for the segment from a to a + d against a triangle
+bool segmentHitsTriangle(const Vector3& a, const Vector3& d, const Vector3& p0, const Vector3& p1,
+                         const Vector3& p2) {
+    Vector3 e1 = p1 - p0, e2 = p2 - p0;
+    Vector3 p = cross(d, e2);
+    float det = dot(e1, p);
+    if (fabs(det) < 1e-12f) return false;
+    Vector3 s = a - p0;
+    float u = dot(s, p) / det;
+    if (u < 0.0f || u > 1.0f) return false;
+    Vector3 q = cross(s, e1);
+    float v = dot(d, q) / det;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    float t = dot(e2, q) / det;
+    return t >= 0.0f && t <= 1.0f;
+}
+
+bool segmentHitsModel(const Model& model, const Vector3& a, const Vector3& d) {
+    for (size_t i = 0; i + 2 < model.collisionIndices.size(); i += 3) {
+        if (segmentHitsTriangle(a, d, model.collisionPositions[model.collisionIndices[i]],
+                                model.collisionPositions[model.collisionIndices[i + 1]],
+                                model.collisionPositions[model.collisionIndices[i + 2]])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Largest box inside a model's enclosed interior, in file units. The
+// collision copy is voxelized (a voxel any triangle touches is wall) and the
+// outside flood-filled through empty voxels, corners included; what the
+// flood cannot reach is inside, and a sight line through it has to cross the
+// walls. Openings narrower than a voxel would not let the flood in, so the
+// box is then checked with rays from its samples in every direction, all of
+// which must hit the model. A model without a closed interior has no box.
+bool findModelSolidBox(const Model& model, ModelSolidBox& box) {
+    box.found = false;
+    if (model.collisionPositions.empty()) return false;
+    Vector3 lo = model.collisionPositions[0], hi = lo;
+    for (size_t i = 1; i < model.collisionPositions.size(); i++) {
+        const Vector3& p = model.collisionPositions[i];
+        lo = Vector3(fmin(lo.x, p.x), fmin(lo.y, p.y), fmin(lo.z, p.z));
+        hi = Vector3(fmax(hi.x, p.x), fmax(hi.y, p.y), fmax(hi.z, p.z));
+    }
+    float voxel = fmax(hi.x - lo.x, fmax(hi.y - lo.y, hi.z - lo.z)) / PVS_SOLID_VOXELS;
+    if (voxel <= 0.0f) return false;
+    // One empty layer all around, so the flood can reach every side
+    Vector3 origin = lo - Vector3(voxel, voxel, voxel);
+    int n[3] = { (int)ceil((hi.x - lo.x) / voxel) + 2, (int)ceil((hi.y - lo.y) / voxel) + 2,
+                 (int)ceil((hi.z - lo.z) / voxel) + 2 };
+    enum { VOXEL_EMPTY, VOXEL_WALL, VOXEL_OUTSIDE };
+    std::vector<unsigned char> voxels((size_t)n[0] * n[1] * n[2], VOXEL_EMPTY);
+    #define PVS_VOXEL(x, y, z) voxels[((size_t)(z) * n[1] + (y)) * n[0] + (x)]
+
+    // Mark walls by sampling every triangle finer than the voxels
+    for (size_t i = 0; i + 2 < model.collisionIndices.size(); i += 3) {
+        const Vector3& p0 = model.collisionPositions[model.collisionIndices[i]];
+        const Vector3& p1 = model.collisionPositions[model.collisionIndices[i + 1]];
+        const Vector3& p2 = model.collisionPositions[model.collisionIndices[i + 2]];
+        float edge = fmax(length(p1 - p0), fmax(length(p2 - p0), length(p2 - p1)));
+        int steps = (int)ceil(edge / (voxel * 0.25f)) + 1;
+        for (int u = 0; u <= steps; u++) {
+            for (int v = 0; u + v <= steps; v++) {
+                Vector3 p = p0 + (p1 - p0) * ((float)u / steps) + (p2 - p0) * ((float)v / steps);
+                int x = (int)((p.x - origin.x) / voxel), y = (int)((p.y - origin.y) / voxel);
+                int z = (int)((p.z - origin.z) / voxel);
+                if (x >= 0 && y >= 0 && z >= 0 && x < n[0] && y < n[1] && z < n[2]) PVS_VOXEL(x, y, z) = VOXEL_WALL;
+            }
+        }
+    }
+
+    std::vector<int> stack(1, 0);
+    PVS_VOXEL(0, 0, 0) = VOXEL_OUTSIDE;
+    while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        int x = index % n[0], y = index / n[0] % n[1], z = index / (n[0] * n[1]);
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int nx = x + dx, ny = y + dy, nz = z + dz;
+                    if (nx < 0 || ny < 0 || nz < 0 || nx >= n[0] || ny >= n[1] || nz >= n[2]) continue;
+                    if (PVS_VOXEL(nx, ny, nz) != VOXEL_EMPTY) continue;
+                    PVS_VOXEL(nx, ny, nz) = VOXEL_OUTSIDE;
+                    stack.push_back((nz * n[1] + ny) * n[0] + nx);
+                }
+            }
+        }
+    }
+
+    // Largest box of inside voxels: every x and y range, with the longest
+    // run of z slices that are inside all over it
+    std::vector<int> inside((size_t)(n[0] + 1) * (n[1] + 1) * n[2], 0);  // Per-slice 2D prefix sums
+    #define PVS_INSIDE(x, y, z) inside[((size_t)(z) * (n[1] + 1) + (y)) * (n[0] + 1) + (x)]
+    for (int z = 0; z < n[2]; z++) {
+        for (int y = 0; y < n[1]; y++) {
+            for (int x = 0; x < n[0]; x++) {
+                PVS_INSIDE(x + 1, y + 1, z) = (PVS_VOXEL(x, y, z) == VOXEL_EMPTY ? 1 : 0) + PVS_INSIDE(x, y + 1, z) +
+                                              PVS_INSIDE(x + 1, y, z) - PVS_INSIDE(x, y, z);
+            }
+        }
+    }
+    long bestVolume = 0;
+    int best[6] = { 0 };
+    for (int x0 = 0; x0 < n[0]; x0++) {
+        for (int x1 = x0; x1 < n[0]; x1++) {
+            for (int y0 = 0; y0 < n[1]; y0++) {
+                for (int y1 = y0; y1 < n[1]; y1++) {
+                    int area = (x1 - x0 + 1) * (y1 - y0 + 1), run = 0;
+                    for (int z = 0; z < n[2]; z++) {
+                        int sum = PVS_INSIDE(x1 + 1, y1 + 1, z) - PVS_INSIDE(x0, y1 + 1, z) -
+                                  PVS_INSIDE(x1 + 1, y0, z) + PVS_INSIDE(x0, y0, z);
+                        run = sum == area ? run + 1 : 0;
+                        if (run > 0 && (long)area * run > bestVolume) {
+                            bestVolume = (long)area * run;
+                            int found[6] = { x0, y0, z - run + 1, x1, y1, z };
+                            memcpy(best, found, sizeof(best));
+                        }
+                    }
+                }
+            }
+        }
+    }
+    #undef PVS_INSIDE
+    #undef PVS_VOXEL
+    if (bestVolume == 0) return false;
+    box.bmin = origin + Vector3((float)best[0], (float)best[1], (float)best[2]) * voxel;
+    box.bmax = origin + Vector3((float)best[3] + 1, (float)best[4] + 1, (float)best[5] + 1) * voxel;
+
+    // Every ray out of the box has to meet the model before it is clear of it
+    float reach = length(hi - lo) * 2.0f;
+    for (int i = 0; i < 27; i++) {
+        Vector3 f((i % 3) * 0.5f, (i / 3 % 3) * 0.5f, (i / 9) * 0.5f);
+        Vector3 start(box.bmin.x + (box.bmax.x - box.bmin.x) * f.x, box.bmin.y + (box.bmax.y - box.bmin.y) * f.y,
+                      box.bmin.z + (box.bmax.z - box.bmin.z) * f.z);
+        for (int dz = -2; dz <= 2; dz++) {
+            for (int dy = -2; dy <= 2; dy++) {
+                for (int dx = -2; dx <= 2; dx++) {
+                    if (dx == 0 && dy == 0 && dz == 0) continue;
+                    Vector3 d = normalize(Vector3((float)dx, (float)dy, (float)dz)) * reach;
+                    if (!segmentHitsModel(model, start, d)) return false;
+                }
+            }
+        }
+    }
+    box.found = true;
+    return true;
+}
+
+// How far the terrain the game draws can sit from the heightmap at (x, z),
+// seen from distance away: no more than the chunk's coarsest LOD error, nor
+// than the LOD selection lets through on the smallest viewport
+float getTerrainMargin(float x, float z, float distance) {
+    static const float pixelsPerUnit =
+        PVS_MIN_VIEWPORT_HEIGHT / (2.0f * tan(PVS_FOV_Y_DEGREES * 3.14159265359f / 360.0f));
+    float coarsest = terrain.chunks[getTerrainChunkIndex(x, z)].lodError[TERRAIN_LOD_COUNT - 1];
+    return fmin(coarsest, TERRAIN_PIXEL_ERROR * fmax(distance, 1.0f) / pixelsPerUnit);
+}
+
+// Whether the terrain rises above the segment somewhere between its ends,
+// ray-marched over the heightmap from the eye a. Terrain only counts once it
+// is more than its margin above the segment, and ridges thinner than a step
+// can be missed; both keep the result on the visible side.
+bool isSegmentUnderTerrain(const Vector3& a, const Vector3& b) {
+    float dx = b.x - a.x, dz = b.z - a.z;
+    float segmentLength = length(b - a);
+    int steps = (int)(sqrt(dx * dx + dz * dz) / (terrain.spacing * PVS_TERRAIN_STEP));
+    for (int i = 1; i < steps; i++) {
+        float t = (float)i / steps;
+        float x = a.x + dx * t, z = a.z + dz * t;
+        float y = a.y + (b.y - a.y) * t;
+        if (getTerrainHeight(x, z) - getTerrainMargin(x, z, segmentLength * t) > y) return true;
+    }
+    return false;
+}
+
+bool isSegmentBlocked(const Vector3& eye, const Vector3& target, int targetObject,
+                      const std::vector<Occluder>& occluders) {
+    for (size_t i = 0; i < occluders.size(); i++) {
+        if (occluders[i].object == targetObject) continue;
+        if (segmentHitsBox(eye, target, occluders[i].bmin, occluders[i].bmax)) {
+            return true;
+        }
+    }
+    return isSegmentUnderTerrain(eye, target);
+}
+
+bool isObjectVisibleFrom(const std::vector<Vector3>& eyes, const LevelObject& obj, int objIndex,
+                         const std::vector<Occluder>& occluders) {
+    const Vector3& bmin = obj.boundsMin;
+    const Vector3& bmax = obj.boundsMax;
+
+    for (size_t e = 0; e < eyes.size(); e++) {
+        // Eyes inside the object's bounds trivially see it
+        if (pointInBox(eyes[e], bmin, bmax)) return true;
+
+        for (int i = 0; i < PVS_TARGET_SAMPLES; i++) {
+            for (int j = 0; j < PVS_TARGET_SAMPLES; j++) {
+                for (int k = 0; k < PVS_TARGET_SAMPLES; k++) {
+                    float fx = (float)i / (PVS_TARGET_SAMPLES - 1);
+                    float fy = (float)j / (PVS_TARGET_SAMPLES - 1);
+                    float fz = (float)k / (PVS_TARGET_SAMPLES - 1);
+                    Vector3 target(bmin.x + (bmax.x - bmin.x) * fx,
+                                   bmin.y + (bmax.y - bmin.y) * fy,
+                                   bmin.z + (bmax.z - bmin.z) * fz);
+                    if (!isSegmentBlocked(eyes[e], target, objIndex, occluders)) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Targets on a chunk's surface, raised by the margin to where the game may
+// draw it
+bool isChunkVisibleFrom(const std::vector<Vector3>& eyes, const TerrainChunk& chunk,
+                        const std::vector<Occluder>& occluders) {
+    for (size_t e = 0; e < eyes.size(); e++) {
+        if (pointInBox(eyes[e], chunk.boundsMin, chunk.boundsMax)) return true;
+        for (int i = 0; i < PVS_CHUNK_SAMPLES; i++) {
+            for (int j = 0; j < PVS_CHUNK_SAMPLES; j++) {
+                float x = chunk.boundsMin.x + (chunk.boundsMax.x - chunk.boundsMin.x) * i / (PVS_CHUNK_SAMPLES - 1);
+                float z = chunk.boundsMin.z + (chunk.boundsMax.z - chunk.boundsMin.z) * j / (PVS_CHUNK_SAMPLES - 1);
+                Vector3 target(x, getTerrainHeight(x, z), z);
+                target.y += getTerrainMargin(x, z, length(target - eyes[e]));
+                if (!isSegmentBlocked(eyes[e], target, -1, occluders)) return true;
+            }
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    const char* outputPath = argc > 1 ? argv[1] : PVS_DEFAULT_PATH;
+    float cellSize = argc > 2 ? (float)atof(argv[2]) : 4.0f;
+    if (cellSize <= 0.0f) {
+        printf("Error: Invalid cell size\n");
+        return 1;
+    }
+
+    buildLevel();
+    loadTerrain(TERRAIN_DEFAULT_PATH);
+    placeLevelOnTerrain();
+    layoutTerrainChunks();
+
+    // Occluders depend on which geometry the game will render for houses
+    Model houseModel;
+    bool houseModelLoaded = loadModel(MODEL_PATH_FARMHOUSE, houseModel);
+    ModelSolidBox houseSolid = { false, Vector3(0, 0, 0), Vector3(0, 0, 0) };
+    if (houseModelLoaded) {
+        buildModelCollision(houseModel);
+        if (findModelSolidBox(houseModel, houseSolid)) {
+            printf("Farmhouse solid box: (%.2f %.2f %.2f) - (%.2f %.2f %.2f) model units\n", houseSolid.bmin.x,
+                   houseSolid.bmin.y, houseSolid.bmin.z, houseSolid.bmax.x, houseSolid.bmax.y, houseSolid.bmax.z);
+        } else {
+            printf("Warning: The farmhouse model has no closed interior, houses will not occlude\n");
+        }
+    }
+
+    std::vector<Occluder> occluders;
+    for (size_t i = 0; i < levelObjects.size(); i++) {
+        Occluder occ;
+        if (getLevelObjectOccluder(levelObjects[i], houseModelLoaded ? &houseSolid : NULL, occ.bmin, occ.bmax)) {
+            occ.object = (int)i;
+            occluders.push_back(occ);
+        }
+    }
+
+    PVSData pvs;
+    PVSHeader& h = pvs.header;
+    h.magic = PVS_MAGIC;
+    h.version = PVS_VERSION;
+    h.flags = houseModelLoaded ? PVS_FLAG_HOUSE_MODEL : 0;
+    h.cols = (int)ceil(2.0f * LEVEL_HALF_EXTENT / cellSize);
+    h.rows = h.cols;
+    h.objectCount = (int)levelObjects.size();
+    h.chunkCount = (int)terrain.chunks.size();
+    h.wordsPerCell = pvsWordsForBits(h.objectCount + h.chunkCount);
+    h.originX = -LEVEL_HALF_EXTENT;
+    h.originZ = -LEVEL_HALF_EXTENT;
+    h.cellSize = cellSize;
+    pvs.bits.assign((size_t)h.cols * h.rows * h.wordsPerCell, 0);
+
+    printf("Building PVS: %dx%d cells of %.1f units, %d objects, %d terrain chunks, %d occluders\n",
+           h.cols, h.rows, cellSize, h.objectCount, h.chunkCount, (int)occluders.size());
+
+    long visibleTotal = 0, visibleChunkTotal = 0;
+    std::vector<Vector3> eyes;
+    for (int row = 0; row < h.rows; row++) {
+        for (int col = 0; col < h.cols; col++) {
+            float cx = h.originX + col * cellSize;
+            float cz = h.originZ + row * cellSize;
+
+            // Eye positions inside the cell that are not buried in an occluder
+            eyes.clear();
+            for (int i = 0; i < PVS_EYE_SAMPLES; i++) {
+                for (int j = 0; j < PVS_EYE_SAMPLES; j++) {
+                    for (int k = 0; k < PVS_EYE_HEIGHT_COUNT; k++) {
+                        float ex = cx + cellSize * (i + 0.5f) / PVS_EYE_SAMPLES;
+                        float ez = cz + cellSize * (j + 0.5f) / PVS_EYE_SAMPLES;
+                        Vector3 eye(ex, getTerrainHeight(ex, ez) + PVS_EYE_HEIGHTS[k], ez);
+                        bool buried = false;
+                        for (size_t o = 0; o < occluders.size() && !buried; o++) {
+                            buried = pointInBox(eye, occluders[o].bmin, occluders[o].bmax);
+                        }
+                        if (!buried) eyes.push_back(eye);
+                    }
+                }
+            }
+
+            unsigned int* cellBits = &pvs.bits[((size_t)row * h.cols + col) * h.wordsPerCell];
+            for (int obj = 0; obj < h.objectCount; obj++) {
+                // A cell with no usable eye positions keeps everything visible
+                if (eyes.empty() || isObjectVisibleFrom(eyes, levelObjects[obj], obj, occluders)) {
+                    cellBits[obj >> 5] |= 1u << (obj & 31);
+                    visibleTotal++;
+                }
+            }
+            for (int chunk = 0; chunk < h.chunkCount; chunk++) {
+                int bit = h.objectCount + chunk;
+                if (eyes.empty() || isChunkVisibleFrom(eyes, terrain.chunks[chunk], occluders)) {
+                    cellBits[bit >> 5] |= 1u << (bit & 31);
+                    visibleChunkTotal++;
+                }
+            }
+        }
+    }
+
+    int cellCount = h.cols * h.rows;
+    printf("Average visible per cell: %.1f of %d objects, %.1f of %d terrain chunks\n",
+           (float)visibleTotal / cellCount, h.objectCount, (float)visibleChunkTotal / cellCount, h.chunkCount);
+    if (visibleTotal + visibleChunkTotal == (long)cellCount * (h.objectCount + h.chunkCount)) {
+        printf("Warning: Everything is visible from every cell, the PVS culls nothing\n");
+    }
+
+    if (!savePVS(outputPath, pvs)) {
+        return 1;
+    }
+    printf("Wrote PVS: %s (%d bytes)\n", outputPath,
+           (int)(sizeof(PVSHeader) + pvs.bits.size() * sizeof(unsigned int)));
+    return 0;
+}
@@ -0,0 +1,131 @@
+// Tests for the job system, run at every thread count from 1 up to the
+// hardware threads (at least TEST_MIN_THREADS, so stealing is exercised on
+// small machines too): parallelFor coverage, trees of parent and child jobs,
+// and nested parallelFor calls. Usage: test_jobs [max threads]; exits
+// non-zero on any failure.
+#include "JobSystem.h"
+
+#define TEST_MIN_THREADS 4
+#define TEST_RANGE 200000
+#define TEST_TREE_DEPTH 5     // Levels below the root
+#define TEST_TREE_CHILDREN 4
+#define TEST_TREE_JOBS 1365   // 1 + 4 + 16 + 64 + 256 + 1024
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static void countIndices(void* data, int begin, int end) {
+    std::atomic<int>* hits = (std::atomic<int>*)data;
+    for (int i = begin; i < end; i++) hits[i].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Every index is visited exactly once, whatever the grain, and nothing past
+// the count is touched
+static void testCoverage() {
+    static std::atomic<int> hits[TEST_RANGE + 1];
+    const int grains[] = { 1, 7, 64, 1000, TEST_RANGE * 2 };
+    const int counts[] = { TEST_RANGE, TEST_RANGE - 1, 4097, 3, 1, 0, -5 };
+    bool exact = true;
+    for (size_t g = 0; g < sizeof(grains) / sizeof(grains[0]); g++) {
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+            for (int i = 0; i <= TEST_RANGE; i++) hits[i].store(0);
+            parallelFor(counts[c], grains[g], countIndices, hits);
+            for (int i = 0; i <= TEST_RANGE && exact; i++) exact = hits[i].load() == (i < counts[c] ? 1 : 0);
+        }
+    }
+    check(exact, "parallelFor runs every index exactly once");
+}
+
+struct TreeNode {
+    int depth;
+    std::atomic<int>* visited;
+};
+
+static void groupChildren(void*) {
+}
+
+// Runs its children under a grouping job and waits for all of them
+static void visitTree(void* data) {
+    TreeNode* node = (TreeNode*)data;
+    node->visited->fetch_add(1);
+    if (node->depth > 0) {
+        Job* group = createJob(groupChildren, NULL);
+        TreeNode children[TEST_TREE_CHILDREN];
+        for (int i = 0; i < TEST_TREE_CHILDREN; i++) {
+            children[i].depth = node->depth - 1;
+            children[i].visited = node->visited;
+            runJob(createJob(visitTree, &children[i], group));
+        }
+        runJob(group);
+        waitForJob(group);
+    }
+}
+
+// A parent is only finished once all of its children are. Repeated so the
+// job pool wraps around and finished slots are reused.
+static void testTree() {
+    bool complete = true;
+    for (int repeat = 0; repeat < 5; repeat++) {
+        std::atomic<int> visited(0);
+        TreeNode root = { TEST_TREE_DEPTH, &visited };
+        Job* job = createJob(visitTree, &root);
+        runJob(job);
+        waitForJob(job);
+        complete = complete && visited.load() == TEST_TREE_JOBS;
+    }
+    check(complete, "tree of jobs finishes after all its children");
+}
+
+static std::atomic<long long> nestedSum;
+
+static void sumIndices(void*, int begin, int end) {
+    long long sum = 0;
+    for (int i = begin; i < end; i++) sum += i;
+    nestedSum.fetch_add(sum);
+}
+
+static void runInnerLoops(void*, int begin, int end) {
+    for (int i = begin; i < end; i++) parallelFor(1000, 50, sumIndices, NULL);
+}
+
+// parallelFor inside a parallelFor piece waits for its own pieces only
+static void testNested() {
+    nestedSum.store(0);
+    parallelFor(64, 1, runInnerLoops, NULL);
+    check(nestedSum.load() == 64LL * 499500, "nested parallelFor sums");
+}
+
+int main(int argc, char** argv) {
+    int maxThreads = (int)std::thread::hardware_concurrency();
+    if (maxThreads < TEST_MIN_THREADS) maxThreads = TEST_MIN_THREADS;
+    if (argc > 1 && atoi(argv[1]) > 0) maxThreads = atoi(argv[1]);
+    if (maxThreads > JOB_MAX_THREADS) maxThreads = JOB_MAX_THREADS;
+    printf("Testing the job system with 1 to %d threads...\n", maxThreads);
+
+    for (int threads = 1; threads <= maxThreads; threads++) {
+        initJobSystem(threads);
+        resetJobStats();
+        testCoverage();
+        testTree();
+        testNested();
+        int executed, stolen;
+        getJobStats(executed, stolen);
+        check(executed > 0, "jobs are counted");
+        if (threads == 1) check(stolen == 0, "one thread runs its own jobs");
+        printf("  %d jobs run, %d stolen\n", executed, stolen);
+    }
+    shutdownJobSystem();
+
+    if (failures > 0) {
+        printf("\nFAILED: %d checks\n", failures);
+        return 1;
+    }
+    printf("\nSUCCESS: all checks passed\n");
+    return 0;
+}
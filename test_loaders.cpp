@@ -0,0 +1,241 @@
+// Tests for the model loaders and the binary model cache. Everything runs on
+// files written to the temp directory (see TestGrid.h), without a GL context.
+// Exits non-zero on any failure.
+#include "ModelLoader.h"
+#include "TestGrid.h"
+
+#define TEST_GRID_SIZE 120   // Quads per side of the generated OBJ
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static bool fileExists(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file) fclose(file);
+    return file != NULL;
+}
+
+// Every triangle corner's packed vertex, in draw order, so models whose
+// vertices are split or shared differently can be compared
+static std::vector<unsigned char> expandTriangles(const Model& model) {
+    std::vector<unsigned char> corners;
+    const unsigned char* vertices = getModelVertices(model);
+    const GLuint* indices = getModelIndices(model);
+    for (size_t m = 0; m < model.meshes.size(); m++) {
+        const Mesh& mesh = model.meshes[m];
+        for (int i = 0; i < mesh.indexCount; i++) {
+            const unsigned char* v = vertices + (size_t)(mesh.firstVertex + indices[mesh.firstIndex + i]) * ModelVertex::STRIDE;
+            corners.insert(corners.end(), v, v + ModelVertex::STRIDE);
+        }
+    }
+    return corners;
+}
+
+// Every triangle corner's position, in draw order
+static std::vector<float> expandPositions(const Model& model) {
+    std::vector<float> corners;
+    std::vector<unsigned char> packed = expandTriangles(model);
+    for (size_t i = 0; i < packed.size(); i += ModelVertex::STRIDE) {
+        float p[3];
+        memcpy(p, &packed[i + VertexOffset<Pos3f, ModelVertex>::VALUE], sizeof(p));
+        corners.insert(corners.end(), p, p + 3);
+    }
+    return corners;
+}
+
+static bool writeText(const std::string& path, const char* text) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    fputs(text, file);
+    return fclose(file) == 0;
+}
+
+struct SpillCheck {
+    ModelCacheWriter* writer;
+    std::string sourcePath;
+    bool besideSource;
+};
+
+static bool checkNoSpillBesideSource(const OBJBatch& batch, void* user) {
+    SpillCheck& spill = *(SpillCheck*)user;
+    if (fileExists(spill.sourcePath + ".v.spill") || fileExists(spill.sourcePath + ".vn.spill")) {
+        spill.besideSource = true;
+    }
+    return writeOBJBatchToCache(batch, spill.writer);
+}
+
+// The cache is used in place: the model keeps the file mapped instead of
+// copying it into an arena, and the mapping moves with the model
+static void testModelCache(const std::string& objPath, const Model& parsed) {
+    printf("\nModel cache\n");
+    check(saveModelCache(objPath.c_str(), parsed), "cache written");
+    std::vector<unsigned char> expected = expandTriangles(parsed);
+
+    Model moved;
+    {
+        Model cached;
+        check(loadModelCache(objPath.c_str(), cached), "cache loaded");
+        check(cached.arena.empty() && cached.mappedArena != NULL, "cache arena stays mapped");
+        check(cached.vertexCount == parsed.vertexCount && cached.indexCount == parsed.indexCount, "cache counts");
+        check(expandTriangles(cached) == expected, "cache triangles");
+        moved = std::move(cached);
+    }
+    check(moved.mappedArena != NULL && expandTriangles(moved) == expected, "cache mapping survives a move");
+
+    // A changed source invalidates the cache
+    FILE* file = fopen(objPath.c_str(), "a");
+    if (file) {
+        fprintf(file, "# touched\n");
+        fclose(file);
+    }
+    Model stale;
+    check(!loadModelCache(objPath.c_str(), stale), "stale cache rejected");
+}
+
+// Streaming with a small budget spills the attributes to the temp directory
+// and must produce the same triangles as parsing in memory
+static void testStreamedOBJ(const std::string& objPath, const Model& parsed) {
+    printf("\nStreamed OBJ\n");
+    OBJStreamOptions options;
+    options.batchTriangles = 1000;
+    options.memoryBudget = 160 * 1024;  // Batch buffers fit, the ~1 MB of attributes do not
+
+    ModelCacheWriter writer;
+    SpillCheck spill;
+    spill.writer = &writer;
+    spill.sourcePath = objPath;
+    spill.besideSource = false;
+    check(beginModelCache(writer, objPath.c_str()), "stream cache opened");
+    bool streamed = streamOBJ(objPath.c_str(), options, checkNoSpillBesideSource, &spill);
+    check(finishModelCache(writer, streamed) && streamed, "OBJ streamed");
+    check(!spill.besideSource, "no spill files next to the source");
+
+    Model model;
+    check(loadModelCache(objPath.c_str(), model), "streamed cache loaded");
+    check((int)model.meshes.size() == (TEST_GRID_SIZE * TEST_GRID_SIZE * 2 + 999) / 1000, "one mesh per batch");
+    check(model.indexCount == parsed.indexCount, "streamed index count");
+    check(expandTriangles(model) == expandTriangles(parsed), "streamed triangles match the in-memory parse");
+}
+
+// Every PLY encoding of the grid loads to the same triangles as the OBJ, and
+// STL to the same positions
+static void testPLYAndSTL(const TestGrid& grid, const Model& parsed) {
+    static const char* formats[3] = { "ascii", "binary_little_endian", "binary_big_endian" };
+    std::vector<unsigned char> expected = expandTriangles(parsed);
+    for (int f = 0; f < 3; f++) {
+        printf("\nPLY %s\n", formats[f]);
+        std::string path = tempPath("blitzmail_test_grid.ply");
+        Model model;
+        check(writeGridPLY(grid, path, formats[f]), "PLY written");
+        check(loadPLY(path.c_str(), model), "PLY loaded");
+        check(model.vertexCount == (int)grid.positions.size() / 3, "PLY vertex count");
+        check(expandTriangles(model) == expected, "PLY triangles match the OBJ");
+        remove(path.c_str());
+    }
+
+    printf("\nSTL\n");
+    std::string path = tempPath("blitzmail_test_grid.stl");
+    Model model;
+    check(writeGridSTL(grid, path), "STL written");
+    check(loadSTL(path.c_str(), model), "STL loaded");
+    check(expandPositions(model) == expandPositions(parsed), "STL positions match the OBJ");
+
+    // STL vertices are split by facet normal; the collision copy welds them
+    // back to one per grid point
+    buildModelCollision(model);
+    check(model.collisionPositions.size() == grid.positions.size() / 3, "collision welds positions");
+    bool sameCorners = (int)model.collisionIndices.size() == model.indexCount;
+    std::vector<float> corners = expandPositions(model);
+    for (size_t i = 0; sameCorners && i < model.collisionIndices.size(); i++) {
+        sameCorners = memcmp(&model.collisionPositions[model.collisionIndices[i]], &corners[i * 3], sizeof(Vector3)) == 0;
+    }
+    check(sameCorners, "collision triangles keep their positions");
+    remove(path.c_str());
+}
+
+// Damaged or unsupported PLY files are rejected rather than loaded with
+// garbage vertices
+static void testBadPLY() {
+    printf("\nBad PLY files\n");
+    std::string header = "ply\nformat ascii 1.0\nelement vertex 3\nproperty float x\nproperty float y\n"
+                         "property float z\nelement face 1\nproperty list uchar int vertex_indices\n";
+    std::string good = header + "end_header\n0 0 0\n1 0 0\n0 0 1\n3 0 1 2\n";
+
+    // More elements than the loader holds, each with a property
+    std::string manyElements = header;
+    for (int e = 0; e < PLY_MAX_ELEMENTS; e++) {
+        char line[64];
+        snprintf(line, sizeof(line), "element extra%d 0\nproperty float value\n", e);
+        manyElements += line;
+    }
+    manyElements += "end_header\n0 0 0\n1 0 0\n0 0 1\n3 0 1 2\n";
+
+    // One property more than the loader holds
+    std::string manyProperties = "ply\nformat ascii 1.0\nelement vertex 3\n";
+    std::string vertexTail;
+    for (int i = 0; i <= PLY_MAX_PROPERTIES; i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "property float p%d\n", i);
+        manyProperties += line;
+        vertexTail += " 0";
+    }
+    manyProperties += "element face 1\nproperty list uchar int vertex_indices\nend_header\n";
+    for (int v = 0; v < 3; v++) manyProperties += vertexTail + "\n";
+    manyProperties += "3 0 1 2\n";
+
+    struct Case {
+        const char* name;
+        std::string text;
+        bool loads;
+    } cases[] = {
+        { "valid triangle", good, true },
+        { "more than PLY_MAX_ELEMENTS elements", manyElements, false },
+        { "more than PLY_MAX_PROPERTIES properties", manyProperties, false },
+        { "property before any element", "ply\nformat ascii 1.0\nproperty float x\n" + good.substr(4), false },
+        { "element without a count", "ply\nformat ascii 1.0\nelement vertex\nend_header\n", false },
+        { "truncated vertices", header + "end_header\n0 0 0\n1 0 0\n", false },
+        { "malformed vertex value", header + "end_header\n0 0 0\n1 zero 0\n0 0 1\n3 0 1 2\n", false },
+        { "truncated face list", header + "end_header\n0 0 0\n1 0 0\n0 0 1\n3 0 1\n", false },
+    };
+    std::string path = tempPath("blitzmail_test_bad.ply");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        Model model;
+        bool loaded = writeText(path, cases[i].text.c_str()) && loadPLY(path.c_str(), model);
+        check(loaded == cases[i].loads, cases[i].name);
+        if (!cases[i].loads) check(model.arena.empty() && model.meshes.empty(), "rejected PLY leaves the model empty");
+    }
+    remove(path.c_str());
+}
+
+int main() {
+    printf("Testing model loaders...\n");
+
+    TestGrid grid;
+    buildGrid(grid, TEST_GRID_SIZE);
+    std::string objPath = tempPath("blitzmail_test_grid.obj");
+    check(writeGridOBJ(grid, objPath), "OBJ written");
+    Model parsed;
+    check(loadOBJ(objPath.c_str(), parsed), "OBJ parsed");
+    check(parsed.indexCount == TEST_GRID_SIZE * TEST_GRID_SIZE * 6, "OBJ index count");
+
+    testStreamedOBJ(objPath, parsed);
+    testModelCache(objPath, parsed);
+    testPLYAndSTL(grid, parsed);
+    testBadPLY();
+
+    remove(getModelCachePath(objPath).c_str());
+    remove(objPath.c_str());
+
+    if (failures > 0) {
+        printf("\nFAILED: %d checks\n", failures);
+        return 1;
+    }
+    printf("\nSUCCESS: all checks passed\n");
+    return 0;
+}
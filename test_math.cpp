@@ -0,0 +1,283 @@
+// Unit tests for MathLib.h: every batch routine is checked against a plain
+// scalar reference on random input. Built twice, as test_math (SSE or NEON
+// when the compiler targets them) and test_math_scalar (MATH_NO_SIMD), so both
+// paths of the 4-wide float type are covered. Exits non-zero on any failure.
+#include "MathLib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define TEST_COUNT 10007      // Not a multiple of 4, so any tail handling is hit
+#define TEST_EPSILON 1e-4f    // Relative to the magnitude of the values compared
+
+static int failures = 0;
+
+static void check(bool ok, const char* what, int index) {
+    if (!ok) {
+        if (failures < 20) printf("  FAILED: %s (item %d)\n", what, index);
+        failures++;
+    }
+}
+
+static bool closeTo(float a, float b) {
+    float scale = maxf(1.0f, maxf(fabsf(a), fabsf(b)));
+    return fabsf(a - b) <= TEST_EPSILON * scale;
+}
+
+static bool closeTo(const vec3& a, const vec3& b) {
+    return closeTo(a.x, b.x) && closeTo(a.y, b.y) && closeTo(a.z, b.z);
+}
+
+static float randomFloat(float lo, float hi) {
+    return lo + (hi - lo) * (float)rand() / (float)RAND_MAX;
+}
+
+static vec3 randomVec3(float range) {
+    return vec3(randomFloat(-range, range), randomFloat(-range, range), randomFloat(-range, range));
+}
+
+// Translation, rotation about a random axis and non-uniform (possibly
+// mirrored) scale: the kind of matrix the scene graph produces
+static mat4 randomMatrix() {
+    quat r = quatFromAxisAngle(randomVec3(1.0f) + vec3(0.01f, 0, 0), randomFloat(-180.0f, 180.0f));
+    vec3 s(randomFloat(0.2f, 4.0f), randomFloat(0.2f, 4.0f), randomFloat(-4.0f, -0.2f));
+    return mat4TRS(randomVec3(100.0f), r, s);
+}
+
+// ---------------------------------------------------------------------------
+// Scalar references
+
+static void referenceMultiply(const float a[16], const float b[16], float out[16]) {
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            float sum = 0;
+            for (int k = 0; k < 4; k++) sum += a[k * 4 + r] * b[c * 4 + k];
+            out[c * 4 + r] = sum;
+        }
+    }
+}
+
+// Arvo's method, as the scene graph did before MathLib
+static void referenceTransformAABB(const float m[16], const vec3& bmin, const vec3& bmax, vec3& outMin,
+                                   vec3& outMax) {
+    float lo[3] = { bmin.x, bmin.y, bmin.z };
+    float hi[3] = { bmax.x, bmax.y, bmax.z };
+    float rmin[3] = { m[12], m[13], m[14] };
+    float rmax[3] = { m[12], m[13], m[14] };
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 3; col++) {
+            float a = m[col * 4 + row] * lo[col];
+            float b = m[col * 4 + row] * hi[col];
+            rmin[row] += minf(a, b);
+            rmax[row] += maxf(a, b);
+        }
+    }
+    outMin = vec3(rmin[0], rmin[1], rmin[2]);
+    outMax = vec3(rmax[0], rmax[1], rmax[2]);
+}
+
+// Positive-vertex test, as isBoxInFrustum does. margin receives the smallest
+// plane distance, so boxes that just touch a plane can be told apart.
+static bool referenceBoxVisible(const float planes[6][4], const vec3& bmin, const vec3& bmax, float& margin) {
+    margin = 1e30f;
+    bool visible = true;
+    for (int p = 0; p < 6; p++) {
+        const float* pl = planes[p];
+        float x = pl[0] >= 0 ? bmax.x : bmin.x;
+        float y = pl[1] >= 0 ? bmax.y : bmin.y;
+        float z = pl[2] >= 0 ? bmax.z : bmin.z;
+        float d = pl[0] * x + pl[1] * y + pl[2] * z + pl[3];
+        if (fabsf(d) < margin) margin = fabsf(d);
+        if (d < 0) visible = false;
+    }
+    return visible;
+}
+
+// Normalised planes of a perspective frustum looking from eye at a random
+// direction: an axis-aligned box of planes, rotated and moved
+static void randomFrustum(float planes[6][4]) {
+    const float local[6][4] = {
+        { 1, 0, 1, 0 }, { -1, 0, 1, 0 },  // Left/right, 90 degree field of view
+        { 0, 1, 1, 0 }, { 0, -1, 1, 0 },  // Bottom/top
+        { 0, 0, 1, -1 }, { 0, 0, -1, 500 }  // Near 1, far 500
+    };
+    quat r = quatFromAxisAngle(randomVec3(1.0f) + vec3(0, 0.01f, 0), randomFloat(-180.0f, 180.0f));
+    vec3 eye = randomVec3(50.0f);
+    for (int p = 0; p < 6; p++) {
+        vec3 n = normalize(rotate(r, vec3(local[p][0], local[p][1], local[p][2])));
+        float d = local[p][3] / length(vec3(local[p][0], local[p][1], local[p][2]));
+        planes[p][0] = n.x;
+        planes[p][1] = n.y;
+        planes[p][2] = n.z;
+        planes[p][3] = d - dot(n, eye);
+    }
+}
+
+static void randomBoxes(std::vector<vec3>& mins, std::vector<vec3>& maxs, float range, float size) {
+    mins.resize(TEST_COUNT);
+    maxs.resize(TEST_COUNT);
+    for (int i = 0; i < TEST_COUNT; i++) {
+        vec3 c = randomVec3(range);
+        vec3 e(randomFloat(0.0f, size), randomFloat(0.0f, size), randomFloat(0.0f, size));
+        mins[i] = c - e;
+        maxs[i] = c + e;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Tests
+
+static void testMultiply() {
+    for (int i = 0; i < 1000; i++) {
+        mat4 a = randomMatrix(), b = randomMatrix();
+        float expected[16], out[16];
+        referenceMultiply(a.m, b.m, expected);
+        multiplyMatrices(a.m, b.m, out);
+        bool ok = true;
+        for (int k = 0; k < 16; k++) ok = ok && closeTo(out[k], expected[k]);
+        check(ok, "multiplyMatrices", i);
+
+        // Output aliasing an input
+        multiplyMatrices(a.m, b.m, a.m);
+        ok = true;
+        for (int k = 0; k < 16; k++) ok = ok && closeTo(a.m[k], expected[k]);
+        check(ok, "multiplyMatrices in place", i);
+    }
+}
+
+static void testTRS() {
+    for (int i = 0; i < 1000; i++) {
+        vec3 t = randomVec3(100.0f), s(randomFloat(0.2f, 4.0f), randomFloat(0.2f, 4.0f), randomFloat(0.2f, 4.0f));
+        float yaw = randomFloat(-360.0f, 360.0f);
+        mat4 a = mat4TRSY(t, yaw, s);
+        mat4 b = mat4TRS(t, quatFromAxisAngle(vec3(0, 1, 0), yaw), s);
+        bool ok = true;
+        for (int k = 0; k < 16; k++) ok = ok && closeTo(a.m[k], b.m[k]);
+        check(ok, "mat4TRSY matches mat4TRS", i);
+
+        // Same as translate * rotate * scale
+        mat4 composed = mat4Translation(t) * mat4FromQuat(quatFromAxisAngle(vec3(0, 1, 0), yaw)) * mat4Scale(s);
+        ok = true;
+        for (int k = 0; k < 16; k++) ok = ok && closeTo(composed.m[k], b.m[k]);
+        check(ok, "mat4TRS matches T * R * S", i);
+
+        vec3 p = randomVec3(10.0f);
+        check(closeTo(transformPoint(b, p), rotate(quatFromAxisAngle(vec3(0, 1, 0), yaw),
+                                                  vec3(p.x * s.x, p.y * s.y, p.z * s.z)) + t),
+              "transformPoint matches rotate", i);
+    }
+}
+
+static void testTransformPoints() {
+    mat4 m = randomMatrix();
+    std::vector<vec3> in(TEST_COUNT), out(TEST_COUNT);
+    for (int i = 0; i < TEST_COUNT; i++) in[i] = randomVec3(100.0f);
+    transformPoints(m.m, &in[0], &out[0], TEST_COUNT);
+    for (int i = 0; i < TEST_COUNT; i++) {
+        check(closeTo(out[i], transformPoint(m, in[i])), "transformPoints", i);
+    }
+}
+
+static void testTransformSpheres() {
+    mat4 m = randomMatrix();
+    float scale = 0;
+    for (int c = 0; c < 3; c++) {
+        scale = maxf(scale, length(vec3(m.m[c * 4 + 0], m.m[c * 4 + 1], m.m[c * 4 + 2])));
+    }
+    std::vector<vec4> in(TEST_COUNT), out(TEST_COUNT);
+    for (int i = 0; i < TEST_COUNT; i++) in[i] = vec4(randomVec3(100.0f), randomFloat(0.0f, 10.0f));
+    transformSpheres(m.m, &in[0], &out[0], TEST_COUNT);
+    for (int i = 0; i < TEST_COUNT; i++) {
+        vec3 center = transformPoint(m, vec3(in[i].x, in[i].y, in[i].z));
+        check(closeTo(vec3(out[i].x, out[i].y, out[i].z), center), "transformSpheres center", i);
+        check(closeTo(out[i].w, in[i].w * scale), "transformSpheres radius", i);
+    }
+}
+
+static void testTransformAABBs() {
+    mat4 m = randomMatrix();
+    std::vector<vec3> mins, maxs;
+    randomBoxes(mins, maxs, 100.0f, 10.0f);
+    std::vector<vec3> outMins(TEST_COUNT), outMaxs(TEST_COUNT);
+    transformAABBs(m.m, &mins[0], &maxs[0], &outMins[0], &outMaxs[0], TEST_COUNT);
+    for (int i = 0; i < TEST_COUNT; i++) {
+        vec3 expectedMin, expectedMax;
+        referenceTransformAABB(m.m, mins[i], maxs[i], expectedMin, expectedMax);
+        check(closeTo(outMins[i], expectedMin) && closeTo(outMaxs[i], expectedMax), "transformAABBs", i);
+
+        // Every transformed corner lies inside the result
+        for (int c = 0; c < 8; c++) {
+            vec3 corner(c & 1 ? maxs[i].x : mins[i].x, c & 2 ? maxs[i].y : mins[i].y, c & 4 ? maxs[i].z : mins[i].z);
+            vec3 p = transformPoint(m, corner);
+            vec3 slack = vec3(1, 1, 1) * (TEST_EPSILON * 100.0f);
+            vec3 lo = outMins[i] - slack, hi = outMaxs[i] + slack;
+            check(p.x >= lo.x && p.y >= lo.y && p.z >= lo.z && p.x <= hi.x && p.y <= hi.y && p.z <= hi.z,
+                  "transformAABBs contains corners", i);
+        }
+    }
+
+    vec3 single0, single1;
+    transformAABB(m.m, mins[0], maxs[0], single0, single1);
+    check(closeTo(single0, outMins[0]) && closeTo(single1, outMaxs[0]), "transformAABB", 0);
+}
+
+static void testCullAABBs() {
+    int visibleCount = 0, tested = 0;
+    for (int round = 0; round < 20; round++) {
+        float planes[6][4];
+        randomFrustum(planes);
+        std::vector<vec3> mins, maxs;
+        randomBoxes(mins, maxs, 200.0f, 20.0f);
+        std::vector<unsigned char> visible(TEST_COUNT + 1, 0xAB);
+        cullAABBs(planes, &mins[0], &maxs[0], TEST_COUNT, &visible[0]);
+        check(visible[TEST_COUNT] == 0xAB, "cullAABBs writes past count", TEST_COUNT);
+        for (int i = 0; i < TEST_COUNT; i++) {
+            float margin;
+            bool expected = referenceBoxVisible(planes, mins[i], maxs[i], margin);
+            check(visible[i] == 0 || visible[i] == 1, "cullAABBs result is 0 or 1", i);
+            // Boxes touching a plane may round either way
+            if (margin < 1e-3f) continue;
+            check((visible[i] != 0) == expected, "cullAABBs", i);
+            visibleCount += expected ? 1 : 0;
+            tested++;
+        }
+    }
+    // The random frusta should see some boxes and reject most
+    check(visibleCount > 0 && visibleCount < tested, "cullAABBs input has both outcomes", visibleCount);
+}
+
+static void testConstexpr() {
+    static_assert(clampf(5.0f, 0.0f, 1.0f) == 1.0f, "clampf");
+    static_assert(lerpf(2.0f, 4.0f, 0.5f) == 3.0f, "lerpf");
+    static_assert(dot(vec3(1, 2, 3), vec3(4, 5, 6)) == 32.0f, "dot");
+    static_assert(cross(vec3(1, 0, 0), vec3(0, 1, 0)).z == 1.0f, "cross");
+    static_assert(componentMax(vec3(1, 5, 2), vec3(3, 4, 6)).y == 5.0f, "componentMax");
+    check(closeTo(radToDeg(degToRad(37.0f)), 37.0f), "degToRad round trip", 0);
+    check(closeTo(yawForward(90.0f), vec3(1, 0, 0)), "yawForward", 0);
+}
+
+int main() {
+#if MATH_SIMD_SSE
+    printf("Testing MathLib (SSE)...\n");
+#elif MATH_SIMD_NEON
+    printf("Testing MathLib (NEON)...\n");
+#else
+    printf("Testing MathLib (plain floats)...\n");
+#endif
+    srand(12345);
+
+    testConstexpr();
+    testMultiply();
+    testTRS();
+    testTransformPoints();
+    testTransformSpheres();
+    testTransformAABBs();
+    testCullAABBs();
+
+    if (failures > 0) {
+        printf("FAILED: %d checks\n", failures);
+        return 1;
+    }
+    printf("SUCCESS: all checks passed\n");
+    return 0;
+}
@@ -17,7 +17,8 @@ int main() {
         std::cout << "SUCCESS: Player.blend loaded" << std::endl;
         std::cout << "  Meshes: " << testModel.meshes.size() << std::endl;
         for (size_t i = 0; i < testModel.meshes.size(); i++) {
-            std::cout << "  Mesh " << i << ": " << testModel.meshes[i].vertices.size() << " vertices" << std::endl;
+            std::cout << "  Mesh " << i << ": " << testModel.meshes[i].vertexCount << " vertices, "
+                      << testModel.meshes[i].indexCount << " indices" << std::endl;
         }
     } else {
         std::cout << "FAILED: Could not load Player.blend" << std::endl;
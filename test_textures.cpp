@@ -0,0 +1,109 @@
+// Tests for the BMP reader on the fixtures in tests/bmp (see TestBMP.h),
+// without a GL context: readBMPImage's header checks, copyTextureRows'
+// output, which is what setTextureImage hands to glTexImage2D, and the
+// content hashes textures are shared by.
+// Usage: test_textures [fixture directory]; exits non-zero on any failure.
+#include "ModelLoader.h"
+#include "TestBMP.h"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// The rows as GL receives them: bottom row first, each padded to 4 bytes
+static bool rowsMatch(const TestBMP& bmp, const std::vector<unsigned char>& rows) {
+    int channels = bmp.bits / 8;
+    size_t rowSize = ((size_t)bmp.width * channels + 3) / 4 * 4;
+    if (rows.size() != rowSize * bmp.height) return false;
+    for (int y = 0; y < bmp.height; y++) {
+        for (int x = 0; x < bmp.width; x++) {
+            for (int c = 0; c < channels; c++) {
+                if (rows[rowSize * y + (size_t)x * channels + c] != testBMPPixel(x, y, c)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void testGoodFiles(const std::string& directory) {
+    printf("\nSupported BMPs\n");
+    for (int i = 0; i < TEST_BMP_COUNT; i++) {
+        const TestBMP& bmp = testBMPs[i];
+        std::string path = directory + bmp.file;
+        TextureImage image;
+        if (!readBMPImage(path.c_str(), image)) {
+            check(false, bmp.file);
+            continue;
+        }
+        bool shape = image.width == bmp.width && image.height == bmp.height && image.topDown == bmp.topDown &&
+                     image.format == (bmp.bits == 32 ? GL_BGRA : GL_BGR) && image.alignment == 4;
+        std::vector<unsigned char> rows(image.bytes);
+        copyTextureRows(image, &rows[0]);
+        releaseTextureImage(image);
+        check(shape, (std::string(bmp.file) + " size and format").c_str());
+        check(rowsMatch(bmp, rows), (std::string(bmp.file) + " pixels").c_str());
+    }
+}
+
+static void testBadFiles(const std::string& directory) {
+    printf("\nRejected BMPs\n");
+    for (int i = 0; i < BAD_TEST_BMP_COUNT; i++) {
+        std::string path = directory + badTestBMPs[i];
+        TextureImage image;
+        bool read = readBMPImage(path.c_str(), image);
+        if (read) releaseTextureImage(image);
+        check(!read && image.file.data == NULL, badTestBMPs[i]);
+    }
+}
+
+// The same pixels under two paths hash alike, so they share one texture;
+// different pixels do not. The texture names here are stand-ins.
+static void testContentSharing(const std::string& directory) {
+    printf("\nContent sharing\n");
+    std::string original = directory + "w13_24.bmp";
+    std::string copy = getTempDirectory() + "blitzmail_test_copy.bmp";
+    std::string other = directory + "w13_24_topdown.bmp";
+    check(copyTestBMP(original, copy), "fixture copied");
+    TextureImage a, b, c;
+    bool read = readBMPImage(original.c_str(), a) && readBMPImage(copy.c_str(), b) && readBMPImage(other.c_str(), c);
+    check(read, "images read");
+    if (read) {
+        unsigned long long hash = hashTextureContent(a);
+        check(hashTextureContent(b) == hash, "same pixels under two paths hash alike");
+        check(hashTextureContent(c) != hash, "different pixels hash differently");
+
+        check(findTextureByContent(hash, a.bytes) == 0, "unknown pixels have no texture");
+        GLuint first = 7, second = 9;
+        check(addTextureByContent(hash, first, a.bytes), "first texture registered");
+        check(findTextureByContent(hashTextureContent(b), b.bytes) == 7, "copy finds the first texture");
+        check(!addTextureByContent(hash, second, b.bytes) && second == 7, "a racing upload is handed the first texture");
+        check(assetDedupStats.textures == 2 && assetDedupStats.sharedTextures == 2, "dedup stats");
+        clearSharedGPUResources();
+        check(findTextureByContent(hash, a.bytes) == 0, "cleared with the other shared resources");
+    }
+    releaseTextureImage(a);
+    releaseTextureImage(b);
+    releaseTextureImage(c);
+    remove(copy.c_str());
+}
+
+int main(int argc, char** argv) {
+    std::string directory = testBMPDirectory(argc, argv);
+    printf("Testing BMP textures from %s...\n", directory.c_str());
+
+    testGoodFiles(directory);
+    testBadFiles(directory);
+    testContentSharing(directory);
+
+    if (failures > 0) {
+        printf("\nFAILED: %d checks\n", failures);
+        return 1;
+    }
+    printf("\nSUCCESS: all checks passed\n");
+    return 0;
+}